@@ -36,6 +36,7 @@
 
 
 #include "ArbGeomParams.h"
+#include <cstring>
 #include <sstream>
 
 
@@ -223,6 +224,51 @@ void SetArrayByArnoldType(AtArray* array, int idx, int arnoldAPIType, typename T
 
 }
 
+// The elements of a scope kept by the selection, or NULL to keep them all.
+// Values that don't match the kept topology are left as is.
+const std::vector<unsigned int>* GetSelectedElements(const ArbGeomParamsSelection * selection, GeometryScope scope, size_t numValues)
+{
+    if(selection == NULL)
+        return NULL;
+
+    const std::vector<unsigned int>* kept = NULL;
+    switch (scope)
+    {
+    case kUniformScope:
+        kept = selection->primitives;
+        break;
+    case kVaryingScope:
+    case kVertexScope:
+    case kFacevaryingScope:
+        kept = selection->vertices;
+        break;
+    default:
+        break;
+    }
+
+    if(kept != NULL && !kept->empty() && kept->back() >= numValues)
+        return NULL;
+    return kept;
+}
+
+template <typename T>
+AtArray* ConvertSelectedValues(typename T::prop_type::sample_ptr_type valueSample, int arnoldAPIType, const std::vector<unsigned int>* kept)
+{
+    if(kept == NULL)
+        return AiArrayConvert( valueSample->size(), 1, arnoldAPIType,
+                (void *) valueSample->get() );
+
+    const size_t elementSize = valueSample->getDataType().getNumBytes();
+    const char* src = reinterpret_cast<const char *>( valueSample->get() );
+
+    std::vector<char> values(kept->size() * elementSize);
+    for ( size_t i = 0; i < kept->size(); ++i )
+        memcpy(&values[i * elementSize], src + (*kept)[i] * elementSize, elementSize);
+
+    return AiArrayConvert( kept->size(), 1, arnoldAPIType,
+            values.empty() ? NULL : (void *) &values[0] );
+}
+
 //-*****************************************************************************
 
 template <typename T>
@@ -230,7 +276,8 @@ void AddArbitraryGeomParam( ICompoundProperty & parent,
                             const PropertyHeader &propHeader,
                             ISampleSelector &sampleSelector,
                             AtNode * primNode,
-                            int arnoldAPIType)
+                            int arnoldAPIType,
+                            const ArbGeomParamsSelection * selection)
 {
 
     T param( parent, propHeader.getName() );
@@ -299,8 +346,8 @@ void AddArbitraryGeomParam( ICompoundProperty & parent,
 			}
 
             AiNodeSetArray( primNode, CleanAttributeName(param.getName()).c_str(),
-                    AiArrayConvert( valueSample->size(), 1, arnoldAPIType,
-                            (void *) valueSample->get() ) );
+                    ConvertSelectedValues<T>( valueSample, arnoldAPIType,
+                            GetSelectedElements( selection, param.getScope(), valueSample->size() ) ) );
 
 	}
 
@@ -479,11 +526,19 @@ void AddArbitraryGeomParam( ICompoundProperty & parent,
 
 				int basis = AiNodeGetInt(primNode, AtString("basis"));
 
+				// the kept strands, num_points already holds their topology.
+				const std::vector<unsigned int>* keptVertices = GetSelectedElements( selection, kVertexScope, valueSample->size() );
+
 				if(basis != 3)
 				{
 					AtArray* curveNumPoints = AiNodeGetArray( primNode , "num_points"); 
-					AtArray* radius = AiNodeGetArray( primNode, "radius");
-					AtArray* finalValues = AiArrayAllocate( AiArrayGetNumElements(radius), 1, arnoldAPIType);
+
+					// the radius may hold a single value, so we count the values from the topology.
+					unsigned int numValues = 0;
+					for ( int curCurve = 0; curCurve < AiArrayGetNumElements(curveNumPoints); curCurve++)
+						numValues += GetCurveNumValues(AiArrayGetUInt(curveNumPoints, curCurve), basis);
+
+					AtArray* finalValues = AiArrayAllocate( numValues, 1, arnoldAPIType);
 
 					unsigned int c_verts = 0;
 					unsigned int w_start = 0; 
@@ -500,7 +555,7 @@ void AddArbitraryGeomParam( ICompoundProperty & parent,
 							{
 								if ( r != w_start+1 && r != w_end-2 )
 								{
-									SetArrayByArnoldType<T>(finalValues, idxArray, arnoldAPIType, valueSample, r);
+									SetArrayByArnoldType<T>(finalValues, idxArray, arnoldAPIType, valueSample, keptVertices ? (*keptVertices)[r] : r);
 									idxArray++;
 								}
 							}
@@ -510,7 +565,7 @@ void AddArbitraryGeomParam( ICompoundProperty & parent,
 							//  skip the control points.
 							for ( int r = w_start; r < w_end; r+=3 )
 							{
-								SetArrayByArnoldType<T>(finalValues, idxArray, arnoldAPIType, valueSample, r);
+								SetArrayByArnoldType<T>(finalValues, idxArray, arnoldAPIType, valueSample, keptVertices ? (*keptVertices)[r] : r);
 								idxArray++;
 							}
 						}
@@ -520,8 +575,7 @@ void AddArbitraryGeomParam( ICompoundProperty & parent,
 				else
 				{
 					AiNodeSetArray( primNode, CleanAttributeName(param.getName()).c_str(),
-						AiArrayConvert( valueSample->size(), 1, arnoldAPIType,
-								(void *) valueSample->get() ) );
+						ConvertSelectedValues<T>( valueSample, arnoldAPIType, keptVertices ) );
 				}
 
 			}
@@ -539,8 +593,8 @@ void AddArbitraryGeomParam( ICompoundProperty & parent,
 				}
 
             AiNodeSetArray( primNode, CleanAttributeName(param.getName()).c_str(),
-                    AiArrayConvert( valueSample->size(), 1, arnoldAPIType,
-                            (void *) valueSample->get() ) );
+                    ConvertSelectedValues<T>( valueSample, arnoldAPIType,
+                            GetSelectedElements( selection, param.getScope(), valueSample->size() ) ) );
 
         }
 }
@@ -554,7 +608,8 @@ void AddArbitraryGeomParam( ICompoundProperty & parent,
 void AddArbitraryStringGeomParam( ICompoundProperty & parent,
                             const PropertyHeader &propHeader,
                             ISampleSelector &sampleSelector,
-                            AtNode * primNode)
+                            AtNode * primNode,
+                            const ArbGeomParamsSelection * selection)
 {
     IStringGeomParam param( parent, propHeader.getName() );
 
@@ -616,15 +671,18 @@ void AddArbitraryStringGeomParam( ICompoundProperty & parent,
     }
     else
     {
+        const std::vector<unsigned int>* kept = GetSelectedElements( selection, param.getScope(), valueSample->size() );
+        const size_t numValues = kept ? kept->size() : valueSample->size();
+
         std::vector<const char *> strPtrs;
-        strPtrs.reserve( valueSample->size() );
-        for ( size_t i = 0; i < valueSample->size(); ++i )
+        strPtrs.reserve( numValues );
+        for ( size_t i = 0; i < numValues; ++i )
         {
-            strPtrs.push_back( valueSample->get()[i].c_str() );
+            strPtrs.push_back( valueSample->get()[kept ? (*kept)[i] : i].c_str() );
         }
 
         AiNodeSetArray( primNode, CleanAttributeName(param.getName()).c_str(),
-                AiArrayConvert( valueSample->size(), 1, AI_TYPE_STRING,
+                AiArrayConvert( numValues, 1, AI_TYPE_STRING,
                         (void *) &strPtrs[0] ) );
 
 
@@ -641,7 +699,8 @@ void AddArbitraryStringGeomParam( ICompoundProperty & parent,
 void AddArbitraryGeomParams( ICompoundProperty &parent,
                              ISampleSelector &sampleSelector,
                              AtNode * primNode,
-                             const std::set<std::string> * excludeNames
+                             const std::set<std::string> * excludeNames,
+                             const ArbGeomParamsSelection * selection
                            )
 {
 
@@ -671,7 +730,8 @@ void AddArbitraryGeomParams( ICompoundProperty &parent,
                    propHeader,
                    sampleSelector,
                    primNode,
-                   AI_TYPE_DOUBLE);
+                   AI_TYPE_DOUBLE,
+                    selection);
         }
         if ( IFloatGeomParam::matches( propHeader ) )
         {
@@ -681,7 +741,8 @@ void AddArbitraryGeomParams( ICompoundProperty &parent,
                     propHeader,
                     sampleSelector,
                     primNode,
-                    AI_TYPE_FLOAT);
+                    AI_TYPE_FLOAT,
+                    selection);
         }
         else if ( IBoolGeomParam::matches( propHeader ) )
         {
@@ -690,7 +751,8 @@ void AddArbitraryGeomParams( ICompoundProperty &parent,
                     propHeader,
                     sampleSelector,
                     primNode,
-                    AI_TYPE_BOOLEAN);
+                    AI_TYPE_BOOLEAN,
+                    selection);
         }
         else if ( IInt32GeomParam::matches( propHeader ) )
         {
@@ -699,7 +761,8 @@ void AddArbitraryGeomParams( ICompoundProperty &parent,
                     propHeader,
                     sampleSelector,
                     primNode,
-                    AI_TYPE_INT);
+                    AI_TYPE_INT,
+                    selection);
         }
         else if ( IStringGeomParam::matches( propHeader ) )
         {
@@ -707,7 +770,8 @@ void AddArbitraryGeomParams( ICompoundProperty &parent,
                     parent,
                     propHeader,
                     sampleSelector,
-                    primNode);
+                    primNode,
+                    selection);
         }
         else if ( IV2fGeomParam::matches( propHeader ) )
         {
@@ -716,7 +780,8 @@ void AddArbitraryGeomParams( ICompoundProperty &parent,
                     propHeader,
                     sampleSelector,
                     primNode,
-                    AI_TYPE_VECTOR2);
+                    AI_TYPE_VECTOR2,
+                    selection);
         }
         else if ( IV3fGeomParam::matches( propHeader ) )
         {
@@ -725,7 +790,8 @@ void AddArbitraryGeomParams( ICompoundProperty &parent,
                     propHeader,
                     sampleSelector,
                     primNode,
-                    AI_TYPE_VECTOR);
+                    AI_TYPE_VECTOR,
+                    selection);
         }
         else if ( IP3fGeomParam::matches( propHeader ) )
         {
@@ -734,7 +800,8 @@ void AddArbitraryGeomParams( ICompoundProperty &parent,
                     propHeader,
                     sampleSelector,
                     primNode,
-                    AI_TYPE_VECTOR);
+                    AI_TYPE_VECTOR,
+                    selection);
         }
         else if ( IN3fGeomParam::matches( propHeader ) )
         {
@@ -743,7 +810,8 @@ void AddArbitraryGeomParams( ICompoundProperty &parent,
                     propHeader,
                     sampleSelector,
                     primNode,
-                    AI_TYPE_VECTOR);
+                    AI_TYPE_VECTOR,
+                    selection);
         }
         else if ( IC3fGeomParam::matches( propHeader ) )
         {
@@ -752,7 +820,8 @@ void AddArbitraryGeomParams( ICompoundProperty &parent,
                     propHeader,
                     sampleSelector,
                     primNode,
-                    AI_TYPE_RGB);
+                    AI_TYPE_RGB,
+                    selection);
         }
         else if ( IC4fGeomParam::matches( propHeader ) )
         {
@@ -761,7 +830,8 @@ void AddArbitraryGeomParams( ICompoundProperty &parent,
                     propHeader,
                     sampleSelector,
                     primNode,
-                    AI_TYPE_RGBA);
+                    AI_TYPE_RGBA,
+                    selection);
         }
         if ( IM44fGeomParam::matches( propHeader ) )
         {
@@ -770,7 +840,8 @@ void AddArbitraryGeomParams( ICompoundProperty &parent,
                     propHeader,
                     sampleSelector,
                     primNode,
-                    AI_TYPE_MATRIX);
+                    AI_TYPE_MATRIX,
+                    selection);
         }
 
 
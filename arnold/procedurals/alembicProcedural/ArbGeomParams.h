@@ -42,14 +42,46 @@
 #include "pystring.h"
 #include <Alembic/AbcGeom/All.h>
 
+#include <vector>
+
 using namespace Alembic::AbcGeom;
 
+// Elements kept by the level of detail, so that only those are read into the
+// user data. A NULL list keeps all the elements of that scope.
+struct ArbGeomParamsSelection
+{
+    ArbGeomParamsSelection() : primitives(NULL), vertices(NULL) {}
+
+    const std::vector<unsigned int>* primitives; // uniform values
+    const std::vector<unsigned int>* vertices;   // varying, vertex and curve facevarying values
+};
+
 void AddArbitraryGeomParams( ICompoundProperty &parent,
                              ISampleSelector &sampleSelector,
                              AtNode * primNode,
-                             const std::set<std::string> * excludeNames = NULL
+                             const std::set<std::string> * excludeNames = NULL,
+                             const ArbGeomParamsSelection * selection = NULL
                            );
 
 void AddArbitraryProceduralParams(AtNode* proc, AtNode * primNode);
 
+// Number of varying values arnold expects for a curve of numPoints points,
+// as the control points are skipped for the bezier, b-spline and catmull-rom basis.
+inline unsigned int GetCurveNumValues(unsigned int numPoints, int basis)
+{
+    if ( basis == 0 )
+        return (numPoints + 2) / 3;
+
+    if ( basis == 1 || basis == 2 )
+    {
+        unsigned int numValues = 0;
+        for ( unsigned int r = 0; r < numPoints; ++r )
+            if ( r != 1 && r + 2 != numPoints )
+                numValues++;
+        return numValues;
+    }
+
+    return numPoints;
+}
+
 #endif
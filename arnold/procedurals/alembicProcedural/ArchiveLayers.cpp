@@ -0,0 +1,89 @@
+#include "ArchiveLayers.h"
+
+#include <ai.h>
+#include <Alembic/AbcCoreLayer/Read.h>
+#include <chrono>
+
+namespace
+{
+    double elapsedMs(const std::chrono::steady_clock::time_point& start)
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+}
+
+IArchive OpenLayeredArchive(Alembic::AbcCoreFactory::IFactory& factory,
+                            const std::vector<std::string>& filenames,
+                            bool report,
+                            std::vector<ArchiveLayerInfo>& layers)
+{
+    layers.clear();
+
+    // A single archive doesn't need any layering.
+    if ( filenames.size() == 1 && !report )
+        return factory.getArchive(filenames[0]);
+
+    // Each layer is opened once, the merged archive is built from the same readers.
+    std::vector<IArchive> validLayers;
+    for ( size_t i = 0; i < filenames.size(); ++i )
+    {
+        ArchiveLayerInfo info;
+        info.filename = filenames[i];
+        info.valid = false;
+        info.openTime = 0.0;
+
+        std::chrono::steady_clock::time_point start;
+        if ( report )
+            start = std::chrono::steady_clock::now();
+        IArchive layer = factory.getArchive(filenames[i]);
+        if ( report )
+            info.openTime = elapsedMs(start);
+
+        if ( !layer.valid() )
+        {
+            AiMsgWarning("Cannot read layer %s, skipping it", filenames[i].c_str());
+        }
+        else if ( i > 0 && layer.getTop().getNumChildren() == 0 )
+        {
+            // Nothing to override.
+            AiMsgDebug("Layer %s is empty, skipping it", filenames[i].c_str());
+        }
+        else
+        {
+            info.valid = true;
+            validLayers.push_back(layer);
+        }
+
+        layers.push_back(info);
+    }
+
+    if ( report )
+    {
+        // Opening a layer only reads its header & top object. What the procedural then reads
+        // through the merged archive is reported by its profiler, enabled with the report.
+        for ( size_t i = 0; i < layers.size(); ++i )
+        {
+            const ArchiveLayerInfo& info = layers[i];
+            if ( info.valid )
+                AiMsgInfo("Layer %d %s : opened in %.2f ms", (int) i, info.filename.c_str(), info.openTime);
+            else
+                AiMsgInfo("Layer %d %s : skipped after %.2f ms", (int) i, info.filename.c_str(), info.openTime);
+        }
+    }
+
+    if ( validLayers.empty() )
+        return IArchive();
+    if ( validLayers.size() == 1 )
+        return validLayers[0];
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    Alembic::AbcCoreLayer::ArchiveReaderPtrs readers;
+    for ( size_t i = 0; i < validLayers.size(); ++i )
+        readers.push_back(validLayers[i].getPtr());
+    Alembic::AbcCoreLayer::ReadArchive readArchive;
+    IArchive archive(readArchive(readers), Alembic::Abc::kWrapExisting);
+    if ( report )
+        AiMsgInfo("Merged %d layers in %.2f ms", (int) validLayers.size(), elapsedMs(start));
+
+    return archive;
+}
@@ -0,0 +1,36 @@
+#ifndef _Alembic_Arnold_ArchiveLayers_h_
+#define _Alembic_Arnold_ArchiveLayers_h_
+
+#include <string>
+#include <vector>
+
+#include <Alembic/AbcGeom/All.h>
+#include <Alembic/AbcCoreFactory/All.h>
+
+using namespace Alembic::AbcGeom;
+
+/*
+Opening of the layered archives given in "fileNames".
+Every layer is opened on its own first, so that a layer that can't be read is skipped
+instead of failing the whole procedural, and a layer that doesn't hold any object is
+never merged. The base archive is the first one, the next ones override it by path.
+The layers are opened once, the merged archive reuses their readers. Opening a layer
+only reads its header & top object, its other objects & properties are read when the
+procedural walks the merged archive.
+*/
+
+struct ArchiveLayerInfo
+{
+    std::string filename;
+    bool valid;
+    double openTime;        // in milliseconds, only filled when reporting
+};
+
+// Open the layers & return the merged archive. If report is true, the open time of each
+// layer & the merge time are printed.
+IArchive OpenLayeredArchive(Alembic::AbcCoreFactory::IFactory& factory,
+                            const std::vector<std::string>& filenames,
+                            bool report,
+                            std::vector<ArchiveLayerInfo>& layers);
+
+#endif
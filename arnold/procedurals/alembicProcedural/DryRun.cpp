@@ -0,0 +1,321 @@
+#include "DryRun.h"
+#include "WriteOverrides.h"
+#include "parseAttributes.h"
+#include "LevelOfDetail.h"
+
+#include <algorithm>
+#include <fstream>
+
+namespace
+{
+    // Bytes of the values of a property at a sample, without reading them.
+    uint64_t getPropertyBytes( ICompoundProperty &parent, const PropertyHeader &header, const ISampleSelector &sel )
+    {
+        if ( header.isCompound() )
+        {
+            uint64_t bytes = 0;
+            ICompoundProperty compound( parent, header.getName() );
+            for ( size_t i = 0; i < compound.getNumProperties(); ++i )
+                bytes += getPropertyBytes( compound, compound.getPropertyHeader( i ), sel );
+            return bytes;
+        }
+
+        const uint64_t elementBytes = header.getDataType().getNumBytes();
+        if ( header.isScalar() )
+            return elementBytes;
+
+        IArrayProperty array( parent, header.getName() );
+        Alembic::Util::Dimensions dims;
+        array.getDimensions( dims, sel );
+        return elementBytes * dims.numPoints();
+    }
+
+    size_t getNumElements( const IArrayProperty &property, const ISampleSelector &sel )
+    {
+        if ( !property.valid() || property.getNumSamples() == 0 )
+            return 0;
+
+        Alembic::Util::Dimensions dims;
+        property.getDimensions( dims, sel );
+        return dims.numPoints();
+    }
+
+    // Number of deformation keys the procedural would write.
+    template <typename schemaT>
+    size_t getNumDeformKeys( schemaT &ps, ProcArgs &args )
+    {
+        if ( ps.getTopologyVariance() == kHeterogenousTopology )
+            return 1;
+
+        SampleTimeSet sampleTimes;
+        GetRelevantSampleTimes( args, ps.getTimeSampling(), ps.getNumSamples(), sampleTimes );
+        return std::max<size_t>( 1, sampleTimes.size() );
+    }
+
+    // points & curves only use the frame sample, moved along their velocities for the motion blur.
+    template <typename schemaT>
+    size_t getNumFrameSampleKeys( schemaT &ps, ProcArgs &args )
+    {
+        SampleTimeSet sampleTimes;
+        sampleTimes.insert( ps.getTimeSampling()->getFloorIndex( args.frame / args.fps, ps.getNumSamples() ).second );
+        return UseVelocityKeys( ps, sampleTimes, args ) ? 2 : 1;
+    }
+
+    template <>
+    size_t getNumDeformKeys<IPointsSchema>( IPointsSchema &ps, ProcArgs &args ) { return getNumFrameSampleKeys( ps, args ); }
+
+    template <>
+    size_t getNumDeformKeys<ICurvesSchema>( ICurvesSchema &ps, ProcArgs &args ) { return getNumFrameSampleKeys( ps, args ); }
+
+    // Fraction of the primitives kept by the level of detail, only points & curves are decimated.
+    template <typename schemaT>
+    float getLodDensity( schemaT &ps, const std::string &originalName, const ISampleSelector &sel,
+                         MatrixSampleMap * xformSamples, ProcArgs &args )
+    {
+        return 1.0f;
+    }
+
+    template <typename schemaT>
+    float getDecimatedLodDensity( schemaT &ps, const std::string &originalName, const ISampleSelector &sel,
+                                  MatrixSampleMap * xformSamples, ProcArgs &args )
+    {
+        Box3d bounds;
+        if ( ps.getSelfBoundsProperty().valid() )
+            bounds = ps.getSelfBoundsProperty().getValue( sel );
+        return std::max( 0.0f, GetLodDensity( ps.getObject(), originalName, bounds, xformSamples, args ) );
+    }
+
+    template <>
+    float getLodDensity<IPointsSchema>( IPointsSchema &ps, const std::string &originalName, const ISampleSelector &sel,
+                                        MatrixSampleMap * xformSamples, ProcArgs &args )
+    {
+        return getDecimatedLodDensity( ps, originalName, sel, xformSamples, args );
+    }
+
+    template <>
+    float getLodDensity<ICurvesSchema>( ICurvesSchema &ps, const std::string &originalName, const ISampleSelector &sel,
+                                        MatrixSampleMap * xformSamples, ProcArgs &args )
+    {
+        return getDecimatedLodDensity( ps, originalName, sel, xformSamples, args );
+    }
+
+    // Vertices left by the level of detail, selected like WritePoint & WriteCurves do. The
+    // decimated curves are counted in the stats.
+    template <typename schemaT>
+    size_t getNumKeptVertices( schemaT &ps, const ISampleSelector &sel, float density, size_t numVertices,
+                               Json::Value &stats )
+    {
+        return numVertices;
+    }
+
+    template <>
+    size_t getNumKeptVertices<IPointsSchema>( IPointsSchema &ps, const ISampleSelector &sel, float density,
+                                              size_t numVertices, Json::Value &stats )
+    {
+        UInt64ArraySamplePtr ids;
+        if ( ps.getIdsProperty().valid() )
+            ids = ps.getIdsProperty().getValue( sel );
+        const bool useIds = ids && ids->size() == numVertices;
+
+        size_t numKept = 0;
+        for ( size_t pId = 0; pId < numVertices; ++pId )
+        {
+            if ( keepPrimitive( useIds ? (*ids)[pId] : pId, density ) )
+                ++numKept;
+        }
+        return numKept;
+    }
+
+    template <>
+    size_t getNumKeptVertices<ICurvesSchema>( ICurvesSchema &ps, const ISampleSelector &sel, float density,
+                                              size_t numVertices, Json::Value &stats )
+    {
+        Int32ArraySamplePtr curveNumVertices = ps.getNumVerticesProperty().getValue( sel );
+
+        size_t numKeptCurves = 0;
+        size_t numKept = 0;
+        for ( size_t c = 0; c < curveNumVertices->size(); ++c )
+        {
+            if ( keepPrimitive( c, density ) )
+            {
+                ++numKeptCurves;
+                numKept += (*curveNumVertices)[c];
+            }
+        }
+        stats["curves"] = (Json::UInt64) numKeptCurves;
+        return numKept;
+    }
+
+    // Bytes of the topology, faces or curves, as the procedural writes it.
+    template <typename schemaT>
+    uint64_t getTopologyBytes( schemaT &ps, const ISampleSelector &sel, Json::Value &stats )
+    {
+        const size_t numFaces = getNumElements( ps.getFaceCountsProperty(), sel );
+        const size_t numIndices = getNumElements( ps.getFaceIndicesProperty(), sel );
+        stats["faces"] = (Json::UInt64) numFaces;
+        return numFaces + numIndices * sizeof( unsigned int ); // nsides & vidxs
+    }
+
+    template <>
+    uint64_t getTopologyBytes<IPointsSchema>( IPointsSchema &ps, const ISampleSelector &sel, Json::Value &stats )
+    {
+        return 0;
+    }
+
+    template <>
+    uint64_t getTopologyBytes<ICurvesSchema>( ICurvesSchema &ps, const ISampleSelector &sel, Json::Value &stats )
+    {
+        const size_t numCurves = getNumElements( ps.getNumVerticesProperty(), sel );
+        stats["curves"] = (Json::UInt64) numCurves;
+        return numCurves * sizeof( unsigned int ); // num_points
+    }
+
+    template <>
+    uint64_t getTopologyBytes<INuPatchSchema>( INuPatchSchema &ps, const ISampleSelector &sel, Json::Value &stats )
+    {
+        // the tessellation is only known once the patch is read.
+        return 0;
+    }
+
+    void addToTotals( ProcArgs &args, const std::string &type, const Json::Value &stats )
+    {
+        Json::Value &totals = args.dryRunStats["totals"];
+        totals["objects"] = totals.get( "objects", 0 ).asUInt64() + 1;
+        totals["objects_by_type"][type] = totals["objects_by_type"].get( type, 0 ).asUInt64() + 1;
+
+        const char* summed[] = {"vertices", "faces", "curves", "primvars", "override_matches", "estimated_bytes"};
+        for ( size_t i = 0; i < sizeof( summed ) / sizeof( summed[0] ); ++i )
+        {
+            if ( stats.isMember( summed[i] ) )
+                totals[summed[i]] = totals.get( summed[i], 0 ).asUInt64() + stats[summed[i]].asUInt64();
+        }
+    }
+
+    void addAssignments( IObject &object, const std::string &originalName, ProcArgs &args, Json::Value &stats )
+    {
+        std::vector<std::string> tags;
+        getAllTags( object, tags, &args );
+
+        if ( args.linkAttributes )
+        {
+            std::vector<size_t> rules;
+            args.attributesMatcher.getMatchingRules( originalName, tags, rules );
+            stats["override_matches"] = (Json::UInt64) rules.size();
+        }
+
+        if ( args.linkShader )
+        {
+            AtNode* shader = getShader( originalName, tags, args );
+            if ( shader != NULL )
+                stats["shader"] = AiNodeGetName( shader );
+        }
+    }
+}
+
+template <typename primT>
+void DryRunShape( primT &prim, ProcArgs &args, MatrixSampleMap * xformSamples )
+{
+    if ( !prim.valid() )
+        return;
+
+    typename primT::schema_type &ps = prim.getSchema();
+    const std::string originalName = prim.getFullName();
+
+    TimeSamplingPtr ts = ps.getTimeSampling();
+    ISampleSelector frameSelector( ts->getFloorIndex( args.frame / args.fps, ps.getNumSamples() ).second );
+
+    Json::Value stats;
+    const std::string type = primT::getSchemaTitle();
+    stats["type"] = type;
+
+    const size_t numFileVertices = getNumElements( ps.getPositionsProperty(), frameSelector );
+    const size_t numDeformKeys = getNumDeformKeys( ps, args );
+    uint64_t bytes = getTopologyBytes( ps, frameSelector, stats );
+
+    // The decimated points & curves only write the primitives they keep, with their user data.
+    size_t numVertices = numFileVertices;
+    const float density = getLodDensity( ps, originalName, frameSelector, xformSamples, args );
+    if ( density < 1.0f )
+    {
+        stats["lod_density"] = density;
+        numVertices = getNumKeptVertices( ps, frameSelector, density, numFileVertices, stats );
+        // the topology only has the kept curves, points have none.
+        bytes = 0;
+        if ( stats.isMember( "curves" ) )
+            bytes = stats["curves"].asUInt64() * sizeof( unsigned int );
+    }
+
+    stats["vertices"] = (Json::UInt64) numVertices;
+    stats["deform_keys"] = (Json::UInt64) numDeformKeys;
+    stats["xform_keys"] = (Json::UInt64) ( xformSamples ? std::max<size_t>( 1, xformSamples->size() ) : 1 );
+    bytes += (uint64_t) numVertices * sizeof( AtVector ) * numDeformKeys;
+
+    ICompoundProperty arbGeomParams = ps.getArbGeomParams();
+    size_t numPrimvars = 0;
+    if ( arbGeomParams.valid() )
+    {
+        numPrimvars = arbGeomParams.getNumProperties();
+        uint64_t primvarBytes = 0;
+        for ( size_t i = 0; i < numPrimvars; ++i )
+            primvarBytes += getPropertyBytes( arbGeomParams, arbGeomParams.getPropertyHeader( i ), frameSelector );
+        if ( numFileVertices > 0 && numVertices < numFileVertices )
+            primvarBytes = primvarBytes * numVertices / numFileVertices;
+        bytes += primvarBytes;
+    }
+    stats["primvars"] = (Json::UInt64) numPrimvars;
+    stats["estimated_bytes"] = (Json::UInt64) bytes;
+
+    IObject object = ps.getObject();
+    addAssignments( object, originalName, args, stats );
+
+    args.dryRunStats["objects"][originalName] = stats;
+    addToTotals( args, type, stats );
+}
+
+template void DryRunShape<IPolyMesh>( IPolyMesh &prim, ProcArgs &args, MatrixSampleMap * xformSamples );
+template void DryRunShape<ISubD>( ISubD &prim, ProcArgs &args, MatrixSampleMap * xformSamples );
+template void DryRunShape<INuPatch>( INuPatch &prim, ProcArgs &args, MatrixSampleMap * xformSamples );
+template void DryRunShape<IPoints>( IPoints &prim, ProcArgs &args, MatrixSampleMap * xformSamples );
+template void DryRunShape<ICurves>( ICurves &prim, ProcArgs &args, MatrixSampleMap * xformSamples );
+
+void DryRunObject( IObject &object, const std::string& type, ProcArgs &args, MatrixSampleMap * xformSamples )
+{
+    const std::string originalName = object.getFullName();
+
+    Json::Value stats;
+    stats["type"] = type;
+    stats["xform_keys"] = (Json::UInt64) ( xformSamples ? std::max<size_t>( 1, xformSamples->size() ) : 1 );
+    addAssignments( object, originalName, args, stats );
+
+    args.dryRunStats["objects"][originalName] = stats;
+    addToTotals( args, type, stats );
+}
+
+void WriteDryRunReport( ProcArgs &args )
+{
+    const Json::Value &totals = args.dryRunStats["totals"];
+    AiMsgInfo( "[Alembic Procedural] Dry run of %s: %llu objects, %llu vertices, %llu primvars, %llu override matches, %.2f MB estimated",
+               AiNodeGetName( args.proceduralNode ),
+               (unsigned long long) totals.get( "objects", 0 ).asUInt64(),
+               (unsigned long long) totals.get( "vertices", 0 ).asUInt64(),
+               (unsigned long long) totals.get( "primvars", 0 ).asUInt64(),
+               (unsigned long long) totals.get( "override_matches", 0 ).asUInt64(),
+               totals.get( "estimated_bytes", 0 ).asUInt64() / ( 1024.0 * 1024.0 ) );
+
+    std::string reportFile( AiNodeGetStr( args.proceduralNode, "dryRunReport" ).c_str() );
+    if ( reportFile.empty() )
+        return;
+
+    args.dryRunStats["procedural"] = AiNodeGetName( args.proceduralNode );
+    args.dryRunStats["frame"] = args.frame;
+
+    std::ofstream report( reportFile.c_str() );
+    if ( !report )
+    {
+        AiMsgWarning( "[Alembic Procedural] Can't write the dry run report %s", reportFile.c_str() );
+        return;
+    }
+
+    Json::StyledStreamWriter writer;
+    writer.write( report, args.dryRunStats );
+}
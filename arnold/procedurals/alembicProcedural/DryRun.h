@@ -0,0 +1,27 @@
+#ifndef _Alembic_Arnold_DryRun_h_
+#define _Alembic_Arnold_DryRun_h_
+
+#include <Alembic/AbcGeom/All.h>
+
+#include "ProcArgs.h"
+#include "SampleUtil.h"
+
+using namespace Alembic::AbcGeom;
+
+/*
+Dry run of the procedural, enabled by its "dryRun" parameter.
+The walk and the shader & attribute resolution run as usual, but no node is created.
+Each object only reads the dimensions of its samples to report its vertices, motion keys,
+primvars, override matches and an estimate of the memory its nodes would take. The
+stats are written as JSON to the "dryRunReport" file, or logged if it is empty.
+*/
+
+template <typename primT>
+void DryRunShape( primT &prim, ProcArgs &args, MatrixSampleMap * xformSamples );
+
+// Lights and cameras are only listed.
+void DryRunObject( IObject &object, const std::string& type, ProcArgs &args, MatrixSampleMap * xformSamples );
+
+void WriteDryRunReport( ProcArgs &args );
+
+#endif
@@ -0,0 +1,65 @@
+#include "LevelOfDetail.h"
+#include "parseAttributes.h"
+
+#include "json/json.h"
+
+
+float GetLodDensity(IObject iObj,
+                    const std::string& originalName,
+                    const Box3d& bounds,
+                    MatrixSampleMap * xformSamples,
+                    ProcArgs & args)
+{
+    float density = AiNodeGetFlt(args.proceduralNode, "lodDensity");
+    float lodDistance = AiNodeGetFlt(args.proceduralNode, "lodDistance");
+    float minDensity = AiNodeGetFlt(args.proceduralNode, "lodMinDensity");
+
+    // Attribute overrides..
+    if(args.linkAttributes)
+    {
+        std::vector<std::string> tags;
+        getAllTags(iObj, tags, &args);
+
+        std::vector<size_t> rules;
+        args.attributesMatcher.getMatchingRules(originalName, tags, rules, OverrideMatcher::TAGS_BEFORE_PATH_MATCH);
+        for(std::vector<size_t>::iterator it = rules.begin(); it != rules.end(); ++it)
+        {
+            const Json::Value& overrides = args.attributesRoot[args.attributesMatcher.getRule(*it)];
+            if(overrides.isObject())
+            {
+                if(overrides.isMember("lod_density"))
+                    density = overrides["lod_density"].asFloat();
+                if(overrides.isMember("lod_distance"))
+                    lodDistance = overrides["lod_distance"].asFloat();
+                if(overrides.isMember("lod_min_density"))
+                    minDensity = overrides["lod_min_density"].asFloat();
+            }
+        }
+    }
+
+    // Distance to the render camera
+    AtNode* camera = AiUniverseGetCamera();
+    if(lodDistance > 0.0f && camera != NULL && !bounds.isEmpty())
+    {
+        Imath::V3d center = bounds.center();
+        if(xformSamples && !xformSamples->empty())
+            center = center * xformSamples->begin()->second;
+
+        AtMatrix procMatrix = AiNodeGetMatrix(args.proceduralNode, "matrix");
+        AtVector worldCenter = AiM4PointByMatrixMult(procMatrix, AtVector(center.x, center.y, center.z));
+
+        AtMatrix camMatrix = AiNodeGetMatrix(camera, "matrix");
+        AtVector camPosition(camMatrix[3][0], camMatrix[3][1], camMatrix[3][2]);
+
+        float distance = AiV3Dist(worldCenter, camPosition);
+        if(distance > lodDistance)
+        {
+            float attenuation = lodDistance / distance;
+            float falloff = quantizeLodFalloff(attenuation * attenuation);
+            density = AiMax(density * falloff, AiMin(density, minDensity));
+        }
+    }
+
+    return AiClamp(density, 0.0f, 1.0f);
+}
+
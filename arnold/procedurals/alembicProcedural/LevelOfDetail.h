@@ -0,0 +1,60 @@
+#ifndef _Alembic_Arnold_LevelOfDetail_h_
+#define _Alembic_Arnold_LevelOfDetail_h_
+
+#include <ai.h>
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include <Alembic/AbcGeom/All.h>
+
+#include "ProcArgs.h"
+#include "SampleUtil.h"
+
+using namespace Alembic::AbcGeom;
+
+/*
+Level of detail for points and curves.
+The density is the fraction of primitives kept at load time. It comes from the
+"lodDensity" procedural parameter or the "lod_density" attribute override. If a
+"lodDistance" is set, the density decreases with the square of the camera distance
+past that distance, so the on-screen density stays constant, but never goes
+under "lodMinDensity".
+Only that falloff is snapped to a power of two, down to 1/2^LOD_NUM_LEVELS, so that
+objects at close distances share the same decimation and the same cache entry; the
+user density is applied as is.
+*/
+
+#define LOD_NUM_LEVELS 10
+
+float GetLodDensity(IObject iObj,
+                    const std::string& originalName,
+                    const Box3d& bounds,
+                    MatrixSampleMap * xformSamples,
+                    ProcArgs & args);
+
+// Snap a distance falloff to the nearest level, in log2, of 1, 1/2, 1/4.. 1/2^LOD_NUM_LEVELS.
+inline float quantizeLodFalloff(float falloff)
+{
+    if(falloff >= 1.0f)
+        return 1.0f;
+    if(falloff <= 0.0f)
+        return 0.0f;
+
+    int level = (int)floorf(-log2f(falloff) + 0.5f);
+    return ldexpf(1.0f, -std::min(level, LOD_NUM_LEVELS));
+}
+
+// Deterministic selection of a primitive from its id, so that the same
+// primitives survive from one frame to the next.
+inline bool keepPrimitive(uint64_t id, float density)
+{
+    uint64_t h = id + 0x9E3779B97F4A7C15ULL;
+    h = (h ^ (h >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    h = (h ^ (h >> 27)) * 0x94D049BB133111EBULL;
+    h = h ^ (h >> 31);
+    return (float)(h >> 40) * (1.0f / 16777216.0f) < density;
+}
+
+#endif
@@ -0,0 +1,18 @@
+#ifndef _Alembic_Arnold_LightBatch_h_
+#define _Alembic_Arnold_LightBatch_h_
+
+#include <ai.h>
+#include <vector>
+
+/*
+Quad lights sharing all their parameters, waiting to be merged into a single mesh light.
+The first light is kept as a template, the vertices of all the quads are in world space.
+*/
+
+struct LightBatch
+{
+    AtNode* light;
+    std::vector<AtVector> vertices;
+};
+
+#endif
@@ -0,0 +1,205 @@
+#include "NurbsTessellator.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+    const int maxSegmentsPerSpan = 64;
+
+    // Knot span containing u (The NURBS Book, A2.1)
+    int findSpan(int numCV, int degree, float u, const float* knots)
+    {
+        if(u >= knots[numCV])
+            return numCV - 1;
+        if(u <= knots[degree])
+            return degree;
+
+        int low = degree;
+        int high = numCV;
+        int mid = (low + high) / 2;
+        while(u < knots[mid] || u >= knots[mid + 1])
+        {
+            if(u < knots[mid])
+                high = mid;
+            else
+                low = mid;
+            mid = (low + high) / 2;
+        }
+        return mid;
+    }
+
+    // Non zero basis functions at u (The NURBS Book, A2.2)
+    void basisFunctions(int span, float u, int degree, const float* knots, float* N)
+    {
+        std::vector<float> left(degree + 1);
+        std::vector<float> right(degree + 1);
+
+        N[0] = 1.0f;
+        for(int j = 1; j <= degree; ++j)
+        {
+            left[j] = u - knots[span + 1 - j];
+            right[j] = knots[span + j] - u;
+            float saved = 0.0f;
+            for(int r = 0; r < j; ++r)
+            {
+                float denom = right[r + 1] + left[j - r];
+                float temp = denom != 0.0f ? N[r] / denom : 0.0f;
+                N[r] = saved + right[r + 1] * temp;
+                saved = left[j - r] * temp;
+            }
+            N[j] = saved;
+        }
+    }
+
+    struct ParamBasis
+    {
+        std::vector<int> spans;
+        std::vector<float> values; // order values per param
+    };
+
+    void computeBasis(int numCV, int order, const float* knots, const std::vector<float>& params, ParamBasis& basis)
+    {
+        basis.spans.resize(params.size());
+        basis.values.resize(params.size() * order);
+        for(size_t i = 0; i < params.size(); ++i)
+        {
+            basis.spans[i] = findSpan(numCV, order - 1, params[i], knots);
+            basisFunctions(basis.spans[i], params[i], order - 1, knots, &basis.values[i * order]);
+        }
+    }
+
+    void evaluateRows(const NurbsSurface& surface, const ParamBasis& uBasis, const ParamBasis& vBasis,
+                      size_t firstRow, size_t lastRow, float* out)
+    {
+        const int uDegree = surface.uOrder - 1;
+        const int vDegree = surface.vOrder - 1;
+        const size_t numUParams = uBasis.spans.size();
+
+        for(size_t iv = firstRow; iv < lastRow; ++iv)
+        {
+            const int vSpan = vBasis.spans[iv];
+            const float* Nv = &vBasis.values[iv * surface.vOrder];
+
+            for(size_t iu = 0; iu < numUParams; ++iu)
+            {
+                const int uSpan = uBasis.spans[iu];
+                const float* Nu = &uBasis.values[iu * surface.uOrder];
+
+                float x = 0.0f, y = 0.0f, z = 0.0f, w = 0.0f;
+                for(int a = 0; a <= vDegree; ++a)
+                {
+                    const size_t row = (size_t)(vSpan - vDegree + a) * surface.numU;
+                    for(int b = 0; b <= uDegree; ++b)
+                    {
+                        const size_t index = row + uSpan - uDegree + b;
+                        float coeff = Nv[a] * Nu[b];
+                        if(surface.weights)
+                            coeff *= surface.weights[index];
+
+                        x += coeff * surface.positions[3 * index + 0];
+                        y += coeff * surface.positions[3 * index + 1];
+                        z += coeff * surface.positions[3 * index + 2];
+                        w += coeff;
+                    }
+                }
+
+                if(w != 0.0f)
+                {
+                    x /= w;
+                    y /= w;
+                    z /= w;
+                }
+
+                float* point = out + 3 * ((iv - firstRow) * numUParams + iu);
+                point[0] = x;
+                point[1] = y;
+                point[2] = z;
+            }
+        }
+    }
+}
+
+bool IsValidNurbs(const NurbsSurface& surface, size_t numPositions, size_t numUKnots, size_t numVKnots)
+{
+    if(surface.uOrder < 1 || surface.vOrder < 1)
+        return false;
+    if(surface.numU < surface.uOrder || surface.numV < surface.vOrder)
+        return false;
+    if(numPositions != (size_t)surface.numU * surface.numV)
+        return false;
+    if(numUKnots != (size_t)(surface.numU + surface.uOrder) || numVKnots != (size_t)(surface.numV + surface.vOrder))
+        return false;
+    return surface.positions != NULL && surface.uKnot != NULL && surface.vKnot != NULL;
+}
+
+void ComputeNurbsParams(const NurbsSurface& surface, bool alongU, int sampling, float tolerance, std::vector<float>& params)
+{
+    const int numCV = alongU ? surface.numU : surface.numV;
+    const int numRows = alongU ? surface.numV : surface.numU;
+    const int degree = (alongU ? surface.uOrder : surface.vOrder) - 1;
+    const float* knots = alongU ? surface.uKnot : surface.vKnot;
+    const size_t stride = alongU ? 1 : surface.numU;
+    const size_t rowStride = alongU ? surface.numU : 1;
+
+    params.clear();
+
+    for(int span = degree; span < numCV; ++span)
+    {
+        const float start = knots[span];
+        const float end = knots[span + 1];
+        if(end <= start)
+            continue;
+
+        // A linear span is exact with one segment, but a fixed sampling still cuts it,
+        // to get the same density of vertices on every span, e.g. for displacement.
+        int segments = 1;
+        if(sampling > 0)
+            segments = std::min(sampling, maxSegmentsPerSpan);
+        else if(degree > 1)
+        {
+            // The distance between a Bezier curve and its control polygon is bounded by
+            // d(d-1)/8 * max|P(i-1) - 2P(i) + P(i+1)| / n^2 when cut in n segments.
+            float flatness = 0.0f;
+            for(int row = 0; row < numRows; ++row)
+            {
+                for(int i = span - degree + 1; i < span; ++i)
+                {
+                    const float* p0 = surface.positions + 3 * (row * rowStride + (i - 1) * stride);
+                    const float* p1 = surface.positions + 3 * (row * rowStride + i * stride);
+                    const float* p2 = surface.positions + 3 * (row * rowStride + (i + 1) * stride);
+                    float dx = p0[0] - 2.0f * p1[0] + p2[0];
+                    float dy = p0[1] - 2.0f * p1[1] + p2[1];
+                    float dz = p0[2] - 2.0f * p1[2] + p2[2];
+                    flatness = std::max(flatness, dx * dx + dy * dy + dz * dz);
+                }
+            }
+            flatness = std::sqrt(flatness);
+
+            if(tolerance > 0.0f)
+                segments = (int)std::ceil(std::sqrt(degree * (degree - 1) * flatness / (8.0f * tolerance)));
+            else
+                segments = maxSegmentsPerSpan;
+            segments = std::max(1, std::min(segments, maxSegmentsPerSpan));
+        }
+
+        for(int s = 0; s < segments; ++s)
+            params.push_back(start + (end - start) * float(s) / float(segments));
+    }
+
+    params.push_back(knots[numCV]);
+}
+
+void TessellateNurbs(const NurbsSurface& surface, const std::vector<float>& uParams, const std::vector<float>& vParams, std::vector<float>& vlist)
+{
+    ParamBasis uBasis, vBasis;
+    computeBasis(surface.numU, surface.uOrder, surface.uKnot, uParams, uBasis);
+    computeBasis(surface.numV, surface.vOrder, surface.vKnot, vParams, vBasis);
+
+    const size_t numRows = vParams.size();
+    const size_t numPoints = uParams.size() * numRows;
+    const size_t offset = vlist.size();
+    vlist.resize(offset + numPoints * 3);
+    // The patches are tessellated serially, procedural_init already runs on Arnold's threads.
+    evaluateRows(surface, uBasis, vBasis, 0, numRows, &vlist[offset]);
+}
@@ -0,0 +1,38 @@
+#ifndef _Alembic_Arnold_NurbsTessellator_h_
+#define _Alembic_Arnold_NurbsTessellator_h_
+
+#include <cstddef>
+#include <vector>
+
+/*
+Tessellation of NURBS patches into a grid of points.
+The parameters at which the patch is evaluated are chosen per knot span, either with a
+fixed number of segments or adaptively from the flatness of the control hull, so that
+the distance between the patch and the tessellation stays under a tolerance.
+*/
+
+struct NurbsSurface
+{
+    int numU;
+    int numV;
+    int uOrder;
+    int vOrder;
+    const float* uKnot;         // numU + uOrder values
+    const float* vKnot;         // numV + vOrder values
+    const float* positions;     // numU * numV points, u varying fastest
+    const float* weights;       // numU * numV values, or NULL for a non rational patch
+};
+
+// Check that the arrays sizes are consistent with the orders.
+bool IsValidNurbs(const NurbsSurface& surface, size_t numPositions, size_t numUKnots, size_t numVKnots);
+
+// Fill the parameters at which the patch is evaluated in one direction.
+// If sampling is > 0, each span, even a linear one, is cut in sampling segments, otherwise the number of segments
+// is chosen so that the chord error stays under tolerance.
+void ComputeNurbsParams(const NurbsSurface& surface, bool alongU, int sampling, float tolerance, std::vector<float>& params);
+
+// Evaluate the patch at every (u, v) of the grid and append the points to vlist (3 floats per point, u varying fastest).
+// The evaluation is serial, procedural_init already runs in parallel for several procedurals.
+void TessellateNurbs(const NurbsSurface& surface, const std::vector<float>& uParams, const std::vector<float>& vParams, std::vector<float>& vlist);
+
+#endif
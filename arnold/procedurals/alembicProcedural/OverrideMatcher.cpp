@@ -0,0 +1,177 @@
+#include "OverrideMatcher.h"
+#include "../../../common/PathUtil.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace
+{
+    std::string joinPath(const PathList& parts, size_t count)
+    {
+        std::string path;
+        for(size_t i = 0; i < count; ++i)
+        {
+            if(i > 0)
+                path += "/";
+            path += parts[i];
+        }
+        return path;
+    }
+
+    // how an assignment matched, in the order of precedence of a rule matching both ways.
+    enum ShaderMatch
+    {
+        MATCH_PATH,
+        MATCH_PATTERN,
+        MATCH_TAG
+    };
+}
+
+void OverrideMatcher::setRules(const std::vector<std::string>& newRules)
+{
+    rules = newRules;
+    isPath.assign(rules.size(), false);
+    validPattern.assign(rules.size(), false);
+    patterns.clear();
+    patterns.resize(rules.size());
+
+    for(size_t i = 0; i < rules.size(); ++i)
+    {
+        if(rules[i].find("/") != std::string::npos)
+        {
+            isPath[i] = true;
+            continue;
+        }
+
+        try
+        {
+            patterns[i] = std::regex(translatePattern(rules[i]));
+            validPattern[i] = true;
+        }
+        catch (const std::regex_error& e)
+        {
+            validPattern[i] = false;
+        }
+    }
+}
+
+void OverrideMatcher::getMatchingRules(const std::string& name, const std::vector<std::string>& tags, std::vector<size_t>& matchingRules,
+                                       TagRules tagRules) const
+{
+    matchingRules.clear();
+
+    size_t pathSize = 0;
+    bool foundInPath = false;
+    for(size_t i = 0; i < rules.size(); ++i)
+    {
+        bool matched = false;
+        if(isPath[i])
+            matched = pathContainsOtherPath(name, rules[i]);
+        else if(validPattern[i]) // based on wildcard expression
+            matched = std::regex_search(name, patterns[i]);
+        foundInPath = foundInPath || matched;
+
+        if(matched && rules[i].length() > pathSize)
+        {
+            pathSize = rules[i].length();
+            matchingRules.push_back(i);
+        }
+        else if(tagRules == TAGS_BEFORE_PATH_MATCH)
+        {
+            if(!foundInPath && !isPath[i] && rules[i].length() > pathSize &&
+               std::find(tags.begin(), tags.end(), rules[i]) != tags.end())
+            {
+                pathSize = rules[i].length();
+                matchingRules.push_back(i);
+            }
+        }
+        else if(std::find(tags.begin(), tags.end(), rules[i]) != tags.end())
+            matchingRules.push_back(i);
+    }
+}
+
+void ShaderMatcher::setRules(const std::vector<std::string>& newRules)
+{
+    rules = newRules;
+    paths.clear();
+    tags.clear();
+    patterns.clear();
+
+    for(size_t i = 0; i < rules.size(); ++i)
+    {
+        if(rules[i].find("/") != std::string::npos)
+        {
+            PathList parts;
+            TokenizePath(rules[i], "/", parts);
+            paths[joinPath(parts, parts.size())].push_back(i);
+            continue;
+        }
+
+        // a rule that isn't a path is a tag when its wildcard expression doesn't match.
+        tags[rules[i]].push_back(i);
+        try
+        {
+            patterns.push_back(std::make_pair(i, std::regex(translatePattern(rules[i]))));
+        }
+        catch (const std::regex_error& e)
+        {
+            // an invalid expression never matches, the rule can still be a tag.
+        }
+    }
+}
+
+int ShaderMatcher::getMatchingRule(const std::string& name, const std::vector<std::string>& objectTags) const
+{
+    std::vector<std::pair<size_t, ShaderMatch> > matches;
+
+    // the paths containing name are the ones made of its first components.
+    PathList parts;
+    TokenizePath(name, "/", parts);
+    for(size_t count = 0; count <= parts.size(); ++count)
+    {
+        std::unordered_map<std::string, std::vector<size_t> >::const_iterator it = paths.find(joinPath(parts, count));
+        if(it != paths.end())
+            for(size_t i = 0; i < it->second.size(); ++i)
+                matches.push_back(std::make_pair(it->second[i], MATCH_PATH));
+    }
+
+    for(size_t i = 0; i < patterns.size(); ++i)
+        if(std::regex_search(name, patterns[i].second))
+            matches.push_back(std::make_pair(patterns[i].first, MATCH_PATTERN));
+
+    for(size_t t = 0; t < objectTags.size(); ++t)
+    {
+        std::unordered_map<std::string, std::vector<size_t> >::const_iterator it = tags.find(objectTags[t]);
+        if(it != tags.end())
+            for(size_t i = 0; i < it->second.size(); ++i)
+                matches.push_back(std::make_pair(it->second[i], MATCH_TAG));
+    }
+
+    // Replay the scan on the matching rules, a rule matching its wildcard isn't a tag.
+    std::sort(matches.begin(), matches.end());
+    int appliedRule = -1;
+    size_t pathSize = 0;
+    bool foundInPath = false;
+    for(size_t m = 0; m < matches.size(); ++m)
+    {
+        const size_t i = matches[m].first;
+        if(m > 0 && matches[m - 1].first == i)
+            continue;
+
+        if(matches[m].second == MATCH_PATTERN)
+            appliedRule = int(i);
+        else if(matches[m].second == MATCH_TAG)
+        {
+            if(!foundInPath)
+                appliedRule = int(i);
+            continue;
+        }
+        foundInPath = true;
+        if(rules[i].length() > pathSize)
+        {
+            pathSize = rules[i].length();
+            appliedRule = int(i);
+        }
+    }
+    return appliedRule;
+}
@@ -0,0 +1,76 @@
+#ifndef _Alembic_Arnold_OverrideMatcher_h_
+#define _Alembic_Arnold_OverrideMatcher_h_
+
+#include <string>
+#include <vector>
+#include <regex>
+#include <unordered_map>
+
+/*
+This class resolves which attribute rules apply to an object.
+A rule is either a path (it contains a "/"), a wildcard expression or a tag. The
+wildcard expressions are compiled once when the rules are set, instead of on every match.
+*/
+
+class OverrideMatcher
+{
+public:
+    enum TagRules
+    {
+        // a tag rule always applies.
+        TAGS_ALWAYS_APPLY,
+        // a tag rule only applies until a path or a wildcard rule matched, and like them
+        // only if it is longer than the previous rule that matched.
+        TAGS_BEFORE_PATH_MATCH
+    };
+
+    OverrideMatcher() {};
+
+    // rules must be sorted, like args.attributes.
+    void setRules(const std::vector<std::string>& rules);
+
+    // Fill the indices of the rules applying to name, in the order they must be applied.
+    // A path or a wildcard rule only applies if it is longer than the previous one that matched,
+    // tagRules tells when a tag rule applies.
+    void getMatchingRules(const std::string& name, const std::vector<std::string>& tags, std::vector<size_t>& matchingRules,
+                          TagRules tagRules = TAGS_ALWAYS_APPLY) const;
+
+    const std::string& getRule(size_t index) const { return rules[index]; };
+    size_t getNumRules() const { return rules.size(); };
+
+private:
+    std::vector<std::string> rules;
+    std::vector<bool> isPath;
+    std::vector<bool> validPattern;
+    std::vector<std::regex> patterns;
+};
+
+/*
+This class resolves which shader assignment applies to an object, with the precedence of a
+scan of all the assignments in their order: the longest path containing the object, unless a
+later wildcard expression matches it, and a tag only while no path nor wildcard matched.
+The paths are indexed by their components, so only the parents of the object are looked up,
+the wildcard expressions are compiled once and the tags are indexed too. Only the assignments
+matching the object are then replayed, in their order.
+*/
+
+class ShaderMatcher
+{
+public:
+    ShaderMatcher() {};
+
+    // rules are in the order of the assignments, like args.shaders.
+    void setRules(const std::vector<std::string>& rules);
+
+    // Index of the assignment applying to name, -1 if there is none.
+    int getMatchingRule(const std::string& name, const std::vector<std::string>& tags) const;
+
+private:
+    std::vector<std::string> rules;
+    // assignments of each path, by its components joined with "/".
+    std::unordered_map<std::string, std::vector<size_t> > paths;
+    std::unordered_map<std::string, std::vector<size_t> > tags;
+    std::vector<std::pair<size_t, std::regex> > patterns;
+};
+
+#endif
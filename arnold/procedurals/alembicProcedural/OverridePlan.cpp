@@ -0,0 +1,207 @@
+#include "OverridePlan.h"
+
+void OverridePlan::setRules(const std::vector<std::string>& rules, const Json::Value& attributesRoot, uint8_t procViz)
+{
+    procVisibility = procViz;
+    entries.clear();
+    values.clear();
+    values.resize(rules.size());
+
+    for(size_t i = 0; i < rules.size(); ++i)
+    {
+        const Json::Value& overrides = attributesRoot[rules[i]];
+        if(!overrides.isObject())
+            continue;
+
+        for( Json::ValueConstIterator itr = overrides.begin() ; itr != overrides.end() ; itr++ )
+        {
+            const Json::Value& val = *itr;
+
+            Value value;
+            value.param = AtString(itr.key().asCString());
+            value.b = false;
+            value.i = 0;
+            value.u = 0;
+            value.f = 0.0f;
+
+            if( val.isString() )
+            {
+                value.type = AI_TYPE_STRING;
+                value.str = val.asString();
+            }
+            else if( val.isBool() )
+            {
+                value.type = AI_TYPE_BOOLEAN;
+                value.b = val.asBool();
+            }
+            else if ( val.type() == Json::realValue )
+            {
+                value.type = AI_TYPE_FLOAT;
+                value.f = val.asDouble();
+            }
+            else if( val.isInt() )
+            {
+                value.type = AI_TYPE_INT;
+                value.i = val.asInt();
+            }
+            else if( val.isUInt() )
+            {
+                value.type = AI_TYPE_UINT;
+                value.u = val.asUInt();
+            }
+            else
+                continue;
+
+            values[i].push_back(value);
+        }
+    }
+}
+
+void OverridePlan::compile(size_t rule, const AtNodeEntry* nodeEntry, SetterList& setters) const
+{
+    static const AtString visibility("visibility");
+
+    const std::vector<Value>& ruleValues = values[rule];
+    setters.reserve(ruleValues.size());
+
+    for(std::vector<Value>::const_iterator it = ruleValues.begin(); it != ruleValues.end(); ++it)
+    {
+        const AtParamEntry* paramEntry = AiNodeEntryLookUpParameter(nodeEntry, it->param);
+        if ( paramEntry == NULL)
+            continue;
+
+        Setter setter;
+        setter.param = it->param;
+        setter.type = it->type;
+        switch(it->type)
+        {
+            case AI_TYPE_STRING:
+                setter.str = AtString(it->str.c_str());
+                break;
+            case AI_TYPE_BOOLEAN:
+                setter.b = it->b;
+                break;
+            case AI_TYPE_FLOAT:
+                setter.f = it->f;
+                break;
+            case AI_TYPE_UINT:
+                setter.u = it->u;
+                break;
+            case AI_TYPE_INT:
+                //make the difference between Byte & int!
+                if(AiParamGetType(paramEntry) == AI_TYPE_BYTE)
+                {
+                    setter.type = AI_TYPE_BYTE;
+                    if(it->param == visibility)
+                        setter.byte = ComposeVisibility(procVisibility, it->i);
+                    else
+                        setter.byte = it->i;
+                }
+                else
+                    setter.i = it->i;
+                break;
+        }
+
+        setters.push_back(setter);
+    }
+}
+
+void OverridePlan::apply(AtNode* node, const std::vector<size_t>& rules)
+{
+    if(rules.empty())
+        return;
+
+    const AtNodeEntry* nodeEntry = AiNodeGetNodeEntry(node);
+    CompiledEntry& entry = entries[nodeEntry];
+    if(entry.setters.empty())
+    {
+        entry.setters.resize(values.size());
+        entry.compiled.assign(values.size(), false);
+    }
+
+    for(std::vector<size_t>::const_iterator ruleIt = rules.begin(); ruleIt != rules.end(); ++ruleIt)
+    {
+        SetterList& setters = entry.setters[*ruleIt];
+        if(!entry.compiled[*ruleIt])
+        {
+            compile(*ruleIt, nodeEntry, setters);
+            entry.compiled[*ruleIt] = true;
+        }
+
+        for(SetterList::const_iterator it = setters.begin(); it != setters.end(); ++it)
+        {
+            switch(it->type)
+            {
+                case AI_TYPE_STRING:
+                    AiNodeSetStr(node, it->param, it->str);
+                    break;
+                case AI_TYPE_BOOLEAN:
+                    AiNodeSetBool(node, it->param, it->b);
+                    break;
+                case AI_TYPE_FLOAT:
+                    AiNodeSetFlt(node, it->param, it->f);
+                    break;
+                case AI_TYPE_BYTE:
+                    AiNodeSetByte(node, it->param, it->byte);
+                    break;
+                case AI_TYPE_INT:
+                    AiNodeSetInt(node, it->param, it->i);
+                    break;
+                case AI_TYPE_UINT:
+                    AiNodeSetUInt(node, it->param, it->u);
+                    break;
+                default:
+                    break;
+            }
+        }
+    }
+}
+
+uint8_t ComposeVisibility(uint8_t procViz, uint8_t attrViz)
+{
+    // special case, we must determine it against the general viz.
+    uint8_t compViz = AI_RAY_ALL;
+    {
+        compViz &= ~AI_RAY_SUBSURFACE;
+        if (procViz > compViz)
+            procViz &= ~AI_RAY_SUBSURFACE;
+        else
+            attrViz &= ~AI_RAY_SUBSURFACE;
+        compViz &= ~AI_RAY_SUBSURFACE;
+        if(procViz > compViz)
+            procViz &= ~AI_RAY_SPECULAR_REFLECT;
+        else
+            attrViz &= ~AI_RAY_SPECULAR_REFLECT;
+        compViz &= ~AI_RAY_DIFFUSE_REFLECT;
+        if(procViz > compViz)
+            procViz &= ~AI_RAY_DIFFUSE_REFLECT;
+        else
+            attrViz &= ~AI_RAY_DIFFUSE_REFLECT;
+        compViz &= ~AI_RAY_VOLUME;
+        if(procViz > compViz)
+            procViz &= ~AI_RAY_VOLUME;
+        else
+            attrViz &= ~AI_RAY_VOLUME;
+        compViz &= ~AI_RAY_SPECULAR_TRANSMIT;
+        if(procViz > compViz)
+            procViz &= ~AI_RAY_SPECULAR_TRANSMIT;
+        else
+            attrViz &= ~AI_RAY_SPECULAR_TRANSMIT;
+        compViz &= ~AI_RAY_DIFFUSE_TRANSMIT;
+        if(procViz > compViz)
+            procViz &= ~AI_RAY_DIFFUSE_TRANSMIT;
+        else
+            attrViz &= ~AI_RAY_DIFFUSE_TRANSMIT;
+        compViz &= ~AI_RAY_SHADOW;
+        if(procViz > compViz)
+            procViz &= ~AI_RAY_SHADOW;
+        else
+            attrViz &= ~AI_RAY_SHADOW;
+        compViz &= ~AI_RAY_CAMERA;
+        if(procViz > compViz)
+            procViz &= ~AI_RAY_CAMERA;
+        else
+            attrViz &= ~AI_RAY_CAMERA;
+    }
+    return attrViz;
+}
@@ -0,0 +1,75 @@
+#ifndef _Alembic_Arnold_OverridePlan_h_
+#define _Alembic_Arnold_OverridePlan_h_
+
+#include <ai.h>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "json/json.h"
+
+/*
+The attribute overrides compiled into typed setters.
+The JSON values of every rule are read once when the rules are set. The first time a
+rule is applied to a node of a given type, its attributes are looked up in that node
+entry and turned into a list of typed values, the visibility being already composed
+with the one of the procedural. Applying a rule is then a loop over these values.
+*/
+
+class OverridePlan
+{
+public:
+    OverridePlan() {};
+
+    // rules are the keys of attributesRoot, in the order of the OverrideMatcher.
+    void setRules(const std::vector<std::string>& rules, const Json::Value& attributesRoot, uint8_t procVisibility);
+
+    // Apply the rules, given by index, in order.
+    void apply(AtNode* node, const std::vector<size_t>& rules);
+
+private:
+    struct Value
+    {
+        AtString param;
+        uint8_t type;       // type of the JSON value, an int may still become a byte
+        std::string str;
+        bool b;
+        int i;
+        unsigned int u;
+        float f;
+    };
+
+    struct Setter
+    {
+        AtString param;
+        uint8_t type;
+        AtString str;
+        union
+        {
+            bool b;
+            uint8_t byte;
+            int i;
+            unsigned int u;
+            float f;
+        };
+    };
+
+    typedef std::vector<Setter> SetterList;
+
+    struct CompiledEntry
+    {
+        std::vector<SetterList> setters;
+        std::vector<bool> compiled;
+    };
+
+    void compile(size_t rule, const AtNodeEntry* nodeEntry, SetterList& setters) const;
+
+    std::vector<std::vector<Value> > values;
+    std::map<const AtNodeEntry*, CompiledEntry> entries;
+    uint8_t procVisibility;
+};
+
+// Compose a visibility override with the one of the procedural.
+uint8_t ComposeVisibility(uint8_t procViz, uint8_t attrViz);
+
+#endif
@@ -38,6 +38,7 @@
 #include <vector>
 #include <algorithm>
 #include <iostream>
+#include <cstdlib>
 
 //-*****************************************************************************
 //INSERT YOUR OWN TOKENIZATION CODE AND STYLE HERE
@@ -52,6 +53,7 @@ ProcArgs::ProcArgs( AtNode *node )
   , linkDisplacement(false)
   , linkAttributes(false)
   , useAbcShaders(false)
+  , dryRun(false)
 {
 
     // Grab the shutter a camera attached to AiUniverse if present
@@ -70,5 +72,12 @@ ProcArgs::ProcArgs( AtNode *node )
    frame = AiNodeGetFlt(node, "frame");
    fps = AiNodeGetFlt(node, "fps");
 
+   const char* profileEnv = std::getenv("ALEMBIC_PROCEDURAL_PROFILE");
+   // the layer report relies on the profiler for what is actually read from the layers.
+   profiler.setEnabled(AiNodeGetBool(node, "profile") || AiNodeGetBool(node, "layerReport") ||
+                       (profileEnv != NULL && std::string(profileEnv) != "0"));
+
+   dryRun = AiNodeGetBool(node, "dryRun");
+
 }
 
@@ -48,6 +48,10 @@
 #include "json/json.h"
 
 #include "NodeCache.h"
+#include "OverrideMatcher.h"
+#include "OverridePlan.h"
+#include "LightBatch.h"
+#include "ProcProfiler.h"
 
 
 //-*****************************************************************************
@@ -94,13 +98,29 @@ struct ProcArgs
 	std::string shaderAssignationAttribute;
 
     std::vector<std::pair<std::string, AtNode*> > shaders;
+    ShaderMatcher shadersMatcher;
     std::map<std::string, AtNode*> displacements;
 	std::map<std::string, std::string> pathRemapping;
     std::vector<std::string> attributes;
     Json::Value attributesRoot;
+    OverrideMatcher attributesMatcher;
+    OverridePlan attributesPlan;
+
+    std::map<std::string, LightBatch> lightBatches;
+
+    ProcProfiler profiler;
+
+    bool dryRun;
+    Json::Value dryRunStats;
+
+    // Resolved once per object during the walk.
+    std::map<std::string, std::vector<std::string> > allTags;
+    std::map<std::string, bool> visibleForArnold;
+    std::map<std::string, Alembic::AbcGeom::IVisibilityProperty> visibilityProperties;
 
     bool useAbcShaders;
     Alembic::AbcGeom::IObject materialsObject;
+    std::map<std::string, AtNode*> abcNetworks; // network built for each material, by path of the material it instances, or by file:material of a bound AbcShader
     const char* abcShaderFile;
 };
 
@@ -45,12 +45,15 @@
 #include "WriteGeo.h"
 #include "WritePoint.h"
 #include "WriteLight.h"
+#include "WriteCamera.h"
 #include "WriteCurves.h"
 #include "json/json.h"
 #include "parseAttributes.h"
 #include "NodeCache.h"
 
 #include "ReadInstancer.h"
+#include "ArchiveLayers.h"
+#include "DryRun.h"
 
 #include <Alembic/AbcGeom/All.h>
 
@@ -89,6 +92,23 @@ node_parameters
     AiParameterBool("skipAttributes", false);
     AiParameterBool("skipLayers", false);
     AiParameterBool("skipDisplacements", false);
+
+    AiParameterFlt("lodDensity", 1.0);
+    AiParameterFlt("lodDistance", 0.0);
+    AiParameterFlt("lodMinDensity", 0.0);
+
+    AiParameterBool("loadCameras", false);
+    AiParameterBool("cameraDepthOfField", false);
+
+    AiParameterBool("layerReport", false);
+
+    AiParameterBool("mergeQuadLights", false);
+
+    AiParameterBool("profile", false);
+    AiParameterStr("profileReport", "");
+
+    AiParameterBool("dryRun", false);
+    AiParameterStr("dryRunReport", "");
 }
 
 
@@ -186,7 +206,10 @@ void WalkObject( IObject & parent, const ObjectHeader &i_ohead, ProcArgs &args,
     else if ( ISubD::matches( ohead ) )
     {
         ISubD subd( parent, ohead.getName() );
-        ProcessSubD( subd, args, xformSamples );
+        if(args.dryRun)
+            DryRunShape( subd, args, xformSamples );
+        else
+            ProcessSubD( subd, args, xformSamples );
 
         nextParentObject = subd;
 
@@ -196,14 +219,26 @@ void WalkObject( IObject & parent, const ObjectHeader &i_ohead, ProcArgs &args,
         IPolyMesh polymesh( parent, ohead.getName() );
         
         if(isVisibleForArnold(parent, &args)) // check if the object is invisible for arnold. It is there to avoid skipping the whole hierarchy.
-            ProcessPolyMesh( polymesh, args, xformSamples);
+        {
+            if(args.dryRun)
+                DryRunShape( polymesh, args, xformSamples );
+            else
+                ProcessPolyMesh( polymesh, args, xformSamples);
+        }
 
         nextParentObject = polymesh; 
     }
     else if ( INuPatch::matches( ohead ) )
     {
         INuPatch patch( parent, ohead.getName() );
-        // TODO ProcessNuPatch( patch, args );
+
+        if(isVisibleForArnold(parent, &args))
+        {
+            if(args.dryRun)
+                DryRunShape( patch, args, xformSamples );
+            else
+                ProcessNuPatch( patch, args, xformSamples );
+        }
 
         nextParentObject = patch;
     }
@@ -212,7 +247,12 @@ void WalkObject( IObject & parent, const ObjectHeader &i_ohead, ProcArgs &args,
         IPoints points( parent, ohead.getName() );
 
         if(isVisibleForArnold(parent, &args))
-            ProcessPoint( points, args, xformSamples );
+        {
+            if(args.dryRun)
+                DryRunShape( points, args, xformSamples );
+            else
+                ProcessPoint( points, args, xformSamples );
+        }
 
         nextParentObject = points;
     }
@@ -221,7 +261,12 @@ void WalkObject( IObject & parent, const ObjectHeader &i_ohead, ProcArgs &args,
         ICurves curves( parent, ohead.getName() );
 
         if(isVisibleForArnold(parent, &args))
-            ProcessCurves( curves, args, xformSamples );
+        {
+            if(args.dryRun)
+                DryRunShape( curves, args, xformSamples );
+            else
+                ProcessCurves( curves, args, xformSamples );
+        }
 
         nextParentObject = curves;
     }
@@ -229,6 +274,14 @@ void WalkObject( IObject & parent, const ObjectHeader &i_ohead, ProcArgs &args,
     {
         ICamera camera( parent, ohead.getName() );
 
+        if(AiNodeGetBool(args.proceduralNode, "loadCameras") && isVisibleForArnold(parent, &args))
+        {
+            if(args.dryRun)
+                DryRunObject( camera, "camera", args, xformSamples );
+            else
+                ProcessCamera( camera, args, xformSamples );
+        }
+
         nextParentObject = camera;
     }
     else if ( ILight::matches( ohead ) )
@@ -236,7 +289,12 @@ void WalkObject( IObject & parent, const ObjectHeader &i_ohead, ProcArgs &args,
         ILight light( parent, ohead.getName() );
         
         if(isVisibleForArnold(parent, &args)) // check if the object is invisible for arnold. It is there to avoid skipping the whole hierarchy.
-            ProcessLight( light, args, xformSamples);
+        {
+            if(args.dryRun)
+                DryRunObject( light, "light", args, xformSamples );
+            else
+                ProcessLight( light, args, xformSamples);
+        }
 
         nextParentObject = light;
     }
@@ -350,6 +408,8 @@ procedural_init
     ProcArgs * args = new ProcArgs(node);
     *user_ptr = args;
 
+    ProfileScope initScope(args->profiler, "init");
+
     
 	if(const char* env_p = std::getenv("PATH_REMAPPING")) // TODO: Read from json file and procedural parameters & merge them all.
 	{
@@ -396,6 +456,8 @@ procedural_init
     }
 
 
+    ProfileScope jsonScope(args->profiler, "json_parse");
+
     Json::Value jrootShaders;
     Json::Value jrootAttributes;
     Json::Value jrootDisplacements;
@@ -592,6 +654,9 @@ procedural_init
         args->shaderAssignationAttribute = std::string(shadersAttribute.c_str());
     }
 
+    jsonScope.stop();
+    ProfileScope assignmentsScope(args->profiler, "assignments");
+
     //Check displacements
 
     if( jrootDisplacements.size() > 0 )
@@ -606,6 +671,11 @@ procedural_init
     {
         args->linkShader = true;
         ParseShaders(jrootShaders, args->ns, args->nameprefix, args, 1);
+
+        std::vector<std::string> shaderRules;
+        for(size_t i = 0; i < args->shaders.size(); ++i)
+            shaderRules.push_back(args->shaders[i].first);
+        args->shadersMatcher.setRules(shaderRules);
     }
 
 
@@ -620,12 +690,24 @@ procedural_init
 
         }
         std::sort(args->attributes.begin(), args->attributes.end());
+        args->attributesMatcher.setRules(args->attributes);
+        args->attributesPlan.setRules(args->attributes, args->attributesRoot, AiNodeGetByte(node, "visibility"));
     }
+    assignmentsScope.stop();
 
 
     // check if we have a instancer archive attribute
     if (instancerArchive.empty() == false )
     {
+        // the instancer creates its nodes as it walks, so a dry run only
+        // reports what was resolved so far.
+        if(args->dryRun)
+        {
+            AiMsgWarning("[alembic] dry run does not walk the instancer archive %s", instancerArchive.c_str());
+            WriteDryRunReport(*args);
+            return 1;
+        }
+
         // if so, we try to load the archive.
         IArchive archive;
         Alembic::AbcCoreFactory::IFactory factory;
@@ -657,7 +739,10 @@ procedural_init
 
     std::string fileCacheId = g_cache->g_fileCache->getHash(args->filenames, args->shaders, args->displacements, args->attributesRoot, args->frame);
 
-    const std::vector<CachedNodeFile>& createdNodes = g_cache->g_fileCache->getCachedFile(fileCacheId);
+    // a dry run must walk the archive even if it was already loaded.
+    const std::vector<CachedNodeFile> noCachedNodes;
+    const std::vector<CachedNodeFile>& createdNodes = args->dryRun ? noCachedNodes : g_cache->g_fileCache->getCachedFile(fileCacheId);
+    args->profiler.addCacheLookup("file_cache", !createdNodes.empty());
     
     if (!createdNodes.empty())
     {
@@ -783,7 +868,10 @@ procedural_init
 
     Alembic::AbcCoreFactory::IFactory factory;
     factory.setOgawaNumStreams(8);
-    IArchive archive = factory.getArchive(args->filenames);
+    std::vector<ArchiveLayerInfo> layers;
+    ProfileScope archiveScope(args->profiler, "archive_open");
+    IArchive archive = OpenLayeredArchive(factory, args->filenames, AiNodeGetBool(node, "layerReport"), layers);
+    archiveScope.stop();
     
     if (!archive.valid())
     {
@@ -797,6 +885,8 @@ procedural_init
             AiMsgDebug ( "reading file %s", args->filenames[i].c_str());
     }
 
+    ProfileScope walkScope(args->profiler, "walk");
+
     IObject root = archive.getTop();
     PathList path;
     TokenizePath( args->objectpath, "/", path );
@@ -833,6 +923,12 @@ procedural_init
         AiMsgError("exception thrown");
     }
     */
+    FlushLightBatches(*args);
+    walkScope.stop();
+
+    if(args->dryRun)
+        WriteDryRunReport(*args);
+
     //g_cache->g_fileCache->removeFromOpenedFiles(args->filename);
     return 1;
 }
@@ -846,8 +942,11 @@ procedural_cleanup
     ProcArgs * args = reinterpret_cast<ProcArgs*>( user_ptr );
     if(args != NULL)
     {
+        args->profiler.report(args->proceduralNode, args->createdNodes);
 
-        if(args->createdNodes->getNumNodes() > 0)
+        // a dry run only collected the shaders, it must not be served to a
+        // real load of the same file.
+        if(!args->dryRun && args->createdNodes->getNumNodes() > 0)
         {
             caches *g_cache = reinterpret_cast<caches*>(AiNodeGetPluginData(args->proceduralNode));
             std::string fileCacheId = g_cache->g_fileCache->getHash(args->filenames, args->shaders, args->displacements, args->attributesRoot, args->frame);
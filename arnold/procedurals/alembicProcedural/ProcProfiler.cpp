@@ -0,0 +1,181 @@
+#include "ProcProfiler.h"
+
+#include <cstdlib>
+#include <fstream>
+#include <mutex>
+
+#include "json/json.h"
+
+namespace
+{
+    // the procedurals can be released from several threads.
+    std::mutex reportMutex;
+
+    uint64_t getArrayBytes(AtNode* node, const AtString& param)
+    {
+        AtArray* array = AiNodeGetArray(node, param);
+        if(array == NULL)
+            return 0;
+        return (uint64_t) AiArrayGetNumElements(array) * AiArrayGetNumKeys(array) * AiParamGetTypeSize(AiArrayGetType(array));
+    }
+
+    // The arrays of the node parameters, the geometry, & of its user data.
+    uint64_t getArrayBytes(AtNode* node)
+    {
+        uint64_t bytes = 0;
+        const AtNodeEntry* nentry = AiNodeGetNodeEntry(node);
+        AtParamIterator* iter = AiNodeEntryGetParamIterator(nentry);
+        while (!AiParamIteratorFinished(iter))
+        {
+            const AtParamEntry* pentry = AiParamIteratorGetNext(iter);
+            if(AiParamGetType(pentry) == AI_TYPE_ARRAY)
+                bytes += getArrayBytes(node, AiParamGetName(pentry));
+        }
+        AiParamIteratorDestroy(iter);
+
+        AtUserParamIterator* userIter = AiNodeGetUserParamIterator(node);
+        while (!AiUserParamIteratorFinished(userIter))
+        {
+            const AtUserParamEntry* upentry = AiUserParamIteratorGetNext(userIter);
+            if(AiUserParamGetType(upentry) == AI_TYPE_ARRAY)
+                bytes += getArrayBytes(node, AtString(AiUserParamGetName(upentry)));
+        }
+        AiUserParamIteratorDestroy(userIter);
+        return bytes;
+    }
+}
+
+void ProcProfiler::addTime(const char* phase, double seconds)
+{
+    if(!enabled)
+        return;
+
+    times[phase] += seconds;
+    selfTimes[phase] += seconds;
+    if(!nestedTimes.empty())
+        nestedTimes.back() += seconds;
+}
+
+void ProcProfiler::beginPhase()
+{
+    if(enabled)
+        nestedTimes.push_back(0.0);
+}
+
+void ProcProfiler::endPhase(const char* phase, double seconds)
+{
+    if(!enabled || nestedTimes.empty())
+        return;
+
+    const double nested = nestedTimes.back();
+    nestedTimes.pop_back();
+    addTime(phase, seconds);
+    selfTimes[phase] -= nested;
+}
+
+void ProcProfiler::addCount(const char* counter, uint64_t value)
+{
+    if(enabled)
+        counters[counter] += value;
+}
+
+void ProcProfiler::addCacheLookup(const char* cache, bool hit)
+{
+    if(!enabled)
+        return;
+
+    std::string name(cache);
+    counters[name + "_lookups"]++;
+    if(hit)
+        counters[name + "_hits"]++;
+}
+
+void ProcProfiler::report(AtNode* proceduralNode, NodeCollector* createdNodes) const
+{
+    if(!enabled)
+        return;
+
+    const char* procName = AiNodeGetName(proceduralNode);
+
+    std::map<std::string, uint64_t> nodeCounts;
+    uint64_t arrayBytes = 0;
+    if(createdNodes != NULL)
+    {
+        for(size_t i = 0; i < createdNodes->getNumNodes(); ++i)
+        {
+            AtNode* node = createdNodes->getNode(i);
+            nodeCounts[AiNodeEntryGetName(AiNodeGetNodeEntry(node))]++;
+            arrayBytes += getArrayBytes(node);
+        }
+    }
+
+    Json::Value root;
+    root["procedural"] = procName;
+    root["frame"] = AiNodeGetFlt(proceduralNode, "frame");
+
+    AtArray* fileNames = AiNodeGetArray(proceduralNode, "fileNames");
+    root["files"] = Json::Value(Json::arrayValue);
+    for (uint32_t i = 0; i < AiArrayGetNumElements(fileNames); i++)
+        root["files"].append(AiArrayGetStr(fileNames, i).c_str());
+
+    AiMsgInfo("[Alembic Procedural] %s stats", procName);
+
+    // "phases" are the total times, with the nested phases, and "self_phases" the times without them.
+    AiMsgInfo("[Alembic Procedural]   %-24s %12s %12s", "phase", "total", "self");
+    for(std::map<std::string, double>::const_iterator it = times.begin(); it != times.end(); ++it)
+    {
+        const double self = selfTimes.find(it->first)->second;
+        AiMsgInfo("[Alembic Procedural]   %-24s %10.3f s %10.3f s", it->first.c_str(), it->second, self);
+        root["phases"][it->first] = it->second;
+        root["self_phases"][it->first] = self;
+    }
+
+    for(std::map<std::string, uint64_t>::const_iterator it = counters.begin(); it != counters.end(); ++it)
+    {
+        AiMsgInfo("[Alembic Procedural]   %-24s %10llu", it->first.c_str(), (unsigned long long) it->second);
+        root["counters"][it->first] = (Json::UInt64) it->second;
+    }
+
+    const char* caches[] = {"node_cache", "file_cache"};
+    for(size_t i = 0; i < 2; ++i)
+    {
+        std::map<std::string, uint64_t>::const_iterator lookups = counters.find(std::string(caches[i]) + "_lookups");
+        if(lookups == counters.end() || lookups->second == 0)
+            continue;
+
+        std::map<std::string, uint64_t>::const_iterator hits = counters.find(std::string(caches[i]) + "_hits");
+        double rate = hits != counters.end() ? double(hits->second) / double(lookups->second) : 0.0;
+        AiMsgInfo("[Alembic Procedural]   %-24s %9.1f %%", (std::string(caches[i]) + "_hit_rate").c_str(), rate * 100.0);
+        root["hit_rates"][caches[i]] = rate;
+    }
+
+    for(std::map<std::string, uint64_t>::const_iterator it = nodeCounts.begin(); it != nodeCounts.end(); ++it)
+    {
+        AiMsgInfo("[Alembic Procedural]   nodes %-18s %10llu", it->first.c_str(), (unsigned long long) it->second);
+        root["nodes"][it->first] = (Json::UInt64) it->second;
+    }
+
+    AiMsgInfo("[Alembic Procedural]   %-24s %10.2f MB", "arnold_array_bytes", arrayBytes / (1024.0 * 1024.0));
+    root["arnold_array_bytes"] = (Json::UInt64) arrayBytes;
+
+    std::string reportFile(AiNodeGetStr(proceduralNode, "profileReport").c_str());
+    if(reportFile.empty())
+    {
+        const char* reportEnv = std::getenv("ALEMBIC_PROCEDURAL_PROFILE_REPORT");
+        if(reportEnv == NULL || reportEnv[0] == '\0')
+            return;
+        reportFile = reportEnv;
+    }
+
+    Json::FastWriter writer;
+    std::string line = writer.write(root);
+
+    std::lock_guard<std::mutex> lock(reportMutex);
+    std::ofstream report(reportFile.c_str(), std::ios::app);
+    if(!report)
+    {
+        AiMsgWarning("[Alembic Procedural] Can't write the stats report %s", reportFile.c_str());
+        return;
+    }
+    report << line;
+}
@@ -0,0 +1,90 @@
+#ifndef _Alembic_Arnold_ProcProfiler_h_
+#define _Alembic_Arnold_ProcProfiler_h_
+
+#include <ai.h>
+#include <chrono>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "NodeCache.h"
+
+/*
+Instrumentation of a procedural.
+It is enabled by the "profile" parameter of the procedural, or for all of them by the
+ALEMBIC_PROCEDURAL_PROFILE environment variable. It accumulates the wall time of the
+loading phases and a few counters, and reports them when the procedural is released,
+as stats lines in the log and, if a report file is given by the "profileReport" parameter
+or the ALEMBIC_PROCEDURAL_PROFILE_REPORT environment variable, as one JSON object per
+procedural appended to that file.
+The phases nest, e.g. the overrides are applied during mesh_decode, which is part of walk,
+so each phase is reported with its total time, that includes the phases nested in it, and
+its self time, that doesn't. The self times add up to the time of the outermost phases.
+When it is disabled, the timers and counters do nothing.
+*/
+
+class ProcProfiler
+{
+public:
+    ProcProfiler() : enabled(false) {};
+
+    void setEnabled(bool enable) { enabled = enable; };
+    bool isEnabled() const { return enabled; };
+
+    void addTime(const char* phase, double seconds);
+
+    // Called by ProfileScope, the phases of a profiler are ended in the reverse order they began.
+    void beginPhase();
+    void endPhase(const char* phase, double seconds);
+    void addCount(const char* counter, uint64_t value = 1);
+
+    // Count a lookup in one of the caches.
+    void addCacheLookup(const char* cache, bool hit);
+
+    // Log the stats of the procedural, with the nodes it created, and append them to the report file if any.
+    void report(AtNode* proceduralNode, NodeCollector* createdNodes) const;
+
+private:
+    bool enabled;
+    std::map<std::string, double> times;
+    std::map<std::string, double> selfTimes;
+    // Time of the phases nested in each running phase.
+    std::vector<double> nestedTimes;
+    std::map<std::string, uint64_t> counters;
+};
+
+// Adds the time spent between its creation and its destruction, or the call to stop, to a phase.
+class ProfileScope
+{
+public:
+    ProfileScope(ProcProfiler& profiler, const char* phase)
+    : profiler(profiler)
+    , phase(phase)
+    , running(profiler.isEnabled())
+    {
+        if(running)
+        {
+            profiler.beginPhase();
+            start = std::chrono::steady_clock::now();
+        }
+    };
+
+    ~ProfileScope() { stop(); };
+
+    void stop()
+    {
+        if(!running)
+            return;
+        running = false;
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        profiler.endPhase(phase, elapsed.count());
+    };
+
+private:
+    ProcProfiler& profiler;
+    const char* phase;
+    bool running;
+    std::chrono::steady_clock::time_point start;
+};
+
+#endif
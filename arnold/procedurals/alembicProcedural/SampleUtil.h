@@ -65,6 +65,17 @@ void ConcatenateXformSamples( ProcArgs &args,
 
 Abc::chrono_t GetRelativeSampleTime( ProcArgs &args, Abc::chrono_t sampleTime);
 
+//-*****************************************************************************
+
+// Points & curves read at a single sample are moved along their velocities for the motion
+// blur, they then get 2 deformation keys, at the shutter open & close.
+template <typename schemaT>
+bool UseVelocityKeys( schemaT &ps, const SampleTimeSet &sampleTimes, ProcArgs &args )
+{
+    return sampleTimes.size() == 1 && args.shutterOpen != args.shutterClose &&
+           ps.getVelocitiesProperty().valid();
+}
+
 
 
 #endif
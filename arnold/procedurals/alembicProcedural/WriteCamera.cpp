@@ -1,38 +1,99 @@
 #include "WriteCamera.h"
 
+#include "ArbGeomParams.h"
+#include "parseAttributes.h"
+#include "WriteTransform.h"
+#include "WriteOverrides.h"
 
 #include <ai.h>
 #include <sstream>
 
 #include "json/json.h"
 
-void ProcessCamera( ICamera &camera, const ProcArgs &args,
+void ProcessCamera( ICamera &camera, ProcArgs &args,
         MatrixSampleMap * xformSamples)
 {
     if (!camera.valid())
         return;
 
-    SampleTimeSet sampleTimes;
+    std::string originalName = camera.getFullName();
+    std::string name = args.nameprefix + originalName;
 
     ICameraSchema ps = camera.getSchema();
-
     TimeSamplingPtr ts = ps.getTimeSampling();
-    sampleTimes.insert( ts->getFloorIndex(args.frame / args.fps, ps.getNumSamples()).second );
 
+    // The camera samples are read once for the whole shutter, like the transforms.
+    SampleTimeSet sampleTimes;
+    if ( ps.isConstant() )
+        sampleTimes.insert( ts->getFloorIndex(args.frame / args.fps, ps.getNumSamples()).second );
+    else
+        GetRelevantSampleTimes( args, ts, ps.getNumSamples(), sampleTimes );
 
-    std::string name = args.nameprefix + camera.getFullName();
+    std::vector<CameraSample> samples;
+    samples.reserve( sampleTimes.size() );
+    for ( SampleTimeSet::iterator I = sampleTimes.begin(); I != sampleTimes.end(); ++I )
+        samples.push_back( ps.getValue( ISampleSelector( *I ) ) );
 
     SampleTimeSet singleSampleTimes;
     singleSampleTimes.insert( ts->getFloorIndex(args.frame / args.fps, ps.getNumSamples()).second );
-
-    ISampleSelector sampleSelector( *singleSampleTimes.begin() );
-
-    Alembic::AbcGeom::CameraSample sample = ps.getValue( sampleSelector );
+    ISampleSelector frameSelector( *singleSampleTimes.begin() );
+    CameraSample frameSample = ps.getValue( frameSelector );
 
     AtNode * cameraNode = AiNode("persp_camera");
     AiNodeSetStr(cameraNode, "name", name.c_str());
 
-    AiNodeSetFlt(cameraNode, "fov", sample.getFocalLength());
-
-
+    // Lens. Alembic stores the focal length in mm and the apertures in cm.
+    bool depthOfField = AiNodeGetBool(args.proceduralNode, "cameraDepthOfField");
+
+    AtArray* fovArray = AiArrayAllocate(1, samples.size(), AI_TYPE_FLOAT);
+    AtArray* focusArray = AiArrayAllocate(1, samples.size(), AI_TYPE_FLOAT);
+    AtArray* apertureArray = AiArrayAllocate(1, samples.size(), AI_TYPE_FLOAT);
+    for ( size_t i = 0; i < samples.size(); ++i )
+    {
+        AiArraySetFlt(fovArray, i, samples[i].getFieldOfView());
+        AiArraySetFlt(focusArray, i, samples[i].getFocusDistance());
+
+        float apertureSize = 0.0f;
+        if ( depthOfField && samples[i].getFStop() > 0.0 )
+            apertureSize = 0.1f * samples[i].getFocalLength() / (2.0f * samples[i].getFStop());
+        AiArraySetFlt(apertureArray, i, apertureSize);
+    }
+    AiNodeSetArray(cameraNode, "fov", fovArray);
+    AiNodeSetArray(cameraNode, "focus_distance", focusArray);
+    AiNodeSetArray(cameraNode, "aperture_size", apertureArray);
+
+    // Film offsets.
+    double horizontalAperture = frameSample.getHorizontalAperture();
+    double verticalAperture = frameSample.getVerticalAperture();
+    if ( horizontalAperture > 0.0 && verticalAperture > 0.0 )
+    {
+        float offsetX = 2.0 * frameSample.getHorizontalFilmOffset() / horizontalAperture;
+        float offsetY = 2.0 * frameSample.getVerticalFilmOffset() / verticalAperture;
+        AiNodeSetVec2(cameraNode, "screen_window_min", -1.0f + offsetX, -1.0f + offsetY);
+        AiNodeSetVec2(cameraNode, "screen_window_max", 1.0f + offsetX, 1.0f + offsetY);
+    }
+
+    // Clipping planes can't be animated.
+    AiNodeSetFlt(cameraNode, "near_clip", frameSample.getNearClippingPlane());
+    AiNodeSetFlt(cameraNode, "far_clip", frameSample.getFarClippingPlane());
+
+    // adding arbitary parameters
+    ICompoundProperty arbGeomParams = ps.getArbGeomParams();
+    AddArbitraryGeomParams(
+            arbGeomParams,
+            frameSelector,
+            cameraNode );
+
+    //get tags
+    std::vector<std::string> tags;
+    getAllTags(camera, tags, &args);
+
+    // Arnold Attribute from json
+    if(args.linkAttributes)
+        ApplyOverrides(originalName, cameraNode, tags, args);
+
+    // Xform
+    ApplyTransformation( cameraNode, xformSamples, args );
+
+    args.createdNodes->addNode(cameraNode);
 }
@@ -40,6 +40,7 @@
 #include "ArbGeomParams.h"
 #include "parseAttributes.h"
 #include "NodeCache.h"
+#include "LevelOfDetail.h"
 
 #include "../../../common/PathUtil.h"
 
@@ -82,7 +83,8 @@ std::string getHash(
     const std::string& originalName,
     ICurves & prim,
     ProcArgs & args,
-    const SampleTimeSet& sampleTimes
+    const SampleTimeSet& sampleTimes,
+    float density
     )
 {
     Alembic::AbcGeom::ICurvesSchema  &ps = prim.getSchema();
@@ -174,6 +176,10 @@ std::string getHash(
 
     buffer << "@" << computeHash(hashAttributes);
 
+    // decimated curves are a different geometry.
+    if(density < 1.0f)
+        buffer << "@lod" << density;
+
     cacheId = buffer.str();
 
     return cacheId;
@@ -187,9 +193,12 @@ AtNode* writeCurves(
     const std::string& cacheId,
     ICurves & prim,
     ProcArgs & args,
-    const SampleTimeSet& sampleTimes
+    const SampleTimeSet& sampleTimes,
+    float density
     )
 {
+    ProfileScope profileScope(args.profiler, "curves_decode");
+
 	std::vector<AtVector> vlist;
 	std::vector<float> radius;
 	std::vector<float> finalRadius;
@@ -221,8 +230,6 @@ AtNode* writeCurves(
         return NULL;
     }
 
-	args.createdNodes->addNode(curvesNode);
-
     float radiusCurves = 1.0f;
     float scaleVelocity = 1.0f/args.fps;
 	std::string radiusParam = "pscale";
@@ -306,21 +313,16 @@ AtNode* writeCurves(
     if (AiNodeLookUpUserParameter(args.proceduralNode, "radiusProperty") !=NULL )
         radiusParam = std::string(AiNodeGetStr(args.proceduralNode, "radiusProperty"));
 
-    bool useVelocities = false;
-    if ((sampleTimes.size() == 1) && (args.shutterOpen != args.shutterClose))
-    {
-        // no sample, and motion blur needed, let's try to get velocities.
-        if(ps.getVelocitiesProperty().valid())
-            useVelocities = true;
-    }
-
+    // no sample, and motion blur needed, let's try to get velocities.
+    const bool useVelocities = UseVelocityKeys(ps, sampleTimes, args);
 
-    if ((sampleTimes.size() == 1) && (args.shutterOpen != args.shutterClose))
-    {
-        // no sample, and motion blur needed, let's try to get velocities.
-        if(ps.getVelocitiesProperty().valid())
-            useVelocities = true;
-    }
+    // Surviving strands are widened to keep the same coverage.
+    const bool decimate = density < 1.0f;
+    std::vector<unsigned int> keptCurves;
+    std::vector<unsigned int> keptVertices;
+    size_t numVertices = 0;
+    if(decimate)
+        radiusCurves /= density;
 
     for ( SampleTimeSet::iterator I = sampleTimes.begin();
           I != sampleTimes.end(); ++I, isFirstSample = false)
@@ -330,6 +332,7 @@ AtNode* writeCurves(
 
         Alembic::Abc::P3fArraySamplePtr v3ptr = sample.getPositions();
         size_t pSize = sample.getPositions()->size();
+        args.profiler.addCount("alembic_bytes", pSize * sizeof(V3f));
 
         // handling radius
 
@@ -382,14 +385,36 @@ AtNode* writeCurves(
                     break;
                 }
             }
+
+            // Level of detail : we select the strands before filling any array.
+            if(decimate)
+            {
+                keptCurves.reserve(size_t(numCurves * density) + 1);
+                for ( size_t c = 0; c < numCurves; ++c )
+                {
+                    unsigned int c_verts = nVertices->get()[c];
+                    if(keepPrimitive(c, density))
+                    {
+                        keptCurves.push_back(c);
+                        for ( unsigned int v = 0; v < c_verts; ++v )
+                            keptVertices.push_back(numVertices + v);
+                    }
+                    numVertices += c_verts;
+                }
+            }
+
 			if(widthSamp)
 			{
-				for ( size_t pId = 0; pId < pSize; ++pId )
-					radius.push_back((*widthSamp.getVals())[pId] * radiusCurves);
+				const size_t numKept = decimate ? keptVertices.size() : pSize;
+				radius.reserve(numKept);
+				for ( size_t k = 0; k < numKept; ++k )
+					radius.push_back((*widthSamp.getVals())[decimate ? keptVertices[k] : k] * radiusCurves);
 			}
 
 		}
 
+        const size_t numKept = decimate ? keptVertices.size() : pSize;
+
         
         if(useVelocities && isFirstSample)
         {
@@ -397,13 +422,14 @@ AtNode* writeCurves(
             if (AiNodeLookUpUserParameter(args.proceduralNode, "scaleVelocity") !=NULL )
                 scaleVelocity *= AiNodeGetFlt(args.proceduralNode, "scaleVelocity");
 
-            vlist.resize(pSize*2);
+            vlist.resize(numKept*2);
             Alembic::Abc::V3fArraySamplePtr velptr = sample.getVelocities();
 
             float timeoffset = ((args.frame / args.fps) - ts->getFloorIndex((*I), ps.getNumSamples()).second) * args.fps;
 
-            for ( size_t pId = 0; pId < pSize; ++pId )
+            for ( size_t k = 0; k < numKept; ++k )
             {
+                size_t pId = decimate ? keptVertices[k] : k;
                 if(pId <= velptr->size())
                 {
                     Alembic::Abc::V3f posAtOpen = ((*v3ptr)[pId] + (*velptr)[pId] * scaleVelocity *-timeoffset);
@@ -411,22 +437,24 @@ AtNode* writeCurves(
                     pos1.x = posAtOpen.x;
                     pos1.y = posAtOpen.y;
                     pos1.z = posAtOpen.z;
-                    vlist[pId]= pos1;
+                    vlist[k]= pos1;
 
                     Alembic::Abc::V3f posAtEnd = ((*v3ptr)[pId] + (*velptr)[pId]* scaleVelocity *(1.0f-timeoffset));
                     AtVector pos2;
                     pos2.x = posAtEnd.x;
                     pos2.y = posAtEnd.y;
                     pos2.z = posAtEnd.z;
-                    vlist[pId+pSize]= pos2;
+                    vlist[k+numKept]= pos2;
                 }
             }
         }
         else
             // not motion blur or correctly sampled curves
         {
-            for ( size_t pId = 0; pId < pSize; ++pId )
+            vlist.reserve(vlist.size() + numKept);
+            for ( size_t k = 0; k < numKept; ++k )
             {
+                size_t pId = decimate ? keptVertices[k] : k;
                 AtVector pos;
                 pos.x = (*v3ptr)[pId].x;
                 pos.y = (*v3ptr)[pId].y;
@@ -436,12 +464,24 @@ AtNode* writeCurves(
         }
     }
 
-	AtArray* curveNumPoints = AiArrayAllocate( numCurves , 1, AI_TYPE_UINT); 
+    // everything was decimated away.
+    if(vlist.empty())
+    {
+        AiNodeDestroy(curvesNode);
+        return NULL;
+    }
+
+    // only collected once it survives the decimation, the collector must not
+    // hold destroyed nodes.
+    args.createdNodes->addNode(curvesNode);
+
+	const size_t numKeptCurves = decimate ? keptCurves.size() : numCurves;
+	AtArray* curveNumPoints = AiArrayAllocate( numKeptCurves , 1, AI_TYPE_UINT); 
 	unsigned int w_end = 0;
 
-    for ( size_t i = 0; i < numCurves ; i++ )
+    for ( size_t i = 0; i < numKeptCurves ; i++ )
 	{
-		unsigned int c_verts = nVertices->get()[i];
+		unsigned int c_verts = nVertices->get()[decimate ? keptCurves[i] : i];
 		AiArraySetUInt(curveNumPoints, i, c_verts);
 
 		if ( !radius.empty() && ( basis == 1 || basis == 2 ) /* for spline & catmull */ )
@@ -528,11 +568,19 @@ AtNode* writeCurves(
 
 	AiNodeSetInt(curvesNode, "basis", basis);
 
-	AiNodeSetArray(curvesNode, "num_points", curveNumPoints);
-
-
     ICompoundProperty arbPointsParams = ps.getArbGeomParams();
-    AddArbitraryGeomParams( arbGeomParams, frameSelector, curvesNode );
+    AiNodeSetArray(curvesNode, "num_points", curveNumPoints);
+
+    ProfileScope primvarsScope(args.profiler, "primvars");
+    // only the kept strands are read into the user data.
+    ArbGeomParamsSelection selection;
+    if(decimate)
+    {
+        selection.primitives = &keptCurves;
+        selection.vertices = &keptVertices;
+    }
+    AddArbitraryGeomParams( arbGeomParams, frameSelector, curvesNode, NULL, &selection );
+    primvarsScope.stop();
 
 	args.nodeCache->addNode(cacheId, curvesNode);
     return curvesNode;
@@ -614,13 +662,22 @@ void ProcessCurves( ICurves &curves, ProcArgs &args,
     SampleTimeSet sampleTimes;
     getSampleTimes(curves, args, sampleTimes);
 
+    Box3d bounds;
+    ICurvesSchema &ps = curves.getSchema();
+    if(ps.getSelfBoundsProperty().valid())
+        bounds = ps.getSelfBoundsProperty().getValue(ISampleSelector(*sampleTimes.begin()));
+
+    float density = GetLodDensity(curves, originalName, bounds, xformSamples, args);
+    if(density <= 0.0f)
+        return;
 
-    std::string cacheId = getHash(name, originalName, curves, args, sampleTimes);
+    std::string cacheId = getHash(name, originalName, curves, args, sampleTimes, density);
     AtNode* curvesNode = args.nodeCache->getCachedNode(cacheId);
+    args.profiler.addCacheLookup("node_cache", curvesNode != NULL);
 
     if(curvesNode == NULL)
     { // We don't have a cache, so we much create this points object.
-        curvesNode = writeCurves(name, originalName, cacheId, curves, args, sampleTimes);
+        curvesNode = writeCurves(name, originalName, cacheId, curves, args, sampleTimes, density);
     }
 
     // we can create the instance, with correct transform, attributes & shaders.
@@ -41,6 +41,7 @@
 #include "../../../common/PathUtil.h"
 #include "parseAttributes.h"
 #include "NodeCache.h"
+#include "NurbsTessellator.h"
 
 #include <ai.h>
 #include <sstream>
@@ -173,6 +174,49 @@ void getSampleTimes(
 }
 
 
+//-*************************************************************************
+// hashTopology
+// This function adds to the hash the data that defines the geometry besides the positions.
+template <typename schemaT>
+inline void hashTopology(schemaT& ps, const ISampleSelector& frameSelector, std::ostringstream& buffer)
+{
+}
+
+template<>
+inline void hashTopology<INuPatchSchema>(INuPatchSchema& ps, const ISampleSelector& frameSelector, std::ostringstream& buffer)
+{
+    AbcA::ArraySampleKey knotSampleKey;
+    ps.getUKnotsProperty().getKey(knotSampleKey, frameSelector);
+    knotSampleKey.digest.print(buffer);
+    buffer << ":";
+
+    ps.getVKnotsProperty().getKey(knotSampleKey, frameSelector);
+    knotSampleKey.digest.print(buffer);
+    buffer << ":";
+
+    if ( ps.getPositionWeightsProperty().valid() )
+    {
+        AbcA::ArraySampleKey weightSampleKey;
+        ps.getPositionWeightsProperty().getKey(weightSampleKey, frameSelector);
+        weightSampleKey.digest.print(buffer);
+        buffer << ":";
+    }
+}
+
+//-*************************************************************************
+// getFaceSetNames
+// NuPatches don't have facesets.
+template <typename schemaT>
+inline void getFaceSetNames(schemaT& ps, std::vector< std::string >& faceSetNames)
+{
+    ps.getFaceSetNames(faceSetNames);
+}
+
+template<>
+inline void getFaceSetNames<INuPatchSchema>(INuPatchSchema& ps, std::vector< std::string >& faceSetNames)
+{
+}
+
 //-*************************************************************************
 // getHash
 // This function return the hash of the mesh, with attributes & displacement applied to it.
@@ -286,7 +330,9 @@ std::string getHash(
                         || attribute=="disp_zero_value"
                         || attribute=="disp_autobump"
                         || attribute=="sss_setname"
-                        || attribute=="invert_normals")
+                        || attribute=="invert_normals"
+                        || attribute=="nurbs_sampling"
+                        || attribute=="nurbs_tolerance")
                     {
                         Json::Value val = args.attributesRoot[*it][itr.key().asString()];
 
@@ -331,6 +377,8 @@ std::string getHash(
     
     }
 
+    hashTopology(ps, frameSelector, buffer);
+
     buffer << "@" << computeHash(hashAttributes);
 
     cacheId = buffer.str();
@@ -431,6 +479,223 @@ inline void doNormals<IPolyMesh>(IPolyMesh& prim, AtNode *meshNode, const Sample
     }
 }
 
+//-*************************************************************************
+// applyMeshOverrides
+// This function sets the overrides that change the geometry on a polymesh node.
+void applyMeshOverrides(
+    const std::string& name,
+    const std::vector<std::string>& tags,
+    AtNode* meshNode,
+    ProcArgs & args
+    )
+{
+    if(args.linkAttributes)
+    {
+        for(std::vector<std::string>::iterator it=args.attributes.begin(); it!=args.attributes.end(); ++it)
+        {
+            if(name.find(*it) != string::npos || std::find(tags.begin(), tags.end(), *it) != tags.end() || matchPattern(name,*it))
+            {
+                Json::Value overrides = args.attributesRoot[*it];
+                if(overrides.size() > 0)
+                {
+                    for( Json::ValueIterator itr = overrides.begin() ; itr != overrides.end() ; itr++ )
+                    {
+                        std::string attribute = itr.key().asString();
+
+                        // All these attribute affect the nodeCacheId.
+                        if (attribute=="smoothing"
+                            || attribute=="subdiv_iterations"
+                            || attribute=="subdiv_type"
+                            || attribute=="subdiv_adaptive_metric"
+                            || attribute=="subdiv_uv_smoothing"
+                            || attribute=="subdiv_pixel_error"
+                            || attribute=="disp_height"
+                            || attribute=="disp_padding"
+                            || attribute=="disp_zero_value"
+                            || attribute=="disp_autobump"
+                            || attribute=="sss_setname"
+                            || attribute=="invert_normals")
+                        {
+                            const AtNodeEntry* nodeEntry = AiNodeGetNodeEntry(meshNode);
+                            const AtParamEntry* paramEntry = AiNodeEntryLookUpParameter(nodeEntry, attribute.c_str());
+
+                            Json::Value val = args.attributesRoot[*it][itr.key().asString()];
+
+                            if ( paramEntry == NULL)
+                            {
+                                // the param doesn't exists, but we can add it!
+                                if( val.isString() )
+                                    AiNodeDeclare(meshNode, attribute.c_str(), "constant STRING");
+                                else if( val.isBool() )
+                                    AiNodeDeclare(meshNode, attribute.c_str(), "constant BOOL");
+                                else if ( val.type() == Json::realValue )
+                                    AiNodeDeclare(meshNode, attribute.c_str(), "constant FLOAT");
+                                else if( val.isInt() || val.isUInt() )
+                                    AiNodeDeclare(meshNode, attribute.c_str(), "constant INT");
+                            }
+                                
+                            if( val.isString() )
+                                AiNodeSetStr(meshNode, attribute.c_str(), val.asCString());
+                            else if( val.isBool() )
+                                AiNodeSetBool(meshNode, attribute.c_str(), val.asBool());
+                            else if ( val.type() == Json::realValue )
+                              AiNodeSetFlt(meshNode, attribute.c_str(), val.asDouble());
+                            else if( val.isInt() )
+                            {
+                                //make the difference between Byte & int!
+                                if ( paramEntry != NULL)
+                                {
+                                    int typeEntry = AiParamGetType(paramEntry);
+                                    if(typeEntry == AI_TYPE_BYTE)
+                                        AiNodeSetByte(meshNode, attribute.c_str(), val.asInt());
+                                    else
+                                        AiNodeSetInt(meshNode, attribute.c_str(), val.asInt());
+                                }
+                                else
+                                    AiNodeSetInt(meshNode, attribute.c_str(), val.asInt());
+                            }
+                            else if( val.isUInt() )
+                                AiNodeSetUInt(meshNode, attribute.c_str(), val.asUInt());
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+//-*************************************************************************
+// getDisplacement
+// This function returns the displacement shader assigned to an object.
+AtNode* getDisplacement(
+    const std::string& originalName,
+    const std::vector<std::string>& tags,
+    ProcArgs & args
+    )
+{
+    AtNode* appliedDisplacement = NULL;
+    if(args.linkDisplacement)
+    {
+        bool foundInPath = false;
+        for(std::map<std::string, AtNode*>::iterator it = args.displacements.begin(); it != args.displacements.end(); ++it)
+        {
+            //check both path & tag
+            if(it->first.find("/") != string::npos)
+            {
+                if(pathContainsOtherPath(originalName, it->first))
+                {
+                    appliedDisplacement = it->second;
+                    foundInPath = true;
+                }
+            }
+            else if(matchPattern(originalName,it->first)) // based on wildcard expression
+            {
+                appliedDisplacement = it->second;
+                foundInPath = true;
+            }
+            else if(foundInPath == false)
+            {
+                if (std::find(tags.begin(), tags.end(), it->first) != tags.end())
+                {
+                    appliedDisplacement = it->second;
+                }
+            }
+        }
+    }
+
+    return appliedDisplacement;
+}
+
+//-*************************************************************************
+// writeFaceSetIndices
+// This function sets the per-face shader index of a mesh from its facesets, in one pass
+// over all the faceset faces. Meshes sharing the same facesets share the same array.
+template <typename schemaT>
+void writeFaceSetIndices(
+    const std::string& originalName,
+    schemaT& ps,
+    AtNode* meshNode,
+    size_t numFaces,
+    const ISampleSelector& frameSelector,
+    ProcArgs & args
+    )
+{
+    std::vector< std::string > faceSetNames;
+    ps.getFaceSetNames(faceSetNames);
+
+    if ( faceSetNames.empty() )
+        return;
+
+    std::vector<IFaceSet> faceSets(faceSetNames.size());
+
+    // The faces keys identify the facesets without reading them.
+    bool shareable = true;
+    std::ostringstream buffer;
+    buffer << "shidxs:" << numFaces;
+    for(size_t i = 0; i < faceSetNames.size(); i++)
+    {
+        buffer << ":" << faceSetNames[i];
+        if ( !ps.hasFaceSet( faceSetNames[i] ) )
+            continue;
+
+        faceSets[i] = ps.getFaceSet( faceSetNames[i] );
+
+        AbcA::ArraySampleKey facesSampleKey;
+        IInt32ArrayProperty facesProperty( faceSets[i].getSchema(), ".faces" );
+        if ( facesProperty.valid() && facesProperty.getKey(facesSampleKey, frameSelector) )
+        {
+            buffer << "=";
+            facesSampleKey.digest.print(buffer);
+        }
+        else
+            shareable = false;
+    }
+
+    std::string cacheId = shareable ? buffer.str() : std::string();
+    if ( !cacheId.empty() )
+    {
+        AtNode* cachedMesh = args.nodeCache->getCachedNode(cacheId);
+        if ( cachedMesh != NULL )
+        {
+            AiNodeSetArray( meshNode, "shidxs", AiArrayCopy( AiNodeGetArray(cachedMesh, "shidxs") ) );
+            return;
+        }
+    }
+
+    // By default, we are using all the faces.
+    std::vector<uint8_t> faceSetArray(numFaces, 0);
+
+    for(size_t i = 0; i < faceSets.size(); i++)
+    {
+        if ( !faceSets[i].valid() )
+            continue;
+
+        Int32ArraySamplePtr faces = faceSets[i].getSchema().getValue( frameSelector ).getFaces();
+        if ( !faces )
+            continue;
+
+        const Alembic::Util::int32_t* faceArray = faces->get();
+        const size_t numFaceSetFaces = faces->size();
+        AiMsgDebug("Faceset %s on %s with %i faces",  faceSetNames[i].c_str(), originalName.c_str(), (int) numFaceSetFaces);
+
+        size_t numInvalid = 0;
+        for( size_t f = 0; f < numFaceSetFaces; f++)
+        {
+            if( faceArray[f] >= 0 && (size_t) faceArray[f] < numFaces )
+                faceSetArray[faceArray[f]] = (uint8_t) i;
+            else
+                numInvalid++;
+        }
+        if ( numInvalid > 0 )
+            AiMsgWarning("Face set %s on %s has %i faces higher than nsides side", faceSetNames[i].c_str(), originalName.c_str(), (int) numInvalid);
+    }
+
+    AiNodeSetArray( meshNode, "shidxs", AiArrayConvert( faceSetArray.size(), 1, AI_TYPE_BYTE, &faceSetArray[0]) );
+
+    if ( !cacheId.empty() )
+        args.nodeCache->addNode(cacheId, meshNode);
+}
+
 //-*************************************************************************
 // writeMesh
 // This function create & return a mesh node with displace & attributes related to it.
@@ -445,6 +710,7 @@ AtNode* writeMesh(
     )
 
 {
+    ProfileScope profileScope(args.profiler, "mesh_decode");
 
     AiMsgDebug("Writing %s", originalName.c_str());
 
@@ -477,8 +743,11 @@ AtNode* writeMesh(
         ISampleSelector sampleSelector( *I );
         typename primT::schema_type::Sample sample = ps.getValue( sampleSelector );
 
+        args.profiler.addCount("alembic_bytes", sample.getPositions()->size() * sizeof(V3f));
+
         if ( isFirstSample )
         {
+            args.profiler.addCount("alembic_bytes", (sample.getFaceCounts()->size() + sample.getFaceIndices()->size()) * sizeof(Alembic::Util::int32_t));
 
             size_t numPolys = sample.getFaceCounts()->size();
             nsides.reserve( sample.getFaceCounts()->size() );
@@ -605,112 +874,10 @@ AtNode* writeMesh(
     AiNodeSetByte( meshNode, "visibility", 0 );
     AiNodeSetBool(meshNode, "smoothing", true);
 
-    if(args.linkAttributes)
-    {
-        for(std::vector<std::string>::iterator it=args.attributes.begin(); it!=args.attributes.end(); ++it)
-        {
-            if(name.find(*it) != string::npos || std::find(tags.begin(), tags.end(), *it) != tags.end() || matchPattern(name,*it))
-            {
-                Json::Value overrides = args.attributesRoot[*it];
-                if(overrides.size() > 0)
-                {
-                    for( Json::ValueIterator itr = overrides.begin() ; itr != overrides.end() ; itr++ )
-                    {
-                        std::string attribute = itr.key().asString();
-
-                        // All these attribute affect the nodeCacheId.
-                        if (attribute=="smoothing"
-                            || attribute=="subdiv_iterations"
-                            || attribute=="subdiv_type"
-                            || attribute=="subdiv_adaptive_metric"
-                            || attribute=="subdiv_uv_smoothing"
-                            || attribute=="subdiv_pixel_error"
-                            || attribute=="disp_height"
-                            || attribute=="disp_padding"
-                            || attribute=="disp_zero_value"
-                            || attribute=="disp_autobump"
-                            || attribute=="sss_setname"
-                            || attribute=="invert_normals")
-                        {
-                            const AtNodeEntry* nodeEntry = AiNodeGetNodeEntry(meshNode);
-                            const AtParamEntry* paramEntry = AiNodeEntryLookUpParameter(nodeEntry, attribute.c_str());
-
-                            Json::Value val = args.attributesRoot[*it][itr.key().asString()];
-
-                            if ( paramEntry == NULL)
-                            {
-                                // the param doesn't exists, but we can add it!
-                                if( val.isString() )
-                                    AiNodeDeclare(meshNode, attribute.c_str(), "constant STRING");
-                                else if( val.isBool() )
-                                    AiNodeDeclare(meshNode, attribute.c_str(), "constant BOOL");
-                                else if ( val.type() == Json::realValue )
-                                    AiNodeDeclare(meshNode, attribute.c_str(), "constant FLOAT");
-                                else if( val.isInt() || val.isUInt() )
-                                    AiNodeDeclare(meshNode, attribute.c_str(), "constant INT");
-                            }
-                                
-                            if( val.isString() )
-                                AiNodeSetStr(meshNode, attribute.c_str(), val.asCString());
-                            else if( val.isBool() )
-                                AiNodeSetBool(meshNode, attribute.c_str(), val.asBool());
-                            else if ( val.type() == Json::realValue )
-                              AiNodeSetFlt(meshNode, attribute.c_str(), val.asDouble());
-                            else if( val.isInt() )
-                            {
-                                //make the difference between Byte & int!
-                                if ( paramEntry != NULL)
-                                {
-                                    int typeEntry = AiParamGetType(paramEntry);
-                                    if(typeEntry == AI_TYPE_BYTE)
-                                        AiNodeSetByte(meshNode, attribute.c_str(), val.asInt());
-                                    else
-                                        AiNodeSetInt(meshNode, attribute.c_str(), val.asInt());
-                                }
-                                else
-                                    AiNodeSetInt(meshNode, attribute.c_str(), val.asInt());
-                            }
-                            else if( val.isUInt() )
-                                AiNodeSetUInt(meshNode, attribute.c_str(), val.asUInt());
-                        }
-                    }
-                }
-            }
-        }
-    }
+    applyMeshOverrides(name, tags, meshNode, args);
 
     // displaces assignation
-    // displacement stuff
-    AtNode* appliedDisplacement = NULL;
-    if(args.linkDisplacement)
-    {
-        bool foundInPath = false;
-        for(std::map<std::string, AtNode*>::iterator it = args.displacements.begin(); it != args.displacements.end(); ++it)
-        {
-            //check both path & tag
-            if(it->first.find("/") != string::npos)
-            {
-                if(pathContainsOtherPath(originalName, it->first))
-                {
-                    appliedDisplacement = it->second;
-                    foundInPath = true;
-                }
-            }
-            else if(matchPattern(originalName,it->first)) // based on wildcard expression
-            {
-                appliedDisplacement = it->second;
-                foundInPath = true;
-            }
-            else if(foundInPath == false)
-            {
-                if (std::find(tags.begin(), tags.end(), it->first) != tags.end())
-                {
-                    appliedDisplacement = it->second;
-                }
-            }
-        }
-    }
-
+    AtNode* appliedDisplacement = getDisplacement(originalName, tags, args);
     if(appliedDisplacement!= NULL)
         AiNodeSetPtr(meshNode, "disp_map", appliedDisplacement);
 
@@ -799,53 +966,223 @@ AtNode* writeMesh(
     doNormals(prim, meshNode, sampleTimes, numSampleTimes, vidxs);
 
     // facesets
-    std::vector< std::string > faceSetNames;
-    ps.getFaceSetNames(faceSetNames);
-    
-    if ( faceSetNames.size() > 0 )
+    writeFaceSetIndices(originalName, ps, meshNode, nsides.size(), frameSelector, args);
+
     {
+        ProfileScope primvarsScope(args.profiler, "primvars");
 
-        std::vector<uint8_t> faceSetArray;
-        // By default, we are using all the faces.
-        faceSetArray.resize(nsides.size());
-        for ( int i = 0; i < (int) nsides.size(); ++i )
-            faceSetArray[i] = 0;
+        ICompoundProperty arbGeomParams = ps.getArbGeomParams();
+        ISampleSelector frameSelector( *singleSampleTimes.begin() );
+
+        AddArbitraryGeomParams( arbGeomParams, frameSelector, meshNode );
 
-        for(int i = 0; i < faceSetNames.size(); i++)
+    }
+
+    args.createdNodes->addNode(meshNode);
+    args.nodeCache->addNode(cacheId, meshNode);
+    return meshNode;
+
+}
+
+//-*************************************************************************
+// getNuPatchTessellation
+// This function reads the tessellation settings of a NuPatch from the attributes overrides.
+// "nurbs_sampling" is a fixed number of segments per span, "nurbs_tolerance" is the maximum
+// distance to the surface, relative to the size of the patch.
+void getNuPatchTessellation(
+    const std::string& originalName,
+    const std::vector<std::string>& tags,
+    ProcArgs & args,
+    int & sampling,
+    float & tolerance
+    )
+{
+    if(args.linkAttributes)
+    {
+        std::vector<size_t> rules;
+        args.attributesMatcher.getMatchingRules(originalName, tags, rules, OverrideMatcher::TAGS_BEFORE_PATH_MATCH);
+        for(std::vector<size_t>::iterator it = rules.begin(); it != rules.end(); ++it)
         {
-            if ( ps.hasFaceSet( faceSetNames[i] ) )
+            const Json::Value& overrides = args.attributesRoot[args.attributesMatcher.getRule(*it)];
+            if(overrides.isObject())
             {
-                
-                IFaceSet faceSet = ps.getFaceSet( faceSetNames[i] );
-                IFaceSetSchema::Sample faceSetSample = faceSet.getSchema().getValue( frameSelector );
-
-                const int* faceArray((int *)faceSetSample.getFaces()->getData()); 
-                AiMsgDebug("Faceset %s on %s with %i faces",  faceSetNames[i].c_str(), originalName.c_str(),  faceSetSample.getFaces()->size());
-                for( int f = 0; f < (int) faceSetSample.getFaces()->size(); f++)
-                {
-                    if(faceArray[f] <= nsides.size() )
-                        faceSetArray[faceArray[f]] = (uint8_t) i;
-                    else
-                        AiMsgWarning("Face set is higher than nsides side");
-                }
+                if(overrides.isMember("nurbs_sampling"))
+                    sampling = overrides["nurbs_sampling"].asInt();
+                if(overrides.isMember("nurbs_tolerance"))
+                    tolerance = overrides["nurbs_tolerance"].asFloat();
             }
         }
-        AtArray *tmpArray = AiArrayConvert( faceSetArray.size(), 1, AI_TYPE_BYTE, (void *) &faceSetArray[0]);
-        AiNodeSetArray( meshNode, "shidxs", tmpArray );
     }
+}
+
+//-*************************************************************************
+// writeNuPatch
+// This function tessellates a NuPatch & return a mesh node with displace & attributes related to it.
+// The arbitrary geom params of the patch are not carried over to the tessellated mesh.
+AtNode* writeNuPatch(
+    const std::string& name,
+    const std::string& originalName,
+    const std::string& cacheId,
+    INuPatch & prim,
+    ProcArgs & args,
+    const SampleTimeSet& sampleTimes
+    )
+{
+    ProfileScope profileScope(args.profiler, "nurbs_tessellation");
+
+    AiMsgDebug("Tessellating %s", originalName.c_str());
+
+    INuPatchSchema &ps = prim.getSchema();
+
+    //get tags
+    std::vector<std::string> tags;
+    getAllTags(ps.getObject(), tags, &args);
+
+    int sampling = 0;
+    float tolerance = 0.001f;
+    getNuPatchTessellation(originalName, tags, args, sampling, tolerance);
+
+    std::vector<float> uParams;
+    std::vector<float> vParams;
+    std::vector<float> vlist;
+    NurbsSurface firstSurface;
+
+    bool isFirstSample = true;
+    for ( SampleTimeSet::iterator I = sampleTimes.begin();
+          I != sampleTimes.end(); ++I, isFirstSample = false)
+    {
+        ISampleSelector sampleSelector( *I );
+        INuPatchSchema::Sample sample = ps.getValue( sampleSelector );
+
+        NurbsSurface surface;
+        surface.numU = sample.getNumU();
+        surface.numV = sample.getNumV();
+        surface.uOrder = sample.getUOrder();
+        surface.vOrder = sample.getVOrder();
+        surface.uKnot = sample.getUKnot() ? sample.getUKnot()->get() : NULL;
+        surface.vKnot = sample.getVKnot() ? sample.getVKnot()->get() : NULL;
+        surface.positions = sample.getPositions() ? (const float32_t*) sample.getPositions()->get() : NULL;
+        surface.weights = NULL;
+        if(sample.getPositionWeights() && sample.getPositionWeights()->size() == sample.getPositions()->size())
+            surface.weights = sample.getPositionWeights()->get();
+
+        if(!IsValidNurbs(surface,
+                sample.getPositions() ? sample.getPositions()->size() : 0,
+                sample.getUKnot() ? sample.getUKnot()->size() : 0,
+                sample.getVKnot() ? sample.getVKnot()->size() : 0))
+        {
+            AiMsgWarning("Invalid NuPatch %s", originalName.c_str());
+            return NULL;
+        }
+
+        if ( isFirstSample )
+        {
+            if(sample.hasTrimCurve())
+                AiMsgWarning("Trim curves on %s are ignored", originalName.c_str());
+
+            // The tolerance is relative to the size of the patch.
+            Box3f bounds;
+            for ( size_t i = 0; i < sample.getPositions()->size(); ++i )
+                bounds.extendBy( (*sample.getPositions())[i] );
+            float size = bounds.isEmpty() ? 0.0f : (bounds.max - bounds.min).length();
+
+            ComputeNurbsParams(surface, true, sampling, tolerance * size, uParams);
+            ComputeNurbsParams(surface, false, sampling, tolerance * size, vParams);
+            firstSurface = surface;
+        }
+        else if( surface.numU != firstSurface.numU || surface.numV != firstSurface.numV
+            || surface.uOrder != firstSurface.uOrder || surface.vOrder != firstSurface.vOrder )
+        {
+            // the topology changed, we keep the samples we already have.
+            break;
+        }
+
+        TessellateNurbs(surface, uParams, vParams, vlist);
+    }
+
+    const unsigned int numUParams = uParams.size();
+    const unsigned int numVParams = vParams.size();
+    const size_t numPoints = numUParams * numVParams;
+    const size_t numSampleTimes = vlist.size() / (numPoints * 3);
 
+    // Quads of the grid, with parametric uvs.
+    std::vector<unsigned int> vidxs;
+    std::vector<uint8_t> nsides;
+    vidxs.reserve( (numUParams - 1) * (numVParams - 1) * 4 );
+    nsides.reserve( (numUParams - 1) * (numVParams - 1) );
+    for (unsigned int v = 0; v + 1 < numVParams; ++v)
     {
-        ICompoundProperty arbGeomParams = ps.getArbGeomParams();
-        ISampleSelector frameSelector( *singleSampleTimes.begin() );
+        for (unsigned int u = 0; u + 1 < numUParams; ++u)
+        {
+            vidxs.push_back( v * numUParams + u );
+            vidxs.push_back( v * numUParams + u + 1 );
+            vidxs.push_back( (v + 1) * numUParams + u + 1 );
+            vidxs.push_back( (v + 1) * numUParams + u );
+            nsides.push_back( 4 );
+        }
+    }
 
-        AddArbitraryGeomParams( arbGeomParams, frameSelector, meshNode );
+    std::vector<float> uvlist;
+    uvlist.reserve( numPoints * 2 );
+    const float uRange = uParams.back() - uParams.front();
+    const float vRange = vParams.back() - vParams.front();
+    for (unsigned int v = 0; v < numVParams; ++v)
+    {
+        for (unsigned int u = 0; u < numUParams; ++u)
+        {
+            uvlist.push_back( uRange > 0.0f ? (uParams[u] - uParams.front()) / uRange : 0.0f );
+            uvlist.push_back( vRange > 0.0f ? (vParams[v] - vParams.front()) / vRange : 0.0f );
+        }
+    }
+
+    // Set the meshNode.
+    AtNode* meshNode = AiNode( "polymesh" );
 
+    if (!meshNode)
+    {
+        AiMsgError("Failed to make polymesh node for %s",
+                prim.getFullName().c_str());
+        return NULL;
     }
 
+    AiNodeSetStr( meshNode, "name", (name + ":src").c_str() );
+    AiNodeSetByte( meshNode, "visibility", 0 );
+    AiNodeSetBool(meshNode, "smoothing", true);
+
+    applyMeshOverrides(name, tags, meshNode, args);
+
+    // displaces assignation
+    AtNode* appliedDisplacement = getDisplacement(originalName, tags, args);
+    if(appliedDisplacement!= NULL)
+        AiNodeSetPtr(meshNode, "disp_map", appliedDisplacement);
+
+    // Fill mesh infos
+    AiNodeSetArray(meshNode, "vidxs",
+            AiArrayConvert(vidxs.size(), 1, AI_TYPE_UINT,
+                    (void*)&vidxs[0]));
+
+    AiNodeSetArray(meshNode, "nsides",
+            AiArrayConvert(nsides.size(), 1, AI_TYPE_BYTE,
+                    &(nsides[0])));
+
+    AiNodeSetArray(meshNode, "vlist",
+            AiArrayConvert( numPoints,
+                    numSampleTimes, AI_TYPE_VECTOR, &vlist[0]
+                            ));
+
+    AiNodeSetArray(meshNode, "uvlist",
+            AiArrayConvert(numPoints, 1, AI_TYPE_VECTOR2, &uvlist[0]));
+
+    AiNodeSetArray(meshNode, "uvidxs",
+            AiArrayConvert(vidxs.size(), 1, AI_TYPE_UINT,
+                    &(vidxs[0])));
+
+    // The arbitrary geom params of a NuPatch are defined on the CVs, so they don't
+    // match the tessellation. The constant ones are added on the instance.
+
     args.createdNodes->addNode(meshNode);
     args.nodeCache->addNode(cacheId, meshNode);
     return meshNode;
-
 }
 
 //-*************************************************************************
@@ -905,7 +1242,7 @@ AtNode* createInstance(
     if (nodeHasParameter( instanceNode, "shader" ) )
     {
         std::vector< std::string > faceSetNames;
-        ps.getFaceSetNames(faceSetNames);
+        getFaceSetNames(ps, faceSetNames);
 
         // Managing faceSets.
         if ( faceSetNames.size() > 0 )
@@ -1083,6 +1420,7 @@ void ProcessPolyMesh( IPolyMesh &polymesh, ProcArgs &args,
     std::string cacheId = getHash(name, originalName, polymesh, args, sampleTimes);
 
     AtNode* meshNode = args.nodeCache->getCachedNode(cacheId);
+    args.profiler.addCacheLookup("node_cache", meshNode != NULL);
 
     if(meshNode == NULL)
     { // We don't have a cache, so we much create this mesh.
@@ -1117,6 +1455,7 @@ void ProcessSubD( ISubD &subd, ProcArgs &args,
     std::string cacheId = getHash(name, originalName, subd, args, sampleTimes);
 
     AtNode* meshNode = args.nodeCache->getCachedNode(cacheId);
+    args.profiler.addCacheLookup("node_cache", meshNode != NULL);
 
     if(meshNode == NULL) // We don't have a cache, so we much create this mesh.
     {
@@ -1133,4 +1472,35 @@ void ProcessSubD( ISubD &subd, ProcArgs &args,
 
 }
 
+//-*************************************************************************
+
+void ProcessNuPatch( INuPatch &patch, ProcArgs &args,
+        MatrixSampleMap * xformSamples )
+{
+
+    if ( !patch.valid() )
+        return;
+
+    std::string originalName = patch.getFullName();
+    std::string name = args.nameprefix + originalName;
 
+    SampleTimeSet sampleTimes;
+
+    getSampleTimes( patch, args, sampleTimes);
+    std::string cacheId = getHash(name, originalName, patch, args, sampleTimes);
+
+    AtNode* meshNode = args.nodeCache->getCachedNode(cacheId);
+    args.profiler.addCacheLookup("node_cache", meshNode != NULL);
+
+    if(meshNode == NULL) // We don't have a cache, so we much tessellate this patch.
+        meshNode = writeNuPatch(name, originalName, cacheId, patch, args, sampleTimes);
+
+    AtNode *instanceNode = NULL;
+    // we can create the instance, with correct transform, attributes & shaders.
+    if(meshNode != NULL)
+        instanceNode = createInstance(name, originalName, patch, args, xformSamples, meshNode);
+
+    // Handling meshLights.
+    if(instanceNode != NULL && isMeshLight(originalName, patch, args))
+        createMeshLight(name, originalName, patch, args, xformSamples, instanceNode);
+}
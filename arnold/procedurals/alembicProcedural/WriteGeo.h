@@ -51,8 +51,9 @@ void ProcessPolyMesh( IPolyMesh &polymesh, ProcArgs &args,
 void ProcessSubD( ISubD &subd, ProcArgs &args,
         MatrixSampleMap * xformSamples);
 
-// void ProcessNuPatch( INuPatch &patch, ProcArgs &args );
-//
+void ProcessNuPatch( INuPatch &patch, ProcArgs &args,
+        MatrixSampleMap * xformSamples);
+
 //void ProcessPoints( IPoints &patch, ProcArgs &args );
 //
 //void ProcessCurves( ICurves &curves, ProcArgs &args );
@@ -9,6 +9,8 @@
 
 
 #include <ai.h>
+#include <cstring>
+#include <iomanip>
 #include <sstream>
 
 
@@ -167,70 +169,369 @@ AtRGB ConvertKelvinToRGB(float kelvin)
 } 
 
 
+// Blackbody colors are tabulated once, evenly spaced in mired (1e6 / kelvin)
+// as the color varies much more evenly with it than with the temperature.
+namespace
+{
+    const float kelvinTableMin = 1000.0f;
+    const float kelvinTableMax = 40000.0f;
+    const int kelvinTableSize = 1024;
+
+    struct KelvinTable
+    {
+        float miredMin;
+        float miredMax;
+        std::vector<AtRGB> colors;
+
+        KelvinTable()
+        : miredMin(1e6f / kelvinTableMax)
+        , miredMax(1e6f / kelvinTableMin)
+        {
+            colors.resize(kelvinTableSize);
+            for (int i = 0; i < kelvinTableSize; ++i)
+            {
+                float mired = miredMin + (miredMax - miredMin) * float(i) / float(kelvinTableSize - 1);
+                colors[i] = ConvertKelvinToRGB(1e6f / mired);
+            }
+        }
+    };
+}
+
+AtRGB KelvinToRGB(float kelvin)
+{
+    if (kelvin < kelvinTableMin || kelvin > kelvinTableMax)
+        return ConvertKelvinToRGB(kelvin);
+
+    static const KelvinTable table;
+
+    float position = (1e6f / kelvin - table.miredMin) / (table.miredMax - table.miredMin) * float(kelvinTableSize - 1);
+    int index = AiClamp(int(position), 0, kelvinTableSize - 2);
+    float t = position - float(index);
+
+    const AtRGB& c0 = table.colors[index];
+    const AtRGB& c1 = table.colors[index + 1];
+    return c0 * (1.0f - t) + c1 * t;
+}
+
+
+// Unlike the other overrides, tag rules are ignored once a path rule matched.
 void GetColorTemperatureOverride(const std::string& name, const std::vector<std::string>& tags,
                                  ProcArgs & args, bool & use_temperature, float & temperature)
 {
-    bool foundInPath = false;
-    int pathSize = 0;
-    for(std::vector<std::string>::iterator it=args.attributes.begin(); it!=args.attributes.end(); ++it)
+    std::vector<size_t> rules;
+    args.attributesMatcher.getMatchingRules(name, tags, rules, OverrideMatcher::TAGS_BEFORE_PATH_MATCH);
+    for(std::vector<size_t>::const_iterator it = rules.begin(); it != rules.end(); ++it)
+    {
+        const Json::Value& overrides = args.attributesRoot[args.attributesMatcher.getRule(*it)];
+        if(overrides.isMember("use_color_temperature"))
+            use_temperature = overrides["use_color_temperature"].asBool();
+        if(overrides.isMember("color_temperature"))
+            temperature = overrides["color_temperature"].asFloat();
+    }
+}
+
+
+// Copy the parameters that exist with the same type on both lights.
+void CopyLightParameters(AtNode* src, AtNode* dst)
+{
+    const AtNodeEntry* srcEntry = AiNodeGetNodeEntry(src);
+    const AtNodeEntry* dstEntry = AiNodeGetNodeEntry(dst);
+
+    AtParamIterator* iter = AiNodeEntryGetParamIterator(srcEntry);
+    while (!AiParamIteratorFinished(iter))
     {
-        Json::Value overrides;
-        if(it->find("/") != std::string::npos)
+        const AtParamEntry* pentry = AiParamIteratorGetNext(iter);
+        const char* paramName = AiParamGetName(pentry);
+        if(strcmp(paramName, "name") == 0 || strcmp(paramName, "matrix") == 0)
+            continue;
+
+        const AtParamEntry* dstParam = AiNodeEntryLookUpParameter(dstEntry, paramName);
+        if(dstParam == NULL || AiParamGetType(dstParam) != AiParamGetType(pentry))
+            continue;
+
+        switch(AiParamGetType(pentry))
         {
-            bool curFoundInPath = pathContainsOtherPath(name, *it);
-            if(curFoundInPath)
+            case AI_TYPE_BYTE:
+                AiNodeSetByte(dst, paramName, AiNodeGetByte(src, paramName));
+                break;
+            case AI_TYPE_INT:
+            case AI_TYPE_ENUM:
+                AiNodeSetInt(dst, paramName, AiNodeGetInt(src, paramName));
+                break;
+            case AI_TYPE_BOOLEAN:
+                AiNodeSetBool(dst, paramName, AiNodeGetBool(src, paramName));
+                break;
+            case AI_TYPE_FLOAT:
+                AiNodeSetFlt(dst, paramName, AiNodeGetFlt(src, paramName));
+                break;
+            case AI_TYPE_RGB:
             {
-                foundInPath = true;
-                std::string overridePath = *it;
-                if(overridePath.length() > pathSize)
-                {
-                    pathSize = overridePath.length();
-                    overrides = args.attributesRoot[*it];
-                }
+                AtRGB col = AiNodeGetRGB(src, paramName);
+                AiNodeSetRGB(dst, paramName, col.r, col.g, col.b);
+                break;
+            }
+            case AI_TYPE_VECTOR:
+            {
+                AtVector vec = AiNodeGetVec(src, paramName);
+                AiNodeSetVec(dst, paramName, vec.x, vec.y, vec.z);
+                break;
             }
+            case AI_TYPE_STRING:
+                AiNodeSetStr(dst, paramName, AiNodeGetStr(src, paramName));
+                break;
+            case AI_TYPE_POINTER:
+            case AI_TYPE_NODE:
+                AiNodeSetPtr(dst, paramName, AiNodeGetPtr(src, paramName));
+                break;
+            case AI_TYPE_ARRAY:
+            {
+                // light filters and the other array parameters, when the element types agree.
+                AtArray* array = AiNodeGetArray(src, paramName);
+                const AtArray* dstDefault = AiParamGetDefault(dstParam)->ARRAY();
+                if(array != NULL && (dstDefault == NULL || AiArrayGetType(dstDefault) == AiArrayGetType(array)))
+                    AiNodeSetArray(dst, paramName, AiArrayCopy(array));
+                break;
+            }
+            default:
+                break;
         }
-        else if(matchPattern(name,*it)) // based on wildcard expression
+    }
+    AiParamIteratorDestroy(iter);
+}
+
+
+// A quad light can only be merged if the mesh light keeps all its settings: the quad_light
+// parameters that mesh_light doesn't have must be at their defaults, and portals stay quads.
+bool CanBatchQuadLight(AtNode* light)
+{
+    if(AiNodeGetBool(light, "portal"))
+        return false;
+
+    const AtNodeEntry* meshLightEntry = AiNodeEntryLookUp("mesh_light");
+    bool canBatch = meshLightEntry != NULL;
+
+    AtParamIterator* iter = AiNodeEntryGetParamIterator(AiNodeGetNodeEntry(light));
+    while (canBatch && !AiParamIteratorFinished(iter))
+    {
+        const AtParamEntry* pentry = AiParamIteratorGetNext(iter);
+        const char* paramName = AiParamGetName(pentry);
+        if(strcmp(paramName, "name") == 0 || strcmp(paramName, "matrix") == 0 || strcmp(paramName, "vertices") == 0)
+            continue;
+
+        // the links aren't copied to the mesh light.
+        if(AiNodeIsLinked(light, paramName))
         {
-            foundInPath = true;
-            std::string overridePath = *it;
-            if(overridePath.length() > pathSize)
-            {   
-                pathSize = overridePath.length();
-                overrides = args.attributesRoot[*it];
-            }
-            
+            canBatch = false;
+            break;
         }
-        else if(foundInPath == false)
+
+        const AtParamEntry* meshLightParam = AiNodeEntryLookUpParameter(meshLightEntry, paramName);
+        if(meshLightParam != NULL && AiParamGetType(meshLightParam) == AiParamGetType(pentry))
+            continue;
+
+        const AtParamValue* defaultValue = AiParamGetDefault(pentry);
+        switch(AiParamGetType(pentry))
         {
-            if (std::find(tags.begin(), tags.end(), *it) != tags.end())
-            {
-                std::string overridePath = *it;
-                if(overridePath.length() > pathSize)
-                {
-                    pathSize = overridePath.length();
-                    overrides = args.attributesRoot[*it];
-                }
-            }
+            case AI_TYPE_BYTE:
+                canBatch = AiNodeGetByte(light, paramName) == defaultValue->BYTE();
+                break;
+            case AI_TYPE_INT:
+            case AI_TYPE_ENUM:
+                canBatch = AiNodeGetInt(light, paramName) == defaultValue->INT();
+                break;
+            case AI_TYPE_BOOLEAN:
+                canBatch = AiNodeGetBool(light, paramName) == defaultValue->BOOL();
+                break;
+            case AI_TYPE_FLOAT:
+                canBatch = AiNodeGetFlt(light, paramName) == defaultValue->FLT();
+                break;
+            case AI_TYPE_RGB:
+                canBatch = AiNodeGetRGB(light, paramName) == defaultValue->RGB();
+                break;
+            case AI_TYPE_VECTOR:
+                canBatch = AiNodeGetVec(light, paramName) == defaultValue->VEC();
+                break;
+            case AI_TYPE_STRING:
+                canBatch = AiNodeGetStr(light, paramName) == defaultValue->STR();
+                break;
+            case AI_TYPE_POINTER:
+            case AI_TYPE_NODE:
+                canBatch = AiNodeGetPtr(light, paramName) == NULL;
+                break;
+            default:
+                canBatch = false;
+                break;
         }
-        if(overrides.size() > 0)
+    }
+    AiParamIteratorDestroy(iter);
+    return canBatch;
+}
+
+
+float QuadArea(const AtVector* quad)
+{
+    return 0.5f * AiV3Length(AiV3Cross(quad[2] - quad[0], quad[3] - quad[1]));
+}
+
+
+// Appends the element type, the size and the raw contents of an array to a batch key.
+// Node arrays (the light filters) are keyed by their node pointers.
+void AppendArrayKey(std::ostringstream& key, AtArray* array)
+{
+    if(array == NULL)
+        return;
+
+    key << (int)AiArrayGetType(array) << "[" << AiArrayGetNumElements(array) << "x" << (int)AiArrayGetNumKeys(array) << "]";
+
+    size_t numBytes = (size_t)AiArrayGetKeySize(array) * AiArrayGetNumKeys(array);
+    const char* data = (const char*)AiArrayMap(array);
+    if(data != NULL)
+        key.write(data, numBytes);
+    AiArrayUnmap(array);
+}
+
+
+// Two quad lights can be merged if all their parameters but the transform are the same.
+// Normalized lights also need the same area, as their radiance depends on it.
+std::string GetLightBatchKey(AtNode* light, const AtVector* quad)
+{
+    std::ostringstream key;
+    key << std::setprecision(9) << AiNodeEntryGetName(AiNodeGetNodeEntry(light));
+
+    AtParamIterator* iter = AiNodeEntryGetParamIterator(AiNodeGetNodeEntry(light));
+    while (!AiParamIteratorFinished(iter))
+    {
+        const AtParamEntry* pentry = AiParamIteratorGetNext(iter);
+        const char* paramName = AiParamGetName(pentry);
+        if(strcmp(paramName, "name") == 0 || strcmp(paramName, "matrix") == 0 || strcmp(paramName, "vertices") == 0)
+            continue;
+
+        key << "|" << paramName << "=";
+        switch(AiParamGetType(pentry))
         {
-            for( Json::ValueIterator itr = overrides.begin() ; itr != overrides.end() ; itr++ )
+            case AI_TYPE_BYTE:
+                key << (int)AiNodeGetByte(light, paramName);
+                break;
+            case AI_TYPE_INT:
+            case AI_TYPE_ENUM:
+                key << AiNodeGetInt(light, paramName);
+                break;
+            case AI_TYPE_BOOLEAN:
+                key << AiNodeGetBool(light, paramName);
+                break;
+            case AI_TYPE_FLOAT:
+                key << AiNodeGetFlt(light, paramName);
+                break;
+            case AI_TYPE_RGB:
             {
-                std::string attribute = itr.key().asString();
-                
-                if(attribute.compare("use_color_temperature") == 0)
-                {
-                    Json::Value val = args.attributesRoot[*it][itr.key().asString()];
-                    use_temperature = val.asBool();
-                }
-                else if (attribute.compare("color_temperature") == 0)
-                {
-                    Json::Value val = args.attributesRoot[*it][itr.key().asString()];
-                    temperature = val.asFloat();
-                }
+                AtRGB col = AiNodeGetRGB(light, paramName);
+                key << col.r << "," << col.g << "," << col.b;
+                break;
+            }
+            case AI_TYPE_VECTOR:
+            {
+                AtVector vec = AiNodeGetVec(light, paramName);
+                key << vec.x << "," << vec.y << "," << vec.z;
+                break;
             }
+            case AI_TYPE_STRING:
+                key << AiNodeGetStr(light, paramName).c_str();
+                break;
+            case AI_TYPE_POINTER:
+            case AI_TYPE_NODE:
+                key << AiNodeGetPtr(light, paramName);
+                break;
+            case AI_TYPE_ARRAY:
+                AppendArrayKey(key, AiNodeGetArray(light, paramName));
+                break;
+            default:
+                break;
+        }
+    }
+    AiParamIteratorDestroy(iter);
+
+    if(AiNodeGetBool(light, "normalize"))
+    {
+        key.precision(3);
+        key << "|area=" << QuadArea(quad);
+    }
+
+    return key.str();
+}
+
+
+void AddToLightBatch(AtNode* lightNode, ProcArgs & args)
+{
+    AtMatrix matrix = AiNodeGetMatrix(lightNode, "matrix");
+    AtArray* vertices = AiNodeGetArray(lightNode, "vertices");
+
+    AtVector quad[4];
+    for (int i = 0; i < 4; ++i)
+        quad[i] = AiM4PointByMatrixMult(matrix, AiArrayGetVec(vertices, i));
+
+    std::string key = GetLightBatchKey(lightNode, quad);
+    std::map<std::string, LightBatch>::iterator it = args.lightBatches.find(key);
+    if(it == args.lightBatches.end())
+    {
+        LightBatch& batch = args.lightBatches[key];
+        batch.light = lightNode;
+        batch.vertices.assign(quad, quad + 4);
+    }
+    else
+    {
+        it->second.vertices.insert(it->second.vertices.end(), quad, quad + 4);
+        AiNodeDestroy(lightNode);
+    }
+}
+
+
+void FlushLightBatches(ProcArgs & args)
+{
+    for(std::map<std::string, LightBatch>::iterator it = args.lightBatches.begin(); it != args.lightBatches.end(); ++it)
+    {
+        LightBatch& batch = it->second;
+        const size_t numQuads = batch.vertices.size() / 4;
+
+        if(numQuads == 1)
+        {
+            args.createdNodes->addNode(batch.light);
+            continue;
+        }
+
+        std::string name = std::string(AiNodeGetName(batch.light)) + ":merged";
+        AiMsgDebug("Merging %i quad lights into %s", (int) numQuads, name.c_str());
+
+        std::vector<unsigned int> vidxs(batch.vertices.size());
+        for (size_t i = 0; i < vidxs.size(); ++i)
+            vidxs[i] = i;
+        std::vector<uint8_t> nsides(numQuads, 4);
+
+        AtNode* meshNode = AiNode("polymesh");
+        AiNodeSetStr(meshNode, "name", (name + ":src").c_str());
+        AiNodeSetByte(meshNode, "visibility", 0);
+        AiNodeSetArray(meshNode, "vlist", AiArrayConvert(batch.vertices.size(), 1, AI_TYPE_VECTOR, &batch.vertices[0]));
+        AiNodeSetArray(meshNode, "vidxs", AiArrayConvert(vidxs.size(), 1, AI_TYPE_UINT, &vidxs[0]));
+        AiNodeSetArray(meshNode, "nsides", AiArrayConvert(nsides.size(), 1, AI_TYPE_BYTE, &nsides[0]));
+        args.createdNodes->addNode(meshNode);
+
+        AtNode* meshLightNode = AiNode("mesh_light");
+        CopyLightParameters(batch.light, meshLightNode);
+        AiNodeSetStr(meshLightNode, "name", name.c_str());
+        AiNodeSetPtr(meshLightNode, "mesh", meshNode);
+
+        // A normalized quad light spreads its power over its own area, not over all the merged quads.
+        if(AiNodeGetBool(batch.light, "normalize"))
+        {
+            float area = QuadArea(&batch.vertices[0]);
+            if(area > 0.0f)
+                AiNodeSetFlt(meshLightNode, "intensity", AiNodeGetFlt(batch.light, "intensity") / area);
         }
+        AiNodeSetBool(meshLightNode, "normalize", false);
+
+        args.createdNodes->addNode(meshLightNode);
+        AiNodeDestroy(batch.light);
     }
+    args.lightBatches.clear();
 }
 
 
@@ -262,9 +563,14 @@ void ProcessLight( ILight &light, ProcArgs &args,
     
     getAllTags(ps.getObject(), tags, &args);
 
+    // The attribute rules matching this light are resolved once.
+    std::vector<size_t> rules;
+    if(args.linkAttributes)
+        args.attributesMatcher.getMatchingRules(originalName, tags, rules);
+
     // Checking if the light must be exported.
     const PropertyHeader * lightIntensityHeader = arbGeomParams.getPropertyHeader("intensity");
-    if (IFloatGeomParam::matches( *lightIntensityHeader ))
+    if (lightIntensityHeader != NULL && IFloatGeomParam::matches( *lightIntensityHeader ))
     {
         IFloatGeomParam param( arbGeomParams,  "intensity" );
         if ( param.valid() )
@@ -278,36 +584,24 @@ void ProcessLight( ILight &light, ProcArgs &args,
         }
     }
 
-    if(args.linkAttributes)
+    for(std::vector<size_t>::iterator it = rules.begin(); it != rules.end(); ++it)
     {
-        for(std::vector<std::string>::iterator it=args.attributes.begin(); it!=args.attributes.end(); ++it)
+        const Json::Value& overrides = args.attributesRoot[args.attributesMatcher.getRule(*it)];
+        if(overrides.isMember("intensity"))
         {
-            if(name.find(*it) != string::npos || std::find(tags.begin(), tags.end(), *it) != tags.end() || matchPattern(name,*it))
-            {
-                Json::Value overrides = args.attributesRoot[*it];
-                if(overrides.size() > 0)
-                {
-                    for( Json::ValueIterator itr = overrides.begin() ; itr != overrides.end() ; itr++ )
-                    {
-                        std::string attribute = itr.key().asString();
-                        if (attribute=="intensity")
-                        {
-                            Json::Value val = args.attributesRoot[*it][itr.key().asString()];
-                            if (val.type() == Json::realValue )
-                              if(val.asDouble() <= 0.0)
-                                  return;
-                        }
-                    }
-                }
-            }
+            const Json::Value& val = overrides["intensity"];
+            if (val.type() == Json::realValue )
+              if(val.asDouble() <= 0.0)
+                  return;
         }
     }
 
 
     AtNode * lightNode;
+    Alembic::Abc::int32_t lightType = -1;
 
     const PropertyHeader * lightTypeHeader = arbGeomParams.getPropertyHeader("light_type");
-    if (IInt32GeomParam::matches( *lightTypeHeader ))
+    if (lightTypeHeader != NULL && IInt32GeomParam::matches( *lightTypeHeader ))
     {
         IInt32GeomParam param( arbGeomParams,  "light_type" );
         if ( param.valid() )
@@ -315,7 +609,7 @@ void ProcessLight( ILight &light, ProcArgs &args,
             if ( param.getScope() == kConstantScope || param.getScope() == kUnknownScope)
             {
                 IInt32GeomParam::prop_type::sample_ptr_type valueSample = param.getExpandedValue().getVals();
-                Alembic::Abc::int32_t lightType = valueSample->get()[0];
+                lightType = valueSample->get()[0];
                 switch(lightType)
                 {
                     case 0:
@@ -376,7 +670,7 @@ void ProcessLight( ILight &light, ProcArgs &args,
 
     // Eventually override color with temperature
     const PropertyHeader * useTempHeader = arbGeomParams.getPropertyHeader("use_color_temperature");
-    if (IBoolGeomParam::matches( *useTempHeader ))
+    if (useTempHeader != NULL && IBoolGeomParam::matches( *useTempHeader ))
     {
         IBoolGeomParam param( arbGeomParams,  "use_color_temperature" );
         if ( param.valid() )
@@ -392,7 +686,7 @@ void ProcessLight( ILight &light, ProcArgs &args,
 
     const PropertyHeader * TempHeader = arbGeomParams.getPropertyHeader("color_temperature");
                     
-    if (IFloatGeomParam::matches( *TempHeader ))
+    if (TempHeader != NULL && IFloatGeomParam::matches( *TempHeader ))
     {
         IFloatGeomParam param( arbGeomParams,  "color_temperature" );
         if ( param.valid() )
@@ -407,12 +701,12 @@ void ProcessLight( ILight &light, ProcArgs &args,
 
     if(useTemperature)
     {
-        AtRGB color = ConvertKelvinToRGB(colorTemperature);
+        AtRGB color = KelvinToRGB(colorTemperature);
         AiNodeSetRGB(lightNode, "color", color.r, color.g, color.b);
     }
 
     if(args.linkAttributes)
-        ApplyOverrides(originalName, lightNode, tags, args);
+        ApplyOverrides(lightNode, rules, args);
 
     // Xform
     ApplyTransformation( lightNode, xformSamples, args );
@@ -421,5 +715,14 @@ void ProcessLight( ILight &light, ProcArgs &args,
     float exposure = AiNodeGetFlt(lightNode, "exposure");
     AiNodeSetFlt(lightNode, "exposure", ScaleLightExposure(exposure, args));
 
+    // Static quad lights are batched, the identical ones become a single mesh light.
+    // The merged light is named after the first one, the names of the others are lost.
+    if(lightType == 3 && AiNodeGetBool(args.proceduralNode, "mergeQuadLights") && (xformSamples == NULL || xformSamples->size() <= 1) &&
+       CanBatchQuadLight(lightNode))
+    {
+        AddToLightBatch(lightNode, args);
+        return;
+    }
+
     args.createdNodes->addNode(lightNode);
 }
@@ -1,6 +1,6 @@
 
-#ifndef _Alembic_Arnold_WriteCamera_h_
-#define _Alembic_Arnold_WriteCamera_h_
+#ifndef _Alembic_Arnold_WriteLight_h_
+#define _Alembic_Arnold_WriteLight_h_
 
 #include <Alembic/AbcGeom/All.h>
 
@@ -17,4 +17,7 @@ using namespace Alembic::AbcGeom;
 void ProcessLight( ILight &light, ProcArgs &args,
         MatrixSampleMap * xformSamples);
 
+// Create the lights merged from the batched quad lights.
+void FlushLightBatches( ProcArgs &args );
+
 #endif
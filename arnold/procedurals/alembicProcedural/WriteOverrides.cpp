@@ -46,175 +46,25 @@
 
 void ApplyOverrides(const std::string& name, AtNode* node, const std::vector<std::string>& tags, ProcArgs & args)
 {
-    bool foundInPath = false;
-    int pathSize = 0;
-    for(std::vector<std::string>::iterator it=args.attributes.begin(); it!=args.attributes.end(); ++it)
+    std::vector<size_t> rules;
     {
-        Json::Value overrides;
-        if(it->find("/") != std::string::npos)
-        {
-            bool curFoundInPath = pathContainsOtherPath(name, *it);
-            if(curFoundInPath)
-            {
-                foundInPath = true;
-                std::string overridePath = *it;
-                if(overridePath.length() > pathSize)
-                {
-                    pathSize = overridePath.length();
-                    overrides = args.attributesRoot[*it];
-                }
-            }
-        }
-        else if(matchPattern(name,*it)) // based on wildcard expression
-        {
-            foundInPath = true;
-            std::string overridePath = *it;
-            if(overridePath.length() > pathSize)
-            {   
-                pathSize = overridePath.length();
-                overrides = args.attributesRoot[*it];
-            }
-            
-        }
-        //else if(foundInPath == false || pathSize != name.length())
-        {
-            if (std::find(tags.begin(), tags.end(), *it) != tags.end())
-            {
-                overrides = args.attributesRoot[*it];
-            }
-        }
-        if(overrides.size() > 0)
-        {
-            for( Json::ValueIterator itr = overrides.begin() ; itr != overrides.end() ; itr++ )
-            {
-                std::string attribute = itr.key().asString();
-                
-                const AtNodeEntry* nodeEntry = AiNodeGetNodeEntry(node);
-                const AtParamEntry* paramEntry = AiNodeEntryLookUpParameter(nodeEntry, attribute.c_str());
-
-                if ( paramEntry != NULL)
-                {
-                    Json::Value val = args.attributesRoot[*it][itr.key().asString()];
-                    if( val.isString() )
-                        AiNodeSetStr(node, attribute.c_str(), val.asCString());
-                    else if( val.isBool() )
-                        AiNodeSetBool(node, attribute.c_str(), val.asBool());
-                    else if ( val.type() == Json::realValue )
-                        AiNodeSetFlt(node, attribute.c_str(), val.asDouble());
-                    else if( val.isInt() )
-                    {
-                        //make the difference between Byte & int!
-                        int typeEntry = AiParamGetType(paramEntry);
-                        if(typeEntry == AI_TYPE_BYTE)
-                        {
-                            if(attribute=="visibility")
-                            {
-                                uint8_t attrViz = val.asInt();
-                                // special case, we must determine it against the general viz.
-                                uint8_t procViz = AiNodeGetByte( args.proceduralNode, "visibility" );
-                                uint8_t compViz = AI_RAY_ALL;
-                                {
-                                    compViz &= ~AI_RAY_SUBSURFACE;
-                                    if (procViz > compViz)
-                                        procViz &= ~AI_RAY_SUBSURFACE;
-                                    else
-                                        attrViz &= ~AI_RAY_SUBSURFACE;
-                                    compViz &= ~AI_RAY_SUBSURFACE;
-                                    if(procViz > compViz)
-                                        procViz &= ~AI_RAY_SPECULAR_REFLECT;
-                                    else
-                                        attrViz &= ~AI_RAY_SPECULAR_REFLECT;
-                                    compViz &= ~AI_RAY_DIFFUSE_REFLECT;
-                                    if(procViz > compViz)
-                                        procViz &= ~AI_RAY_DIFFUSE_REFLECT;
-                                    else
-                                        attrViz &= ~AI_RAY_DIFFUSE_REFLECT;
-                                    compViz &= ~AI_RAY_VOLUME;
-                                    if(procViz > compViz)
-                                        procViz &= ~AI_RAY_VOLUME;
-                                    else
-                                        attrViz &= ~AI_RAY_VOLUME;
-                                    compViz &= ~AI_RAY_SPECULAR_TRANSMIT;
-                                    if(procViz > compViz)
-                                        procViz &= ~AI_RAY_SPECULAR_TRANSMIT;
-                                    else
-                                        attrViz &= ~AI_RAY_SPECULAR_TRANSMIT;
-                                    compViz &= ~AI_RAY_DIFFUSE_TRANSMIT;
-                                    if(procViz > compViz)
-                                        procViz &= ~AI_RAY_DIFFUSE_TRANSMIT;
-                                    else
-                                        attrViz &= ~AI_RAY_DIFFUSE_TRANSMIT;
-                                    compViz &= ~AI_RAY_SHADOW;
-                                    if(procViz > compViz)
-                                        procViz &= ~AI_RAY_SHADOW;
-                                    else
-                                        attrViz &= ~AI_RAY_SHADOW;
-                                    compViz &= ~AI_RAY_CAMERA;
-                                    if(procViz > compViz)
-                                        procViz &= ~AI_RAY_CAMERA;
-                                    else
-                                        attrViz &= ~AI_RAY_CAMERA;
-                                }
-
-                                AiNodeSetByte(node, attribute.c_str(), attrViz);
-                            }
-                            else
-                                AiNodeSetByte(node, attribute.c_str(), val.asInt());
-                        }
-                        else
-                            AiNodeSetInt(node, attribute.c_str(), val.asInt());
-                    }
-                    else if( val.isUInt() )
-                        AiNodeSetUInt(node, attribute.c_str(), val.asUInt());
-                }
-            }
-        }
+        ProfileScope profileScope(args.profiler, "override_matching");
+        args.attributesMatcher.getMatchingRules(name, tags, rules);
     }
+    ApplyOverrides(node, rules, args);
 }
 
-AtNode* getShader(const std::string& name, const std::vector<std::string>& tags, ProcArgs & args)
+void ApplyOverrides(AtNode* node, const std::vector<size_t>& rules, ProcArgs & args)
 {
-    bool foundInPath = false;
-    int pathSize = 0;
-    AtNode* appliedShader = NULL;
-    for(std::vector<std::pair<std::string, AtNode*> >::iterator it = args.shaders.begin(); it != args.shaders.end(); ++it)
-    {
-        //check both path & tag
-        if(it->first.find("/") != std::string::npos)
-        {
-            if(pathContainsOtherPath(name, it->first))
-            {
-                foundInPath = true;
-                std::string shaderPath = it->first;
-                if(shaderPath.length() > pathSize)
-                {
-                    pathSize = shaderPath.length();
-                    appliedShader = it->second;
-                }
-            }
-        }
-        else if(matchPattern(name,it->first)) // based on wildcard expression
-        {
-            appliedShader = it->second;
-            foundInPath = true;
-            std::string shaderPath = it->first;
-            if(shaderPath.length() > pathSize)
-            {
-                pathSize = shaderPath.length();
-                appliedShader = it->second;
-            }
-        }
-
-        else if(foundInPath == false)
-        {
-            if (std::find(tags.begin(), tags.end(), it->first) != tags.end())
-            {
-                appliedShader = it->second;
-            }
-        }
-    }
+    ProfileScope profileScope(args.profiler, "overrides");
+    args.attributesPlan.apply(node, rules);
+}
 
-    return appliedShader;
+AtNode* getShader(const std::string& name, const std::vector<std::string>& tags, ProcArgs & args)
+{
+    // path, wildcard & tag assignments, resolved by the matcher built from args.shaders.
+    int rule = args.shadersMatcher.getMatchingRule(name, tags);
+    return rule >= 0 ? args.shaders[rule].second : NULL;
 }
 
 AtNode* getShaderByName(const std::string& name, ProcArgs & args)
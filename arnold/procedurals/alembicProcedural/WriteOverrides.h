@@ -43,6 +43,7 @@
 //-*****************************************************************************
 
 void ApplyOverrides(const std::string& name, AtNode* node, const std::vector<std::string>& tags, ProcArgs & args);
+void ApplyOverrides(AtNode* node, const std::vector<size_t>& rules, ProcArgs & args);
 AtNode* getShader(const std::string& name, const std::vector<std::string>& tags, ProcArgs & args);
 AtNode* getShaderByName(const std::string& name, ProcArgs & args);
 bool ApplyShaders(const std::string& name, AtNode* node, const std::vector<std::string>& tags, ProcArgs & args);
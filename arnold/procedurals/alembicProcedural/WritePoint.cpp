@@ -39,6 +39,7 @@
 #include "WriteOverrides.h"
 #include "parseAttributes.h"
 #include "NodeCache.h"
+#include "LevelOfDetail.h"
 
 #include "ArbGeomParams.h"
 #include "../../../common/PathUtil.h"
@@ -84,7 +85,8 @@ std::string getHash(
     const std::string& originalName,
     IPoints & prim,
     ProcArgs & args,
-    const SampleTimeSet& sampleTimes
+    const SampleTimeSet& sampleTimes,
+    float density
     )
 {
     Alembic::AbcGeom::IPointsSchema  &ps = prim.getSchema();
@@ -176,6 +178,10 @@ std::string getHash(
 
     buffer << "@" << computeHash(hashAttributes);
 
+    // decimated points are a different geometry.
+    if(density < 1.0f)
+        buffer << "@lod" << density;
+
     cacheId = buffer.str();
 
     return cacheId;
@@ -188,11 +194,13 @@ AtNode* writePoints(
     const std::string& cacheId,
     IPoints & prim,
     ProcArgs & args,
-    const SampleTimeSet& sampleTimes
+    const SampleTimeSet& sampleTimes,
+    float density
     )
 
 {
     //GLOBAL_LOCK;
+    ProfileScope profileScope(args.profiler, "points_decode");
 
     std::vector<AtVector> vidxs;
     std::vector<float> radius;
@@ -224,8 +232,6 @@ AtNode* writePoints(
         return NULL;
     }
 
-    args.createdNodes->addNode(pointsNode);
-    
 
     float radiusPoint = 1.0f;
     float scaleVelocity = 1.0f/args.fps;
@@ -314,13 +320,14 @@ AtNode* writePoints(
         radiusParam = std::string(AiNodeGetStr(args.proceduralNode, "radiusProperty"));
 
 
-    bool useVelocities = false;
-    if ((sampleTimes.size() == 1) && (args.shutterOpen != args.shutterClose))
-    {
-        // no sample, and motion blur needed, let's try to get velocities.
-        if(ps.getVelocitiesProperty().valid())
-            useVelocities = true;
-    }
+    // no sample, and motion blur needed, let's try to get velocities.
+    const bool useVelocities = UseVelocityKeys(ps, sampleTimes, args);
+
+    // Surviving points are scaled to keep the same coverage.
+    const bool decimate = density < 1.0f;
+    std::vector<unsigned int> kept;
+    if(decimate)
+        radiusPoint /= sqrtf(density);
 
     for ( SampleTimeSet::iterator I = sampleTimes.begin();
           I != sampleTimes.end(); ++I, isFirstSample = false)
@@ -330,6 +337,7 @@ AtNode* writePoints(
 
         Alembic::Abc::P3fArraySamplePtr v3ptr = sample.getPositions();
         size_t pSize = sample.getPositions()->size();
+        args.profiler.addCount("alembic_bytes", pSize * sizeof(V3f));
 
         // handling radius
 
@@ -356,19 +364,37 @@ AtNode* writePoints(
             widthParam.getExpanded(widthSamp, sampleSelector);
 
         
+        // Level of detail : we select the points before filling any array.
+        if(decimate && isFirstSample)
+        {
+            UInt64ArraySamplePtr idsptr = sample.getIds();
+            bool useIds = idsptr && idsptr->size() == pSize;
+
+            kept.reserve(size_t(pSize * density) + 1);
+            for ( size_t pId = 0; pId < pSize; ++pId )
+            {
+                if(keepPrimitive(useIds ? (*idsptr)[pId] : pId, density))
+                    kept.push_back(pId);
+            }
+        }
+
+        const size_t numKept = decimate ? kept.size() : pSize;
+        radius.reserve(radius.size() + numKept);
+
         if(useVelocities && isFirstSample)
         {
             
             if (AiNodeLookUpUserParameter(args.proceduralNode, "scaleVelocity") !=NULL )
                 scaleVelocity *= AiNodeGetFlt(args.proceduralNode, "scaleVelocity");
 
-            vidxs.resize(pSize*2);
+            vidxs.resize(numKept*2);
             Alembic::Abc::V3fArraySamplePtr velptr = sample.getVelocities();
 
             float timeoffset = ((args.frame / args.fps) - ts->getFloorIndex((*I), ps.getNumSamples()).second) * args.fps;
 
-            for ( size_t pId = 0; pId < pSize; ++pId )
+            for ( size_t k = 0; k < numKept; ++k )
             {
+                size_t pId = decimate ? kept[k] : k;
                 if(pId <= velptr->size())
                 {
                     Alembic::Abc::V3f posAtOpen = ((*v3ptr)[pId] + (*velptr)[pId] * scaleVelocity *-timeoffset);
@@ -376,14 +402,14 @@ AtNode* writePoints(
                     pos1.x = posAtOpen.x;
                     pos1.y = posAtOpen.y;
                     pos1.z = posAtOpen.z;
-                    vidxs[pId]= pos1;
+                    vidxs[k]= pos1;
 
                     Alembic::Abc::V3f posAtEnd = ((*v3ptr)[pId] + (*velptr)[pId]* scaleVelocity *(1.0f-timeoffset));
                     AtVector pos2;
                     pos2.x = posAtEnd.x;
                     pos2.y = posAtEnd.y;
                     pos2.z = posAtEnd.z;
-                    vidxs[pId+pSize]= pos2;
+                    vidxs[k+numKept]= pos2;
                 }
                 if(widthSamp && pId <= widthSamp.getVals()->size())
                     radius.push_back((*widthSamp.getVals())[pId] * radiusPoint);
@@ -394,8 +420,10 @@ AtNode* writePoints(
         else
             // not motion blur or correctly sampled particles
         {
-            for ( size_t pId = 0; pId < pSize; ++pId )
+            vidxs.reserve(vidxs.size() + numKept);
+            for ( size_t k = 0; k < numKept; ++k )
             {
+                size_t pId = decimate ? kept[k] : k;
                 AtVector pos;
                 pos.x = (*v3ptr)[pId].x;
                 pos.y = (*v3ptr)[pId].y;
@@ -409,6 +437,17 @@ AtNode* writePoints(
         }
     }
 
+    // everything was decimated away.
+    if(vidxs.empty())
+    {
+        AiNodeDestroy(pointsNode);
+        return NULL;
+    }
+
+    // only collected once it survives the decimation, the collector must not
+    // hold destroyed nodes.
+    args.createdNodes->addNode(pointsNode);
+
     if(!useVelocities)
     {
         AiNodeSetArray(pointsNode, "points",
@@ -456,7 +495,14 @@ AtNode* writePoints(
     }
 
     ICompoundProperty arbPointsParams = ps.getArbGeomParams();
-    AddArbitraryGeomParams( arbGeomParams, frameSelector, pointsNode );
+    {
+        ProfileScope primvarsScope(args.profiler, "primvars");
+        // only the kept points are read into the user data.
+        ArbGeomParamsSelection selection;
+        if(decimate)
+            selection.primitives = selection.vertices = &kept;
+        AddArbitraryGeomParams( arbGeomParams, frameSelector, pointsNode, NULL, &selection );
+    }
 
 	args.nodeCache->addNode(cacheId, pointsNode);
     return pointsNode;
@@ -539,12 +585,22 @@ void ProcessPoint( IPoints &points, ProcArgs &args,
     SampleTimeSet sampleTimes;
     getSampleTimes(points, args, sampleTimes);
 
-    std::string cacheId = getHash(name, originalName, points, args, sampleTimes);
+    Box3d bounds;
+    IPointsSchema &ps = points.getSchema();
+    if(ps.getSelfBoundsProperty().valid())
+        bounds = ps.getSelfBoundsProperty().getValue(ISampleSelector(*sampleTimes.begin()));
+
+    float density = GetLodDensity(points, originalName, bounds, xformSamples, args);
+    if(density <= 0.0f)
+        return;
+
+    std::string cacheId = getHash(name, originalName, points, args, sampleTimes, density);
     AtNode* pointsNode = args.nodeCache->getCachedNode(cacheId);
+    args.profiler.addCacheLookup("node_cache", pointsNode != NULL);
 
     if(pointsNode == NULL)
     { // We don't have a cache, so we much create this points object.
-        pointsNode = writePoints(name, originalName, cacheId, points, args, sampleTimes);
+        pointsNode = writePoints(name, originalName, cacheId, points, args, sampleTimes, density);
     }
 
     // we can create the instance, with correct transform, attributes & shaders.
@@ -4,6 +4,7 @@
 #include "../../../common/PathUtil.h"
 
 #include <pystring.h>
+#include <Alembic/AbcCoreFactory/IFactory.h>
 
 namespace
 {
@@ -103,18 +104,36 @@ void getTags(IObject iObj, std::vector<std::string> & tags, ProcArgs* args)
 
 void getAllTags(IObject iObj, std::vector<std::string> & tags, ProcArgs* args)
 {
-	
-	getTags(iObj, tags, args);
-	Alembic::Abc::IObject parent = iObj.getParent();
-	if (parent.valid() && Alembic::AbcGeom::IXform::matches(parent.getMetaData())) // our parent is an xform no matter what.
-		getAllTags( parent, tags, args);
+	if (!iObj.valid())
+		return;
 
+	// The tags of an object and of its parents are read once, all the children of an xform reuse them.
+	const std::string name = iObj.getFullName();
+	std::map<std::string, std::vector<std::string> >::const_iterator cached = args->allTags.find(name);
+	if (cached == args->allTags.end())
+	{
+		std::vector<std::string> objectTags;
+		getTags(iObj, objectTags, args);
+		Alembic::Abc::IObject parent = iObj.getParent();
+		if (parent.valid() && Alembic::AbcGeom::IXform::matches(parent.getMetaData())) // our parent is an xform no matter what.
+			getAllTags( parent, objectTags, args);
+
+		cached = args->allTags.insert(std::make_pair(name, objectTags)).first;
+	}
+	tags.insert(tags.end(), cached->second.begin(), cached->second.end());
 }
 
 
 bool isVisible(IObject child, IXformSchema xs, ProcArgs* args)
 {
-    if(GetVisibility( child, ISampleSelector( args->frame / args->fps ) ) == kVisibilityHidden)
+    // The visibility property of an object is looked up once, an object without one gets an invalid property.
+    const std::string fullName = child.getFullName();
+    std::map<std::string, IVisibilityProperty>::iterator visibility = args->visibilityProperties.find(fullName);
+    if(visibility == args->visibilityProperties.end())
+        visibility = args->visibilityProperties.insert(std::make_pair(fullName, GetVisibilityProperty(child))).first;
+
+    if(visibility->second.valid() &&
+       ObjectVisibility(visibility->second.getValue( ISampleSelector( args->frame / args->fps ) )) == kVisibilityHidden)
     {
         // check if the object is not forced to be visible
         std::string name = args->nameprefix + child.getFullName();
@@ -190,61 +209,38 @@ bool isVisible(IObject child, IXformSchema xs, ProcArgs* args)
 
 bool isVisibleForArnold(IObject child, ProcArgs* args)
 {
-    uint16_t minVis = AI_RAY_ALL & ~(AI_RAY_SUBSURFACE | AI_RAY_SPECULAR_REFLECT | AI_RAY_DIFFUSE_REFLECT | AI_RAY_VOLUME | AI_RAY_SPECULAR_TRANSMIT | AI_RAY_DIFFUSE_TRANSMIT |AI_RAY_SHADOW|AI_RAY_CAMERA);
-    std::string name = child.getFullName();
-    int pathSize = 0;
-    if(args->linkAttributes)
-    {
-        for(std::vector<std::string>::iterator it=args->attributes.begin(); it!=args->attributes.end(); ++it)
-        {
-                Json::Value attributes;
-                if(it->find("/") != string::npos)
-                {
-                    if(pathContainsOtherPath(name, *it))
-					{
-                        std::string overridePath = *it;
-                        if(overridePath.length() > pathSize)
-                        {
-                            pathSize = overridePath.length();
-                            attributes = args->attributesRoot[*it];
-                        }
-					}
-                }
-                else if(matchPattern(name,*it)) // based on wildcard expression
-                {
-                    std::string overridePath = *it;
-                    if(overridePath.length() > pathSize)
-                    {   
-                        pathSize = overridePath.length();
-                        attributes = args->attributesRoot[*it];
-                    }
-            
-                }
-
-                if(attributes.size() > 0)
-                {
-                    for( Json::ValueIterator itr = attributes.begin() ; itr != attributes.end() ; itr++ )
-                    {
-                        std::string attribute = itr.key().asString();
-                        if (attribute == "visibility")
-                        {
+    if(!args->linkAttributes)
+        return true;
 
-                            uint16_t vis = args->attributesRoot[*it][itr.key().asString()].asInt();
-                            if(vis <= minVis)
-                            {
-                                AiMsgDebug("Object %s is invisible", name.c_str());
-                                return false;
-                            }
+    // The shapes pass their parent, so it is only resolved once for all its children.
+    std::string name = child.getFullName();
+    std::map<std::string, bool>::const_iterator cached = args->visibleForArnold.find(name);
+    if(cached != args->visibleForArnold.end())
+        return cached->second;
 
-                            break;
-                        }
+    uint16_t minVis = AI_RAY_ALL & ~(AI_RAY_SUBSURFACE | AI_RAY_SPECULAR_REFLECT | AI_RAY_DIFFUSE_REFLECT | AI_RAY_VOLUME | AI_RAY_SPECULAR_TRANSMIT | AI_RAY_DIFFUSE_TRANSMIT |AI_RAY_SHADOW|AI_RAY_CAMERA);
+    bool visible = true;
 
-                    }
-                }
+    // Without tags, the matcher only returns the path & wildcard rules, each one longer than the previous.
+    std::vector<size_t> rules;
+    args->attributesMatcher.getMatchingRules(name, std::vector<std::string>(), rules);
+    for(std::vector<size_t>::const_iterator it = rules.begin(); it != rules.end(); ++it)
+    {
+        const Json::Value& attributes = args->attributesRoot[args->attributesMatcher.getRule(*it)];
+        if(attributes.isMember("visibility"))
+        {
+            uint16_t vis = attributes["visibility"].asInt();
+            if(vis <= minVis)
+            {
+                AiMsgDebug("Object %s is invisible", name.c_str());
+                visible = false;
+                break;
+            }
         }
     }
-    return true;
 
+    args->visibleForArnold[name] = visible;
+    return visible;
 }
 
 
@@ -459,6 +455,49 @@ AtNode* createNetwork(IObject object, std::string prefix, ProcArgs & args)
 
 }
 
+// An AbcShader only builds the network of its material and passes the terminal through at
+// every hit. Without interface overrides, which only it can apply, the shapes are bound to the
+// terminal of the same network instead, built once per material.
+AtNode* bindAbcShaderTerminal(AtNode* shaderNode, ProcArgs* args)
+{
+    if(!AiNodeIs(shaderNode, AtString("AbcShader")))
+        return shaderNode;
+
+    // the interface overrides are declared as user parameters of the AbcShader.
+    AtUserParamIterator* iter = AiNodeGetUserParamIterator(shaderNode);
+    const bool hasOverrides = !AiUserParamIteratorFinished(iter);
+    AiUserParamIteratorDestroy(iter);
+    if(hasOverrides)
+        return shaderNode;
+
+    const std::string file(AiNodeGetStr(shaderNode, "file").c_str());
+    const std::string material(AiNodeGetStr(shaderNode, "shader").c_str());
+    const std::string networkKey = file + ":" + material;
+    std::map<std::string, AtNode*>::iterator network = args->abcNetworks.find(networkKey);
+    if(network != args->abcNetworks.end())
+        return network->second != NULL ? network->second : shaderNode;
+
+    AtNode* terminal = NULL;
+    Alembic::AbcCoreFactory::IFactory factory;
+    factory.setPolicy(ErrorHandler::kQuietNoopPolicy);
+    IArchive archive = factory.getArchive(file);
+    if(archive.valid())
+    {
+        IObject materialsObject(archive.getTop(), "materials");
+        IObject object = materialsObject.valid() ? materialsObject.getChild(material) : IObject();
+        if(object.valid() && IMaterial::matches(object.getHeader()))
+            terminal = createNetwork(object, std::string(AiNodeGetName(shaderNode)) + "_terminal", *args);
+    }
+
+    // a material that can't be read keeps its AbcShader, that reports the error.
+    args->abcNetworks[networkKey] = terminal;
+    if(terminal == NULL)
+        return shaderNode;
+
+    AiMsgDebug("[ABC] Binding the terminal of %s instead of %s", material.c_str(), AiNodeGetName(shaderNode));
+    return terminal;
+}
+
 void ParseShaders(Json::Value jroot, const std::string& ns, const std::string& nameprefix, ProcArgs* args, uint8_t type)
 {
     // We have to lock here as we need to be sure that another thread is not checking the root while we are creating it here.
@@ -484,7 +523,18 @@ void ParseShaders(Json::Value jroot, const std::string& ns, const std::string& n
 
                 IObject object = args->materialsObject.getChild(originalName);
                 if (IMaterial::matches(object.getHeader()))
-                    shaderNode = createNetwork(object, shaderName, *args);
+                {
+                    // Materials exported as instances of an identical one share its network.
+                    std::string sourcePath = object.isInstanceRoot() ? object.instanceSourcePath() : object.getFullName();
+                    std::map<std::string, AtNode*>::iterator network = args->abcNetworks.find(sourcePath);
+                    if(network != args->abcNetworks.end())
+                        shaderNode = network->second;
+                    else
+                    {
+                        shaderNode = createNetwork(object, shaderName, *args);
+                        args->abcNetworks[sourcePath] = shaderNode;
+                    }
+                }
 
             }
             if(shaderNode == NULL)
@@ -507,6 +557,9 @@ void ParseShaders(Json::Value jroot, const std::string& ns, const std::string& n
                 }
             }
         }
+        if(shaderNode != NULL && type == 1)
+            shaderNode = bindAbcShaderTerminal(shaderNode, args);
+
         if(shaderNode != NULL)
         {
             Json::Value paths = jroot[itr.key().asString()];
@@ -29,10 +29,19 @@ enum AbcShaderParams
     p_shader
 };
 
+// An interface parameter of the material, resolved to the network node & parameter it drives.
+struct InterfaceBinding
+{
+    std::string interfaceName;
+    AtNode* target;
+    Alembic::AbcCoreAbstract::PropertyHeader header;
+};
+
 struct ShaderData
 {
     std::map<std::string,AtNode*> aShaders;
     Mat::IMaterial matObj;
+    std::vector<InterfaceBinding> bindings;
 };
 
 
@@ -141,8 +150,12 @@ node_initialize
                     {
                         if (abcnode.getConnection(j, inputName, connectedNodeName, connectedOutputName))
                         {
+                            std::map<std::string,AtNode*>::iterator source = data->aShaders.find(connectedNodeName);
+                            if (source == data->aShaders.end())
+                                continue;
+
                             AiMsgDebug("Linking %s.%s to %s.%s", connectedNodeName.c_str(), connectedOutputName.c_str(), abcnode.getName().c_str(), inputName.c_str());
-                            AiNodeLinkOutput(data->aShaders[connectedNodeName.c_str()], connectedOutputName.c_str(), data->aShaders[abcnode.getName().c_str()], inputName.c_str());
+                            AiNodeLinkOutput(source->second, connectedOutputName.c_str(), data->aShaders[abcnode.getName()], inputName.c_str());
                         }
                     }
 
@@ -151,13 +164,51 @@ node_initialize
         }
 
         // Getting the root node now ...
+        // The terminal drives the RGB output, so the node can still be linked into RGB inputs.
         std::string connectedNodeName = "<undefined>";
         std::string connectedOutputName = "<undefined>";
         if (matObj.getSchema().getNetworkTerminal(
                     "arnold", "surface", connectedNodeName, connectedOutputName))
         {
-            AiMsgDebug("Linking %s.%s to root", connectedNodeName.c_str(), connectedOutputName.c_str());
-            AiNodeLink(data->aShaders[connectedNodeName.c_str()],  "shaderIn", node);
+            std::map<std::string,AtNode*>::iterator root = data->aShaders.find(connectedNodeName);
+            if (root != data->aShaders.end())
+            {
+                AiMsgDebug("Linking %s.%s to root", connectedNodeName.c_str(), connectedOutputName.c_str());
+                AiNodeLink(root->second, "shaderIn", node);
+            }
+        }
+
+        // The interface parameters are resolved once, node_update then only has to set them.
+        std::vector<std::string> mappingNames;
+        matObj.getSchema().getNetworkInterfaceParameterMappingNames(mappingNames);
+        for (std::vector<std::string>::iterator I = mappingNames.begin(); I != mappingNames.end(); ++I)
+        {
+            std::string mapToNodeName;
+            std::string mapToParamName;
+            if (!matObj.getSchema().getNetworkInterfaceParameterMapping((*I), mapToNodeName, mapToParamName))
+                continue;
+
+            Mat::IMaterialSchema::NetworkNode abcNode = matObj.getSchema().getNetworkNode(mapToNodeName);
+            if (!abcNode.valid())
+                continue;
+
+            std::map<std::string,AtNode*>::iterator target = data->aShaders.find(abcNode.getName());
+            if (target == data->aShaders.end())
+                continue;
+
+            Abc::ICompoundProperty props = abcNode.getParameters();
+            if (!props.valid())
+                continue;
+
+            const Abc::PropertyHeader* header = props.getPropertyHeader(mapToParamName);
+            if (header == NULL)
+                continue;
+
+            InterfaceBinding binding;
+            binding.interfaceName = *I;
+            binding.target = target->second;
+            binding.header = *header;
+            data->bindings.push_back(binding);
         }
 
     }
@@ -169,68 +220,39 @@ node_update
     ShaderData* data = reinterpret_cast<ShaderData*>(AiNodeGetLocalData(node));
 
     // We have to over-write the parameters that need it.
-    std::vector<std::string> mappingNames;
-    data->matObj.getSchema().getNetworkInterfaceParameterMappingNames(mappingNames);
-    for (std::vector<std::string>::iterator I = mappingNames.begin(); I != mappingNames.end(); ++I)
+    for (std::vector<InterfaceBinding>::const_iterator it = data->bindings.begin(); it != data->bindings.end(); ++it)
     {
+        const char* interfaceName = it->interfaceName.c_str();
+        const char* paramName = it->header.getName().c_str();
+        AtNode* aShader = it->target;
 
-        std::string mapToNodeName;
-        std::string mapToParamName;
+        const AtUserParamEntry* type = AiNodeLookUpUserParameter(node, interfaceName);
+        if(!type)
+            continue;
 
-        if (data->matObj.getSchema().getNetworkInterfaceParameterMapping((*I), mapToNodeName, mapToParamName))
+        if (AiUserParamGetType(type) == AI_TYPE_NODE)
         {
-            std::string interfaceName = *I;
-
-            Alembic::AbcMaterial::IMaterialSchema::NetworkNode abcNode = data->matObj.getSchema().getNetworkNode(mapToNodeName);
-            if (!abcNode.valid())
-                continue;
-
-
-            if (data->aShaders.count(abcNode.getName()) == 0)
-                continue;
-
-            AtNode* aShader = data->aShaders[abcNode.getName()];
-
-            Alembic::Abc::ICompoundProperty props = abcNode.getParameters();
-            if (!props.valid())
-                continue;
-
-            if (props.getNumProperties() > 0)
+            AtNode *linked = (AtNode*)AiNodeGetPtr(node, interfaceName);
+            if (linked)
             {
-
-                Alembic::AbcCoreAbstract::PropertyHeader header = *props.getPropertyHeader(mapToParamName);
-                const AtUserParamEntry* type = AiNodeLookUpUserParameter(node, interfaceName.c_str());
-                if(type)
+                if(!AiNodeIsLinked (aShader, paramName))
+                    AiNodeLink(linked, paramName, aShader);
+                else
                 {
-                    if (AiUserParamGetType(type) == AI_TYPE_NODE)
+                    AtNode* oldLink = AiNodeGetLink (aShader, paramName);
+                    if(oldLink != linked)
                     {
-                        AtNode *linked = (AtNode*)AiNodeGetPtr(node, interfaceName.c_str());
-                        if (linked)
-                        {
-                            if(!AiNodeIsLinked (aShader, header.getName().c_str()))
-                                AiNodeLink(linked, header.getName().c_str(), aShader);
-                            else
-                            {
-                                AtNode* oldLink = AiNodeGetLink (aShader, header.getName().c_str());
-                                if(oldLink != linked)
-                                {
-                                    AiNodeUnlink (aShader, header.getName().c_str());
-                                    AiNodeLink(linked, header.getName().c_str(), aShader);
-                                }
-
-                            }
-                        }
-                        else
-                            AiMsgDebug("shader is not linked %s", header.getName().c_str());
+                        AiNodeUnlink (aShader, paramName);
+                        AiNodeLink(linked, paramName, aShader);
                     }
-                    else
-                        setUserParameter(node, interfaceName, header, aShader);
-                }
-
 
+                }
             }
-
+            else
+                AiMsgDebug("shader is not linked %s", paramName);
         }
+        else
+            setUserParameter(node, it->interfaceName, it->header, aShader);
     }
 
 }
@@ -243,8 +265,8 @@ node_finish
 
 shader_evaluate
 {
-    ShaderData* data = reinterpret_cast<ShaderData*>(AiNodeGetLocalData(node));
-
+    // Only reached with interface overrides, the alembic procedural binds the shapes to the
+    // terminal of the same network otherwise.
     sg->out.RGB() = AiShaderEvalParamRGB(p_shader);
 }
 
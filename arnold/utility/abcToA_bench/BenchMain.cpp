@@ -0,0 +1,497 @@
+#include <ai.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "ezOptionParser.hpp"
+
+/*
+Benchmark of the procedural, without rendering.
+Each run starts a fresh Arnold session, creates an alembicProcedural node on the given
+archive and expands it with AiProceduralViewport, which calls procedural_init and collects
+the created nodes in a separate universe, as bounding boxes. The expansion time of every
+run and their statistics are printed.
+With --render, each run then also renders the scene, framed on those boxes, and the render
+time is printed too. --abc-shader assigns an AbcShader material to all the shapes, to
+measure what its evaluation costs at render time: the runs are done twice, once with the
+shapes bound by the procedural to the terminal of the material network, and once through
+the AbcShader node, that passes the terminal through at every hit.
+With --expect, the scene is rendered once instead, and the visibility, matte and opaque
+overrides and the faceset shaders the shapes got are compared with the file written by
+abcToA_benchScene --check.
+The differences are printed and the exit status is a failure if there are any.
+*/
+
+struct RunSettings
+{
+    std::vector<std::string> files;
+    std::string jsonFile;
+    std::vector<std::string> pluginFolders;
+    float frame;
+    float fps;
+    bool profile;
+    std::string dryRunReport;
+    int renderSize;
+    std::string renderOutput;
+    std::string abcShaderFile;
+    std::string abcShaderName;
+    // keeps the shapes on the AbcShader instead of its terminal.
+    bool abcShaderPassThrough;
+};
+
+AtNode* createProcedural(const RunSettings& settings)
+{
+    AtNode* proc = AiNode("alembicProcedural");
+    if (proc == NULL)
+        return NULL;
+
+    AiNodeSetStr(proc, "name", "bench");
+    AtArray* fileNames = AiArrayAllocate(settings.files.size(), 1, AI_TYPE_STRING);
+    for (size_t i = 0; i < settings.files.size(); i++)
+        AiArraySetStr(fileNames, i, settings.files[i].c_str());
+    AiNodeSetArray(proc, "fileNames", fileNames);
+    AiNodeSetStr(proc, "jsonFile", settings.jsonFile.c_str());
+    AiNodeSetFlt(proc, "frame", settings.frame);
+    AiNodeSetFlt(proc, "fps", settings.fps);
+    AiNodeSetBool(proc, "profile", settings.profile);
+    if (!settings.dryRunReport.empty())
+    {
+        AiNodeSetBool(proc, "dryRun", true);
+        AiNodeSetStr(proc, "dryRunReport", settings.dryRunReport.c_str());
+    }
+    return proc;
+}
+
+// Bounds of the boxes created by AiProceduralViewport.
+bool boxesBounds(AtUniverse* universe, AtVector& bmin, AtVector& bmax)
+{
+    bool found = false;
+    AtNodeIterator* iter = AiUniverseGetNodeIterator(universe, AI_NODE_SHAPE);
+    while (!AiNodeIteratorFinished(iter))
+    {
+        AtNode* box = AiNodeIteratorGetNext(iter);
+        if (!AiNodeIs(box, AtString("box")))
+            continue;
+
+        AtVector boxMin = AiNodeGetVec(box, "min");
+        AtVector boxMax = AiNodeGetVec(box, "max");
+        AtMatrix matrix = AiNodeGetMatrix(box, "matrix");
+        for (int c = 0; c < 8; c++)
+        {
+            AtVector corner((c & 1) ? boxMax.x : boxMin.x, (c & 2) ? boxMax.y : boxMin.y, (c & 4) ? boxMax.z : boxMin.z);
+            corner = AiM4PointByMatrixMult(matrix, corner);
+            bmin = found ? AiV3Min(bmin, corner) : corner;
+            bmax = found ? AiV3Max(bmax, corner) : corner;
+            found = true;
+        }
+    }
+    AiNodeIteratorDestroy(iter);
+    return found;
+}
+
+// Render the procedural in the default universe, with a camera looking at the bounds.
+double renderOnce(const RunSettings& settings, AtNode* proc, const AtVector& bmin, const AtVector& bmax)
+{
+    if (!settings.abcShaderFile.empty())
+    {
+        AtNode* shader = AiNode("AbcShader");
+        if (shader == NULL)
+        {
+            std::cerr << "Can't create an AbcShader node, check the plugin folders." << std::endl;
+            return -1.0;
+        }
+        AiNodeSetStr(shader, "name", "benchAbcShader");
+        AiNodeSetStr(shader, "file", settings.abcShaderFile.c_str());
+        AiNodeSetStr(shader, "shader", settings.abcShaderName.c_str());
+        // the procedural binds the shapes to the terminal of the material, unless the
+        // AbcShader has interface overrides, declared as user parameters, to apply.
+        if (settings.abcShaderPassThrough)
+            AiNodeDeclare(shader, "benchInterfaceOverride", "constant FLOAT");
+        AiNodeSetStr(proc, "shadersAssignation", "{\"benchAbcShader\": [\"/\"]}");
+    }
+
+    const AtVector center = (bmin + bmax) * 0.5f;
+    const float radius = std::max(AiV3Dist(bmin, bmax) * 0.5f, 1e-3f);
+
+    AtNode* camera = AiNode("persp_camera");
+    AiNodeSetStr(camera, "name", "benchCamera");
+    AiNodeSetFlt(camera, "fov", 54.0f);
+    // Looks down -Z at the center, from far enough to see the whole bounds.
+    AtMatrix cameraMatrix = AiM4Translation(AtVector(center.x, center.y, center.z + 2.0f * radius));
+    AiNodeSetMatrix(camera, "matrix", cameraMatrix);
+
+    AtNode* light = AiNode("skydome_light");
+    AiNodeSetStr(light, "name", "benchLight");
+
+    AtNode* filter = AiNode("gaussian_filter");
+    AiNodeSetStr(filter, "name", "benchFilter");
+    AtNode* driver = AiNode("driver_exr");
+    AiNodeSetStr(driver, "name", "benchDriver");
+    AiNodeSetStr(driver, "filename", settings.renderOutput.c_str());
+
+    AtNode* options = AiUniverseGetOptions();
+    AiNodeSetInt(options, "xres", settings.renderSize);
+    AiNodeSetInt(options, "yres", settings.renderSize);
+    AiNodeSetPtr(options, "camera", camera);
+    AtArray* outputs = AiArrayAllocate(1, 1, AI_TYPE_STRING);
+    AiArraySetStr(outputs, 0, "RGBA RGBA benchFilter benchDriver");
+    AiNodeSetArray(options, "outputs", outputs);
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    int result = AiRender(AI_RENDER_MODE_CAMERA);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    if (result != AI_SUCCESS)
+    {
+        std::cerr << "The render failed." << std::endl;
+        return -1.0;
+    }
+    return elapsed.count();
+}
+
+void beginSession(const RunSettings& settings)
+{
+    AiBegin();
+    AiMsgSetConsoleFlags(settings.profile ? AI_LOG_INFO + AI_LOG_WARNINGS + AI_LOG_ERRORS : AI_LOG_WARNINGS + AI_LOG_ERRORS);
+
+    AiLoadPlugins("../procedurals");
+    AiLoadPlugins(".");
+    for (size_t i = 0; i < settings.pluginFolders.size(); i++)
+        AiLoadPlugins(settings.pluginFolders[i].c_str());
+}
+
+// Expected values written by abcToA_benchScene --check.
+struct ExpectedShape
+{
+    std::string path;
+    int created;
+    int visibility;
+    int matte;
+    int opaque;
+};
+
+struct ExpectedFaceSet
+{
+    std::string shapePath;
+    unsigned int index;
+    std::string shader;
+};
+
+struct Expectations
+{
+    std::vector<std::string> shaders;
+    std::vector<ExpectedShape> shapes;
+    std::vector<ExpectedFaceSet> faceSets;
+};
+
+// One line per shader to create, per shape: path, created, visibility, matte, opaque, and per
+// faceset: path of the shape, index, shader.
+bool readExpectations(const std::string& expectFile, Expectations& expectations)
+{
+    std::ifstream expected(expectFile.c_str());
+    if (!expected.is_open())
+    {
+        std::cerr << "Cannot read " << expectFile << std::endl;
+        return false;
+    }
+
+    std::string line;
+    while (std::getline(expected, line))
+    {
+        std::istringstream values(line);
+        std::string kind;
+        values >> kind;
+        bool valid = true;
+        if (kind == "shader")
+        {
+            std::string shader;
+            valid = bool(values >> shader);
+            expectations.shaders.push_back(shader);
+        }
+        else if (kind == "shape")
+        {
+            ExpectedShape shape;
+            valid = bool(values >> shape.path >> shape.created >> shape.visibility >> shape.matte >> shape.opaque);
+            expectations.shapes.push_back(shape);
+        }
+        else if (kind == "faceset")
+        {
+            ExpectedFaceSet faceSet;
+            valid = bool(values >> faceSet.shapePath >> faceSet.index >> faceSet.shader);
+            expectations.faceSets.push_back(faceSet);
+        }
+        else
+            valid = kind.empty();
+
+        if (!valid)
+        {
+            std::cerr << "Invalid line in " << expectFile << ": " << line << std::endl;
+            return false;
+        }
+    }
+    return !expectations.shapes.empty();
+}
+
+// Compares the shapes created by the procedural with the expected values. Returns the number
+// of differences.
+int compareExpected(const Expectations& expectations)
+{
+    int numDifferences = 0;
+    for (size_t i = 0; i < expectations.shapes.size(); ++i)
+    {
+        const ExpectedShape& shape = expectations.shapes[i];
+        AtNode* node = AiNodeLookUpByName(shape.path.c_str());
+        if (node == NULL)
+        {
+            if (shape.created)
+            {
+                std::cerr << shape.path << ": not created" << std::endl;
+                numDifferences++;
+            }
+            continue;
+        }
+        if (!shape.created)
+        {
+            std::cerr << shape.path << ": created, but should be hidden" << std::endl;
+            numDifferences++;
+            continue;
+        }
+
+        if (AiNodeGetByte(node, "visibility") != shape.visibility)
+        {
+            std::cerr << shape.path << ": visibility " << int(AiNodeGetByte(node, "visibility")) << " instead of " << shape.visibility << std::endl;
+            numDifferences++;
+        }
+        if (AiNodeGetBool(node, "matte") != (shape.matte != 0))
+        {
+            std::cerr << shape.path << ": matte " << AiNodeGetBool(node, "matte") << " instead of " << shape.matte << std::endl;
+            numDifferences++;
+        }
+        if (AiNodeGetBool(node, "opaque") != (shape.opaque != 0))
+        {
+            std::cerr << shape.path << ": opaque " << AiNodeGetBool(node, "opaque") << " instead of " << shape.opaque << std::endl;
+            numDifferences++;
+        }
+    }
+
+    for (size_t i = 0; i < expectations.faceSets.size(); ++i)
+    {
+        const ExpectedFaceSet& faceSet = expectations.faceSets[i];
+        AtNode* node = AiNodeLookUpByName(faceSet.shapePath.c_str());
+        if (node == NULL)
+            continue;
+
+        AtArray* shaders = AiNodeGetArray(node, "shader");
+        AtNode* shader = shaders != NULL && faceSet.index < AiArrayGetNumElements(shaders)
+            ? (AtNode*) AiArrayGetPtr(shaders, faceSet.index) : NULL;
+        const std::string shaderName = shader != NULL ? AiNodeGetName(shader) : "none";
+        if (shaderName != faceSet.shader)
+        {
+            std::cerr << faceSet.shapePath << ": faceset " << faceSet.index << " has the shader " << shaderName << " instead of " << faceSet.shader << std::endl;
+            numDifferences++;
+        }
+    }
+
+    std::cout << expectations.shapes.size() << " shapes and " << expectations.faceSets.size() << " facesets checked, "
+              << numDifferences << " differences" << std::endl;
+    return numDifferences;
+}
+
+// Renders the scene once, so that the procedural is expanded in the default universe, and
+// compares the created shapes with the expected values.
+bool runCheck(const RunSettings& settings, const std::string& expectFile)
+{
+    Expectations expectations;
+    if (!readExpectations(expectFile, expectations))
+        return false;
+
+    beginSession(settings);
+
+    // the shaders the check assigns, they must exist before the procedural reads the assignments.
+    for (size_t i = 0; i < expectations.shaders.size(); ++i)
+    {
+        AtNode* shader = AiNode("utility");
+        AiNodeSetStr(shader, "name", expectations.shaders[i].c_str());
+    }
+
+    AtNode* proc = createProcedural(settings);
+    if (proc == NULL)
+    {
+        std::cerr << "Can't create an alembicProcedural node, check the plugin folders." << std::endl;
+        AiEnd();
+        return false;
+    }
+
+    RunSettings renderSettings = settings;
+    renderSettings.renderSize = std::max(settings.renderSize, 16);
+    const AtVector origin(0.0f, 0.0f, 0.0f);
+    bool success = renderOnce(renderSettings, proc, origin, origin) >= 0.0 && compareExpected(expectations) == 0;
+
+    AiEnd();
+    return success;
+}
+
+double runOnce(const RunSettings& settings, int& numNodes, double& renderSeconds)
+{
+    beginSession(settings);
+
+    AtNode* proc = createProcedural(settings);
+    if (proc == NULL)
+    {
+        std::cerr << "Can't create an alembicProcedural node, check the plugin folders." << std::endl;
+        AiEnd();
+        return -1.0;
+    }
+
+    AtUniverse* universe = AiUniverse();
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    int result = AiProceduralViewport(proc, universe, AI_PROC_BOXES);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    numNodes = 0;
+    renderSeconds = 0.0;
+    AtVector bmin, bmax;
+    bool hasBounds = false;
+    if (result == 0)
+    {
+        AtNodeIterator* iter = AiUniverseGetNodeIterator(universe, AI_NODE_ALL);
+        while (!AiNodeIteratorFinished(iter))
+        {
+            AiNodeIteratorGetNext(iter);
+            numNodes++;
+        }
+        AiNodeIteratorDestroy(iter);
+        hasBounds = boxesBounds(universe, bmin, bmax);
+    }
+    else
+        std::cerr << "The procedural failed to expand." << std::endl;
+
+    AiUniverseDestroy(universe);
+
+    if (result == 0 && settings.renderSize > 0)
+    {
+        if (!hasBounds)
+            bmin = bmax = AtVector(0.0f, 0.0f, 0.0f);
+        renderSeconds = renderOnce(settings, proc, bmin, bmax);
+        if (renderSeconds < 0.0)
+            result = 1;
+    }
+
+    AiEnd();
+
+    return result == 0 ? elapsed.count() : -1.0;
+}
+
+void printStats(const char* label, std::vector<double> times)
+{
+    std::sort(times.begin(), times.end());
+    double total = 0.0;
+    for (size_t i = 0; i < times.size(); i++)
+        total += times[i];
+
+    std::cout << std::fixed << std::setprecision(4) << label
+              << "min " << times.front() << " s, median " << times[times.size() / 2]
+              << " s, mean " << total / times.size() << " s, max " << times.back() << " s" << std::endl;
+}
+
+bool runAll(const RunSettings& settings, int numRuns, const std::string& label)
+{
+    std::vector<double> times;
+    std::vector<double> renderTimes;
+    int numNodes = 0;
+    for (int run = 0; run < std::max(1, numRuns); run++)
+    {
+        double renderSeconds = 0.0;
+        double seconds = runOnce(settings, numNodes, renderSeconds);
+        if (seconds < 0.0)
+            return false;
+
+        times.push_back(seconds);
+        std::cout << label << "run " << run << ": " << std::fixed << std::setprecision(4) << seconds << " s, " << numNodes << " nodes";
+        if (settings.renderSize > 0)
+        {
+            renderTimes.push_back(renderSeconds);
+            std::cout << ", render " << renderSeconds << " s";
+        }
+        std::cout << std::endl;
+    }
+
+    printStats(label.c_str(), times);
+    if (!renderTimes.empty())
+        printStats((label + "render: ").c_str(), renderTimes);
+    return true;
+}
+
+int main(int argc, char *argv[] )
+{
+    RunSettings settings;
+    int numRuns;
+
+    ez::OptionParser opt;
+    opt.overview = "Benchmark of the alembic procedural";
+
+    opt.add("input", true, -1, "Alembic files, as layers", ez::EZ_TEXT);
+    opt.add("-j,--json", false, 1, "Json file of shaders & attributes", ez::EZ_TEXT, "");
+    opt.add("-l,--libraries", false, -1, "Add search path for plugin libraries");
+    opt.add("-r,--runs", false, 1, "Number of runs", ez::EZ_INT32, "5");
+    opt.add("--frame", false, 1, "Frame to load", ez::EZ_FLOAT, "1");
+    opt.add("--fps", false, 1, "Frames per second", ez::EZ_FLOAT, "24");
+    opt.add("--profile", false, 0, "Print the stats of the procedural");
+    opt.add("--dry-run", false, 1, "Only write the stats of the scene to this JSON file, without creating nodes", ez::EZ_TEXT, "");
+    opt.add("--render", false, 1, "Also render the scene at this resolution", ez::EZ_INT32, "0");
+    opt.add("--render-output", false, 1, "Image written by the renders", ez::EZ_TEXT, "abcToA_bench.exr");
+    opt.add("--abc-shader", false, 2, "Assign this AbcShader material to all the shapes: file,material", ez::EZ_TEXT);
+    opt.add("--expect", false, 1, "Check the overrides of the shapes against this file of abcToA_benchScene --check", ez::EZ_TEXT, "");
+
+    if (!opt.parse(argc, argv))
+        return EXIT_SUCCESS;
+
+    opt.get("input").getVector(settings.files);
+    opt.get("-j").get(settings.jsonFile);
+    opt.get("-l").getVector(settings.pluginFolders);
+    opt.get("-r").get(numRuns);
+    opt.get("--frame").get(settings.frame);
+    opt.get("--fps").get(settings.fps);
+    settings.profile = opt.isSet("--profile") != 0;
+    opt.get("--dry-run").get(settings.dryRunReport);
+    opt.get("--render").get(settings.renderSize);
+    opt.get("--render-output").get(settings.renderOutput);
+    if (opt.isSet("--abc-shader"))
+    {
+        std::vector<std::string> abcShader;
+        opt.get("--abc-shader").getVector(abcShader);
+        settings.abcShaderFile = abcShader[0];
+        settings.abcShaderName = abcShader[1];
+    }
+    settings.abcShaderPassThrough = false;
+    if (!settings.dryRunReport.empty())
+        settings.renderSize = 0;
+
+    std::string expectFile;
+    opt.get("--expect").get(expectFile);
+    if (!expectFile.empty())
+    {
+        if (!settings.dryRunReport.empty())
+        {
+            std::cerr << "--expect needs the nodes, it can't be used with --dry-run" << std::endl;
+            return EXIT_FAILURE;
+        }
+        return runCheck(settings, expectFile) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    if (settings.abcShaderFile.empty() || settings.renderSize <= 0)
+        return runAll(settings, numRuns, "") ? EXIT_SUCCESS : EXIT_FAILURE;
+
+    if (!runAll(settings, numRuns, "bound to the terminal, "))
+        return EXIT_FAILURE;
+    settings.abcShaderPassThrough = true;
+    return runAll(settings, numRuns, "through the AbcShader, ") ? EXIT_SUCCESS : EXIT_FAILURE;
+}
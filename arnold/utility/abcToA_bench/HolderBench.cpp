@@ -0,0 +1,139 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <tbb/task_arena.h>
+
+#include "ezOptionParser.hpp"
+
+#include "AlembicScene.h"
+
+/*
+Benchmark of the scrubbing of an alembicHolder scene, without Maya.
+The scene is loaded like the holder does, then AlembicScene::sampleHierarchy samples
+it at every frame of a time range, several times over. The first pass decodes every
+sample, the next ones are served by the caches of the samples as long as they fit in
+the retention budget. The scene can be written by abcToA_benchScene, e.g. for 2000
+animated meshes scrubbed on 4 threads:
+    abcToA_benchScene scrub.abc -m 2000 -v 4096 -s 48
+    abcToA_benchHolder scrub.abc --start 1 --end 48 -t 4
+*/
+
+using namespace AlembicHolder;
+
+struct PassStats
+{
+    double seconds;
+    size_t triangles;
+    CacheRetention::Stats retention;
+};
+
+PassStats scrub(AlembicScene& scene, double startFrame, double endFrame, double step, double fps)
+{
+    sampleCacheRetention().resetCounters();
+
+    PassStats stats;
+    stats.triangles = 0;
+    DrawableSampleVector samples;
+    HierarchyStat hierarchyStat;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (double frame = startFrame; frame <= endFrame + 1e-6; frame += step)
+    {
+        scene.sampleHierarchy(chrono_t(frame / fps), samples, hierarchyStat);
+        stats.triangles += hierarchyStat.triangle_count;
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    stats.seconds = elapsed.count();
+    stats.retention = sampleCacheRetention().stats();
+    return stats;
+}
+
+void printKernelStats()
+{
+    for (size_t k = 0; k < size_t(MeshKernel::COUNT); ++k)
+    {
+        const MeshKernelStats stats = meshKernelStats(MeshKernel(k));
+        std::cout << "    " << meshKernelName(MeshKernel(k)) << ": " << stats.calls << " calls, "
+                  << stats.elements << " elements, " << stats.seconds * 1000.0 << " ms" << std::endl;
+    }
+}
+
+int main(int argc, char *argv[] )
+{
+    ez::OptionParser opt;
+    opt.overview = "Benchmark of the scrubbing of an alembicHolder scene";
+
+    opt.add("input", true, -1, "Alembic files, as layers", ez::EZ_TEXT);
+    opt.add("--start", false, 1, "First frame", ez::EZ_FLOAT, "1");
+    opt.add("--end", false, 1, "Last frame", ez::EZ_FLOAT, "24");
+    opt.add("--step", false, 1, "Frame step, below 1 to sample between the frames", ez::EZ_FLOAT, "1");
+    opt.add("--fps", false, 1, "Frames per second", ez::EZ_FLOAT, "24");
+    opt.add("-n,--passes", false, 1, "Number of passes over the time range", ez::EZ_INT32, "3");
+    opt.add("-t,--threads", false, 1, "Number of threads, 0 for all the cores", ez::EZ_INT32, "0");
+    opt.add("--budget", false, 1, "Memory retained by the sample caches in MB", ez::EZ_INT32, "1024");
+
+    if (!opt.parse(argc, argv))
+        return EXIT_SUCCESS;
+
+    std::vector<std::string> files;
+    float startFrame, endFrame, step, fps;
+    int numPasses, numThreads, budget;
+    opt.get("input").getVector(files);
+    opt.get("--start").get(startFrame);
+    opt.get("--end").get(endFrame);
+    opt.get("--step").get(step);
+    opt.get("--fps").get(fps);
+    opt.get("-n").get(numPasses);
+    opt.get("-t").get(numThreads);
+    opt.get("--budget").get(budget);
+    numPasses = std::max(1, numPasses);
+    if (step <= 0.0f || fps <= 0.0f)
+    {
+        std::cerr << "--step and --fps must be positive" << std::endl;
+        return EXIT_FAILURE;
+    }
+    sampleCacheRetention().setBudget(size_t(std::max(0, budget)) << 20);
+
+    tbb::task_arena arena(numThreads > 0 ? numThreads : tbb::task_arena::automatic);
+    std::cout << std::fixed << std::setprecision(2);
+
+    std::unique_ptr<AlembicScene> scene;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    try
+    {
+        scene.reset(new AlembicScene(AlembicSceneKey(FileRef(files), "")));
+    }
+    catch (const AlembicLoadFailedException&)
+    {
+        std::cerr << "Cannot read " << files[0] << std::endl;
+        return EXIT_FAILURE;
+    }
+    scene->waitUntilLoaded();
+    std::chrono::duration<double> loadTime = std::chrono::steady_clock::now() - start;
+    std::cout << "Loaded " << scene->nodeCategories().drawableCount() << " drawables in "
+              << loadTime.count() * 1000.0 << " ms" << std::endl;
+
+    const int numFrames = int((endFrame - startFrame) / step) + 1;
+    for (int pass = 0; pass < numPasses; ++pass)
+    {
+        resetMeshKernelStats();
+        PassStats stats;
+        arena.execute([&]() { stats = scrub(*scene, startFrame, endFrame, step, fps); });
+
+        std::cout << "Pass " << pass << ": " << numFrames << " frames in " << stats.seconds * 1000.0 << " ms, "
+                  << stats.seconds * 1000.0 / numFrames << " ms per frame, "
+                  << stats.triangles / numFrames << " triangles per frame, samples "
+                  << stats.retention.hits << " hits " << stats.retention.misses << " misses "
+                  << stats.retention.evictions << " evictions, "
+                  << (stats.retention.bytes >> 20) << " MB retained" << std::endl;
+        if (pass == 0)
+            printKernelStats();
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,206 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <unordered_map>
+#include <vector>
+
+#include "ezOptionParser.hpp"
+
+#include "IndexMapping.h"
+
+/*
+Benchmark of computeIndexMapping from the alembicHolder, without Maya.
+The mapping of synthetic meshes with faceVarying normals and uvs is computed both with
+the alembicHolder's version and with the hash map it replaced, which is kept here as the
+reference. The outputs must be identical, the times of both are printed.
+*/
+
+using AlembicHolder::IndexMapping;
+
+struct IndexTriplet
+{
+    int32_t position_index;
+    uint32_t normal_index;
+    uint32_t uv_index;
+    bool operator==(const IndexTriplet& rhs) const
+    {
+        return position_index == rhs.position_index && normal_index == rhs.normal_index && uv_index == rhs.uv_index;
+    }
+};
+
+struct IndexTripletHasher
+{
+    size_t operator()(const IndexTriplet& triplet) const
+    {
+        size_t res = std::hash<int32_t>()(triplet.position_index);
+        res ^= std::hash<uint32_t>()(triplet.normal_index) + 0x9e3779b9 + (res << 6) + (res >> 2);
+        res ^= std::hash<uint32_t>()(triplet.uv_index) + 0x9e3779b9 + (res << 6) + (res >> 2);
+        return res;
+    }
+};
+
+// The hash map version of computeIndexMapping, serial.
+void referenceIndexMapping(const int32_t* face_indices, const uint32_t* normal_indices, const uint32_t* uv_indices,
+                           uint32_t face_vertex_count, IndexMapping& output)
+{
+    std::unordered_map<IndexTriplet, uint32_t, IndexTripletHasher> index_map;
+
+    output.vertex_index_from_face_index.resize(face_vertex_count);
+    uint32_t vertex_count = 0;
+    for (uint32_t i = 0; i < face_vertex_count; ++i)
+    {
+        const int32_t position_index = face_indices[i];
+        const IndexTriplet triplet = { position_index,
+                                       normal_indices ? normal_indices[i] : uint32_t(position_index),
+                                       uv_indices ? uv_indices[i] : uint32_t(position_index) };
+        const auto inserted = index_map.insert(std::make_pair(triplet, vertex_count));
+        if (inserted.second)
+            vertex_count += 1;
+        output.vertex_index_from_face_index[i] = inserted.first->second;
+    }
+
+    output.position_indices.resize(vertex_count);
+    if (normal_indices)
+        output.normal_indices.resize(vertex_count);
+    else
+        output.normal_indices.clear();
+    if (uv_indices)
+        output.uv_indices.resize(vertex_count);
+    else
+        output.uv_indices.clear();
+
+    for (const auto& entry : index_map)
+    {
+        output.position_indices[entry.second] = entry.first.position_index;
+        if (normal_indices)
+            output.normal_indices[entry.second] = entry.first.normal_index;
+        if (uv_indices)
+            output.uv_indices[entry.second] = entry.first.uv_index;
+    }
+}
+
+// Deterministic pseudo random value in [0, 1) from an index.
+float random01(uint64_t i)
+{
+    i = (i ^ (i >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    i = (i ^ (i >> 27)) * 0x94D049BB133111EBULL;
+    i = i ^ (i >> 31);
+    return float(i >> 40) / 16777216.0f;
+}
+
+struct Mesh
+{
+    std::vector<int32_t> face_indices;
+    std::vector<uint32_t> normal_indices;
+    std::vector<uint32_t> uv_indices;
+};
+
+// A grid of resolution x resolution quads. The normals are split along the hard edges and
+// the uvs along the seams, both picked at random with the given ratios.
+void makeMesh(int resolution, float hardEdgeRatio, float seamRatio, Mesh& mesh)
+{
+    const int res = resolution;
+    for (int j = 0; j < res; ++j)
+    {
+        for (int i = 0; i < res; ++i)
+        {
+            const int face = j * res + i;
+            const int corners[4] = { j * (res + 1) + i, (j + 1) * (res + 1) + i, (j + 1) * (res + 1) + i + 1, j * (res + 1) + i + 1 };
+            const bool hardFace = random01(2 * face) < hardEdgeRatio;
+            const bool seamFace = random01(2 * face + 1) < seamRatio;
+            for (int c = 0; c < 4; ++c)
+            {
+                const uint32_t faceVertex = uint32_t(4 * face + c);
+                mesh.face_indices.push_back(corners[c]);
+                mesh.normal_indices.push_back(hardFace ? uint32_t((res + 1) * (res + 1)) + faceVertex : uint32_t(corners[c]));
+                mesh.uv_indices.push_back(seamFace ? uint32_t((res + 1) * (res + 1)) + faceVertex : uint32_t(corners[c]));
+            }
+        }
+    }
+}
+
+bool sameMapping(const IndexMapping& a, const IndexMapping& b)
+{
+    return a.vertex_index_from_face_index == b.vertex_index_from_face_index &&
+        a.position_indices == b.position_indices &&
+        a.normal_indices == b.normal_indices &&
+        a.uv_indices == b.uv_indices;
+}
+
+template <typename Function>
+double bestTime(int numRuns, Function function)
+{
+    double best = 0.0;
+    for (int run = 0; run < numRuns; ++run)
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        function();
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        if (run == 0 || elapsed.count() < best)
+            best = elapsed.count();
+    }
+    return best;
+}
+
+int main(int argc, char *argv[] )
+{
+    ez::OptionParser opt;
+    opt.overview = "Benchmark of the alembicHolder index mapping";
+
+    opt.add("-r,--resolution", false, 1, "Resolution of the biggest grid", ez::EZ_INT32, "1024");
+    opt.add("-n,--runs", false, 1, "Number of runs, the best time is kept", ez::EZ_INT32, "5");
+
+    if (!opt.parse(argc, argv))
+        return EXIT_SUCCESS;
+
+    int maxResolution, numRuns;
+    opt.get("-r").get(maxResolution);
+    opt.get("-n").get(numRuns);
+    numRuns = std::max(1, numRuns);
+
+    struct Case { float hardEdgeRatio; float seamRatio; bool normals; bool uvs; const char* name; };
+    const Case cases[] = {
+        { 0.0f, 0.1f, false, true, "uvs" },
+        { 0.3f, 0.0f, true, false, "normals" },
+        { 0.3f, 0.1f, true, true, "normals+uvs" },
+        { 1.0f, 1.0f, true, true, "all split" },
+    };
+
+    bool identical = true;
+    std::cout << std::fixed << std::setprecision(4);
+    for (int resolution = 16; resolution <= std::max(16, maxResolution); resolution *= 4)
+    {
+        for (const Case& c : cases)
+        {
+            Mesh mesh;
+            makeMesh(resolution, c.hardEdgeRatio, c.seamRatio, mesh);
+            const uint32_t count = uint32_t(mesh.face_indices.size());
+            const uint32_t* normals = c.normals ? &mesh.normal_indices[0] : nullptr;
+            const uint32_t* uvs = c.uvs ? &mesh.uv_indices[0] : nullptr;
+
+            IndexMapping reference, mapping;
+            const double referenceTime = bestTime(numRuns, [&]() {
+                referenceIndexMapping(&mesh.face_indices[0], normals, uvs, count, reference);
+            });
+            const double time = bestTime(numRuns, [&]() {
+                AlembicHolder::computeIndexMapping(&mesh.face_indices[0], normals, uvs, count, mapping);
+            });
+
+            const bool same = sameMapping(reference, mapping);
+            identical = identical && same;
+            std::cout << resolution << "x" << resolution << " " << c.name << ": " << count << " face vertices, "
+                      << mapping.position_indices.size() << " vertices, hash map " << referenceTime * 1000.0
+                      << " ms, sort " << time * 1000.0 << " ms, x" << referenceTime / std::max(time, 1e-9)
+                      << (same ? "" : "  DIFFERENT OUTPUT") << std::endl;
+        }
+    }
+
+    if (!identical)
+    {
+        std::cerr << "The index mappings differ from the reference." << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
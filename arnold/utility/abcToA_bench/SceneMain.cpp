@@ -0,0 +1,554 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+#include "ezOptionParser.hpp"
+#include "OverrideMatcher.h"
+#include "PathUtil.h"
+
+#include <Alembic/AbcGeom/All.h>
+#include <Alembic/AbcCoreOgawa/All.h>
+
+/*
+Writes a synthetic archive for the benchmark of the procedural.
+The meshes are grids, spread in groups under a chain of transforms. A fraction of them,
+the instancing ratio, share the same geometry so that the procedural can instance them.
+Every mesh can carry vertex primvars and facesets, and be animated over several samples.
+With --rules, a json file of attribute overrides for these meshes is written too, to pass
+to abcToA_bench with -j. The rules are a mix of paths of meshes and groups and of
+wildcard expressions, e.g. for the benchmark of the overrides, 5000 rules over 100000
+meshes:
+    abcToA_benchScene scene.abc -m 100000 -v 16 --rules 5000 --json rules.json
+    abcToA_bench scene.abc -j rules.json --profile
+With --check, the transforms are tagged and a json file of visibility, matte and opaque
+overrides by path, wildcard and tag is written, with the file of the values that the shapes
+must get from it. abcToA_bench --expect renders the scene with these overrides and compares
+the created nodes with the expected values. The facesets are assigned shaders too, the
+scene generator checks that the matcher of the procedural resolves them like a scan of all
+the assignments, and abcToA_bench that the procedural assigns them:
+    abcToA_benchScene check.abc -m 200 -f 3 --check check.json check.txt
+    abcToA_bench check.abc -j check.json --expect check.txt
+*/
+
+using namespace Alembic::AbcGeom;
+
+struct SceneSettings
+{
+    int numMeshes;
+    int numVertices;
+    int depth;
+    int meshesPerGroup;
+    int numPrimvars;
+    int numFaceSets;
+    float instancingRatio;
+    int numSamples;
+};
+
+struct Grid
+{
+    std::vector<V3f> positions;
+    std::vector<int32_t> faceIndices;
+    std::vector<int32_t> faceCounts;
+    int resolution;
+};
+
+// A grid of resolution x resolution quads in the XZ plane.
+void makeGrid(int numVertices, Grid& grid)
+{
+    grid.resolution = std::max(1, (int) std::sqrt((double) numVertices) - 1);
+    const int res = grid.resolution;
+
+    grid.positions.reserve((res + 1) * (res + 1));
+    for (int j = 0; j <= res; ++j)
+        for (int i = 0; i <= res; ++i)
+            grid.positions.push_back(V3f(float(i) / res - 0.5f, 0.0f, float(j) / res - 0.5f));
+
+    grid.faceCounts.assign(res * res, 4);
+    grid.faceIndices.reserve(res * res * 4);
+    for (int j = 0; j < res; ++j)
+    {
+        for (int i = 0; i < res; ++i)
+        {
+            int v = j * (res + 1) + i;
+            grid.faceIndices.push_back(v);
+            grid.faceIndices.push_back(v + res + 1);
+            grid.faceIndices.push_back(v + res + 2);
+            grid.faceIndices.push_back(v + 1);
+        }
+    }
+}
+
+// Deterministic pseudo random value in [0, 1) from an index.
+float random01(uint64_t i)
+{
+    i = (i ^ (i >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    i = (i ^ (i >> 27)) * 0x94D049BB133111EBULL;
+    i = i ^ (i >> 31);
+    return float(i >> 40) / 16777216.0f;
+}
+
+void writeMesh(OObject& parent, const std::string& name, const Grid& grid, uint64_t seed,
+               const SceneSettings& settings, TimeSamplingPtr timeSampling)
+{
+    OPolyMesh meshObj(parent, name, timeSampling);
+    OPolyMeshSchema& mesh = meshObj.getSchema();
+
+    std::vector<OFloatGeomParam> primvars;
+    for (int p = 0; p < settings.numPrimvars; ++p)
+    {
+        std::ostringstream primvarName;
+        primvarName << "primvar" << p;
+        primvars.push_back(OFloatGeomParam(mesh.getArbGeomParams(), primvarName.str(), false, kVertexScope, 1, timeSampling));
+    }
+
+    std::vector<V3f> positions(grid.positions);
+    std::vector<float> values(grid.positions.size());
+
+    // the wave is drawn from the whole seed, so only the shared meshes have the same geometry.
+    const float phase = 6.2831853f * random01(seed * 4 + 1);
+    const float angle = 3.1415927f * random01(seed * 4 + 2);
+    const float dirX = std::cos(angle), dirZ = std::sin(angle);
+    const float frequency = 4.0f + 4.0f * random01(seed * 4 + 3);
+
+    for (int s = 0; s < settings.numSamples; ++s)
+    {
+        // a wave going through the grid, the same for all the shared meshes.
+        for (size_t v = 0; v < positions.size(); ++v)
+        {
+            const float x = dirX * grid.positions[v].x + dirZ * grid.positions[v].z;
+            positions[v].y = 0.1f * std::sin(frequency * x + 0.5f * s + phase);
+        }
+
+        if (s == 0)
+        {
+            OPolyMeshSchema::Sample sample(V3fArraySample(positions),
+                                           Int32ArraySample(grid.faceIndices),
+                                           Int32ArraySample(grid.faceCounts));
+            mesh.set(sample);
+        }
+        else
+        {
+            OPolyMeshSchema::Sample sample;
+            sample.setPositions(V3fArraySample(positions));
+            mesh.set(sample);
+        }
+
+        for (size_t p = 0; p < primvars.size(); ++p)
+        {
+            for (size_t v = 0; v < values.size(); ++v)
+                values[v] = random01(seed * 131 + p * 7919 + v);
+            primvars[p].set(OFloatGeomParam::Sample(FloatArraySample(values), kVertexScope));
+        }
+    }
+
+    // facesets are stripes of rows.
+    const int res = grid.resolution;
+    for (int f = 0; f < settings.numFaceSets; ++f)
+    {
+        std::vector<int32_t> faces;
+        for (int j = f * res / settings.numFaceSets; j < (f + 1) * res / settings.numFaceSets; ++j)
+            for (int i = 0; i < res; ++i)
+                faces.push_back(j * res + i);
+
+        std::ostringstream faceSetName;
+        faceSetName << "faceSet" << f;
+        OFaceSet faceSet = mesh.createFaceSet(faceSetName.str());
+        faceSet.getSchema().set(OFaceSetSchema::Sample(Int32ArraySample(faces)));
+    }
+}
+
+// Attribute overrides of polymeshes, one rule out of two is a mesh path, the others are
+// group paths and wildcard expressions.
+bool writeRules(const std::string& jsonFile, int numRules, const std::vector<std::string>& meshPaths,
+                const std::vector<std::string>& groupPaths)
+{
+    std::ofstream json(jsonFile.c_str());
+    if (!json.is_open())
+        return false;
+
+    // the floats always have a decimal point, or they would be read as ints.
+    json << std::showpoint << "{\n    \"attributes\": {\n";
+    for (int r = 0; r < numRules; ++r)
+    {
+        std::ostringstream rule;
+        const uint64_t pick = uint64_t(random01(7 * r) * 16777216.0f);
+        if (r % 2 == 0)
+            rule << meshPaths[pick % meshPaths.size()];
+        else if (r % 4 == 1 && !groupPaths.empty())
+            rule << groupPaths[pick % groupPaths.size()];
+        else
+            rule << "meshShape" << pick % meshPaths.size() << "*";
+
+        json << "        \"" << rule.str() << "\": {"
+             << "\"opaque\": " << (random01(7 * r + 1) < 0.5f ? "true" : "false")
+             << ", \"matte\": " << (random01(7 * r + 2) < 0.1f ? "true" : "false")
+             << ", \"visibility\": " << (random01(7 * r + 3) < 0.9f ? 255 : 254)
+             << ", \"subdiv_iterations\": " << int(random01(7 * r + 4) * 3.0f)
+             << ", \"disp_padding\": " << random01(7 * r + 5)
+             << "}" << (r + 1 < numRules ? "," : "") << "\n";
+    }
+    json << "    }\n}\n";
+    return json.good();
+}
+
+// What the check overrides resolve to for a mesh.
+struct CheckedMesh
+{
+    std::string path;
+    int group;
+    int mesh;
+    bool visible;
+    int visibility;
+    bool matte;
+    bool opaque;
+    // shader of each faceset, in the order of their names.
+    std::vector<std::string> faceSetShaders;
+};
+
+// The tags of the transforms, that the check rules refer to.
+std::string groupTag(int group) { std::ostringstream tag; tag << "groupTag" << group % 4; return tag.str(); }
+std::string meshTag(int mesh) { std::ostringstream tag; tag << "meshTag" << mesh % 5; return tag.str(); }
+
+void writeTag(OXform& xform, const std::string& tag)
+{
+    OStringGeomParam tags(xform.getSchema().getArbGeomParams(), "tags", false, kConstantScope, 1);
+    tags.set(OStringGeomParam::Sample(StringArraySample(&tag, 1), kConstantScope));
+}
+
+// Hides some groups and meshes by path and by wildcard, and sets matte, opaque & visibility
+// by tag. A path or wildcard rule hides the whole transform, so the procedural skips its
+// shapes, while a tag rule is applied on the created shapes.
+CheckedMesh checkMesh(const std::string& path, int group, int mesh)
+{
+    std::ostringstream index;
+    index << mesh;
+
+    CheckedMesh checked;
+    checked.path = path;
+    checked.group = group;
+    checked.mesh = mesh;
+    // the wildcard mesh3[0-9] matches the transforms mesh30 to mesh39, mesh300 to mesh399...
+    checked.visible = group % 7 != 3 && mesh % 11 != 5 && !(index.str()[0] == '3' && index.str().size() > 1);
+    checked.visibility = groupTag(group) == "groupTag2" || meshTag(mesh) == "meshTag4" ? 0 : 255;
+    checked.matte = groupTag(group) == "groupTag1";
+    checked.opaque = meshTag(mesh) != "meshTag2";
+    return checked;
+}
+
+// Shader assignments of the check, in the order the procedural reads them, by shader name
+// then in the order of their paths: tags, short paths, exact faceset paths and wildcards.
+std::vector<std::pair<std::string, std::string> > checkShaderRules(const std::vector<std::string>& groupPaths,
+                                                                   const std::vector<std::string>& meshPaths)
+{
+    std::vector<std::pair<std::string, std::string> > rules;
+    rules.push_back(std::make_pair("groupTag3", "checkShaderA"));
+    rules.push_back(std::make_pair("/group1", "checkShaderA"));
+    rules.push_back(std::make_pair("*faceSet1", "checkShaderB"));
+    for (size_t m = 1; m < meshPaths.size(); m += 6)
+    {
+        std::ostringstream faceSetPath;
+        faceSetPath << meshPaths[m] << "/meshShape" << m << "/faceSet0";
+        rules.push_back(std::make_pair(faceSetPath.str(), "checkShaderC"));
+    }
+    rules.push_back(std::make_pair("meshTag3", "checkShaderD"));
+    for (size_t g = 2; g < groupPaths.size(); g += 5)
+        rules.push_back(std::make_pair(groupPaths[g], "checkShaderD"));
+    rules.push_back(std::make_pair("meshShape1*", "checkShaderE"));
+    return rules;
+}
+
+// The assignment applying to name, found by a scan of all the rules, as the procedural did
+// before it compiled them in its ShaderMatcher.
+int scanShaderRules(const std::string& name, const std::vector<std::string>& tags, const std::vector<std::string>& rules)
+{
+    bool foundInPath = false;
+    size_t pathSize = 0;
+    int appliedRule = -1;
+    for (size_t i = 0; i < rules.size(); ++i)
+    {
+        if (rules[i].find("/") != std::string::npos)
+        {
+            if (pathContainsOtherPath(name, rules[i]))
+            {
+                foundInPath = true;
+                if (rules[i].length() > pathSize)
+                {
+                    pathSize = rules[i].length();
+                    appliedRule = int(i);
+                }
+            }
+        }
+        else if (matchPattern(name, rules[i]))
+        {
+            appliedRule = int(i);
+            foundInPath = true;
+            if (rules[i].length() > pathSize)
+                pathSize = rules[i].length();
+        }
+        else if (!foundInPath && std::find(tags.begin(), tags.end(), rules[i]) != tags.end())
+            appliedRule = int(i);
+    }
+    return appliedRule;
+}
+
+// Resolves the shader of every faceset with the matcher of the procedural, and fails if a
+// scan of the rules finds another one. A faceset without shader gets a utility node named
+// after its path.
+bool resolveFaceSetShaders(const std::vector<std::pair<std::string, std::string> >& shaderRules, int numFaceSets,
+                           std::vector<CheckedMesh>& meshes)
+{
+    std::vector<std::string> rules;
+    for (size_t i = 0; i < shaderRules.size(); ++i)
+        rules.push_back(shaderRules[i].first);
+    ShaderMatcher matcher;
+    matcher.setRules(rules);
+
+    // the facesets of a mesh are listed by name.
+    std::vector<std::string> faceSetNames;
+    for (int f = 0; f < numFaceSets; ++f)
+    {
+        std::ostringstream faceSetName;
+        faceSetName << "faceSet" << f;
+        faceSetNames.push_back(faceSetName.str());
+    }
+    std::sort(faceSetNames.begin(), faceSetNames.end());
+
+    bool same = true;
+    for (size_t m = 0; m < meshes.size(); ++m)
+    {
+        std::vector<std::string> tags;
+        tags.push_back(meshTag(meshes[m].mesh));
+        tags.push_back(groupTag(meshes[m].group));
+
+        meshes[m].faceSetShaders.clear();
+        for (size_t f = 0; f < faceSetNames.size(); ++f)
+        {
+            const std::string name = meshes[m].path + "/" + faceSetNames[f];
+            const int rule = matcher.getMatchingRule(name, tags);
+            const int scannedRule = scanShaderRules(name, tags, rules);
+            if (rule != scannedRule)
+            {
+                std::cerr << name << ": the matcher resolves the shader rule " << rule << " instead of " << scannedRule << std::endl;
+                same = false;
+            }
+            meshes[m].faceSetShaders.push_back(scannedRule >= 0 ? shaderRules[scannedRule].second : name);
+        }
+    }
+    return same;
+}
+
+bool writeCheck(const std::string& jsonFile, const std::string& expectedFile, const std::vector<std::string>& groupPaths,
+                const std::vector<std::string>& meshPaths, const std::vector<std::pair<std::string, std::string> >& shaderRules,
+                const std::vector<CheckedMesh>& meshes)
+{
+    std::ofstream json(jsonFile.c_str());
+    if (!json.is_open())
+        return false;
+
+    // the rules are sorted by shader, so they are grouped in the order they are read.
+    json << "{\n    \"shaders\": {";
+    for (size_t i = 0; i < shaderRules.size(); ++i)
+    {
+        if (i == 0 || shaderRules[i].second != shaderRules[i - 1].second)
+            json << (i == 0 ? "" : "],") << "\n        \"" << shaderRules[i].second << "\": [";
+        else
+            json << ", ";
+        json << "\"" << shaderRules[i].first << "\"";
+    }
+    json << (shaderRules.empty() ? "" : "]") << "\n    },\n";
+
+    json << "    \"attributes\": {\n";
+    for (size_t g = 3; g < groupPaths.size(); g += 7)
+        json << "        \"" << groupPaths[g] << "\": {\"visibility\": 0},\n";
+    for (size_t m = 5; m < meshPaths.size(); m += 11)
+        json << "        \"" << meshPaths[m] << "\": {\"visibility\": 0},\n";
+    json << "        \"mesh3[0-9]\": {\"visibility\": 0},\n"
+         << "        \"groupTag1\": {\"matte\": true},\n"
+         << "        \"groupTag2\": {\"visibility\": 0},\n"
+         << "        \"meshTag2\": {\"opaque\": false},\n"
+         << "        \"meshTag4\": {\"visibility\": 0}\n"
+         << "    }\n}\n";
+    if (!json.good())
+        return false;
+
+    // the shaders to create, then one line per shape: path, created, visibility, matte, opaque,
+    // and one per faceset of the created shapes: path of the shape, index, shader.
+    std::ofstream expected(expectedFile.c_str());
+    if (!expected.is_open())
+        return false;
+    for (size_t i = 0; i < shaderRules.size(); ++i)
+        if (i == 0 || shaderRules[i].second != shaderRules[i - 1].second)
+            expected << "shader " << shaderRules[i].second << "\n";
+    for (size_t m = 0; m < meshes.size(); ++m)
+    {
+        expected << "shape " << meshes[m].path << " " << meshes[m].visible << " " << meshes[m].visibility
+                 << " " << meshes[m].matte << " " << meshes[m].opaque << "\n";
+        if (!meshes[m].visible)
+            continue;
+        for (size_t f = 0; f < meshes[m].faceSetShaders.size(); ++f)
+            expected << "faceset " << meshes[m].path << " " << f << " " << meshes[m].faceSetShaders[f] << "\n";
+    }
+    return expected.good();
+}
+
+int main(int argc, char *argv[] )
+{
+    std::string outputFile;
+    SceneSettings settings;
+
+    ez::OptionParser opt;
+    opt.overview = "Synthetic Alembic scene for abcToA_bench";
+
+    opt.add("output", true, 1, "Output File.", ez::EZ_TEXT);
+    opt.add("-m,--meshes", false, 1, "Number of meshes", ez::EZ_INT32, "1000");
+    opt.add("-v,--vertices", false, 1, "Number of vertices per mesh", ez::EZ_INT32, "1024");
+    opt.add("-d,--depth", false, 1, "Number of transforms above each mesh", ez::EZ_INT32, "4");
+    opt.add("-g,--group", false, 1, "Number of meshes under the same transforms", ez::EZ_INT32, "16");
+    opt.add("-p,--primvars", false, 1, "Number of float vertex primvars per mesh", ez::EZ_INT32, "0");
+    opt.add("-f,--facesets", false, 1, "Number of facesets per mesh", ez::EZ_INT32, "0");
+    opt.add("-i,--instancing", false, 1, "Fraction of the meshes sharing the same geometry", ez::EZ_FLOAT, "0");
+    opt.add("-s,--samples", false, 1, "Number of animated samples", ez::EZ_INT32, "1");
+    opt.add("--fps", false, 1, "Frames per second of the samples", ez::EZ_FLOAT, "24");
+    opt.add("-r,--rules", false, 1, "Number of attribute override rules written to the json file", ez::EZ_INT32, "0");
+    opt.add("-j,--json", false, 1, "Json file of the attribute overrides", ez::EZ_TEXT, "");
+    opt.add("--check", false, 2, "Tag the transforms and write the check overrides and their expected values: json,expected", ez::EZ_TEXT);
+
+    if (!opt.parse(argc, argv))
+        return EXIT_SUCCESS;
+
+    float fps;
+    opt.get("output").get(outputFile);
+    opt.get("-m").get(settings.numMeshes);
+    opt.get("-v").get(settings.numVertices);
+    opt.get("-d").get(settings.depth);
+    opt.get("-g").get(settings.meshesPerGroup);
+    opt.get("-p").get(settings.numPrimvars);
+    opt.get("-f").get(settings.numFaceSets);
+    opt.get("-i").get(settings.instancingRatio);
+    opt.get("-s").get(settings.numSamples);
+    opt.get("--fps").get(fps);
+
+    int numRules;
+    std::string jsonFile;
+    opt.get("-r").get(numRules);
+    opt.get("-j").get(jsonFile);
+    if (numRules > 0 && jsonFile.empty())
+    {
+        std::cerr << "--rules needs a --json file to write them to" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::vector<std::string> checkFiles;
+    if (opt.isSet("--check"))
+        opt.get("--check").getVector(checkFiles);
+    const bool check = !checkFiles.empty();
+    if (check && settings.depth < 1)
+    {
+        std::cerr << "--check needs at least one transform above the meshes" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    settings.numSamples = std::max(1, settings.numSamples);
+    settings.meshesPerGroup = std::max(1, settings.meshesPerGroup);
+    settings.depth = std::max(0, settings.depth);
+
+    Grid grid;
+    makeGrid(settings.numVertices, grid);
+    settings.numFaceSets = std::min(settings.numFaceSets, grid.resolution);
+
+    OArchive archive(Alembic::AbcCoreOgawa::WriteArchive(), outputFile);
+    TimeSamplingPtr timeSampling(new TimeSampling(1.0 / fps, 1.0 / fps));
+    uint32_t timeSamplingIndex = archive.addTimeSampling(*timeSampling);
+    timeSampling = archive.getTimeSampling(timeSamplingIndex);
+
+    OObject root = archive.getTop();
+    const int numGroups = (settings.numMeshes + settings.meshesPerGroup - 1) / settings.meshesPerGroup;
+    const int gridSide = std::max(1, (int) std::ceil(std::sqrt((double) numGroups)));
+
+    std::vector<std::string> meshPaths, groupPaths;
+    const bool keepPaths = numRules > 0 || check;
+    if (keepPaths)
+        meshPaths.reserve(settings.numMeshes);
+    std::vector<CheckedMesh> checkedMeshes;
+
+    int meshIndex = 0;
+    for (int g = 0; g < numGroups; ++g)
+    {
+        OObject parent = root;
+        for (int d = 0; d < settings.depth; ++d)
+        {
+            std::ostringstream xformName;
+            if (d == 0)
+                xformName << "group" << g;
+            else
+                xformName << "level" << d;
+
+            OXform xform(parent, xformName.str());
+            XformSample xformSample;
+            if (d == 0)
+                xformSample.setTranslation(V3d(2.0 * (g % gridSide), 0.0, 2.0 * (g / gridSide)));
+            xform.getSchema().set(xformSample);
+            if (check && d == 0)
+                writeTag(xform, groupTag(g));
+            parent = xform;
+        }
+        if (keepPaths && settings.depth > 0)
+            groupPaths.push_back(parent.getFullName());
+
+        for (int m = 0; m < settings.meshesPerGroup && meshIndex < settings.numMeshes; ++m, ++meshIndex)
+        {
+            // shared meshes have the same seed, so the same data, that is written only once in the archive.
+            uint64_t seed = random01(meshIndex) < settings.instancingRatio ? 0 : meshIndex + 1;
+
+            std::ostringstream xformName, meshName;
+            xformName << "mesh" << meshIndex;
+            meshName << "meshShape" << meshIndex;
+
+            OXform xform(parent, xformName.str());
+            XformSample xformSample;
+            xformSample.setTranslation(V3d(random01(3 * meshIndex), random01(3 * meshIndex + 1), random01(3 * meshIndex + 2)));
+            xform.getSchema().set(xformSample);
+            if (check)
+                writeTag(xform, meshTag(meshIndex));
+
+            writeMesh(xform, meshName.str(), grid, seed, settings, timeSampling);
+            if (keepPaths)
+                meshPaths.push_back(xform.getFullName());
+            if (check)
+                checkedMeshes.push_back(checkMesh(xform.getFullName() + "/" + meshName.str(), g, meshIndex));
+        }
+    }
+
+    std::cout << "Wrote " << settings.numMeshes << " meshes of " << grid.positions.size() << " vertices to " << outputFile << std::endl;
+
+    if (numRules > 0 && !meshPaths.empty())
+    {
+        if (!writeRules(jsonFile, numRules, meshPaths, groupPaths))
+        {
+            std::cerr << "Cannot write " << jsonFile << std::endl;
+            return EXIT_FAILURE;
+        }
+        std::cout << "Wrote " << numRules << " rules to " << jsonFile << std::endl;
+    }
+
+    if (check)
+    {
+        const std::vector<std::pair<std::string, std::string> > shaderRules = checkShaderRules(groupPaths, meshPaths);
+        if (!resolveFaceSetShaders(shaderRules, settings.numFaceSets, checkedMeshes))
+        {
+            std::cerr << "The shader matcher differs from the scan of the assignments" << std::endl;
+            return EXIT_FAILURE;
+        }
+        if (!writeCheck(checkFiles[0], checkFiles[1], groupPaths, meshPaths, shaderRules, checkedMeshes))
+        {
+            std::cerr << "Cannot write " << checkFiles[0] << " or " << checkFiles[1] << std::endl;
+            return EXIT_FAILURE;
+        }
+        std::cout << "Wrote the check overrides to " << checkFiles[0] << " and their expected values to " << checkFiles[1] << std::endl;
+    }
+    return EXIT_SUCCESS;
+}
@@ -1,13 +1,19 @@
 #include <ai.h>
 
 #include <iostream>
+#include <fstream>
 #include <sstream>
 #include <iomanip>
+#include <algorithm>
 
 #include "ezOptionParser.hpp"
 
 #include "abcshaderutils.h"
 #include "abcExporterUtils.h"
+#include "abcShaderNetworkHash.h"
+#include "abcShaderGraph.h"
+
+#include <Alembic/AbcCoreFactory/IFactory.h>
 
 namespace Abc =  Alembic::Abc;
 namespace Mat = Alembic::AbcMaterial;
@@ -22,91 +28,174 @@ void loadLibraries(std::vector<std::string> libraryFolders)
 }
 
 
-int main(int argc, char *argv[] )
+struct ExportJob
 {
-    std::string assFile;
-    std::string outputFile = "";
-    std::vector<std::string> libraryFolders;
-    std::string logfile = "";
+    std::string input;
+    std::string output;
+};
 
-    ez::OptionParser opt;
-    opt.overview = "Ass to Abc";
 
+// Default output of an input, next to it or in outputDir.
+std::string getOutputFile(const std::string& assFile, const std::string& outputDir)
+{
+    std::string outputFile = pystring::endswith(assFile, ".gz") ? assFile.substr(0, assFile.size() - 3) : assFile;
+    outputFile = pystring::replace(outputFile, ".ass", ".abc");
+    if (outputDir.size() == 0)
+        return outputFile;
+
+    std::vector<std::string> parts;
+    pystring::rsplit(pystring::replace(outputFile, "\\", "/"), parts, "/", 1);
+    return outputDir + "/" + parts.back();
+}
 
-    opt.add("input", true, 1, "Ass Input File", ez::EZ_FILE);
-    opt.add("output", true, 1, "Output File.", ez::EZ_TEXT);
-    opt.add("-l,--libraries", false, -1, "Add search path for plugin libraries");
-    opt.add("--log", false, 1, "output log path", ez::EZ_TEXT);
 
-    if (!opt.parse(argc, argv))
-        return EXIT_SUCCESS;
+// A manifest lists one input per line, optionally followed by its output.
+bool readManifest(const std::string& manifestFile, const std::string& outputDir, std::vector<ExportJob>& jobs)
+{
+    std::ifstream manifest(manifestFile.c_str());
+    if (!manifest.is_open())
+        return false;
 
+    std::string line;
+    while (std::getline(manifest, line))
+    {
+        line = pystring::strip(line);
+        if (line.size() == 0 || pystring::startswith(line, "#"))
+            continue;
 
-    opt.get("input").get(assFile);
-    opt.get("output").get(outputFile);
-    opt.get("-l").getVector(libraryFolders);
-    opt.get("--log").get(logfile);
+        std::vector<std::string> parts;
+        pystring::split(line, parts);
 
+        ExportJob job;
+        job.input = parts[0];
+        job.output = parts.size() > 1 ? parts[1] : getOutputFile(parts[0], outputDir);
+        jobs.push_back(job);
+    }
+    return true;
+}
 
-    if (outputFile.size() == 0)
-        outputFile = pystring::replace(assFile, ".ass", ".abc");
 
-    AiBegin();
+// The roots are the shaders that no other shader has as input.
+void getRootShaders(const AtNodeSet& ignoredNodes, std::set<AtNode*>& rootShaders)
+{
+    AtNodeIterator *iter = AiUniverseGetNodeIterator(AI_NODE_SHADER);
 
-    Abc::OArchive archive(Alembic::AbcCoreOgawa::WriteArchive(), outputFile.c_str() );
-    Abc::OObject root(archive, Abc::kTop);
-    Abc::OObject materials(root, "materials");    
+    // First, we iterate all nodes, everything is potentially a root node.
+    while (!AiNodeIteratorFinished(iter))
+    {
+        AtNode* shader = AiNodeIteratorGetNext(iter);
+        if (ignoredNodes.count(shader) == 0)
+            rootShaders.insert(shader);
+    }
+    AiNodeIteratorDestroy(iter);
 
-    if (logfile.size() != 0)
-        AiMsgSetLogFileName(logfile.c_str());
+    // Then we iterate again. If a has another node as input parameter, it's not a root.
+    // The direct inputs are enough, every upstream node is the direct input of another one.
+    std::set<AtNode*> candidates(rootShaders);
+    std::vector<AtNode*> linked;
+    for (std::set<AtNode*>::iterator shader = candidates.begin(); shader != candidates.end(); ++shader)
+    {
+        linked.clear();
+        GetLinkedNodes(*shader, linked);
 
-    AiMsgSetConsoleFlags(AI_LOG_INFO + AI_LOG_WARNINGS + AI_LOG_ERRORS + AI_LOG_STATS + AI_LOG_PLUGINS + AI_LOG_PROGRESS + AI_LOG_TIMESTAMP + AI_LOG_BACKTRACE + AI_LOG_MEMORY);
-    AiMsgSetLogFileFlags(AI_LOG_INFO + AI_LOG_WARNINGS + AI_LOG_ERRORS + AI_LOG_STATS + AI_LOG_PLUGINS + AI_LOG_PROGRESS + AI_LOG_TIMESTAMP + AI_LOG_BACKTRACE + AI_LOG_MEMORY);
+        for (size_t i = 0; i < linked.size(); ++i)
+            rootShaders.erase(linked[i]);
+    }
+}
 
-    loadLibraries(libraryFolders);
 
-    AiASSLoad(assFile.c_str(), AI_NODE_ALL - AI_NODE_DRIVER - AI_NODE_FILTER);
+// Digest of every network of the file, sorted by root name so that it doesn't depend on the load order.
+std::string getNetworksDigest(const std::set<AtNode*>& rootShaders, ShaderNetworkHasher& hasher, bool dedup)
+{
+    std::vector<std::string> entries;
+    for (std::set<AtNode*>::const_iterator root = rootShaders.begin(); root != rootShaders.end(); ++root)
+    {
+        std::ostringstream entry;
+        entry << AiNodeGetName(*root) << "=" << std::hex << hasher.getDigest(*root);
+        entries.push_back(entry.str());
+    }
+    std::sort(entries.begin(), entries.end());
 
-    AtNodeSet* exportedNodes = new AtNodeSet;
+    std::ostringstream digest;
+    digest << (dedup ? "dedup" : "full") << ";" << pystring::join(";", entries);
 
-    // Get all shaders root.
+    // The list can be long, we only keep the digest of it.
+    uint64_t h = 14695981039346656037ULL;
+    const std::string s = digest.str();
+    for (size_t i = 0; i < s.size(); ++i)
+    {
+        h ^= (unsigned char)s[i];
+        h *= 1099511628211ULL;
+    }
+    // The version tells apart the digests written by an older hasher.
+    std::ostringstream out;
+    out << "v" << SHADER_NETWORK_DIGEST_VERSION << ":" << std::hex << std::setw(16) << std::setfill('0') << h;
+    return out.str();
+}
 
-    AtNodeIterator *iter = AiUniverseGetNodeIterator(AI_NODE_SHADER);
-    std::set<AtNode*> rootShaders;
 
-    // First, we iterate all nodes, everything is potentially a root node.
-    while (!AiNodeIteratorFinished(iter))
-        rootShaders.insert(AiNodeIteratorGetNext(iter));
-    AiNodeIteratorDestroy(iter);
+// Digest stored by the previous export in outputFile, or an empty string.
+std::string readNetworksDigest(const std::string& outputFile)
+{
+    Alembic::AbcCoreFactory::IFactory factory;
+    factory.setPolicy(Abc::ErrorHandler::kQuietNoopPolicy);
+    Abc::IArchive archive = factory.getArchive(outputFile);
+    if (!archive.valid())
+        return "";
 
-    // Then we iterate again. If a has another node as input parameter, it's not a root.
-    iter = AiUniverseGetNodeIterator(AI_NODE_SHADER);
-    while (!AiNodeIteratorFinished(iter))
-    {
-        AtNode *shader = AiNodeIteratorGetNext(iter);
+    Abc::IObject materials(archive.getTop(), "materials");
+    if (!materials.valid())
+        return "";
 
-        AtNodeSet* connectedNodes = new AtNodeSet;
+    return materials.getMetaData().get("networkDigest");
+}
 
-        getAllArnoldNodes(shader, connectedNodes);
 
-        std::set<AtNode*>::const_iterator sit (connectedNodes->begin()), send(connectedNodes->end());
-        for(;sit!=send;++sit)
-        {
-            std::set<AtNode*>::iterator toErase = rootShaders.find (*sit);
-            if(toErase !=  rootShaders.end())
-                rootShaders.erase(toErase);    
-        }
-    }    
-    AiNodeIteratorDestroy(iter);
+bool writeMaterials(const std::string& outputFile, const std::set<AtNode*>& rootShaders, ShaderNetworkHasher& hasher, bool dedup, const std::string& digest)
+{
+    Alembic::AbcCoreAbstract::MetaData md;
+    md.set("networkDigest", digest);
 
+    Abc::OArchive archive;
+    try
+    {
+        archive = Abc::OArchive(Alembic::AbcCoreOgawa::WriteArchive(), outputFile.c_str());
+    }
+    catch (std::exception& e)
+    {
+        AiMsgError("[EXPORT] Cannot write %s: %s", outputFile.c_str(), e.what());
+        return false;
+    }
+    Abc::OObject root(archive, Abc::kTop);
+    Abc::OObject materials(root, "materials", md);
+
+    AtNodeSet* exportedNodes = new AtNodeSet;
+
+    // Identical networks are written once, the other materials are instances of it.
+    std::map<size_t, Abc::OObject> exportedNetworks;
 
-    for (std::set<AtNode*>::iterator root = rootShaders.begin() ; root != rootShaders.end(); ++root)
+    for (std::set<AtNode*>::const_iterator root = rootShaders.begin() ; root != rootShaders.end(); ++root)
     {
         std::string containerName(AiNodeGetName(*root));
 
+        if(dedup)
+        {
+            size_t networkId = hasher.getId(*root);
+            std::map<size_t, Abc::OObject>::iterator existing = exportedNetworks.find(networkId);
+            if(existing != exportedNetworks.end())
+            {
+                AiMsgInfo("[EXPORT] Container %s is identical to %s, writing an instance", containerName.c_str(), existing->second.getName().c_str());
+                materials.addChildInstance(existing->second, containerName);
+                continue;
+            }
+        }
+
         AiMsgInfo("[EXPORT] Creating container : %s", AiNodeGetName(*root));
         Mat::OMaterial matObj(materials, AiNodeGetName(*root));
+        if(dedup)
+            exportedNetworks[hasher.getId(*root)] = matObj;
 
+        exportedNodes->clear();
         exportedNodes->insert(*root);
         getAllArnoldNodes(*root, exportedNodes);
         AiMsgTab(-2);
@@ -164,4 +253,135 @@ int main(int argc, char *argv[] )
 
     }
 
-}
\ No newline at end of file
+    delete exportedNodes;
+    return true;
+}
+
+
+// Destroy the shaders loaded from a file, so the next one starts from an empty scene.
+void clearShaders(const AtNodeSet& ignoredNodes)
+{
+    std::vector<AtNode*> shaders;
+    AtNodeIterator *iter = AiUniverseGetNodeIterator(AI_NODE_SHADER);
+    while (!AiNodeIteratorFinished(iter))
+    {
+        AtNode* shader = AiNodeIteratorGetNext(iter);
+        if (ignoredNodes.count(shader) == 0)
+            shaders.push_back(shader);
+    }
+    AiNodeIteratorDestroy(iter);
+
+    for (size_t i = 0; i < shaders.size(); ++i)
+        AiNodeDestroy(shaders[i]);
+}
+
+
+int main(int argc, char *argv[] )
+{
+    std::vector<std::string> inputs;
+    std::string outputFile = "";
+    std::vector<std::string> libraryFolders;
+    std::string logfile = "";
+
+    ez::OptionParser opt;
+    opt.overview = "Ass to Abc";
+
+
+    opt.add("input", true, -1, "Ass Input Files, comma separated. Any other file is read as a manifest listing an input and optionally its output per line", ez::EZ_TEXT);
+    opt.add("output", true, 1, "Output File, or output directory when there are several inputs.", ez::EZ_TEXT);
+    opt.add("-l,--libraries", false, -1, "Add search path for plugin libraries");
+    opt.add("--log", false, 1, "output log path", ez::EZ_TEXT);
+    opt.add("--no-dedup", false, 0, "Write every material network, even the ones identical to an already written one");
+    opt.add("-f,--force", false, 0, "Write the outputs even if their networks didn't change since the last export");
+
+    if (!opt.parse(argc, argv))
+        return EXIT_SUCCESS;
+
+
+    opt.get("input").getVector(inputs);
+    opt.get("output").get(outputFile);
+    opt.get("-l").getVector(libraryFolders);
+    opt.get("--log").get(logfile);
+    bool dedup = !opt.isSet("--no-dedup");
+    bool force = opt.isSet("--force") != 0;
+
+    // With a single input, output is the file to write. Otherwise, it's the directory of the outputs.
+    std::vector<ExportJob> jobs;
+    bool batch = inputs.size() > 1;
+    for (size_t i = 0; i < inputs.size(); ++i)
+    {
+        if (!pystring::endswith(inputs[i], ".ass") && !pystring::endswith(inputs[i], ".ass.gz"))
+        {
+            batch = true;
+            if (!readManifest(inputs[i], outputFile, jobs))
+            {
+                std::cerr << "Cannot read manifest " << inputs[i] << std::endl;
+                return EXIT_FAILURE;
+            }
+            continue;
+        }
+
+        ExportJob job;
+        job.input = inputs[i];
+        if (batch)
+            job.output = getOutputFile(inputs[i], outputFile);
+        else
+            job.output = outputFile.size() != 0 ? outputFile : getOutputFile(inputs[i], "");
+        jobs.push_back(job);
+    }
+
+    // All the files are exported in the same session, so the libraries are only loaded once.
+    AiBegin();
+
+    if (logfile.size() != 0)
+        AiMsgSetLogFileName(logfile.c_str());
+
+    AiMsgSetConsoleFlags(AI_LOG_INFO + AI_LOG_WARNINGS + AI_LOG_ERRORS + AI_LOG_STATS + AI_LOG_PLUGINS + AI_LOG_PROGRESS + AI_LOG_TIMESTAMP + AI_LOG_BACKTRACE + AI_LOG_MEMORY);
+    AiMsgSetLogFileFlags(AI_LOG_INFO + AI_LOG_WARNINGS + AI_LOG_ERRORS + AI_LOG_STATS + AI_LOG_PLUGINS + AI_LOG_PROGRESS + AI_LOG_TIMESTAMP + AI_LOG_BACKTRACE + AI_LOG_MEMORY);
+
+    loadLibraries(libraryFolders);
+
+    // The shaders that exist before loading anything are Arnold's own, they are never exported.
+    AtNodeSet builtinShaders;
+    AtNodeIterator *iter = AiUniverseGetNodeIterator(AI_NODE_SHADER);
+    while (!AiNodeIteratorFinished(iter))
+        builtinShaders.insert(AiNodeIteratorGetNext(iter));
+    AiNodeIteratorDestroy(iter);
+
+    int skipped = 0;
+    int failed = 0;
+    for (size_t i = 0; i < jobs.size(); ++i)
+    {
+        AiMsgInfo("[EXPORT] %s -> %s", jobs[i].input.c_str(), jobs[i].output.c_str());
+
+        // Only the shaders are needed.
+        if (AiASSLoad(jobs[i].input.c_str(), AI_NODE_SHADER) != 0)
+        {
+            AiMsgError("[EXPORT] Cannot load %s", jobs[i].input.c_str());
+            ++failed;
+            clearShaders(builtinShaders);
+            continue;
+        }
+
+        std::set<AtNode*> rootShaders;
+        getRootShaders(builtinShaders, rootShaders);
+
+        // The nodes of this file are destroyed afterwards, their addresses can't be kept from one file to the next.
+        ShaderNetworkHasher hasher;
+        std::string digest = getNetworksDigest(rootShaders, hasher, dedup);
+        if (!force && readNetworksDigest(jobs[i].output) == digest)
+        {
+            AiMsgInfo("[EXPORT] %s is up to date", jobs[i].output.c_str());
+            ++skipped;
+        }
+        else if (!writeMaterials(jobs[i].output, rootShaders, hasher, dedup, digest))
+            ++failed;
+
+        clearShaders(builtinShaders);
+    }
+
+    AiMsgInfo("[EXPORT] %d files exported, %d up to date, %d failed", (int)(jobs.size() - skipped - failed), skipped, failed);
+    AiEnd();
+
+    return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
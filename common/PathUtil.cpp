@@ -192,6 +192,11 @@ static std::string translate(const char *pattern)
     return result;
 }
 
+std::string translatePattern(const std::string& pat)
+{
+    return translate(pat.c_str());
+}
+
 bool matchPattern(const std::string& str, const std::string& pat)
 {
     bool result = false;
@@ -44,5 +44,6 @@ void TokenizePath(const std::string &path, const char *separator, PathList &resu
 bool pathInJsonString(const std::string &path, const std::string &jsonString );
 std::string replace_all(const std::string &str, const char *from, const char *to);
 static std::string translate(const char *pattern);
+std::string translatePattern(const std::string& pat);
 bool matchPattern(const std::string& str, const std::string& pat);
 #endif
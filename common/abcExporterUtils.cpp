@@ -12,6 +12,7 @@ You should have received a copy of the GNU Lesser General Public
 License along with this library.*/
 
 #include "abcExporterUtils.h"
+#include "abcShaderGraph.h"
 #include "to_string_patch.h"
 
 namespace // <anonymous>
@@ -28,13 +29,13 @@ const std::vector< std::string > GetComponentNames(int arnoldParamType)
    switch (arnoldParamType)
    {
    case AI_TYPE_RGB:
-      return  std::vector<std::string> (RGB_COMPONENTS , RGB_COMPONENTS +2);
+      return  std::vector<std::string> (RGB_COMPONENTS , RGB_COMPONENTS + 3);
    case AI_TYPE_RGBA:
-      return std::vector<std::string> (RGBA_COMPONENTS , RGBA_COMPONENTS + 3);
+      return std::vector<std::string> (RGBA_COMPONENTS , RGBA_COMPONENTS + 4);
    case AI_TYPE_VECTOR:
-      return std::vector<std::string> (VECTOR_COMPONENTS , VECTOR_COMPONENTS + 2);
+      return std::vector<std::string> (VECTOR_COMPONENTS , VECTOR_COMPONENTS + 3);
    case AI_TYPE_VECTOR2:
-      return std::vector<std::string> (POINT2_COMPONENTS , POINT2_COMPONENTS + 1);
+      return std::vector<std::string> (POINT2_COMPONENTS , POINT2_COMPONENTS + 2);
    default:
       return std::vector<std::string> ();
    }
@@ -43,113 +44,7 @@ const std::vector< std::string > GetComponentNames(int arnoldParamType)
 
 void getAllArnoldNodes(AtNode* node, AtNodeSet* nodes)
 {
-    AtParamIterator* iter = AiNodeEntryGetParamIterator(AiNodeGetNodeEntry(node));
-    while (!AiParamIteratorFinished(iter))
-    {
-        const AtParamEntry *pentry = AiParamIteratorGetNext(iter);
-        const char* paramName = AiParamGetName(pentry);
-
-
-        int inputType = AiParamGetType(pentry);
-        if(inputType == AI_TYPE_ARRAY)
-        {
-            AtArray* paramArray = AiNodeGetArray(node, paramName);
-            if(AiArrayGetType(paramArray) == AI_TYPE_NODE || AiArrayGetType(paramArray) == AI_TYPE_POINTER)
-            {
-                for(unsigned int i=0; i < AiArrayGetNumElements(paramArray); i++)
-                {
-                    AtNode* linkedNode = (AtNode*)AiArrayGetPtr(paramArray, i);
-                    if(linkedNode != NULL)
-                    {
-                        nodes->insert(linkedNode);
-                        getAllArnoldNodes(linkedNode, nodes);
-                    }
-                }
-
-            }
-            else
-            {
-                if(AiNodeIsLinked(node, paramName))
-                {
-                    int comp;
-                    for(unsigned int i=0; i < AiArrayGetNumElements(paramArray); i++)
-                    {
-
-                        std::string paramNameArray = std::string(paramName) + "[" + to_string(i) +"]";
-						if (AiNodeIsLinked(node, paramNameArray.c_str()))
-                        {
-                            //AiMsgDebug("%s has a link", paramNameArray.c_str());
-                            AtNode* linkedNode = NULL;
-                            linkedNode = AiNodeGetLink(node, paramNameArray.c_str(), &comp);
-                            if(linkedNode)
-                            {
-                                nodes->insert(linkedNode);
-                                getAllArnoldNodes(linkedNode, nodes);
-                            }
-                            else
-                            {
-                                std::vector<std::string> componentNames = GetComponentNames(inputType);
-
-                                unsigned int numComponents = componentNames.size();
-                                for (unsigned int i=0; i < numComponents; i++)
-                                {
-                                    std::string compAttrName = paramNameArray + "." + componentNames[i];
-
-                                    if(AiNodeIsLinked(node, compAttrName.c_str()))
-                                    {
-                                        linkedNode = AiNodeGetLink(node, compAttrName.c_str(), &comp);
-                                        if(linkedNode)
-                                        {
-                                            nodes->insert(linkedNode);
-                                            getAllArnoldNodes(linkedNode, nodes);
-                                        }
-                                    }
-                                }
-                            }
-                        }
-                    }
-                }
-            }
-        }
-
-        else if(AiNodeIsLinked(node, paramName))
-        {
-
-            {
-                AtNode* linkedNode = NULL;
-                int comp;
-                linkedNode = AiNodeGetLink(node, paramName, &comp);
-                if(linkedNode)
-                {
-                    nodes->insert(linkedNode);
-                    getAllArnoldNodes(linkedNode, nodes);
-                }
-                else
-                {
-                    std::vector<std::string> componentNames = GetComponentNames(inputType);
-
-                    unsigned int numComponents = componentNames.size();
-                    for (unsigned int i=0; i < numComponents; i++)
-                    {
-                        std::string compAttrName = std::string(paramName) + "." + componentNames[i];
-
-                        if(AiNodeIsLinked(node, compAttrName.c_str()))
-                        {
-                            linkedNode = AiNodeGetLink(node, compAttrName.c_str(), &comp);
-                            if(linkedNode)
-                            {
-                                nodes->insert(linkedNode);
-                                getAllArnoldNodes(linkedNode, nodes);
-                            }
-                        }
-                    }
-                }
-            }
-        }
-    }
-
-    AiParamIteratorDestroy(iter);
-
+    CollectUpstreamNodes(node, *nodes);
 }
 
 
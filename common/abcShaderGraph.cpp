@@ -0,0 +1,112 @@
+#include "abcShaderGraph.h"
+
+#include <sstream>
+#include <string>
+
+namespace // <anonymous>
+{
+    const char* componentNames(int type)
+    {
+        switch (type)
+        {
+        case AI_TYPE_RGB:
+            return "rgb";
+        case AI_TYPE_RGBA:
+            return "rgba";
+        case AI_TYPE_VECTOR:
+            return "xyz";
+        case AI_TYPE_VECTOR2:
+            return "xy";
+        default:
+            return "";
+        }
+    }
+
+    // The parameter is known to be linked, either as a whole or by component.
+    void appendLink(AtNode* node, const std::string& paramName, int type, std::vector<AtNode*>& linked)
+    {
+        int comp;
+        AtNode* linkedNode = AiNodeGetLink(node, paramName.c_str(), &comp);
+        if (linkedNode)
+        {
+            linked.push_back(linkedNode);
+            return;
+        }
+
+        for (const char* c = componentNames(type); *c; ++c)
+        {
+            std::string compName = paramName + "." + *c;
+            if (AiNodeIsLinked(node, compName.c_str()))
+            {
+                linkedNode = AiNodeGetLink(node, compName.c_str(), &comp);
+                if (linkedNode)
+                    linked.push_back(linkedNode);
+            }
+        }
+    }
+}
+
+
+void GetLinkedNodes(AtNode* node, std::vector<AtNode*>& linked)
+{
+    AtParamIterator* iter = AiNodeEntryGetParamIterator(AiNodeGetNodeEntry(node));
+    while (!AiParamIteratorFinished(iter))
+    {
+        const AtParamEntry *pentry = AiParamIteratorGetNext(iter);
+        const char* paramName = AiParamGetName(pentry);
+        int inputType = AiParamGetType(pentry);
+
+        if (inputType == AI_TYPE_ARRAY)
+        {
+            AtArray* paramArray = AiNodeGetArray(node, paramName);
+            if (paramArray == NULL)
+                continue;
+
+            int arrayType = AiArrayGetType(paramArray);
+            unsigned int numElements = AiArrayGetNumElements(paramArray);
+            if (arrayType == AI_TYPE_NODE || arrayType == AI_TYPE_POINTER)
+            {
+                for (unsigned int i = 0; i < numElements; i++)
+                {
+                    AtNode* linkedNode = (AtNode*)AiArrayGetPtr(paramArray, i);
+                    if (linkedNode != NULL)
+                        linked.push_back(linkedNode);
+                }
+            }
+            // The elements are only checked one by one when the array has a link.
+            else if (AiNodeIsLinked(node, paramName))
+            {
+                for (unsigned int i = 0; i < numElements; i++)
+                {
+                    std::ostringstream element;
+                    element << paramName << "[" << i << "]";
+                    if (AiNodeIsLinked(node, element.str().c_str()))
+                        appendLink(node, element.str(), arrayType, linked);
+                }
+            }
+        }
+        else if (AiNodeIsLinked(node, paramName))
+            appendLink(node, paramName, inputType, linked);
+    }
+    AiParamIteratorDestroy(iter);
+}
+
+
+void CollectUpstreamNodes(AtNode* root, std::set<AtNode*>& nodes)
+{
+    std::vector<AtNode*> toVisit(1, root);
+    std::vector<AtNode*> linked;
+    while (!toVisit.empty())
+    {
+        AtNode* node = toVisit.back();
+        toVisit.pop_back();
+
+        linked.clear();
+        GetLinkedNodes(node, linked);
+        for (size_t i = 0; i < linked.size(); ++i)
+        {
+            if (nodes.insert(linked[i]).second)
+                toVisit.push_back(linked[i]);
+        }
+    }
+}
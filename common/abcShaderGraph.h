@@ -0,0 +1,21 @@
+#ifndef _Abc_Shader_Graph_h_
+#define _Abc_Shader_Graph_h_
+
+#include "ai.h"
+
+#include <set>
+#include <vector>
+
+/*
+Traversal of the links of a shader network, shared by the material exporters.
+*/
+
+// Append the nodes directly connected to the inputs of node: linked parameters,
+// linked components and node arrays. A node linked to several inputs is appended once per input.
+void GetLinkedNodes(AtNode* node, std::vector<AtNode*>& linked);
+
+// Insert every node upstream of root into nodes. The traversal is iterative and
+// a node already in nodes is not visited again, so shared branches are only walked once.
+void CollectUpstreamNodes(AtNode* root, std::set<AtNode*>& nodes);
+
+#endif
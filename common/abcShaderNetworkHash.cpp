@@ -0,0 +1,290 @@
+#include "abcShaderNetworkHash.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+
+namespace // <anonymous>
+{
+    const char* componentNames(int type)
+    {
+        switch (type)
+        {
+        case AI_TYPE_RGB:
+            return "rgb";
+        case AI_TYPE_RGBA:
+            return "rgba";
+        case AI_TYPE_VECTOR:
+            return "xyz";
+        case AI_TYPE_VECTOR2:
+            return "xy";
+        default:
+            return "";
+        }
+    }
+
+    std::ostream& operator<<(std::ostream& out, const AtRGB& v) { return out << v.r << "," << v.g << "," << v.b; }
+    std::ostream& operator<<(std::ostream& out, const AtRGBA& v) { return out << v.r << "," << v.g << "," << v.b << "," << v.a; }
+    std::ostream& operator<<(std::ostream& out, const AtVector& v) { return out << v.x << "," << v.y << "," << v.z; }
+    std::ostream& operator<<(std::ostream& out, const AtVector2& v) { return out << v.x << "," << v.y; }
+
+    // Strings are prefixed with their length, so that they can't be mistaken for the separators.
+    std::ostream& writeString(std::ostream& out, const AtString& s) { return out << s.length() << ":" << s.c_str(); }
+
+    // FNV-1a, so that the digests don't depend on the standard library.
+    uint64_t hashString(const std::string& s)
+    {
+        uint64_t h = 14695981039346656037ULL;
+        for (size_t i = 0; i < s.size(); ++i)
+        {
+            h ^= (unsigned char)s[i];
+            h *= 1099511628211ULL;
+        }
+        return h;
+    }
+}
+
+
+size_t ShaderNetworkHasher::getId(AtNode* node)
+{
+    if (node == NULL)
+        return 0;
+
+    std::map<AtNode*, size_t>::const_iterator it = nodeIds.find(node);
+    if (it != nodeIds.end())
+        return it->second;
+
+    // Arnold refuses cyclic links, this only guards the recursion.
+    if (!visiting.insert(node).second)
+        return 0;
+
+    std::string signature = getSignature(node);
+    visiting.erase(node);
+
+    // Identifiers start at 1, 0 is the null node.
+    size_t id = signatures.insert(std::make_pair(signature, signatures.size() + 1)).first->second;
+    nodeIds[node] = id;
+    std::ostringstream versionTag;
+    versionTag << "v" << SHADER_NETWORK_DIGEST_VERSION << "|";
+    nodeDigests[node] = hashString(versionTag.str() + signature);
+    return id;
+}
+
+
+uint64_t ShaderNetworkHasher::getDigest(AtNode* node)
+{
+    if (getId(node) == 0)
+        return 0;
+    return nodeDigests[node];
+}
+
+
+std::string ShaderNetworkHasher::getSignature(AtNode* node)
+{
+    const AtNodeEntry* entry = AiNodeGetNodeEntry(node);
+    // The upstream nodes are referenced by digest, so the signature doesn't depend on the visit order.
+    std::string signature = AiNodeEntryGetName(entry);
+
+    AtParamIterator* iter = AiNodeEntryGetParamIterator(entry);
+    while (!AiParamIteratorFinished(iter))
+    {
+        const AtParamEntry *pentry = AiParamIteratorGetNext(iter);
+        const char* paramName = AiParamGetName(pentry);
+        if (strcmp(paramName, "name") == 0)
+            continue;
+
+        int type = AiParamGetType(pentry);
+        signature += "|";
+        signature += paramName;
+
+        if (type == AI_TYPE_ARRAY)
+            signature += getArraySignature(node, paramName);
+        else if (AiNodeIsLinked(node, paramName))
+            signature += getLinkSignature(node, paramName, type);
+        else
+            signature += getValueSignature(node, paramName, type);
+    }
+    AiParamIteratorDestroy(iter);
+
+    // The user parameters, sorted by name since their iteration order isn't defined.
+    std::vector<std::string> userParams;
+    AtUserParamIterator* userIter = AiNodeGetUserParamIterator(node);
+    while (!AiUserParamIteratorFinished(userIter))
+        userParams.push_back(AiUserParamGetName(AiUserParamIteratorGetNext(userIter)));
+    AiUserParamIteratorDestroy(userIter);
+    std::sort(userParams.begin(), userParams.end());
+
+    for (size_t i = 0; i < userParams.size(); ++i)
+    {
+        const char* paramName = userParams[i].c_str();
+        const AtUserParamEntry* upentry = AiNodeLookUpUserParameter(node, paramName);
+        int type = AiUserParamGetType(upentry);
+
+        std::ostringstream header;
+        header << "|@" << userParams[i] << ":" << AiUserParamGetCategory(upentry);
+        signature += header.str();
+
+        if (type == AI_TYPE_ARRAY || AiUserParamGetCategory(upentry) != AI_USERDEF_CONSTANT)
+            signature += getArraySignature(node, paramName);
+        else if (AiNodeIsLinked(node, paramName))
+            signature += getLinkSignature(node, paramName, type);
+        else
+            signature += getValueSignature(node, paramName, type);
+    }
+
+    return signature;
+}
+
+
+std::string ShaderNetworkHasher::getLinkSignature(AtNode* node, const std::string& paramName, int type)
+{
+    std::ostringstream out;
+    int comp;
+    AtNode* linked = AiNodeGetLink(node, paramName.c_str(), &comp);
+    if (linked)
+    {
+        out << "<" << getDigest(linked) << "." << comp;
+        return out.str();
+    }
+
+    // Only some components are linked.
+    for (const char* c = componentNames(type); *c; ++c)
+    {
+        std::string compName = paramName + "." + *c;
+        out << "." << *c;
+        if (AiNodeIsLinked(node, compName.c_str()))
+        {
+            linked = AiNodeGetLink(node, compName.c_str(), &comp);
+            out << "<" << getDigest(linked) << "." << comp;
+        }
+    }
+    out << "=" << getValueSignature(node, paramName.c_str(), type);
+    return out.str();
+}
+
+
+std::string ShaderNetworkHasher::getValueSignature(AtNode* node, const char* paramName, int type)
+{
+    std::ostringstream out;
+    out << std::setprecision(9) << "=";
+    switch (type)
+    {
+    case AI_TYPE_BYTE:
+        out << (int)AiNodeGetByte(node, paramName);
+        break;
+    case AI_TYPE_INT:
+    case AI_TYPE_ENUM:
+        out << AiNodeGetInt(node, paramName);
+        break;
+    case AI_TYPE_UINT:
+        out << AiNodeGetUInt(node, paramName);
+        break;
+    case AI_TYPE_BOOLEAN:
+        out << AiNodeGetBool(node, paramName);
+        break;
+    case AI_TYPE_FLOAT:
+        out << AiNodeGetFlt(node, paramName);
+        break;
+    case AI_TYPE_RGB:
+        out << AiNodeGetRGB(node, paramName);
+        break;
+    case AI_TYPE_RGBA:
+        out << AiNodeGetRGBA(node, paramName);
+        break;
+    case AI_TYPE_VECTOR:
+        out << AiNodeGetVec(node, paramName);
+        break;
+    case AI_TYPE_VECTOR2:
+        out << AiNodeGetVec2(node, paramName);
+        break;
+    case AI_TYPE_STRING:
+        writeString(out, AiNodeGetStr(node, paramName));
+        break;
+    case AI_TYPE_NODE:
+        out << "<" << getDigest((AtNode*)AiNodeGetPtr(node, paramName));
+        break;
+    case AI_TYPE_MATRIX:
+    {
+        AtMatrix m = AiNodeGetMatrix(node, paramName);
+        for (int i = 0; i < 4; ++i)
+            for (int j = 0; j < 4; ++j)
+                out << m[i][j] << ",";
+        break;
+    }
+    default:
+        break;
+    }
+    return out.str();
+}
+
+
+std::string ShaderNetworkHasher::getArraySignature(AtNode* node, const char* paramName)
+{
+    AtArray* paramArray = AiNodeGetArray(node, paramName);
+    if (paramArray == NULL)
+        return "[]";
+
+    std::ostringstream out;
+    out << std::setprecision(9);
+    int type = AiArrayGetType(paramArray);
+    unsigned int numElements = AiArrayGetNumElements(paramArray);
+    out << "[" << type << ":" << numElements << ":";
+
+    for (unsigned int i = 0; i < numElements; i++)
+    {
+        switch (type)
+        {
+        case AI_TYPE_BYTE:
+            out << (int)AiArrayGetByte(paramArray, i);
+            break;
+        case AI_TYPE_INT:
+        case AI_TYPE_ENUM:
+            out << AiArrayGetInt(paramArray, i);
+            break;
+        case AI_TYPE_UINT:
+            out << AiArrayGetUInt(paramArray, i);
+            break;
+        case AI_TYPE_BOOLEAN:
+            out << AiArrayGetBool(paramArray, i);
+            break;
+        case AI_TYPE_FLOAT:
+            out << AiArrayGetFlt(paramArray, i);
+            break;
+        case AI_TYPE_RGB:
+            out << AiArrayGetRGB(paramArray, i);
+            break;
+        case AI_TYPE_RGBA:
+            out << AiArrayGetRGBA(paramArray, i);
+            break;
+        case AI_TYPE_VECTOR:
+            out << AiArrayGetVec(paramArray, i);
+            break;
+        case AI_TYPE_VECTOR2:
+            out << AiArrayGetVec2(paramArray, i);
+            break;
+        case AI_TYPE_STRING:
+            writeString(out, AiArrayGetStr(paramArray, i));
+            break;
+        case AI_TYPE_NODE:
+        case AI_TYPE_POINTER:
+            out << "<" << getDigest((AtNode*)AiArrayGetPtr(paramArray, i));
+            break;
+        default:
+            break;
+        }
+
+        // The elements of the array can also be linked one by one.
+        if (type != AI_TYPE_NODE && type != AI_TYPE_POINTER)
+        {
+            std::ostringstream element;
+            element << paramName << "[" << i << "]";
+            if (AiNodeIsLinked(node, element.str().c_str()))
+                out << getLinkSignature(node, element.str(), type);
+        }
+        out << ";";
+    }
+    out << "]";
+    return out.str();
+}
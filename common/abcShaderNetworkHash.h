@@ -0,0 +1,49 @@
+#ifndef _Abc_Shader_Network_Hash_h_
+#define _Abc_Shader_Network_Hash_h_
+
+#include "ai.h"
+
+#include <map>
+#include <set>
+#include <string>
+#include <stdint.h>
+
+/*
+Content based identifiers for shader networks.
+Two nodes get the same identifier when they have the same type, the same parameter
+values, user parameters included, and the same upstream networks, whatever their names are. The exporters use it
+to write a network once and instance it for every other material it appears in.
+The identifiers are only valid within a session, the digests are stable from one run to
+the next and can be stored. SHADER_NETWORK_DIGEST_VERSION is part of every digest, it must be bumped
+whenever the signatures change, so that the digests stored before don't match anymore.
+*/
+
+#define SHADER_NETWORK_DIGEST_VERSION 2
+
+class ShaderNetworkHasher
+{
+public:
+    ShaderNetworkHasher() {};
+
+    // Identifier of the network whose root is node.
+    size_t getId(AtNode* node);
+
+    // Digest of the network whose root is node, tagged with SHADER_NETWORK_DIGEST_VERSION.
+    uint64_t getDigest(AtNode* node);
+
+    // Number of distinct nodes seen so far.
+    size_t getNumUniqueNodes() const { return signatures.size(); };
+
+private:
+    std::string getSignature(AtNode* node);
+    std::string getLinkSignature(AtNode* node, const std::string& paramName, int type);
+    std::string getValueSignature(AtNode* node, const char* paramName, int type);
+    std::string getArraySignature(AtNode* node, const char* paramName);
+
+    std::map<AtNode*, size_t> nodeIds;
+    std::map<AtNode*, uint64_t> nodeDigests;
+    std::map<std::string, size_t> signatures;
+    std::set<AtNode*> visiting;
+};
+
+#endif
@@ -14,6 +14,7 @@ License along with this library.*/
 
 #include "abcCacheExportCmd.h"
 #include "abcExporterUtils.h"
+#include "abcShaderNetworkHash.h"
 
 namespace Abc =  Alembic::Abc;
 namespace Mat = Alembic::AbcMaterial;
@@ -76,6 +77,11 @@ MStatus abcCacheExportCmd::doIt( const MArgList &args)
 
     CMayaScene::Export(NULL);
 
+    // Identical networks are written once, the other shading groups are instances of it.
+    ShaderNetworkHasher hasher;
+    std::map<size_t, Abc::OObject> exportedNetworks;
+    std::set<std::string> exportedMaterials;
+
     MItSelectionList iter(list, MFn::kPluginShape);
      for (; !iter.isDone(); iter.next())
      {
@@ -108,14 +114,29 @@ MStatus abcCacheExportCmd::doIt( const MArgList &args)
             // create the material
             MFnDependencyNode container(toExport.node());
 
+            // a shading group assigned to several shapes is only written once.
+            if(!exportedMaterials.insert(container.name().asChar()).second)
+                continue;
+
+            CNodeTranslator* translator = arnoldSession->ExportNode(toExport);
+            AtNode* root = translator->GetArnoldNode();
+
+            size_t networkId = hasher.getId(root);
+            std::map<size_t, Abc::OObject>::iterator existing = exportedNetworks.find(networkId);
+            if(existing != exportedNetworks.end())
+            {
+                AiMsgInfo("[EXPORT] Container %s is identical to %s, writing an instance", container.name().asChar(), existing->second.getName().c_str());
+                materials.addChildInstance(existing->second, container.name().asChar());
+                continue;
+            }
+
             AiMsgInfo("[EXPORT] Creating container : %s", container.name().asChar());
             AiMsgTab(+2);
             Mat::OMaterial matObj(materials, container.name().asChar());
+            exportedNetworks[networkId] = matObj;
 
-            CNodeTranslator* translator = arnoldSession->ExportNode(toExport);
             if(true)
              {
-                 AtNode* root = translator->GetArnoldNode();
                  exportedNodes.insert(root);
                  // We need to traverse the tree again...
                  getAllArnoldNodes(root, exportedNodes);
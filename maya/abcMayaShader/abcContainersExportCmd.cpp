@@ -16,6 +16,7 @@ License along with this library.*/
 #include <maya/MArgDatabase.h>
 #include <maya/MGlobal.h>
 #include "abcExporterUtils.h"
+#include "abcShaderNetworkHash.h"
 
 #include <sstream>
 
@@ -70,6 +71,11 @@ MStatus abcContainersExportCmd::doIt( const MArgList &args)
     CMayaScene::Begin(MTOA_SESSION_ASS);
     CArnoldSession* arnoldSession = CMayaScene::GetArnoldSession();
     std::set<AtNode*> exportedNodes;
+
+    // Identical networks are written once, the other containers are instances of it.
+    ShaderNetworkHasher hasher;
+    std::map<size_t, Abc::OObject> exportedNetworks;
+
     MItSelectionList iter(list, MFn::kContainer);
      for (; !iter.isDone(); iter.next())
      {
@@ -79,8 +85,6 @@ MStatus abcContainersExportCmd::doIt( const MArgList &args)
          MFnContainerNode container(dependNode);
          //cout << "found a container" << endl;
 
-         // create the material
-         Mat::OMaterial matObj(materials, container.name().asChar());
          MObjectArray members;
          container.getMembers(members);
          MPlug toExport;
@@ -112,6 +116,29 @@ MStatus abcContainersExportCmd::doIt( const MArgList &args)
              {
                  AtNode* root = translator->GetArnoldNode();
 
+                 MStringArray publishedNames;
+                 MPlugArray publishedPlugs;
+                 container.getPublishedPlugs (publishedPlugs, publishedNames) ;
+
+                 // The published plugs are specific to each container, those are always written.
+                 size_t networkId = hasher.getId(root);
+                 if(publishedNames.length() == 0)
+                 {
+                     std::map<size_t, Abc::OObject>::iterator existing = exportedNetworks.find(networkId);
+                     if(existing != exportedNetworks.end())
+                     {
+                         cout << "instancing " << existing->second.getName() << " as " << container.name().asChar() << endl;
+                         materials.addChildInstance(existing->second, container.name().asChar());
+                         continue;
+                     }
+                 }
+
+                 // create the material
+                 Mat::OMaterial matObj(materials, container.name().asChar());
+                 if(publishedNames.length() == 0)
+                     exportedNetworks[networkId] = matObj;
+
+                 exportedNodes.clear();
                  exportedNodes.insert(root);
                  getAllArnoldNodes(root, exportedNodes);
 
@@ -168,9 +195,6 @@ MStatus abcContainersExportCmd::doIt( const MArgList &args)
                  }
 
             // now, we export all the interface thingies
-            MStringArray publishedNames;
-            MPlugArray publishedPlugs;
-            container.getPublishedPlugs (publishedPlugs, publishedNames) ;
             if( publishedNames.length() >0)
             {
                 for (unsigned i=0; i < publishedNames.length(); ++i)
@@ -12,6 +12,7 @@ You should have received a copy of the GNU Lesser General Public
 License along with this library.*/
 
 #include "abcExporterUtils.h"
+#include "abcShaderGraph.h"
 
 
 
@@ -99,128 +100,9 @@ bool relink(AtNode* src, AtNode* dest, const char* input, int comp)
     return false;
 }
 
-void getAllArnoldNodes(AtNode* node, std::set<AtNode*> nodes)
+void getAllArnoldNodes(AtNode* node, std::set<AtNode*>& nodes)
 {
-    AtParamIterator* iter = AiNodeEntryGetParamIterator(AiNodeGetNodeEntry(node));
-    while (!AiParamIteratorFinished(iter))
-    {
-        const AtParamEntry *pentry = AiParamIteratorGetNext(iter);
-        const char* paramName = AiParamGetName(pentry);
-
-
-        int inputType = AiParamGetType(pentry);
-        if(inputType == AI_TYPE_ARRAY)
-        {
-            AtArray* paramArray = AiNodeGetArray(node, paramName);
-            if(AiArrayGetType(paramArray) == AI_TYPE_NODE || AiArrayGetType(paramArray) == AI_TYPE_POINTER)
-            {
-                for(unsigned int i=0; i < AiArrayGetNumElements(paramArray); i++)
-                {
-                    AtNode* linkedNode = (AtNode*)AiArrayGetPtr(paramArray, i);
-                    if(linkedNode != NULL)
-                    {
-                        //AiMsgDebug("we have a link to %s for %s", AiNodeGetName(linkedNode), AiNodeGetName(node));
-                        //linkedNode = renameAndCloneNodeByParent(linkedNode, node);
-                        //AiArraySetPtr(paramArray, i, linkedNode);
-                        nodes.insert(linkedNode);
-                        getAllArnoldNodes(linkedNode, nodes);
-                    }
-                }
-
-            }
-            else
-            {
-                if(AiNodeIsLinked(node, paramName))
-                {
-                    int comp;
-                    for(unsigned int i=0; i < AiArrayGetNumElements(paramArray); i++)
-                    {
-
-                        MString paramNameArray = MString(paramName) + "[" + MString(to_string(i).c_str()) +"]";
-                        if (AiNodeIsLinked(node, paramNameArray.asChar()))
-                        {
-                            //AiMsgDebug("%s has a link", paramNameArray.asChar());
-                            AtNode* linkedNode = NULL;
-                            linkedNode = AiNodeGetLink(node, paramNameArray.asChar(), &comp);
-                            if(linkedNode)
-                            {
-                                //AiMsgDebug("we have a link to %s on %s", AiNodeGetName(linkedNode), paramNameArray.asChar());
-                                //linkedNode = renameAndCloneNodeByParent(linkedNode, node);
-                                //relink(linkedNode, node, paramNameArray.asChar(), comp);
-                                nodes.insert(linkedNode);
-                                getAllArnoldNodes(linkedNode, nodes);
-                            }
-                            else
-                            {
-                                const MStringArray componentNames = GetComponentNames(inputType);
-
-                                unsigned int numComponents = componentNames.length();
-                                for (unsigned int i=0; i < numComponents; i++)
-                                {
-                                    MString compAttrName = paramNameArray + "." + componentNames[i];
-
-                                    if(AiNodeIsLinked(node, compAttrName.asChar()))
-                                    {
-                                        linkedNode = AiNodeGetLink(node, compAttrName.asChar(), &comp);
-                                        if(linkedNode)
-                                        {
-                                            //linkedNode = renameAndCloneNodeByParent(linkedNode, node);
-                                            //relink(linkedNode, node, compAttrName.asChar(), comp);
-                                            nodes.insert(linkedNode);
-                                            getAllArnoldNodes(linkedNode, nodes);
-                                        }
-                                    }
-                                }
-                            }
-                        }
-                    }
-                }
-            }
-        }
-
-        else if(AiNodeIsLinked(node, paramName))
-        {
-
-            {
-                AtNode* linkedNode = NULL;
-                int comp;
-                linkedNode = AiNodeGetLink(node, paramName, &comp);
-                if(linkedNode)
-                {
-                    // CRASHING HERE
-                    //linkedNode = renameAndCloneNodeByParent(linkedNode, node);
-                    //relink(linkedNode, node, paramName, comp);
-                    nodes.insert(linkedNode);
-                    getAllArnoldNodes(linkedNode, nodes);
-                }
-                else
-                {
-                    const MStringArray componentNames = GetComponentNames(inputType);
-
-                    unsigned int numComponents = componentNames.length();
-                    for (unsigned int i=0; i < numComponents; i++)
-                    {
-                        MString compAttrName = MString(paramName) + "." + componentNames[i];
-
-                        if(AiNodeIsLinked(node, compAttrName.asChar()))
-                        {
-                            linkedNode = AiNodeGetLink(node, compAttrName.asChar(), &comp);
-                            if(linkedNode)
-                            {
-                                //linkedNode = renameAndCloneNodeByParent(linkedNode, node);
-                                //relink(linkedNode, node, compAttrName.asChar(), comp);
-                                nodes.insert(linkedNode);
-                                getAllArnoldNodes(linkedNode, nodes);
-                            }
-                        }
-                    }
-                }
-            }
-        }
-    }
-
-    AiParamIteratorDestroy(iter);
-
+    CollectUpstreamNodes(node, nodes);
 }
 
 
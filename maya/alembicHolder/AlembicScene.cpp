@@ -2,10 +2,14 @@
 #include "../../common/PathUtil.h"
 #include <Alembic/AbcCoreFactory/IFactory.h>
 #include <ImathBoxAlgo.h>
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#include <tbb/parallel_sort.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <limits>
 #include <queue>
-#include <unordered_map>
-#include <unordered_set>
 #include <cassert>
 
 namespace AlembicHolder {
@@ -13,14 +17,6 @@ namespace AlembicHolder {
 const uint32_t Hierarchy::NO_PARENT = std::numeric_limits<uint32_t>::max();
 
 namespace {
-    struct QueueEntry {
-        Alembic::Abc::IObject source_object;
-        Hierarchy::NodeID parent;
-        QueueEntry(const Alembic::Abc::IObject& abc_object_, Hierarchy::NodeID parent_)
-            : source_object(abc_object_), parent(parent_)
-        {}
-    };
-
     Hierarchy::NodeType getType(const Alembic::Abc::IObject& object)
     {
         const auto& header = object.getHeader();
@@ -35,37 +31,47 @@ namespace {
         }
         return Hierarchy::NodeType::UNKNOWN;
     }
+
+    Hierarchy::Node makeNode(const Alembic::Abc::IObject& object, Hierarchy::NodeID node_id)
+    {
+        Hierarchy::Node node;
+        node.source_object = object;
+        node.id = node_id;
+        node.children_start = 0;
+        node.children_count = 0;
+        node.type = getType(object);
+        return node;
+    }
 } // unnamed namespace
 
 Hierarchy::Hierarchy(Alembic::Abc::IObject top_object, const std::string& geometry_path)
+    : m_node_count(0), m_depth(0), m_level_start(0)
 {
     if (!top_object.valid())
         return;
 
-    PathList path;
-    TokenizePath(geometry_path, "|/", path);
-    auto path_iter = path.begin();
-
-    std::queue<QueueEntry> queue;
+    TokenizePath(geometry_path, "|/", m_path);
+    m_nodes.push_back(makeNode(top_object, 0));
+}
 
-    queue.push({top_object, NO_PARENT});
-    m_nodes.resize(1);
+bool Hierarchy::expandLevel(const std::atomic<bool>& cancelled)
+{
+    // The levels are appended one after the other, which builds the
+    // hierarchy in BFS order.
+    const auto level_end = NodeCount(m_nodes.size());
+    if (m_level_start == level_end)
+        return false;
 
-    // Build a hierarchy in BFS order.
-    uint32_t node_count = 0;
-    while (!queue.empty()) {
-        auto entry = queue.front();
-        queue.pop();
+    for (NodeID node_id = m_level_start; node_id < level_end; ++node_id) {
+        if (cancelled)
+            return false;
 
-        const uint32_t node_id = node_count++;
+        // The nodes do not move when the children are appended.
         Node& node = m_nodes[node_id];
-        node.id = node_id;
-        node.source_object = entry.source_object;
-        node.children_start = uint32_t(m_nodes.size());
-        node.type = getType(entry.source_object);
+        node.children_start = NodeID(m_nodes.size());
 
         uint16_t children_count = 0;
-        const auto pushChildToQueue = [&queue, node_id, &children_count](Alembic::Abc::IObject child_object) {
+        const auto appendChild = [this, &children_count](Alembic::Abc::IObject child_object) {
             if (!child_object.valid())
                 return;
 
@@ -74,26 +80,24 @@ Hierarchy::Hierarchy(Alembic::Abc::IObject top_object, const std::string& geomet
             if (visibility.valid() && visibility.isConstant() && visibility.getValue(0) == false)
                 return;
 
-            queue.push({child_object, /* parent = */ node_id});
+            m_nodes.push_back(makeNode(child_object, NodeID(m_nodes.size())));
             children_count += 1;
         };
-        if (path_iter != path.end()) {
+        if (m_depth < m_path.size()) {
             // Traverse down the path.
-            const auto& child_name = *path_iter;
-            pushChildToQueue(entry.source_object.getChild(child_name));
-            ++path_iter;
+            appendChild(node.source_object.getChild(m_path[m_depth]));
         } else {
             // Traverse down to children.
-            for (uint32_t i = 0; i < entry.source_object.getNumChildren(); ++i) {
-                pushChildToQueue(entry.source_object.getChild(i));
+            for (uint32_t i = 0; i < node.source_object.getNumChildren(); ++i) {
+                appendChild(node.source_object.getChild(i));
             }
         }
         node.children_count = children_count;
-
-        // Only resize now, since this may invalidate the node reference above.
-        if (children_count != 0)
-            m_nodes.resize(node.children_start + children_count);
     }
+
+    m_level_start = level_end;
+    m_depth += 1;
+    return true;
 }
 
 namespace {
@@ -166,28 +170,166 @@ namespace {
 AlembicScene::AlembicScene(const AlembicSceneKey& scene_key)
     : m_hierarchy(getAlembicTopObject(scene_key.file_ref.paths()), scene_key.root_path)
     , m_categories(m_hierarchy)
-    , m_visibility(m_hierarchy)
+    , m_loading(true)
+    , m_stop_loading(false)
+{
+    // The top object is valid, getAlembicTopObject throws otherwise.
+    auto archive = m_hierarchy.node(0).source_object.getArchive();
+    m_archive_bounds = Alembic::AbcGeom::GetIArchiveBounds(archive);
+
+    m_loading_thread = std::thread(&AlembicScene::load, this);
+}
+
+AlembicScene::~AlembicScene()
+{
+    m_stop_loading = true;
+    m_loading_thread.join();
+
+    // The retained samples must not survive the caches of the samplers.
+    sampleCacheRetention().releaseOwner(this);
+}
+
+void AlembicScene::load()
 {
-    // Get the full names of drawable nodes.
-    m_drawable_names.reserve(m_categories.drawableCount());
-    for (const auto& drawable : m_categories.drawables()) {
-        m_drawable_names.push_back(drawable.node_ref.source_object.getFullName());
+    try {
+        while (m_hierarchy.expandLevel(m_stop_loading)) {
+            const auto node_count = m_hierarchy.expandedNodeCount();
+            m_categories.extend(node_count);
+            m_visibility.extend(m_hierarchy, node_count);
+
+            // Get the full names and the samplers of the new drawables.
+            for (auto drawable_id = HierarchyNodeCategories::DrawableID(m_samplers.size());
+                 drawable_id < m_categories.categorizedDrawableCount(); ++drawable_id) {
+                const auto& node = m_categories.drawableNode(drawable_id);
+                m_drawable_names.push_back(node.source_object.getFullName());
+                m_samplers.emplace_back(node, this);
+            }
+            m_static_materials.grow_to_at_least(m_samplers.size());
+
+            // The nodes are published before their drawables, see
+            // sampleHierarchy.
+            m_hierarchy.publish(node_count);
+            m_categories.publish();
+        }
+    } catch (const std::exception&) {
+        // Keep the levels published so far.
     }
 
-    // Read the diffuse color and diffuse texture values stored in the alembic,
-    // then load the textures. These are assumed to be constant in time.
-    m_static_materials.resize(m_categories.drawableCount());
-    for (const auto& drawable : m_categories.drawables()) {
-        readStaticMaterial(
-            drawable.node_ref.source_object,
-            m_static_materials[drawable.drawable_id]);
+    std::lock_guard<std::mutex> lock(m_loading_mutex);
+    m_loading = false;
+    m_loading_condition.notify_all();
+}
+
+void AlembicScene::waitUntilLoaded()
+{
+    std::unique_lock<std::mutex> lock(m_loading_mutex);
+    m_loading_condition.wait(lock, [this] { return !m_loading; });
+}
+
+const StaticMaterial& AlembicScene::getStaticMaterial(HierarchyNodeCategories::DrawableID drawable_id) const
+{
+    // The diffuse color and diffuse texture values stored in the alembic are
+    // assumed to be constant in time. Reading them for every drawable up
+    // front would open the .arbGeomParams of the whole archive.
+    tbb::mutex::scoped_lock guard(m_static_materials_mutex);
+    auto& entry = m_static_materials[drawable_id];
+    if (!entry.read) {
+        readStaticMaterial(m_categories.drawableNode(drawable_id).source_object, entry.material);
+        entry.read = true;
     }
+    return entry.material;
+}
 
-    // Initialize drawable samplers.
-    m_samplers.reserve(m_categories.drawableCount());
-    for (const auto& drawable : m_categories.drawables()) {
-        m_samplers.emplace_back(drawable.node_ref);
+void AlembicScene::addArchiveBounds(chrono_t time, HierarchyStat& hierarchy_stat) const
+{
+    if (!isLoading() || !m_archive_bounds.valid())
+        return;
+    const auto bounds = m_archive_bounds.getValue(Alembic::Abc::ISampleSelector(time));
+    if (!bounds.isEmpty())
+        hierarchy_stat.bbox.extendBy(Box3f(V3f(bounds.min), V3f(bounds.max)));
+}
+
+namespace {
+
+void releaseBuffers(DrawableSample& sample)
+{
+    sample.cache_handles.indices.reset();
+    for (auto& endpoint : sample.cache_handles.geometry.endpoints)
+        endpoint.reset();
+    for (auto& endpoint : sample.cache_handles.texcoords.endpoints)
+        endpoint.reset();
+    sample.cache_handles.geometry_digest = 0;
+}
+
+void computeHierarchyStat(const DrawableSampleVector& samples, HierarchyStat& out_hierarchy_stat)
+{
+    out_hierarchy_stat = HierarchyStat();
+    for (const auto& sample : samples) {
+        if (!sample.visible)
+            continue;
+        out_hierarchy_stat.bbox.extendBy(Imath::transform(sample.bbox, sample.world_matrix));
+        if (sample.cache_handles.indices)
+            out_hierarchy_stat.triangle_count += (sample.cache_handles.indices->triangle_buffer.size() / 3);
+    }
+}
+
+} // unnamed namespace
+
+DrawableLOD ViewFilter::classify(uint32_t drawable_id, const Box3f& bounds) const
+{
+    if (!enabled() || views.empty() || bounds.isEmpty() ||
+        (drawable_id < always_full.size() && always_full[drawable_id]))
+        return DrawableLOD::FULL;
+
+    // The most detailed level of all the views, FULL < PROXY < CULLED.
+    auto lod = DrawableLOD::CULLED;
+    for (const auto& view : views) {
+        lod = std::min(lod, classifyInView(view, bounds));
+        if (lod == DrawableLOD::FULL)
+            break;
     }
+    return lod;
+}
+
+DrawableLOD ViewFilter::classifyInView(const View& view, const Box3f& bounds) const
+{
+    // Outcodes of the corners against the clip planes, and extent of the
+    // corners in front of the camera in normalized device coordinates.
+    unsigned outside_all = ~0u;
+    bool in_front = true;
+    Imath::Box2f ndc_bounds;
+    for (int i = 0; i < 8; ++i) {
+        const Imath::V4f corner(
+            (i & 1) ? bounds.max.x : bounds.min.x,
+            (i & 2) ? bounds.max.y : bounds.min.y,
+            (i & 4) ? bounds.max.z : bounds.min.z,
+            1.0f);
+        const auto clip = corner * view.view_projection;
+        unsigned outside = 0;
+        outside |= (clip.x < -clip.w) ? 1 : 0;
+        outside |= (clip.x > clip.w) ? 2 : 0;
+        outside |= (clip.y < -clip.w) ? 4 : 0;
+        outside |= (clip.y > clip.w) ? 8 : 0;
+        outside |= (clip.z < -clip.w) ? 16 : 0;
+        outside |= (clip.z > clip.w) ? 32 : 0;
+        outside_all &= outside;
+        if (clip.w > 0)
+            ndc_bounds.extendBy(V2f(clip.x / clip.w, clip.y / clip.w));
+        else
+            in_front = false;
+    }
+
+    if (culling && outside_all != 0)
+        return DrawableLOD::CULLED;
+
+    // Drawables crossing the camera plane are never proxies.
+    if (proxy_screen_size > 0 && in_front) {
+        const auto ndc_size = ndc_bounds.size();
+        const auto screen_size = std::max(ndc_size.x * 0.5f * view.viewport_width, ndc_size.y * 0.5f * view.viewport_height);
+        if (screen_size < proxy_screen_size)
+            return DrawableLOD::PROXY;
+    }
+    return DrawableLOD::FULL;
 }
 
 struct TraverseState {
@@ -199,19 +341,27 @@ struct TraverseState {
     {}
 };
 
-void AlembicScene::sampleHierarchy(chrono_t time, DrawableSampleVector& out_samples, HierarchyStat& out_hierarchy_stat)
+void AlembicScene::sampleHierarchy(chrono_t time, DrawableSampleVector& out_samples, HierarchyStat& out_hierarchy_stat,
+    const ViewFilter* filter)
 {
-    tbb::mutex::scoped_lock guard(m_mutex);
-
+    // The loading thread publishes the nodes of a level before its
+    // drawables, so the drawables counted here are all among the nodes
+    // counted next. The drawables published in between are skipped.
     const auto drawable_count = m_categories.drawableCount();
+    const auto node_count = m_hierarchy.nodeCount();
     out_samples.resize(drawable_count);
     out_hierarchy_stat = HierarchyStat();
 
-    if (m_hierarchy.empty())
+    if (node_count == 0) {
+        addArchiveBounds(time, out_hierarchy_stat);
         return;
+    }
 
-    // Calculate visibility, world matrices and polymesh geometry data.
-    // Top to bottom BFS traversal.
+    // Calculate visibility and world matrices.
+    // Top to bottom BFS traversal. This pass is cheap, the geometry is sampled
+    // afterwards for all the visible drawables at once.
+    std::vector<HierarchyNodeCategories::DrawableID> visible_drawables;
+    visible_drawables.reserve(drawable_count);
     {
         const auto floor_ss = Alembic::Abc::ISampleSelector(time, Alembic::Abc::ISampleSelector::kFloorIndex);
         std::queue<TraverseState> q;
@@ -246,37 +396,92 @@ void AlembicScene::sampleHierarchy(chrono_t time, DrawableSampleVector& out_samp
             }
 
             // Drawable.
-            if (m_categories.isDrawable(node)) {
+            if (m_categories.isDrawable(node) && category_index < drawable_count) {
                 const auto drawable_index = category_index;
                 auto& sample = out_samples[drawable_index];
                 sample.visible = is_visible;
                 sample.drawable_id = drawable_index;
                 sample.world_matrix = world_matrix;
                 sample.type = m_samplers[drawable_index].geometryType();
+                sample.lod = DrawableLOD::FULL;
 
-                // Geometry buffers.
-                if (sample.visible) {
-                    m_samplers[drawable_index].sampleBuffers(time, sample.cache_handles, sample.bbox);
-                    out_hierarchy_stat.bbox.extendBy(Imath::transform(sample.bbox, sample.world_matrix));
-                } else {
-                    sample.bbox.makeEmpty();
-                    sample.cache_handles.indices.reset();
-                    for (auto& endpoint : sample.cache_handles.geometry.endpoints)
-                        endpoint.reset();
-                    for (auto& endpoint : sample.cache_handles.texcoords.endpoints)
-                        endpoint.reset();
+                // The drawables not at full detail only get their bounds.
+                Box3f bounds;
+                if (sample.visible && filter && filter->enabled() &&
+                    m_samplers[drawable_index].sampleBounds(time, bounds)) {
+                    sample.lod = filter->classify(drawable_index, Imath::transform(bounds, world_matrix));
                 }
 
-                // Triangle count stat.
-                if (sample.cache_handles.indices)
-                    out_hierarchy_stat.triangle_count += (sample.cache_handles.indices->triangle_buffer.size() / 3);
+                if (sample.visible && sample.lod == DrawableLOD::FULL) {
+                    visible_drawables.push_back(drawable_index);
+                } else {
+                    sample.bbox = sample.visible ? bounds : Box3f();
+                    releaseBuffers(sample);
+                }
             }
 
-            // Process children.
-            for (const auto& child : m_hierarchy.childrenOf(node))
-                q.push({child, world_matrix, is_visible});
+            // Process children, unless they are not published yet.
+            if (node.children_start + node.children_count <= node_count) {
+                for (const auto& child : m_hierarchy.childrenOf(node))
+                    q.push({child, world_matrix, is_visible});
+            }
         }
     }
+
+    sampleDrawables(time, visible_drawables, out_samples);
+    computeHierarchyStat(out_samples, out_hierarchy_stat);
+    addArchiveBounds(time, out_hierarchy_stat);
+}
+
+bool AlembicScene::refineHierarchySample(chrono_t time, const ViewFilter* filter, DrawableSampleVector& samples,
+    HierarchyStat& hierarchy_stat)
+{
+    // The bbox of a drawable is either its decoded bbox or the bounds from the
+    // file, both do to classify it again.
+    std::vector<HierarchyNodeCategories::DrawableID> decoded_drawables;
+    bool changed = false;
+    for (auto& sample : samples) {
+        if (!sample.visible)
+            continue;
+        const auto lod = filter
+            ? filter->classify(sample.drawable_id, Imath::transform(sample.bbox, sample.world_matrix))
+            : DrawableLOD::FULL;
+        if (!updateValue(sample.lod, lod))
+            continue;
+        changed = true;
+        if (lod == DrawableLOD::FULL)
+            decoded_drawables.push_back(sample.drawable_id);
+        else
+            releaseBuffers(sample);
+    }
+
+    if (changed) {
+        sampleDrawables(time, decoded_drawables, samples);
+        computeHierarchyStat(samples, hierarchy_stat);
+        addArchiveBounds(time, hierarchy_stat);
+    }
+    return changed;
+}
+
+void AlembicScene::sampleDrawables(chrono_t time, const std::vector<HierarchyNodeCategories::DrawableID>& drawable_ids,
+    DrawableSampleVector& samples)
+{
+    // Geometry buffers. This is where the Alembic samples are decoded, each
+    // drawable only touches its own sampler and sample.
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, drawable_ids.size()),
+        [&](const tbb::blocked_range<size_t>& range) {
+            for (size_t i = range.begin(); i != range.end(); ++i) {
+                const auto drawable_index = drawable_ids[i];
+                auto& sample = samples[drawable_index];
+                m_samplers[drawable_index].sampleBuffers(time, sample.cache_handles, sample.bbox);
+            }
+        });
+}
+
+CacheRetention& sampleCacheRetention()
+{
+    static CacheRetention retention(size_t(1024) << 20);
+    return retention;
 }
 
 AlembicSceneCache& AlembicSceneCache::instance()
@@ -300,11 +505,10 @@ AlembicScenePtr AlembicSceneCache::getScene(const AlembicSceneKey& key)
     }
 }
 
-HierarchyNodeVisibility::HierarchyNodeVisibility(Hierarchy& hierarchy)
+void HierarchyNodeVisibility::extend(const Hierarchy& hierarchy, Hierarchy::NodeCount node_count)
 {
-    m_visibility_properties.reserve(hierarchy.nodeCount());
-    for (Hierarchy::NodeID node_id = 0; node_id < hierarchy.nodeCount(); ++node_id) {
-        auto& node = hierarchy.node(node_id);
+    for (auto node_id = Hierarchy::NodeID(m_visibility_properties.size()); node_id < node_count; ++node_id) {
+        const auto& node = hierarchy.node(node_id);
         m_visibility_properties.push_back(Alembic::AbcGeom::GetVisibilityProperty(node.source_object));
     }
 }
@@ -318,20 +522,24 @@ bool HierarchyNodeVisibility::isNodeVisible(const Hierarchy::NodeID& node_id, co
 
 HierarchyNodeCategories::HierarchyNodeCategories(const Hierarchy& hierarchy)
     : m_hierarchy(hierarchy)
+    , m_drawable_count(0)
+{
+    for (auto& count : m_count_by_type)
+        count = 0;
+}
+
+void HierarchyNodeCategories::extend(Hierarchy::NodeCount node_count)
 {
     // Compute hierarchy statistics.
-    m_count_by_type.fill(0);
-    m_category_index.resize(m_hierarchy.nodeCount());
-    m_drawables.reserve(m_hierarchy.nodeCount());
-    for (Hierarchy::NodeID node_id = 0; node_id < m_hierarchy.nodeCount(); ++node_id) {
-        auto& node = m_hierarchy.node(node_id);
+    for (auto node_id = Hierarchy::NodeID(m_category_index.size()); node_id < node_count; ++node_id) {
+        const auto& node = m_hierarchy.node(node_id);
         if (isDrawable(node)) {
-            m_category_index[node_id] = DrawableID(m_drawables.size());
+            m_category_index.push_back(DrawableID(m_drawables.size()));
             m_drawables.push_back(node_id);
         } else if (isXform(node)) {
-            m_category_index[node_id] = m_count_by_type[size_t(node.type)];
+            m_category_index.push_back(m_count_by_type[size_t(node.type)]);
         } else {
-            m_category_index[node_id] = Hierarchy::INVALID_INDEX;
+            m_category_index.push_back(Hierarchy::INVALID_INDEX);
         }
         // Increment count_by_type last, so it can be used as index above.
         if (node.type != Hierarchy::NodeType::UNKNOWN)
@@ -353,102 +561,106 @@ bool HierarchyNodeCategories::isDrawable(const Hierarchy::Node & node) const
 
 namespace {
 
-// The Alembic FaceIndices property is an array of int32s, but the normal
-// and UV index properties are arrays of uint32s. Why? Dunno. Ask the
-// designers of the Alembic library.
-struct IndexTriplet {
-    int32_t position_index;
-    uint32_t normal_index;
-    uint32_t uv_index;
-    IndexTriplet(int32_t position_index_, uint32_t normal_index_, uint32_t uv_index_)
-        : position_index(position_index_)
-        , normal_index(normal_index_)
-        , uv_index(uv_index_)
-    {
-    }
-    bool operator==(const IndexTriplet& rhs) const
-    {
-        return position_index == rhs.position_index &&
-            normal_index == rhs.normal_index &&
-            uv_index == rhs.uv_index;
-    }
+struct MeshKernelCounters {
+    std::atomic<uint64_t> calls;
+    std::atomic<uint64_t> elements;
+    std::atomic<uint64_t> nanoseconds;
 };
-
-struct IndexTripletHasher {
-    size_t operator()(const IndexTriplet& index_triplet) const
+MeshKernelCounters g_mesh_kernel_counters[size_t(MeshKernel::COUNT)];
+
+// Adds the wall time of its scope to the counters of a kernel.
+class MeshKernelTimer {
+public:
+    MeshKernelTimer(MeshKernel kernel, size_t element_count)
+        : m_counters(g_mesh_kernel_counters[size_t(kernel)])
+        , m_element_count(element_count)
+        , m_start(std::chrono::steady_clock::now())
+    {}
+    ~MeshKernelTimer()
     {
-        size_t res = std::hash<int32_t>()(index_triplet.position_index);
-        boost::hash_combine(res, index_triplet.normal_index);
-        boost::hash_combine(res, index_triplet.uv_index);
-        return res;
+        const auto elapsed = std::chrono::steady_clock::now() - m_start;
+        m_counters.calls += 1;
+        m_counters.elements += m_element_count;
+        m_counters.nanoseconds += uint64_t(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
     }
+
+private:
+    MeshKernelCounters& m_counters;
+    size_t m_element_count;
+    std::chrono::steady_clock::time_point m_start;
 };
 
-// If normals or uvs are faceVarying, a mapping from face indices to
-// vertex buffer indices has to be computed.
-void computeIndexMapping(
-    const Int32ArraySample& face_indices,
-    const UInt32ArraySamplePtr& normal_indices,
-    const UInt32ArraySamplePtr& uv_indices,
-    IndexMapping& output)
-{
-    // This will map a triplet of position, normal and uv indices to a
-    // vertex index identifying a unique position, normal and uv triplet.
-    std::unordered_map<IndexTriplet, uint32_t, IndexTripletHasher> index_map;
+// Ranges smaller than this are not split between threads by the kernels.
+const size_t kKernelGrainSize = 4096;
 
-    // Fill the index map by index triplets.
-    const auto face_vertex_count = face_indices.size();
-    output.vertex_index_from_face_index.resize(face_vertex_count);
+// List the triangles around each vertex with a counting sort of the triangle
+// indices.
+void computeVertexTriangles(const std::vector<uint32_t>& triangle_indices, VertexTriangles& output)
+{
     uint32_t vertex_count = 0;
-    for (size_t i_face_vertex = 0; i_face_vertex < face_vertex_count; ++i_face_vertex) {
-        const auto position_index = face_indices.get()[i_face_vertex];
-        const auto normal_index = normal_indices ? normal_indices->get()[i_face_vertex] : position_index;
-        const auto uv_index = uv_indices ? uv_indices->get()[i_face_vertex] : position_index;
-        const IndexTriplet index_triplet = { position_index, normal_index, uv_index };
-        const auto insert_result = index_map.insert({ index_triplet, vertex_count });
-        if (insert_result.second) {
-            // The insertion was succesfull, this is the first occurence of this index triplet.
-            vertex_count += 1;
-        }
-        output.vertex_index_from_face_index[i_face_vertex] = insert_result.first->second;
-    }
-
-    output.position_indices.resize(vertex_count);
-    if (normal_indices)
-        output.normal_indices.resize(vertex_count);
-    else
-        output.normal_indices.clear();
-    if (uv_indices)
-        output.uv_indices.resize(vertex_count);
-    else
-        output.uv_indices.clear();
-
-    for (const auto& triplet_index_pair : index_map) {
-        const auto& triplet = triplet_index_pair.first;
-        const auto vertex_index = triplet_index_pair.second;
-        output.position_indices[vertex_index] = triplet.position_index;
-        if (normal_indices)
-            output.normal_indices[vertex_index] = triplet.normal_index;
-        if (uv_indices)
-            output.uv_indices[vertex_index] = triplet.uv_index;
-    }
+    for (const auto index : triangle_indices)
+        vertex_count = std::max(vertex_count, index + 1);
+
+    output.offsets.assign(vertex_count + 1, 0);
+    for (const auto index : triangle_indices)
+        ++output.offsets[index + 1];
+    for (uint32_t i = 0; i < vertex_count; ++i)
+        output.offsets[i + 1] += output.offsets[i];
+
+    output.triangles.resize(triangle_indices.size());
+    std::vector<uint32_t> cursors(output.offsets.begin(), output.offsets.end() - 1);
+    for (size_t i = 0; i < triangle_indices.size(); ++i)
+        output.triangles[cursors[triangle_indices[i]]++] = uint32_t(i / 3);
 }
 
-// Compute normals by averaging face (triangle) normals.
-void generateNormals(const std::vector<uint32_t>& triangle_indices, const std::vector<V3f>& positions, std::vector<V3f>& out_normals)
+// Compute normals by averaging face (triangle) normals. Each vertex gathers
+// the normals of its own triangles, so the vertices are computed in parallel
+// without atomics, summing in the same order as a serial scatter would.
+void generateNormals(
+    const std::vector<uint32_t>& triangle_indices,
+    const VertexTriangles& vertex_triangles,
+    const std::vector<V3f>& positions,
+    std::vector<V3f>& out_normals)
 {
-    out_normals.assign(positions.size(), V3f(0, 0, 0));
-    for (size_t i = 0; i < triangle_indices.size(); i += 3) {
-        const auto& a = positions[triangle_indices[i + 0]];
-        const auto& b = positions[triangle_indices[i + 1]];
-        const auto& c = positions[triangle_indices[i + 2]];
-        const auto face_normal = (c - a).cross(b - a);
-        for (size_t j = 0; j < 3; j++)
-            out_normals[triangle_indices[i + j]] += face_normal;
-    }
-    for (auto& n : out_normals) {
-        n.normalize();
+    const MeshKernelTimer timer(MeshKernel::NORMALS, positions.size());
+
+    // Meshes with normals of an unsupported scope have no cached adjacency.
+    VertexTriangles computed_vertex_triangles;
+    const auto* adjacency = &vertex_triangles;
+    if (vertex_triangles.offsets.empty()) {
+        computeVertexTriangles(triangle_indices, computed_vertex_triangles);
+        adjacency = &computed_vertex_triangles;
     }
+
+    const auto triangle_count = triangle_indices.size() / 3;
+    std::vector<V3f> face_normals(triangle_count);
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, triangle_count, kKernelGrainSize),
+        [&](const tbb::blocked_range<size_t>& range) {
+            for (auto i = range.begin(); i != range.end(); ++i) {
+                const auto& a = positions[triangle_indices[3 * i + 0]];
+                const auto& b = positions[triangle_indices[3 * i + 1]];
+                const auto& c = positions[triangle_indices[3 * i + 2]];
+                face_normals[i] = (c - a).cross(b - a);
+            }
+        });
+
+    // Vertices past the last one indexed by a triangle get null normals.
+    const auto& offsets = adjacency->offsets;
+    const auto& triangles = adjacency->triangles;
+    const auto indexed_vertex_count = std::min(positions.size(), offsets.size() - 1);
+    out_normals.resize(positions.size());
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, positions.size(), kKernelGrainSize),
+        [&](const tbb::blocked_range<size_t>& range) {
+            for (auto i = range.begin(); i != range.end(); ++i) {
+                V3f normal(0, 0, 0);
+                if (i < indexed_vertex_count) {
+                    for (auto j = offsets[i]; j != offsets[i + 1]; ++j)
+                        normal += face_normals[triangles[j]];
+                }
+                out_normals[i] = normal.normalize();
+            }
+        });
 }
 
 template <typename T, typename IndexT>
@@ -468,12 +680,17 @@ void fillBuffer(
         return;
     }
 
+    const MeshKernelTimer timer(MeshKernel::GATHER, indices.size);
     const auto count = indices.size;
-    output.reserve(count);
-    output.clear();
-    for (size_t i = 0; i < count; ++i) {
-        output.push_back(values[indices[i]]);
-    }
+    output.resize(count);
+    const auto* value_data = values.start;
+    const auto* index_data = indices.start;
+    auto* output_data = output.data();
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, count, kKernelGrainSize),
+        [=](const tbb::blocked_range<size_t>& range) {
+            for (auto i = range.begin(); i != range.end(); ++i)
+                output_data[i] = value_data[index_data[i]];
+        });
 }
 
 template <typename T>
@@ -509,6 +726,7 @@ void getParamSample(
 struct MeshEdge {
     int32_t index1;
     int32_t index2;
+    MeshEdge() : index1(0), index2(0) {}
     MeshEdge(int32_t index1_, int32_t index2_)
         : index1(std::min(index1_, index2_))
         , index2(std::max(index1_, index2_))
@@ -517,14 +735,9 @@ struct MeshEdge {
     {
         return index1 == rhs.index1 && index2 == rhs.index2;
     }
-};
-
-struct MeshEdgeHasher {
-    size_t operator()(const MeshEdge& mesh_edge) const
+    bool operator<(const MeshEdge& rhs) const
     {
-        size_t res = std::hash<int32_t>()(mesh_edge.index1);
-        boost::hash_combine(res, mesh_edge.index2);
-        return res;
+        return index1 < rhs.index1 || (index1 == rhs.index1 && index2 < rhs.index2);
     }
 };
 
@@ -535,42 +748,112 @@ void computeTriangleAndWireframeIndices(
     std::vector<uint32_t>& out_triangle_indices,
     std::vector<uint32_t>& out_wireframe_indices)
 {
-    out_triangle_indices.clear();
+    const MeshKernelTimer timer(MeshKernel::TRIANGULATION, face_indices.size());
 
     const auto indices =
         index_mapping.position_indices.empty()
         ? Span<const int32_t>(face_indices)
         : Span<const int32_t>(index_mapping.vertex_index_from_face_index);
 
-    std::unordered_set<MeshEdge, MeshEdgeHasher> mesh_edges;
-    size_t base_index = 0;
-    for (size_t i = 0; i < face_counts.size(); ++i) {
-        const int32_t face_vertex_count = face_counts[i];
+    // Prefix sums of the face counts give where each face starts in the face
+    // indices and in the triangle buffer, so the faces are independent.
+    const auto face_count = face_counts.size();
+    std::vector<size_t> face_offsets(face_count + 1);
+    std::vector<size_t> triangle_offsets(face_count + 1);
+    face_offsets[0] = 0;
+    triangle_offsets[0] = 0;
+    for (size_t i = 0; i < face_count; ++i) {
+        const auto face_vertex_count = size_t(std::max(face_counts[i], 0));
+        face_offsets[i + 1] = face_offsets[i] + face_vertex_count;
+        triangle_offsets[i + 1] = triangle_offsets[i] +
+            (face_vertex_count > 2 ? 3 * (face_vertex_count - 2) : 0);
+    }
+    if (face_offsets.back() > indices.size) {
+        out_triangle_indices.clear();
+        out_wireframe_indices.clear();
+        return;
+    }
 
-        // Triangulate this face and push the vertices to the triangle_buffer.
-        for (int32_t j = 2; j < face_vertex_count; ++j) {
-            out_triangle_indices.push_back(indices[base_index + 0]);
-            out_triangle_indices.push_back(indices[base_index + j - 1]);
-            out_triangle_indices.push_back(indices[base_index + j]);
-        }
+    // Triangulate each face as a fan, and list its edges in the same pass.
+    out_triangle_indices.resize(triangle_offsets.back());
+    std::vector<MeshEdge> mesh_edges(face_offsets.back());
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, face_count, kKernelGrainSize),
+        [&](const tbb::blocked_range<size_t>& range) {
+            for (auto i = range.begin(); i != range.end(); ++i) {
+                const auto base_index = face_offsets[i];
+                const auto face_vertex_count = face_offsets[i + 1] - base_index;
+                auto* triangle = out_triangle_indices.data() + triangle_offsets[i];
+                for (size_t j = 2; j < face_vertex_count; ++j) {
+                    *triangle++ = indices[base_index + 0];
+                    *triangle++ = indices[base_index + j - 1];
+                    *triangle++ = indices[base_index + j];
+                }
+                for (size_t j = 0; j < face_vertex_count; ++j) {
+                    mesh_edges[base_index + j] = MeshEdge(
+                        indices[base_index + j],
+                        indices[base_index + (j + 1) % face_vertex_count]);
+                }
+            }
+        });
+
+    // Edges shared by several faces are drawn once.
+    tbb::parallel_sort(mesh_edges.begin(), mesh_edges.end());
+    mesh_edges.erase(std::unique(mesh_edges.begin(), mesh_edges.end()), mesh_edges.end());
+
+    out_wireframe_indices.resize(2 * mesh_edges.size());
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, mesh_edges.size(), kKernelGrainSize),
+        [&](const tbb::blocked_range<size_t>& range) {
+            for (auto i = range.begin(); i != range.end(); ++i) {
+                out_wireframe_indices[2 * i + 0] = mesh_edges[i].index1;
+                out_wireframe_indices[2 * i + 1] = mesh_edges[i].index2;
+            }
+        });
+};
 
-        // Insert face edges to the mesh_edges hashset.
-        for (int32_t j = 0; j < face_vertex_count; ++j) {
-            const auto index1 = indices[base_index + j];
-            const auto index2 = indices[base_index + (j + 1) % face_vertex_count];
-            mesh_edges.insert({ index1, index2 });
-        }
+// Hash the key of sample `sample_index` of `property` into `digest`. The keys
+// are digests of the array contents, written to the file. Returns false if the
+// key is not available.
+bool combineArrayKey(size_t& digest, const Alembic::Abc::IArrayProperty& property, index_t sample_index)
+{
+    Alembic::AbcCoreAbstract::ArraySampleKey key;
+    if (!property.valid() || !property.getKey(key, Alembic::Abc::ISampleSelector(sample_index)))
+        return false;
+    boost::hash_combine(digest, key.digest.words[0]);
+    boost::hash_combine(digest, key.digest.words[1]);
+    boost::hash_combine(digest, key.numBytes);
+    return true;
+}
 
-        base_index += face_vertex_count;
-    }
+template <typename GeomParam>
+bool combineParamKeys(size_t& digest, const GeomParam& param, index_t sample_index)
+{
+    if (!param.valid())
+        return true;
+    if (param.isIndexed() && !combineArrayKey(digest, param.getIndexProperty(), sample_index))
+        return false;
+    return combineArrayKey(digest, param.getValueProperty(), sample_index);
+}
 
-    // Push edge indices to the wireframe_buffer.
-    out_wireframe_indices.clear();
-    for (const auto& edge : mesh_edges) {
-        out_wireframe_indices.push_back(edge.index1);
-        out_wireframe_indices.push_back(edge.index2);
-    }
-};
+template <typename SamplePtr>
+bool hasEndpointDigests(const InterpolationData<SamplePtr>& data)
+{
+    for (const auto& endpoint : data.endpoints)
+        if (endpoint && !endpoint->digest)
+            return false;
+    return true;
+}
+
+// The endpoints and, when interpolated, the alpha identify the interpolated
+// buffer.
+template <typename SamplePtr>
+void combineEndpointDigests(size_t& digest, const InterpolationData<SamplePtr>& data)
+{
+    for (const auto& endpoint : data.endpoints)
+        if (endpoint)
+            boost::hash_combine(digest, endpoint->digest);
+    if (data.endpoints[1])
+        boost::hash_combine(digest, data.alpha);
+}
 
 template <typename PropertyOrParam>
 std::pair<index_t, chrono_t> floorIndexAndTime(const PropertyOrParam& obj, chrono_t time)
@@ -586,8 +869,40 @@ std::pair<index_t, chrono_t> ceilIndexAndTime(const PropertyOrParam& obj, chrono
 
 } // unnamed namespace
 
+const char* meshKernelName(MeshKernel kernel)
+{
+    switch (kernel) {
+    case MeshKernel::INDEX_MAPPING: return "indexMapping";
+    case MeshKernel::TRIANGULATION: return "triangulation";
+    case MeshKernel::NORMALS: return "normals";
+    case MeshKernel::GATHER: return "gather";
+    default: return "unknown";
+    }
+}
+
+MeshKernelStats meshKernelStats(MeshKernel kernel)
+{
+    const auto& counters = g_mesh_kernel_counters[size_t(kernel)];
+    MeshKernelStats stats;
+    stats.calls = counters.calls;
+    stats.elements = counters.elements;
+    stats.seconds = double(counters.nanoseconds) * 1e-9;
+    return stats;
+}
+
+void resetMeshKernelStats()
+{
+    for (auto& counters : g_mesh_kernel_counters) {
+        counters.calls = 0;
+        counters.elements = 0;
+        counters.nanoseconds = 0;
+    }
+}
+
 void DrawableBufferSampler::sampleBuffers(chrono_t time, DrawableCacheHandles& out_handles, Box3f& out_bbox)
 {
+    tbb::mutex::scoped_lock guard(*m_mutex);
+
     // Get floor indices.
     // sidx: sample index.
 
@@ -633,7 +948,11 @@ void DrawableBufferSampler::sampleBuffers(chrono_t time, DrawableCacheHandles& o
                 UInt32ArraySamplePtr uvs_indices;
                 getParamSample(m_normals_param, geo_floor_sidx, normals_sample, &normals_indices);
                 getParamSample(m_uvs_param, uvs_floor_sidx, uvs_sample, &uvs_indices);
-                computeIndexMapping(*face_indices_sample, normals_indices, uvs_indices, index_mapping);
+                const MeshKernelTimer timer(MeshKernel::INDEX_MAPPING, face_indices_sample->size());
+                computeIndexMapping(face_indices_sample->get(),
+                    normals_indices ? normals_indices->get() : nullptr,
+                    uvs_indices ? uvs_indices->get() : nullptr,
+                    uint32_t(face_indices_sample->size()), index_mapping);
 
             } else {
                 // Clear index_mapping to indicate that the indices are not remapped.
@@ -648,6 +967,22 @@ void DrawableBufferSampler::sampleBuffers(chrono_t time, DrawableCacheHandles& o
                 index_buffer_sample->triangle_buffer,
                 index_buffer_sample->wireframe_buffer);
 
+            // Meshes without normals generate them every frame, from the
+            // same triangles around each vertex.
+            if (m_type == GeometryType::TRIANGLES && !m_normals_param.valid()) {
+                computeVertexTriangles(
+                    index_buffer_sample->triangle_buffer,
+                    index_buffer_sample->vertex_triangles);
+            }
+
+            // The index mapping depends on the normal and uv indices too,
+            // they are part of the geometry and texcoords digests.
+            size_t digest = 0;
+            if (combineArrayKey(digest, m_face_counts_property, indices_sidx) &&
+                combineArrayKey(digest, m_face_indices_property, indices_sidx)) {
+                index_buffer_sample->digest = digest;
+            }
+
             // Put the index sample into the cache.
             index_sample_ptr = m_index_buffer_cache.put(indices_sidx, index_buffer_sample.release());
         }
@@ -714,7 +1049,17 @@ void DrawableBufferSampler::sampleBuffers(chrono_t time, DrawableCacheHandles& o
         if (normals_sample) {
             fillBuffer(Span<const V3f>(normals_sample), normal_indices, geo_sample->normals);
         } else if (m_type == GeometryType::TRIANGLES && index_sample_ptr) {
-            generateNormals(index_sample_ptr->triangle_buffer, geo_sample->positions, geo_sample->normals);
+            generateNormals(
+                index_sample_ptr->triangle_buffer, index_sample_ptr->vertex_triangles,
+                geo_sample->positions, geo_sample->normals);
+        }
+
+        if (m_type == GeometryType::TRIANGLES) {
+            size_t digest = 0;
+            if (combineArrayKey(digest, m_positions_property, sample_index) &&
+                combineParamKeys(digest, m_normals_param, sample_index)) {
+                geo_sample->digest = digest;
+            }
         }
 
         return m_geometry_sample_cache.put(sample_index, geo_sample.release());
@@ -745,6 +1090,10 @@ void DrawableBufferSampler::sampleBuffers(chrono_t time, DrawableCacheHandles& o
             : Span<const uint32_t>();
         fillBuffer(Span<const V2f>(uvs_sample), uv_indices, texcoords_sample->uvs);
 
+        size_t digest = 0;
+        if (combineParamKeys(digest, m_uvs_param, sample_index))
+            texcoords_sample->digest = digest;
+
         return m_texcoords_sample_cache.put(sample_index, texcoords_sample.release());
     };
 
@@ -781,9 +1130,22 @@ void DrawableBufferSampler::sampleBuffers(chrono_t time, DrawableCacheHandles& o
         }
     }
 
+    // Interpolated buffers are identical if their endpoints and their alpha
+    // are, so the meshes sharing their samples keep the same digest, whether
+    // the time falls on a sample or between two.
+    size_t geometry_digest = 0;
+    const bool can_share = m_type == GeometryType::TRIANGLES && index_sample_ptr && index_sample_ptr->digest &&
+        out_geometry.endpoints[0] && hasEndpointDigests(out_geometry) && hasEndpointDigests(out_texcoords);
+    if (can_share) {
+        geometry_digest = index_sample_ptr->digest;
+        combineEndpointDigests(geometry_digest, out_geometry);
+        combineEndpointDigests(geometry_digest, out_texcoords);
+    }
+
     out_handles.indices = index_sample_ptr;
     out_handles.geometry = out_geometry;
     out_handles.texcoords = out_texcoords;
+    out_handles.geometry_digest = geometry_digest;
 
     out_bbox.makeEmpty();
     for (auto& geo : out_handles.geometry.endpoints)
@@ -791,11 +1153,29 @@ void DrawableBufferSampler::sampleBuffers(chrono_t time, DrawableCacheHandles& o
             out_bbox.extendBy(geo->bbox);
 }
 
-DrawableBufferSampler::DrawableBufferSampler(const Hierarchy::Node& node)
-    : m_topology_variance(Alembic::AbcGeom::MeshTopologyVariance::kConstantTopology)
+bool DrawableBufferSampler::sampleBounds(chrono_t time, Box3f& out_bounds)
+{
+    tbb::mutex::scoped_lock guard(*m_mutex);
+
+    if (!m_self_bounds_property.valid() || m_self_bounds_property.getNumSamples() == 0)
+        return false;
+    const auto bounds = m_self_bounds_property.getValue(
+        Alembic::Abc::ISampleSelector(time, Alembic::Abc::ISampleSelector::kFloorIndex));
+    out_bounds = Box3f(V3f(bounds.min), V3f(bounds.max));
+    return !out_bounds.isEmpty();
+}
+
+DrawableBufferSampler::DrawableBufferSampler(const Hierarchy::Node& node, const void* retention_owner)
+    : m_mutex(new tbb::mutex())
+    , m_topology_variance(Alembic::AbcGeom::MeshTopologyVariance::kConstantTopology)
     , m_normals_are_indexed(false)
     , m_uvs_are_indexed(false)
 {
+    auto& retention = sampleCacheRetention();
+    m_index_buffer_cache.setRetention(&retention, retention_owner, &sampleBytes);
+    m_geometry_sample_cache.setRetention(&retention, retention_owner, &sampleBytes);
+    m_texcoords_sample_cache.setRetention(&retention, retention_owner, &sampleBytes);
+
     if (node.type == Hierarchy::NodeType::POLYMESH) {
         m_type = GeometryType::TRIANGLES;
         auto schema = Alembic::AbcGeom::IPolyMesh(node.source_object).getSchema();
@@ -807,16 +1187,19 @@ DrawableBufferSampler::DrawableBufferSampler(const Hierarchy::Node& node)
         m_topology_variance = schema.getTopologyVariance();
         m_normals_are_indexed = m_normals_param.valid() && m_normals_param.getScope() == kFacevaryingScope;
         m_uvs_are_indexed = m_uvs_param.valid() && m_uvs_param.getScope() == kFacevaryingScope;
+        m_self_bounds_property = schema.getSelfBoundsProperty();
 
     } else if (node.type == Hierarchy::NodeType::CURVES) {
         m_type = GeometryType::LINES;
         auto schema = Alembic::AbcGeom::ICurves(node.source_object).getSchema();
         m_positions_property = schema.getPositionsProperty();
+        m_self_bounds_property = schema.getSelfBoundsProperty();
 
     } else if (node.type == Hierarchy::NodeType::POINTS) {
         m_type = GeometryType::POINTS;
         auto schema = Alembic::AbcGeom::IPoints(node.source_object).getSchema();
         m_positions_property = schema.getPositionsProperty();
+        m_self_bounds_property = schema.getSelfBoundsProperty();
 
     } else {
         abort();
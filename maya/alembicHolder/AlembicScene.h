@@ -2,12 +2,18 @@
 
 #include "Cache.h"
 #include "Foundation.h"
+#include "IndexMapping.h"
 #include <maya/MHWGeometry.h>
+#include <tbb/concurrent_vector.h>
 #include <tbb/mutex.h>
 #include <boost/range/iterator_range.hpp>
 #include <array>
+#include <atomic>
+#include <condition_variable>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
 
 namespace AlembicHolder {
 
@@ -30,26 +36,36 @@ public:
         NodeType type;
     };
 
-    // Read a hierarchy starting from top_object.
+    // Start a hierarchy at top_object, its levels are then read by
+    // expandLevel.
     // If geometry_path is not empty, cull everything which is not one of or
     // descendant of the nodes on the geometry_path.
     Hierarchy(Alembic::Abc::IObject top_object, const std::string& geometry_path = "");
 
+    // Read the children of the deepest level, appending them in BFS order.
+    // Returns false once there is no level left, or if cancelled is set
+    // meanwhile. Only one thread may expand the hierarchy.
+    bool expandLevel(const std::atomic<bool>& cancelled);
+
+    // The nodes whose children have been read. They are never modified
+    // again, so they can be published while the next levels are read.
+    NodeCount expandedNodeCount() const { return m_level_start; }
+    void publish(NodeCount node_count) { m_node_count.store(node_count, std::memory_order_release); }
+
     // Get node from node index.
     const Node& node(NodeID index) const { return m_nodes[index]; }
-    Node& node(NodeID index) { return m_nodes[index]; }
 
-    // Get total node count.
-    NodeCount nodeCount() const { return uint32_t(m_nodes.size()); }
+    // Get the published node count.
+    NodeCount nodeCount() const { return m_node_count.load(std::memory_order_acquire); }
 
     // Get the root node of the hierarchy.
     const Node& rootNode() const { return node(0); }
-    Node& rootNode() { return node(0); }
 
-    bool empty() const { return m_nodes.empty(); }
+    bool empty() const { return nodeCount() == 0; }
 
-    // Get an iterator range to the children of the given node.
-    typedef boost::iterator_range<std::vector<Node>::const_iterator> NodeRange;
+    // Get an iterator range to the children of the given node. The children
+    // of the deepest published level are not published yet.
+    typedef boost::iterator_range<tbb::concurrent_vector<Node>::const_iterator> NodeRange;
     NodeRange childrenOf(NodeID node_id) const { return childrenOf(node(node_id)); }
     NodeRange childrenOf(const Node& node) const {
         const auto start = m_nodes.begin() + node.children_start;
@@ -57,15 +73,23 @@ public:
     }
 
 private:
-    std::vector<Node> m_nodes;
+    // The nodes do not move as the hierarchy grows.
+    tbb::concurrent_vector<Node> m_nodes;
+    std::atomic<NodeCount> m_node_count;
+
+    // Only used by the expanding thread.
+    std::vector<std::string> m_path;
+    size_t m_depth;
+    NodeCount m_level_start;
 };
 
 class HierarchyNodeVisibility {
 public:
-    HierarchyNodeVisibility(Hierarchy& hierarchy);
+    // Get the visibility properties of the nodes up to node_count.
+    void extend(const Hierarchy& hierarchy, Hierarchy::NodeCount node_count);
     bool isNodeVisible(const Hierarchy::NodeID& node_id, const Alembic::Abc::ISampleSelector& ss) const;
 private:
-    std::vector<Alembic::AbcGeom::IVisibilityProperty> m_visibility_properties;
+    tbb::concurrent_vector<Alembic::AbcGeom::IVisibilityProperty> m_visibility_properties;
 };
 
 class HierarchyNodeCategories {
@@ -75,6 +99,12 @@ public:
 
     HierarchyNodeCategories(const Hierarchy& hierarchy);
 
+    // Categorize the nodes up to node_count. The new drawables are only
+    // counted by drawableCount once published.
+    void extend(Hierarchy::NodeCount node_count);
+    DrawableID categorizedDrawableCount() const { return DrawableID(m_drawables.size()); }
+    void publish() { m_drawable_count.store(categorizedDrawableCount(), std::memory_order_release); }
+
     // Returns:
     //  - the number of xforms with id < `node_id` if node `node_id` is an xform (aka the XformID).
     //  - the number of drawables with id < `node_id` if node `node_id` is a drawable (aba the DrawableID).
@@ -85,7 +115,9 @@ public:
     Hierarchy::NodeCount countByType(Hierarchy::NodeType type) const { return m_count_by_type[size_t(type)]; }
 
     bool isDrawable(const Hierarchy::Node& node) const;
-    Hierarchy::NodeCount drawableCount() const { return Hierarchy::NodeCount(m_drawables.size()); }
+    // Get the published drawable count.
+    Hierarchy::NodeCount drawableCount() const { return m_drawable_count.load(std::memory_order_acquire); }
+    const Hierarchy::Node& drawableNode(DrawableID drawable_id) const { return m_hierarchy.node(m_drawables[drawable_id]); }
 
     struct DrawableNodeRef {
         DrawableID drawable_id;
@@ -96,7 +128,7 @@ public:
     class DrawableIterator : public std::iterator<std::forward_iterator_tag, DrawableNodeRef> {
     public:
         value_type operator*() const {
-            return {m_drawable_id, m_parent.m_hierarchy.node(m_parent.m_drawables[m_drawable_id]) };
+            return {m_drawable_id, m_parent.drawableNode(m_drawable_id) };
         }
         DrawableIterator& operator++() { m_drawable_id++; return *this; }
         bool operator!=(const DrawableIterator& rhs) const { return m_drawable_id != rhs.m_drawable_id; }
@@ -107,7 +139,6 @@ public:
         DrawableIterator(const HierarchyNodeCategories& parent, DrawableID drawable_id)
             : m_parent(parent), m_drawable_id(drawable_id) {}
     };
-    friend class DrawableIterator;
 
     typedef boost::iterator_range<DrawableIterator> Drawables;
     Drawables drawables() const {
@@ -116,27 +147,34 @@ public:
 
 private:
     const Hierarchy& m_hierarchy;
-    std::array<Hierarchy::NodeCount, size_t(Hierarchy::NodeType::NUM_TYPES)> m_count_by_type;
-    std::vector<Hierarchy::NodeID> m_drawables;
-    std::vector<Hierarchy::NodeCount> m_category_index;
+    std::array<std::atomic<Hierarchy::NodeCount>, size_t(Hierarchy::NodeType::NUM_TYPES)> m_count_by_type;
+    tbb::concurrent_vector<Hierarchy::NodeID> m_drawables;
+    tbb::concurrent_vector<Hierarchy::NodeCount> m_category_index;
+    std::atomic<DrawableID> m_drawable_count;
 };
 
 
 // === Geometry sampling =======================================================
 
-// Maps vertex buffer index to indices indexing into the respective Alembic
-// sample arrays.
-struct IndexMapping {
-    std::vector<int32_t> vertex_index_from_face_index;
-    std::vector<int32_t> position_indices;
-    std::vector<uint32_t> normal_indices;
-    std::vector<uint32_t> uv_indices;
+// The triangles around each vertex, used to generate normals: vertex i is
+// used by the triangles listed from triangles[offsets[i]] to
+// triangles[offsets[i + 1]] excluded, in index buffer order.
+struct VertexTriangles {
+    std::vector<uint32_t> offsets;
+    std::vector<uint32_t> triangles;
 };
 
+// The digest of a sample hashes the keys of the Alembic arrays it is built
+// from, so samples with equal digests hold identical buffers. 0 if unknown.
+
 struct IndexBufferSample {
     std::vector<uint32_t> triangle_buffer;
     std::vector<uint32_t> wireframe_buffer;
     IndexMapping index_mapping;
+    // Only built for meshes without authored normals.
+    VertexTriangles vertex_triangles;
+    size_t digest;
+    IndexBufferSample() : digest(0) {}
 };
 typedef Cache<index_t, IndexBufferSample> IndexBufferSampleCache;
 typedef IndexBufferSampleCache::ValuePtr IndexBufferSamplePtr;
@@ -147,10 +185,14 @@ struct GeometrySample {
     std::vector<V3f> normals;
     std::vector<V3f> tangents;
     std::vector<V3f> bitangents;
+    size_t digest;
+    GeometrySample() : digest(0) {}
 };
 
 struct TexCoordsSample {
     std::vector<V2f> uvs;
+    size_t digest;
+    TexCoordsSample() : digest(0) {}
 };
 
 typedef Cache<index_t, GeometrySample> GeometrySampleCache;
@@ -158,6 +200,51 @@ typedef GeometrySampleCache::ValuePtr GeometrySamplePtr;
 typedef Cache<index_t, TexCoordsSample> TexCoordsSampleCache;
 typedef TexCoordsSampleCache::ValuePtr TexCoordsSamplePtr;
 
+// Memory held by the buffers of a sample.
+template <typename T>
+inline size_t vectorBytes(const std::vector<T>& v) { return v.capacity() * sizeof(T); }
+
+inline size_t sampleBytes(const IndexBufferSample& sample)
+{
+    return vectorBytes(sample.triangle_buffer) + vectorBytes(sample.wireframe_buffer) +
+        vectorBytes(sample.index_mapping.vertex_index_from_face_index) +
+        vectorBytes(sample.index_mapping.position_indices) +
+        vectorBytes(sample.index_mapping.normal_indices) +
+        vectorBytes(sample.index_mapping.uv_indices) +
+        vectorBytes(sample.vertex_triangles.offsets) +
+        vectorBytes(sample.vertex_triangles.triangles);
+}
+inline size_t sampleBytes(const GeometrySample& sample)
+{
+    return vectorBytes(sample.positions) + vectorBytes(sample.normals) +
+        vectorBytes(sample.tangents) + vectorBytes(sample.bitangents);
+}
+inline size_t sampleBytes(const TexCoordsSample& sample) { return vectorBytes(sample.uvs); }
+
+// Retains the recently used index, geometry and texcoords samples of all the
+// scenes.
+CacheRetention& sampleCacheRetention();
+
+// The kernels building the buffers of the samples. Their timings are summed
+// over all the scenes; calls running concurrently on several threads each
+// count their own wall time.
+enum class MeshKernel {
+    INDEX_MAPPING,
+    TRIANGULATION,
+    NORMALS,
+    GATHER,
+    COUNT
+};
+struct MeshKernelStats {
+    uint64_t calls;
+    // Face vertices, face vertices, vertices and gathered values.
+    uint64_t elements;
+    double seconds;
+};
+const char* meshKernelName(MeshKernel kernel);
+MeshKernelStats meshKernelStats(MeshKernel kernel);
+void resetMeshKernelStats();
+
 template <typename T>
 struct InterpolationData {
     T endpoints[2];
@@ -187,36 +274,107 @@ struct DrawableCacheHandles {
     // sample to use.
     InterpolationData<GeometrySamplePtr> geometry;
     InterpolationData<TexCoordsSamplePtr> texcoords;
+    // Equal for the meshes with identical buffers, which can then be drawn as
+    // instances of each other. Interpolated meshes are identical when they
+    // have the same endpoints and alpha. 0 if unknown.
+    size_t geometry_digest;
+    DrawableCacheHandles() : geometry_digest(0) {}
+};
+
+// Level of detail of a visible drawable.
+enum class DrawableLOD : uint8_t {
+    FULL,
+    // Too small on screen, drawn as a proxy.
+    PROXY,
+    // Out of the view.
+    CULLED
+};
+
+// Chooses the level of detail of the drawables from their bounds in the views
+// the holder is drawn in. The drawables are shared by all the views, so a
+// drawable is only culled if it is out of all of them, and only drawn as a
+// proxy if it is small or out in all of them.
+struct ViewFilter {
+    struct View {
+        // Holder space to clip space.
+        Imath::M44f view_projection;
+        float viewport_width;
+        float viewport_height;
+
+        View() : viewport_width(0), viewport_height(0) {}
+        bool operator==(const View& rhs) const
+        {
+            return view_projection == rhs.view_projection &&
+                viewport_width == rhs.viewport_width && viewport_height == rhs.viewport_height;
+        }
+        bool operator!=(const View& rhs) const { return !(*this == rhs); }
+    };
+    std::vector<View> views;
+    bool culling;
+    // Drawables whose projected bounds are smaller than this in pixels are
+    // drawn as proxies, 0 disables the proxies.
+    float proxy_screen_size;
+    // Drawables always at full detail, by drawable id.
+    std::vector<bool> always_full;
+
+    ViewFilter() : culling(false), proxy_screen_size(0) {}
+    bool enabled() const { return culling || proxy_screen_size > 0; }
+    // bounds are in holder space.
+    DrawableLOD classify(uint32_t drawable_id, const Box3f& bounds) const;
+
+    bool operator==(const ViewFilter& rhs) const
+    {
+        return views == rhs.views &&
+            culling == rhs.culling && proxy_screen_size == rhs.proxy_screen_size &&
+            always_full == rhs.always_full;
+    }
+    bool operator!=(const ViewFilter& rhs) const { return !(*this == rhs); }
+
+private:
+    DrawableLOD classifyInView(const View& view, const Box3f& bounds) const;
 };
 
 // The purpose of this struct is to keep a reference to cached buffers needed to
 // compute any data needed by visualization.
+// Drawables not at full detail hold no buffers, their bbox holds the bounds
+// stored in the Alembic file.
 struct DrawableSample {
     Imath::M44f world_matrix;
     Imath::Box3f bbox;
     uint32_t drawable_id;
     bool visible;
+    DrawableLOD lod;
 
     GeometryType type;
     DrawableCacheHandles cache_handles;
 
-    DrawableSample() : drawable_id(Hierarchy::INVALID_INDEX), visible(false), type(GeometryType::POINTS) {}
+    DrawableSample() : drawable_id(Hierarchy::INVALID_INDEX), visible(false), lod(DrawableLOD::FULL), type(GeometryType::POINTS) {}
 };
 typedef std::vector<DrawableSample> DrawableSampleVector;
 
 class DrawableBufferSampler {
 public:
-    DrawableBufferSampler(const Hierarchy::Node& node);
+    // The decoded samples are retained on behalf of retention_owner.
+    DrawableBufferSampler(const Hierarchy::Node& node, const void* retention_owner);
+
+    // Thread safe, the samplers of different drawables can be used concurrently.
     void sampleBuffers(chrono_t time, DrawableCacheHandles& out_handles, Box3f& out_bbox);
+    // Read the bounds stored in the file, without decoding the geometry.
+    // Returns false if the file has none.
+    bool sampleBounds(chrono_t time, Box3f& out_bounds);
     GeometryType geometryType() const { return m_type; }
 
 private:
+    // Guards the caches. Held by pointer so that the sampler stays movable.
+    std::unique_ptr<tbb::mutex> m_mutex;
+
     GeometryType m_type;
     Alembic::AbcGeom::IInt32ArrayProperty m_face_counts_property;
     Alembic::AbcGeom::IInt32ArrayProperty m_face_indices_property;
     Alembic::AbcGeom::IP3fArrayProperty m_positions_property;
     Alembic::AbcGeom::IN3fGeomParam m_normals_param;
     Alembic::AbcGeom::IV2fGeomParam m_uvs_param;
+    Alembic::AbcGeom::IBox3dProperty m_self_bounds_property;
 
     Alembic::AbcGeom::MeshTopologyVariance m_topology_variance;
     bool m_normals_are_indexed;
@@ -264,8 +422,6 @@ struct StaticMaterial {
     std::string diffuse_texture_path;
 };
 
-typedef std::vector<StaticMaterial> StaticMaterialVector;
-
 
 struct AlembicLoadFailedException {};
 
@@ -280,10 +436,30 @@ struct HierarchyStat {
 
 class AlembicScene {
 public:
+    // The hierarchy is read level by level on a background thread, the scene
+    // only shows the levels read so far.
     AlembicScene(const AlembicSceneKey& scene_key);
+    ~AlembicScene();
+
+    // True until the last level of the hierarchy is published.
+    bool isLoading() const { return m_loading; }
+    void waitUntilLoaded();
 
     // Sample geometry of each drawable in the hierarchy at time 'time'.
-    void sampleHierarchy(chrono_t time, DrawableSampleVector& out_samples, HierarchyStat& out_hierarchy_stat);
+    // The drawables are sampled in parallel, each sampler has its own lock so
+    // several holders can sample the same scene at once.
+    // If a filter is given, only the bounds of the drawables it does not keep
+    // at full detail are sampled.
+    // While loading, the bounds stored for the whole archive stand in for the
+    // drawables not read yet.
+    void sampleHierarchy(chrono_t time, DrawableSampleVector& out_samples, HierarchyStat& out_hierarchy_stat,
+        const ViewFilter* filter = nullptr);
+
+    // Apply a new filter to samples taken at 'time': the drawables getting
+    // full detail are decoded, the others release their buffers. Returns true
+    // if any sample changed.
+    bool refineHierarchySample(chrono_t time, const ViewFilter* filter, DrawableSampleVector& samples,
+        HierarchyStat& hierarchy_stat);
 
     const Hierarchy& hierarchy() const { return m_hierarchy; }
     const HierarchyNodeCategories& nodeCategories() const { return m_categories; }
@@ -292,25 +468,40 @@ public:
     {
         return m_drawable_names[drawable_id];
     }
-    const StaticMaterial& getStaticMaterial(HierarchyNodeCategories::DrawableID drawable_id) const
-    {
-        return m_static_materials[drawable_id];
-    }
-    const StaticMaterialVector& staticMaterials() const { return m_static_materials; }
+    // Read from the file on first use.
+    const StaticMaterial& getStaticMaterial(HierarchyNodeCategories::DrawableID drawable_id) const;
 
 private:
+    void load();
+    void sampleDrawables(chrono_t time, const std::vector<HierarchyNodeCategories::DrawableID>& drawable_ids,
+        DrawableSampleVector& samples);
+    void addArchiveBounds(chrono_t time, HierarchyStat& hierarchy_stat) const;
+
     // The order of these declaration matter. If the construction of something
     // depends on another object, the dependent should be declared later.
     Hierarchy m_hierarchy;
     HierarchyNodeCategories m_categories;
     HierarchyNodeVisibility m_visibility;
-    std::vector<std::string> m_drawable_names;
+    tbb::concurrent_vector<std::string> m_drawable_names;
+    Alembic::AbcGeom::IBox3dProperty m_archive_bounds;
 
     // Per-drawable diffuse color and texture read from the Alembic file.
-    StaticMaterialVector m_static_materials;
+    struct LazyStaticMaterial {
+        StaticMaterial material;
+        bool read;
+        LazyStaticMaterial() : read(false) {}
+    };
+    mutable tbb::concurrent_vector<LazyStaticMaterial> m_static_materials;
+    mutable tbb::mutex m_static_materials_mutex;
+
+    tbb::concurrent_vector<DrawableBufferSampler> m_samplers;
 
-    std::vector<DrawableBufferSampler> m_samplers;
-    tbb::mutex m_mutex;
+    // The loading thread is declared last, it uses everything above.
+    std::atomic<bool> m_loading;
+    std::atomic<bool> m_stop_loading;
+    std::mutex m_loading_mutex;
+    std::condition_variable m_loading_condition;
+    std::thread m_loading_thread;
 };
 
 typedef std::shared_ptr<AlembicScene> AlembicScenePtr;
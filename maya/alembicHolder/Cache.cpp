@@ -0,0 +1,102 @@
+#include "Cache.h"
+
+namespace AlembicHolder {
+
+CacheRetention::CacheRetention(size_t budget)
+    : m_bytes(0), m_budget(budget), m_hits(0), m_misses(0), m_evictions(0)
+{}
+
+void CacheRetention::retain(const void* owner, const std::shared_ptr<void>& value, size_t bytes)
+{
+    std::vector<std::shared_ptr<void>> released;
+    {
+        tbb::mutex::scoped_lock guard(m_mutex);
+        if (m_entry_from_value.count(value.get()))
+            return;
+        m_entries.push_front({owner, value, bytes});
+        m_entry_from_value[value.get()] = m_entries.begin();
+        m_bytes += bytes;
+        evict(released);
+    }
+}
+
+void CacheRetention::touch(const void* value)
+{
+    tbb::mutex::scoped_lock guard(m_mutex);
+    auto it = m_entry_from_value.find(value);
+    if (it != m_entry_from_value.end())
+        m_entries.splice(m_entries.begin(), m_entries, it->second);
+}
+
+void CacheRetention::releaseOwner(const void* owner)
+{
+    std::vector<std::shared_ptr<void>> released;
+    {
+        tbb::mutex::scoped_lock guard(m_mutex);
+        for (auto it = m_entries.begin(); it != m_entries.end();) {
+            if (it->owner == owner) {
+                m_bytes -= it->bytes;
+                m_entry_from_value.erase(it->value.get());
+                released.push_back(std::move(it->value));
+                it = m_entries.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+}
+
+void CacheRetention::releaseAll()
+{
+    EntryList released;
+    {
+        tbb::mutex::scoped_lock guard(m_mutex);
+        released.swap(m_entries);
+        m_entry_from_value.clear();
+        m_bytes = 0;
+    }
+}
+
+void CacheRetention::resetCounters()
+{
+    m_hits = 0;
+    m_misses = 0;
+    m_evictions = 0;
+}
+
+void CacheRetention::setBudget(size_t budget)
+{
+    std::vector<std::shared_ptr<void>> released;
+    {
+        tbb::mutex::scoped_lock guard(m_mutex);
+        m_budget = budget;
+        evict(released);
+    }
+}
+
+CacheRetention::Stats CacheRetention::stats() const
+{
+    Stats res;
+    res.hits = m_hits;
+    res.misses = m_misses;
+    res.evictions = m_evictions;
+    tbb::mutex::scoped_lock guard(m_mutex);
+    res.entries = m_entries.size();
+    res.bytes = m_bytes;
+    res.budget = m_budget;
+    return res;
+}
+
+void CacheRetention::evict(std::vector<std::shared_ptr<void>>& released)
+{
+    while (m_bytes > m_budget && !m_entries.empty()) {
+        auto& entry = m_entries.back();
+        m_bytes -= entry.bytes;
+        m_entry_from_value.erase(entry.value.get());
+        released.push_back(std::move(entry.value));
+        m_entries.pop_back();
+        ++m_evictions;
+    }
+}
+
+} // namespace AlembicHolder
@@ -1,27 +1,115 @@
 #pragma once
 
+#include <tbb/mutex.h>
+#include <atomic>
+#include <list>
 #include <memory>
 #include <unordered_map>
+#include <vector>
 #include <cstdint>
 
 
 namespace AlembicHolder {
 
+// Keeps the most recently used values of several caches alive up to a memory
+// budget. The caches only hold weak pointers, without retention a value is
+// freed as soon as no drawable uses it and is decoded again when the time
+// comes back to it.
+// Each retained value belongs to an owner (a scene). The owner must release
+// its values before its caches are destroyed.
+class CacheRetention {
+public:
+    struct Stats {
+        size_t hits;
+        size_t misses;
+        size_t evictions;
+        size_t entries;
+        size_t bytes;
+        size_t budget;
+    };
+
+    CacheRetention(size_t budget);
+
+    // Keep value alive, evicting the least recently used values if the budget
+    // is exceeded.
+    void retain(const void* owner, const std::shared_ptr<void>& value, size_t bytes);
+    // Mark value as the most recently used one.
+    void touch(const void* value);
+    void releaseOwner(const void* owner);
+    void releaseAll();
+
+    void countHit() { ++m_hits; }
+    void countMiss() { ++m_misses; }
+    void resetCounters();
+
+    void setBudget(size_t budget);
+    Stats stats() const;
+
+private:
+    struct Entry {
+        const void* owner;
+        std::shared_ptr<void> value;
+        size_t bytes;
+    };
+    typedef std::list<Entry> EntryList;
+
+    // Called with the lock held. The evicted values are moved to released,
+    // they must be destroyed after the lock is released since their deleters
+    // lock their caches.
+    void evict(std::vector<std::shared_ptr<void>>& released);
+
+    mutable tbb::mutex m_mutex;
+    // Most recently used first.
+    EntryList m_entries;
+    std::unordered_map<const void*, EntryList::iterator> m_entry_from_value;
+    size_t m_bytes;
+    size_t m_budget;
+
+    std::atomic<size_t> m_hits;
+    std::atomic<size_t> m_misses;
+    std::atomic<size_t> m_evictions;
+};
+
 template <
     typename Key, typename Value,
     typename KeyHash = std::hash<Key>, typename KeyEq = std::equal_to<Key>,
     typename ValueDeleter = std::default_delete<Value>>
 class Cache {
 public:
-    Cache(ValueDeleter value_deleter = ValueDeleter()) : m_value_deleter(value_deleter) {}
+    Cache(ValueDeleter value_deleter = ValueDeleter())
+        : m_mutex(new tbb::mutex()), m_value_deleter(value_deleter)
+        , m_retention(nullptr), m_retention_owner(nullptr), m_value_bytes(nullptr) {}
+
+    // Retain the values put in this cache in retention, on behalf of owner.
+    // value_bytes returns the memory held by a value.
+    void setRetention(CacheRetention* retention, const void* owner, size_t (*value_bytes)(const Value&))
+    {
+        m_retention = retention;
+        m_retention_owner = owner;
+        m_value_bytes = value_bytes;
+    }
 
+    // The values may be released from any thread, so every access to the map
+    // is locked.
     typedef std::shared_ptr<Value> ValuePtr;
     ValuePtr get(const Key& key) const
     {
-        auto it = m_map.find(key);
-        if (it == m_map.end())
-            return nullptr;
-        return it->second.lock();
+        ValuePtr ptr;
+        {
+            tbb::mutex::scoped_lock guard(*m_mutex);
+            auto it = m_map.find(key);
+            if (it != m_map.end())
+                ptr = it->second.lock();
+        }
+        if (m_retention) {
+            if (ptr) {
+                m_retention->countHit();
+                m_retention->touch(ptr.get());
+            } else {
+                m_retention->countMiss();
+            }
+        }
+        return ptr;
     }
 
     // Will take ownership of raw_ptr.
@@ -29,11 +117,16 @@ public:
     {
         auto ptr = ValuePtr(raw_ptr,
             [this, key](Value* ptr) {
-                erase(key);
+                eraseExpired(key);
                 m_value_deleter(ptr);
             });
         raw_ptr = nullptr;
-        m_map[key] = ptr;
+        {
+            tbb::mutex::scoped_lock guard(*m_mutex);
+            m_map[key] = ptr;
+        }
+        if (m_retention)
+            m_retention->retain(m_retention_owner, ptr, m_value_bytes(*ptr));
         return ptr;
     }
 
@@ -45,13 +138,29 @@ public:
 
     void erase(const Key& key)
     {
+        tbb::mutex::scoped_lock guard(*m_mutex);
         m_map.erase(key);
     }
 
 private:
+    // Called by the deleter of a value. Another thread may have put a new
+    // value for the same key meanwhile, it must be kept.
+    void eraseExpired(const Key& key)
+    {
+        tbb::mutex::scoped_lock guard(*m_mutex);
+        auto it = m_map.find(key);
+        if (it != m_map.end() && it->second.expired())
+            m_map.erase(it);
+    }
+
     typedef std::weak_ptr<Value> WPtr;
+    std::unique_ptr<tbb::mutex> m_mutex;
     std::unordered_map<Key, WPtr, KeyHash, KeyEq> m_map;
     ValueDeleter m_value_deleter;
+
+    CacheRetention* m_retention;
+    const void* m_retention_owner;
+    size_t (*m_value_bytes)(const Value&);
 };
 
 } // namespace AlembicHolder
@@ -136,6 +136,11 @@ inline MBoundingBox mayaFromImath(const Imath::Box<T>& bbox)
     return MBoundingBox(mayaFromImath(bbox.min), mayaFromImath(bbox.max));
 }
 
+inline Imath::M44d imathFromMaya(const MMatrix& m)
+{
+    return Imath::M44d(m.matrix);
+}
+
 //-*****************************************************************************
 //-*****************************************************************************
 // GL ERROR CHECKING
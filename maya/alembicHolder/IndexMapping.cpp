@@ -0,0 +1,103 @@
+#include "IndexMapping.h"
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#include <tbb/parallel_sort.h>
+#include <tuple>
+
+namespace AlembicHolder {
+
+namespace {
+
+// The Alembic FaceIndices property is an array of int32s, but the normal
+// and UV index properties are arrays of uint32s. Why? Dunno. Ask the
+// designers of the Alembic library.
+struct FaceVertexRecord {
+    int32_t position_index;
+    uint32_t normal_index;
+    uint32_t uv_index;
+    uint32_t face_vertex;
+    bool sameTriplet(const FaceVertexRecord& rhs) const
+    {
+        return position_index == rhs.position_index &&
+            normal_index == rhs.normal_index &&
+            uv_index == rhs.uv_index;
+    }
+    // Ordered by triplet, then by face vertex.
+    bool operator<(const FaceVertexRecord& rhs) const
+    {
+        return std::tie(position_index, normal_index, uv_index, face_vertex) <
+            std::tie(rhs.position_index, rhs.normal_index, rhs.uv_index, rhs.face_vertex);
+    }
+};
+
+} // unnamed namespace
+
+void computeIndexMapping(
+    const int32_t* face_indices,
+    const uint32_t* normal_indices,
+    const uint32_t* uv_indices,
+    uint32_t face_vertex_count,
+    IndexMapping& output)
+{
+    // Sort the face vertices by triplet, then by face vertex index. The order
+    // is total, so the result does not depend on how the sort is split
+    // between threads, and each run of equal triplets starts with the first
+    // face vertex using it.
+    std::vector<FaceVertexRecord> records(face_vertex_count);
+    tbb::parallel_for(tbb::blocked_range<uint32_t>(0, face_vertex_count),
+        [&](const tbb::blocked_range<uint32_t>& range) {
+            for (auto i = range.begin(); i != range.end(); ++i) {
+                auto& record = records[i];
+                record.position_index = face_indices[i];
+                record.normal_index = normal_indices ? normal_indices[i] : uint32_t(record.position_index);
+                record.uv_index = uv_indices ? uv_indices[i] : uint32_t(record.position_index);
+                record.face_vertex = i;
+            }
+        });
+    tbb::parallel_sort(records.begin(), records.end());
+
+    // Link each face vertex to the first face vertex with the same triplet.
+    std::vector<uint32_t> first_face_vertex(face_vertex_count);
+    for (uint32_t i = 0; i < face_vertex_count;) {
+        const auto& first = records[i];
+        for (; i < face_vertex_count && records[i].sameTriplet(first); ++i)
+            first_face_vertex[records[i].face_vertex] = first.face_vertex;
+    }
+
+    // Number the vertices in the order of their first face vertex.
+    std::vector<uint32_t> vertex_index_from_first(face_vertex_count);
+    uint32_t vertex_count = 0;
+    for (uint32_t i = 0; i < face_vertex_count; ++i) {
+        if (first_face_vertex[i] == i)
+            vertex_index_from_first[i] = vertex_count++;
+    }
+
+    output.vertex_index_from_face_index.resize(face_vertex_count);
+    output.position_indices.resize(vertex_count);
+    if (normal_indices)
+        output.normal_indices.resize(vertex_count);
+    else
+        output.normal_indices.clear();
+    if (uv_indices)
+        output.uv_indices.resize(vertex_count);
+    else
+        output.uv_indices.clear();
+
+    tbb::parallel_for(tbb::blocked_range<uint32_t>(0, face_vertex_count),
+        [&](const tbb::blocked_range<uint32_t>& range) {
+            for (auto i = range.begin(); i != range.end(); ++i) {
+                const auto first = first_face_vertex[i];
+                const auto vertex_index = vertex_index_from_first[first];
+                output.vertex_index_from_face_index[i] = vertex_index;
+                if (first != i)
+                    continue;
+                output.position_indices[vertex_index] = face_indices[i];
+                if (normal_indices)
+                    output.normal_indices[vertex_index] = normal_indices[i];
+                if (uv_indices)
+                    output.uv_indices[vertex_index] = uv_indices[i];
+            }
+        });
+}
+
+} // namespace AlembicHolder
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Only depends on the standard library and TBB, so that it can be built and
+// checked out of Maya.
+
+namespace AlembicHolder {
+
+// Maps vertex buffer index to indices indexing into the respective Alembic
+// sample arrays.
+struct IndexMapping {
+    std::vector<int32_t> vertex_index_from_face_index;
+    std::vector<int32_t> position_indices;
+    std::vector<uint32_t> normal_indices;
+    std::vector<uint32_t> uv_indices;
+};
+
+// If normals or uvs are faceVarying, a mapping from face indices to
+// vertex buffer indices has to be computed.
+// Each unique position, normal and uv triplet gets a vertex, numbered in the
+// order of the first face vertex using it. normal_indices and uv_indices may
+// be null, they then follow the face indices.
+void computeIndexMapping(
+    const int32_t* face_indices,
+    const uint32_t* normal_indices,
+    const uint32_t* uv_indices,
+    uint32_t face_vertex_count,
+    IndexMapping& output);
+
+} // namespace AlembicHolder
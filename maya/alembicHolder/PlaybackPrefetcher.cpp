@@ -0,0 +1,179 @@
+#include "PlaybackPrefetcher.h"
+#include <cmath>
+#include <unordered_set>
+
+namespace AlembicHolder {
+
+namespace {
+
+// Fraction of a frame under which two times are considered the same frame.
+const double kFrameTolerance = 1e-3;
+
+template <typename T>
+void addBufferBytes(const std::shared_ptr<T>& ptr, std::unordered_set<const void*>& seen, size_t& bytes)
+{
+    if (ptr && seen.insert(ptr.get()).second)
+        bytes += sampleBytes(*ptr);
+}
+
+} // unnamed namespace
+
+PlaybackPrefetcher::PlaybackPrefetcher()
+    : m_request_id(0)
+    , m_stop(false)
+    , m_last_time(-std::numeric_limits<chrono_t>::infinity())
+    , m_direction(0)
+    , m_pinned_bytes(0)
+{}
+
+PlaybackPrefetcher::~PlaybackPrefetcher()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_condition.notify_one();
+    if (m_thread.joinable())
+        m_thread.join();
+}
+
+void PlaybackPrefetcher::update(const AlembicScenePtr& scene, chrono_t time, chrono_t frame_duration, const PrefetchSettings& settings)
+{
+    // Steps of up to the prefetched window are playback (possibly dropping
+    // frames), bigger jumps are scrubbing and stop the prefetch until the
+    // time advances again.
+    const auto delta = time - m_last_time;
+    if (delta != 0) {
+        const bool is_playback = std::abs(delta) <= settings.frame_count * frame_duration;
+        m_direction = is_playback ? (delta > 0 ? 1 : -1) : 0;
+    }
+    m_last_time = time;
+
+    Request request;
+    if (scene && settings.frame_count > 0 && frame_duration > 0) {
+        const int direction = settings.detect_direction ? m_direction : 1;
+        request.step = direction * frame_duration;
+    }
+    if (request.step != 0) {
+        request.scene = scene;
+        request.time = time;
+        request.frame_count = settings.frame_count;
+        request.memory_budget = settings.memory_budget;
+        request.view_filter = settings.view_filter;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        const auto& current = m_request;
+        if (request.scene == current.scene && request.time == current.time && request.step == current.step &&
+            request.frame_count == current.frame_count && request.memory_budget == current.memory_budget &&
+            request.view_filter == current.view_filter) {
+            return;
+        }
+        m_request = request;
+        ++m_request_id;
+    }
+
+    // The worker is started by the first request with something to prefetch
+    // so that holders without prefetch don't own a thread.
+    if (!m_thread.joinable()) {
+        if (!request.scene)
+            return;
+        m_thread = std::thread(&PlaybackPrefetcher::run, this);
+    }
+    m_condition.notify_one();
+}
+
+void PlaybackPrefetcher::run()
+{
+    uint64_t done_id = 0;
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+        m_condition.wait(lock, [this, &done_id] { return m_stop || m_request_id != done_id; });
+        if (m_stop)
+            break;
+
+        const auto request = m_request;
+        done_id = m_request_id;
+        lock.unlock();
+        prefetch(request, done_id);
+        lock.lock();
+    }
+    lock.unlock();
+
+    m_pinned_frames.clear();
+    m_pinned_scene.reset();
+    m_pinned_bytes = 0;
+}
+
+bool PlaybackPrefetcher::isAbandoned(uint64_t request_id)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stop || m_request_id != request_id;
+}
+
+void PlaybackPrefetcher::prefetch(const Request& request, uint64_t request_id)
+{
+    // The handles must not survive the caches of their scene.
+    if (request.scene != m_pinned_scene) {
+        m_pinned_frames.clear();
+        m_pinned_scene = request.scene;
+    }
+
+    // Release the frames out of the new window, keep the others.
+    for (auto it = m_pinned_frames.begin(); it != m_pinned_frames.end();) {
+        const auto offset = (it->first - request.time) / request.step;
+        const auto frame = std::round(offset);
+        const bool in_window = frame >= 1 && frame <= request.frame_count &&
+            std::abs(offset - frame) < kFrameTolerance;
+        if (in_window)
+            ++it;
+        else
+            it = m_pinned_frames.erase(it);
+    }
+    updatePinnedBytes();
+
+    if (!m_pinned_scene)
+        return;
+
+    // Nearest frames first, so a new request abandons the farthest ones.
+    const auto tolerance = std::abs(request.step) * kFrameTolerance;
+    for (int frame = 1; frame <= request.frame_count; ++frame) {
+        if (m_pinned_bytes >= request.memory_budget || isAbandoned(request_id))
+            break;
+
+        const auto time = request.time + frame * request.step;
+        const auto it = m_pinned_frames.lower_bound(time - tolerance);
+        if (it != m_pinned_frames.end() && it->first < time + tolerance)
+            continue;
+
+        // The decoded buffers go to the caches of the samplers, the holder
+        // finds them there when it samples this time.
+        DrawableSampleVector samples;
+        HierarchyStat hierarchy_stat;
+        m_pinned_scene->sampleHierarchy(time, samples, hierarchy_stat, &request.view_filter);
+        m_pinned_frames[time] = std::move(samples);
+        updatePinnedBytes();
+    }
+}
+
+void PlaybackPrefetcher::updatePinnedBytes()
+{
+    // Buffers of static or slow moving drawables are shared by several frames,
+    // count each of them once.
+    std::unordered_set<const void*> seen;
+    size_t bytes = 0;
+    for (const auto& pinned_frame : m_pinned_frames) {
+        for (const auto& sample : pinned_frame.second) {
+            const auto& handles = sample.cache_handles;
+            addBufferBytes(handles.indices, seen, bytes);
+            for (const auto& endpoint : handles.geometry.endpoints)
+                addBufferBytes(endpoint, seen, bytes);
+            for (const auto& endpoint : handles.texcoords.endpoints)
+                addBufferBytes(endpoint, seen, bytes);
+        }
+    }
+    m_pinned_bytes = bytes;
+}
+
+} // namespace AlembicHolder
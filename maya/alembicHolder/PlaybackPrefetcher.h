@@ -0,0 +1,83 @@
+#pragma once
+
+#include "AlembicScene.h"
+#include <atomic>
+#include <condition_variable>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <thread>
+
+namespace AlembicHolder {
+
+struct PrefetchSettings {
+    // Number of frames sampled ahead of the current time, 0 disables the
+    // prefetch.
+    int frame_count;
+    // If true, frames are only prefetched while the time advances by small
+    // steps, in the direction it moves. Otherwise they are always prefetched
+    // forward.
+    bool detect_direction;
+    // No more frames are pinned once their buffers take more than this.
+    size_t memory_budget;
+    // The drawables the holder does not decode are not prefetched either.
+    ViewFilter view_filter;
+    PrefetchSettings() : frame_count(0), detect_direction(true), memory_budget(size_t(512) << 20) {}
+};
+
+// Samples the frames following the current time on a background thread and
+// keeps their cache handles alive, so the buffers are already decoded when the
+// playback reaches them.
+class PlaybackPrefetcher {
+public:
+    PlaybackPrefetcher();
+    ~PlaybackPrefetcher();
+
+    // Called each time the holder samples its scene. frame_duration is the
+    // length of one frame in seconds. Returns immediately, the previous
+    // request is abandoned if the worker is still busy with it.
+    void update(const AlembicScenePtr& scene, chrono_t time, chrono_t frame_duration, const PrefetchSettings& settings);
+
+    // Release the pinned frames.
+    void clear() { update(nullptr, 0, 0, PrefetchSettings()); }
+
+    size_t pinnedBytes() const { return m_pinned_bytes; }
+
+private:
+    struct Request {
+        AlembicScenePtr scene;
+        chrono_t time;
+        // Signed, 0 when nothing should be prefetched.
+        chrono_t step;
+        int frame_count;
+        size_t memory_budget;
+        ViewFilter view_filter;
+        Request() : time(0), step(0), frame_count(0), memory_budget(0) {}
+    };
+
+    void run();
+    void prefetch(const Request& request, uint64_t request_id);
+    bool isAbandoned(uint64_t request_id);
+    void updatePinnedBytes();
+
+    // Shared with the worker, guarded by m_mutex.
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    Request m_request;
+    uint64_t m_request_id;
+    bool m_stop;
+
+    // Only used by the calling thread.
+    chrono_t m_last_time;
+    int m_direction;
+
+    // Only used by the worker. The pinned frames are declared after their
+    // scene so they are released first.
+    AlembicScenePtr m_pinned_scene;
+    std::map<chrono_t, DrawableSampleVector> m_pinned_frames;
+    std::atomic<size_t> m_pinned_bytes;
+
+    std::thread m_thread;
+};
+
+} // namespace AlembicHolder
@@ -11,9 +11,11 @@
 #include <maya/MHWGeometryUtilities.h>
 #include <maya/MDrawContext.h>
 #include <maya/MFnAttribute.h>
+#include <maya/MFloatArray.h>
 #include <maya/MFnDagNode.h>
 #include <maya/MGlobal.h>
 #include <maya/MItDag.h>
+#include <maya/MMatrixArray.h>
 #include <maya/MSelectionList.h>
 #include <maya/MShaderManager.h>
 #include <maya/MFragmentManager.h>
@@ -23,8 +25,10 @@
 
 #include <boost/functional/hash.hpp>
 
+#include <atomic>
 #include <chrono>
 #include <sstream>
+#include <unordered_map>
 #include <unordered_set>
 #include <cstring>
 
@@ -155,6 +159,23 @@ float4 fileTexturePluginFragment(float2 uv, Texture2D map, sampler mapSampler)
     MShaderInstance* s_shaded_shader_template = nullptr;
     MShaderInstance* s_textured_shader_template = nullptr;
 
+    void setAnisotropicSampler(MShaderInstance* shader)
+    {
+        MStatus status;
+        MSamplerStateDesc desc;
+        desc.setDefaults();
+        desc.addressU = MSamplerState::kTexWrap;
+        desc.addressV = MSamplerState::kTexWrap;
+        desc.filter = MHWRender::MSamplerState::kAnisotropic;
+        desc.maxAnisotropy = 8;
+        auto sampler = MStateManager::acquireSamplerState(desc, &status);
+        CHECK_MSTATUS(status);
+        if (!sampler)
+            return;
+        CHECK_MSTATUS(shader->setParameter("textureSampler", *sampler));
+        MStateManager::releaseSamplerState(sampler);
+    }
+
     ShaderPtr getWireShader(const MColor& wire_color)
     {
         auto ptr = s_wire_shader_cache.get(wire_color);
@@ -292,19 +313,7 @@ void SubSceneOverride::initializeShaderTemplates()
     CHECK_MSTATUS(s_textured_shader_template->addInputFragment(s_texture_fragment_name, MString("output"), MString("diffuseColor")));
 
     // Set up anisotropic sampler.
-    MStatus status;
-    MSamplerStateDesc desc;
-    desc.setDefaults();
-    desc.addressU = MSamplerState::kTexWrap;
-    desc.addressV = MSamplerState::kTexWrap;
-    desc.filter = MHWRender::MSamplerState::kAnisotropic;
-    desc.maxAnisotropy = 8;
-    auto sampler = MStateManager::acquireSamplerState(desc, &status);
-    CHECK_MSTATUS(status);
-    if (!sampler)
-        return;
-    CHECK_MSTATUS(s_textured_shader_template->setParameter("textureSampler", *sampler));
-    MStateManager::releaseSamplerState(sampler);
+    setAnisotropicSampler(s_textured_shader_template);
 }
 
 void SubSceneOverride::releaseShaderTemplates()
@@ -368,10 +377,14 @@ SubSceneOverride::SubSceneOverride(const MObject& object)
     , m_shape_node(nullptr)
     , m_update_world_matrix_required(true)
     , m_sample_time(-std::numeric_limits<chrono_t>::infinity())
+    , m_drawable_count(0)
+    , m_scene_loading(false)
     , m_bbox_extended_mode(false)
     , m_is_selected(false)
     , m_is_visible(false)
     , m_wire_color(MColor(FLT_INF, FLT_INF, FLT_INF, FLT_INF))
+    , m_vertex_format(VertexFormat::FULL)
+    , m_proxy_mode(ShapeNode::kProxyBoundingBox)
 {
     // Extract the ShapeNode pointer.
     MFnDagNode dagNode(object);
@@ -415,6 +428,8 @@ bool SubSceneOverride::requiresUpdate(
         m_update_world_matrix_required ||
         m_scene_key != m_shape_node->getSceneKey() ||
         m_sample_time != m_shape_node->getTime() ||
+        m_drawable_count != m_shape_node->getSample().drawable_samples.size() ||
+        m_scene_loading != m_shape_node->getSample().scene_loading ||
         m_bbox_extended_mode != m_shape_node->isBBExtendedMode() ||
         m_selection_key != m_shape_node->getSelectionKey() ||
         m_shader_assignments_json != m_shape_node->getShaderAssignmentsJson() ||
@@ -422,7 +437,72 @@ bool SubSceneOverride::requiresUpdate(
         m_is_visible != dag_path.isVisible() ||
         m_wire_color != MGeometryUtilities::wireframeColor(dag_path) ||
         m_texture_mode != m3dview.textureMode() ||
-        m_display_style != m3dview.displayStyle();
+        m_display_style != m3dview.displayStyle() ||
+        m_vertex_format != vertexFormat() ||
+        m_proxy_mode != m_shape_node->getProxyMode() ||
+        m_view_filter != viewFilter(activeViews(frameContext));
+}
+
+std::map<std::string, ViewFilter::View> SubSceneOverride::activeViews(const MFrameContext& frame_context) const
+{
+    std::map<std::string, ViewFilter::View> views;
+    if (!m_shape_node->isViewCulling() && m_shape_node->getProxyScreenSize() <= 0)
+        return views;
+
+    // The viewports are updated one after the other, the views of the other
+    // panels are kept until they are hidden or closed.
+    M3dView panel_view;
+    for (const auto& view : m_views) {
+        if (M3dView::getM3dViewFromModelPanel(MString(view.first.c_str()), panel_view) == MS::kSuccess &&
+            panel_view.isVisible())
+            views.insert(view);
+    }
+
+    MString destination;
+    frame_context.renderingDestination(destination);
+    auto& view = views[destination.asChar()];
+
+    MStatus status;
+    const auto view_projection = frame_context.getMatrix(MFrameContext::kViewProjMtx, &status);
+    CHECK_MSTATUS(status);
+    const auto node_world_matrix = MDagPath::getAPathTo(m_object).inclusiveMatrix();
+    view.view_projection = Imath::M44f(imathFromMaya(node_world_matrix * view_projection));
+
+    int origin_x, origin_y, width, height;
+    CHECK_MSTATUS(frame_context.getViewportDimensions(origin_x, origin_y, width, height));
+    view.viewport_width = float(width);
+    view.viewport_height = float(height);
+    return views;
+}
+
+ViewFilter SubSceneOverride::viewFilter(const std::map<std::string, ViewFilter::View>& views) const
+{
+    ViewFilter filter;
+    filter.culling = m_shape_node->isViewCulling();
+    filter.proxy_screen_size = m_shape_node->getProxyScreenSize();
+    if (!filter.enabled())
+        return filter;
+
+    filter.views.reserve(views.size());
+    for (const auto& view : views)
+        filter.views.push_back(view.second);
+
+    // Culling instanced meshes would break up their groups and recreate the
+    // render items as the camera moves.
+    if (!m_instance_groups.empty()) {
+        filter.always_full.assign(m_drawn_as_instance.size(), false);
+        for (const auto& group : m_instance_groups)
+            for (const auto drawable_id : group)
+                filter.always_full[drawable_id] = true;
+    }
+    return filter;
+}
+
+VertexFormat SubSceneOverride::vertexFormat() const
+{
+    return m_shape_node->isCompactVertexFormat()
+        ? VertexFormat::COMPACT
+        : VertexFormat::FULL;
 }
 
 void SubSceneOverride::update(
@@ -449,20 +529,82 @@ void SubSceneOverride::update(
     const bool wire_color_updated = updateValue(m_wire_color, MGeometryUtilities::wireframeColor(dag_path));
     const bool texture_mode_changed = updateValue(m_texture_mode, m3dview.textureMode());
     const bool display_style_changed = updateValue(m_display_style, m3dview.displayStyle());
-
-    const bool sample_updated = uninitialized || scene_updated || time_updated;
+    const bool vertex_format_updated = updateValue(m_vertex_format, vertexFormat());
+    const bool proxy_mode_updated = updateValue(m_proxy_mode, m_shape_node->getProxyMode());
 
     const auto& scene = m_shape_node->getScene();
     const auto& scene_sample = m_shape_node->getSample();
+    const bool drawables_added = updateValue(m_drawable_count, scene_sample.drawable_samples.size());
+    const bool scene_loading_updated = updateValue(m_scene_loading, scene_sample.scene_loading);
+
+    // The drawables changing level of detail are decoded or released by the
+    // shape node.
+    m_views = activeViews(frameContext);
+    const bool lod_updated = updateValue(m_view_filter, viewFilter(m_views)) &&
+        m_shape_node->setViewFilter(m_view_filter);
+
+    const auto& color_overrides = m_shape_node->getDiffuseColorOverrides();
+    const auto getDrawableColor = [&scene, &color_overrides](DrawableID drawable_id) {
+        const auto& static_material = scene->getStaticMaterial(drawable_id);
+        const auto color_it = color_overrides.find(drawable_id);
+        if (color_it != color_overrides.end()) {
+            return color_it->second.diffuse_color;
+        } else {
+            return static_material.diffuse_color;
+        }
+    };
+    const auto getDrawableTexturePath = [&scene, &color_overrides](DrawableID drawable_id) {
+        const auto& static_material = scene->getStaticMaterial(drawable_id);
+        const auto color_it = color_overrides.find(drawable_id);
+        if (color_it != color_overrides.end()) {
+            return color_it->second.diffuse_texture_path;
+        } else {
+            return static_material.diffuse_texture_path;
+        }
+    };
+
+    // Group the visible meshes with identical buffers. The instances of a
+    // group share the texture.
+    bool instance_groups_updated = false;
+    if (uninitialized || scene_updated || drawables_added || time_updated || lod_updated ||
+        vertex_format_updated || color_overrides_updated) {
+        std::vector<std::vector<DrawableID>> instance_groups;
+        if (scene) {
+            std::unordered_map<size_t, size_t> group_from_key;
+            for (const auto& sample : scene_sample.drawable_samples) {
+                if (sample.type != GeometryType::TRIANGLES || !sample.visible || !sample.cache_handles.geometry_digest)
+                    continue;
+                size_t key = sample.cache_handles.geometry_digest;
+                boost::hash_combine(key, getDrawableTexturePath(sample.drawable_id));
+                const auto inserted = group_from_key.emplace(key, instance_groups.size());
+                if (inserted.second)
+                    instance_groups.emplace_back();
+                instance_groups[inserted.first->second].push_back(sample.drawable_id);
+            }
+            instance_groups.erase(
+                std::remove_if(instance_groups.begin(), instance_groups.end(),
+                    [](const std::vector<DrawableID>& group) { return group.size() < 2; }),
+                instance_groups.end());
+        }
+        instance_groups_updated = updateValue(m_instance_groups, instance_groups);
+    }
 
-    // Get scene data from the shape node.
-    if (scene_updated) {
+    // Switching the vertex format recreates the render items, since the
+    // meshes change shaders. So do changes of the instance groups and of the
+    // proxy primitive, and the drawables published by a loading scene.
+    const bool items_recreated = uninitialized || scene_updated || drawables_added ||
+        vertex_format_updated || instance_groups_updated || proxy_mode_updated;
+    const bool sample_updated = items_recreated || time_updated || lod_updated;
+
+    // Get scene data from the shape node. The buffers of each vertex format
+    // are cached apart.
+    if (scene_updated || vertex_format_updated) {
         // First release the buffers, because they contain smart pointerts
         // pointing into VP2 scene caches which should not survive longer than
         // the scene itself. But the scene gets destroyed if our handle is
         // the last reference to it.
         m_buffers.clear();
-        m_vp2_cache_handle = VP2SceneCache::instance().getScene(m_scene_key, scene);
+        m_vp2_cache_handle = VP2SceneCache::instance().getScene(m_scene_key, scene, m_vertex_format);
     }
 
     // Wireframe shader. Needs to be updated before updating the render items
@@ -472,7 +614,7 @@ void SubSceneOverride::update(
     }
 
     // Re-populate the render item container if needed.
-    const bool update_render_items = uninitialized || scene_updated;
+    const bool update_render_items = items_recreated;
     if (update_render_items) {
 
         // Helper function for creating render items.
@@ -498,6 +640,10 @@ void SubSceneOverride::update(
         m_bbox_wireframe.render_item->setShader(m_wire_shader.get());
         container.add(m_bbox_wireframe.render_item);
 
+        m_proxies.initRenderItem(m_proxy_mode);
+        m_proxies.point_shader = newPointShader();
+        container.add(m_proxies.render_item);
+
         // Add a wireframe, shaded and textured render item for each drawable.
         // Set default shader for shaded and textured items here, since a valid
         // shader is needed for setGeometryForRenderItem, and we can be certain,
@@ -514,6 +660,17 @@ void SubSceneOverride::update(
         const auto mesh_count = scene ? scene->nodeCategories().countByType(Hierarchy::NodeType::POLYMESH) : 0;
         m_meshes.clear();
         m_meshes.reserve(mesh_count);
+
+        // Only the first mesh of each instance group gets render items.
+        std::vector<const std::vector<DrawableID>*> instance_group_of(scene_sample.drawable_samples.size(), nullptr);
+        m_drawn_as_instance.assign(scene_sample.drawable_samples.size(), false);
+        for (const auto& group : m_instance_groups) {
+            for (const auto drawable_id : group) {
+                instance_group_of[drawable_id] = &group;
+                m_drawn_as_instance[drawable_id] = drawable_id != group.front();
+            }
+        }
+
         for (const auto& sample : scene_sample.drawable_samples) {
 
             if (sample.type == GeometryType::POINTS) {
@@ -547,8 +704,12 @@ void SubSceneOverride::update(
                 lines.shaded_item->setShader(lines.shader.get());
 
             } else if (sample.type == GeometryType::TRIANGLES) {
+                if (m_drawn_as_instance[sample.drawable_id])
+                    continue;
                 m_meshes.push_back({sample.drawable_id});
                 auto& mesh = m_meshes.back();
+                if (instance_group_of[sample.drawable_id])
+                    mesh.instances = *instance_group_of[sample.drawable_id];
 
                 // Wireframe item.
                 auto& wireframe_item = mesh.wireframe_item;
@@ -584,9 +745,9 @@ void SubSceneOverride::update(
 
     // Check what aspects of the bbox need to be updated.
     const bool update_bbox_visibility = uninitialized || scene_updated || bboxmode_updated ||
-        selection_key_updated || node_visibility_updated || node_selection_updated;
+        selection_key_updated || node_visibility_updated || node_selection_updated || scene_loading_updated;
     const bool update_bbox_shader = uninitialized || wire_color_updated;
-    const bool update_bbox_streams = sample_updated;
+    const bool update_bbox_streams = sample_updated || scene_loading_updated;
     const bool force_bbox = m_bbox_extended_mode && !m_is_selected;
 
     // Update the bounding box wireframe.
@@ -594,9 +755,9 @@ void SubSceneOverride::update(
         // Visibility.
         if (update_bbox_visibility) {
             // Show the wireframe if the shape node is visible and ethier the
-            // scene is invalid or bbox mode is on.
+            // scene is invalid or still loading or bbox mode is on.
             const bool selection_mode = !m_selection_key.empty();
-            m_bbox_wireframe.render_item->enable((!scene || force_bbox || selection_mode) && m_is_visible);
+            m_bbox_wireframe.render_item->enable((!scene || m_scene_loading || force_bbox || selection_mode) && m_is_visible);
         }
         // Shader.
         if (update_bbox_shader) {
@@ -618,19 +779,22 @@ void SubSceneOverride::update(
         selection_key_updated || bboxmode_updated ||
         node_selection_updated || node_visibility_updated ||
         display_style_changed;
-    const bool update_wire_shaders = uninitialized || scene_updated || wire_color_updated;
-    const bool update_shaded_shaders = uninitialized || scene_updated || color_overrides_updated;
-    const bool update_textured_shaders = (uninitialized || scene_updated || color_overrides_updated || texture_mode_changed) && m_texture_mode;
+    const bool update_wire_shaders = items_recreated || wire_color_updated;
+    const bool update_shaded_shaders = items_recreated || color_overrides_updated;
+    const bool update_textured_shaders = (items_recreated || color_overrides_updated || texture_mode_changed) && m_texture_mode;
     const bool update_streams = sample_updated;
     const bool update_matrices = m_update_world_matrix_required || sample_updated;
 
     const bool node_is_visible = m_is_visible;
     const auto& selection_visibility = scene_sample.selection_visibility;
-    const auto sampleIsVisible = [node_is_visible, &selection_visibility, force_bbox](const DrawableSample& sample) {
+    const auto sampleIsShown = [node_is_visible, &selection_visibility, force_bbox](const DrawableSample& sample) {
         return node_is_visible && sample.visible &&
             selection_visibility[sample.drawable_id] &&
             !force_bbox;
     };
+    const auto sampleIsVisible = [&sampleIsShown](const DrawableSample& sample) {
+        return sampleIsShown(sample) && sample.lod == DrawableLOD::FULL;
+    };
 
     // Update visibility.
     if (update_visibility) {
@@ -660,10 +824,12 @@ void SubSceneOverride::update(
                 lines.shaded_item->enable(sample_is_visible);
         }
 
-        // Meshes.
+        // Meshes. Instanced meshes are shown if any of their instances is.
         for (auto& mesh : m_meshes) {
             const auto& sample = scene_sample.drawable_samples[mesh.drawable_id];
-            const bool sample_is_visible = sampleIsVisible(sample);
+            bool sample_is_visible = sampleIsVisible(sample);
+            for (const auto drawable_id : mesh.instances)
+                sample_is_visible = sample_is_visible || sampleIsVisible(scene_sample.drawable_samples[drawable_id]);
 
             // Update wireframe visibility.
             if (mesh.wireframe_item) {
@@ -702,16 +868,6 @@ void SubSceneOverride::update(
     }
 
     // Shaded items.
-    const auto& color_overrides = m_shape_node->getDiffuseColorOverrides();
-    const auto getDrawableColor = [&scene, &color_overrides](DrawableID drawable_id) {
-        const auto& static_material = scene->getStaticMaterial(drawable_id);
-        const auto color_it = color_overrides.find(drawable_id);
-        if (color_it != color_overrides.end()) {
-            return color_it->second.diffuse_color;
-        } else {
-            return static_material.diffuse_color;
-        }
-    };
     if (update_shaded_shaders) {
 
         // Lines.
@@ -734,15 +890,6 @@ void SubSceneOverride::update(
     }
 
     // Textured items.
-    const auto getDrawableTexturePath = [&scene, &color_overrides](DrawableID drawable_id) {
-        const auto& static_material = scene->getStaticMaterial(drawable_id);
-        const auto color_it = color_overrides.find(drawable_id);
-        if (color_it != color_overrides.end()) {
-            return color_it->second.diffuse_texture_path;
-        } else {
-            return static_material.diffuse_texture_path;
-        }
-    };
     if (update_textured_shaders) {
         for (auto& mesh : m_meshes) {
             if (!mesh.textured_item)
@@ -792,7 +939,8 @@ void SubSceneOverride::update(
     if (update_streams) {
 
         if (m_vp2_cache_handle)
-            m_vp2_cache_handle->updateVP2Buffers(m_sample_time, scene_sample.drawable_samples, m_buffers);
+            m_vp2_cache_handle->updateVP2Buffers(scene->nodeCategories(), m_sample_time, scene_sample.drawable_samples, m_buffers,
+                m_drawn_as_instance);
 
         // Assign buffers to render items.
         const auto addBufferIfNotEmpty = [&](MVertexBufferArray& vba, const char* buffer_name, MVertexBuffer* buffer) {
@@ -862,6 +1010,7 @@ void SubSceneOverride::update(
 
             const MBoundingBox maya_bbox = mayaFromImath(sample.bbox);
 
+
             // Wireframe render item.
             {
                 MVertexBufferArray vba;
@@ -892,7 +1041,7 @@ void SubSceneOverride::update(
                     addBufferIfNotEmpty(vba, "normals", &vp2_buffers.geometry->normals);
                 if (vp2_buffers.texcoords)
                     addBufferIfNotEmpty(vba, "uvs", &vp2_buffers.texcoords->uvs);
-                // TODO: tangents, bitangents
+                // TODO: tangents, bitangents.
                 const auto index_buffer = vp2_buffers.indices
                     ? vp2_buffers.indices->triangle_buffer
                     : MIndexBuffer(MGeometry::kUnsignedInt32);
@@ -901,6 +1050,43 @@ void SubSceneOverride::update(
         }
     }
 
+    // Update the proxies.
+    const bool update_proxies = sample_updated || update_visibility || update_wire_shaders;
+    if (m_proxies && update_proxies) {
+        const bool points_mode = m_proxy_mode == ShapeNode::kProxyPoint;
+        if (points_mode) {
+            setPointShaderSolidColor(m_proxies.point_shader.get(), C3f(m_wire_color.r, m_wire_color.g, m_wire_color.b));
+            m_proxies.render_item->setShader(m_proxies.point_shader.get());
+        } else {
+            m_proxies.render_item->setShader(m_wire_shader.get());
+        }
+
+        std::vector<V3f> positions;
+        std::vector<uint32_t> indices;
+        Box3f proxies_bbox;
+        for (const auto& sample : scene_sample.drawable_samples) {
+            if (sample.lod != DrawableLOD::PROXY || !sampleIsShown(sample))
+                continue;
+            const auto bbox = Imath::transform(sample.bbox, sample.world_matrix);
+            proxies_bbox.extendBy(bbox);
+            if (points_mode) {
+                positions.push_back(bbox.center());
+                continue;
+            }
+            const auto base_index = uint32_t(positions.size());
+            const auto extent = bbox.max - bbox.min;
+            const auto zeroOne = [](int f) { return (f != 0) ? 1.0f : 0.0f; };
+            for (int i = 0; i < 8; ++i)
+                positions.push_back(bbox.min + extent * V3f(zeroOne(i & 1), zeroOne(i & 2), zeroOne(i & 4)));
+            for (int i = 0; i < 24; ++i)
+                indices.push_back(base_index + BBoxWireframe::BOX_INDICES[i]);
+        }
+        m_proxies.updateGeometry(*this, positions, indices, proxies_bbox);
+    }
+    if (m_proxies && update_matrices) {
+        m_proxies.render_item->setMatrix(&node_world_matrix);
+    }
+
     // Update world matrices.
     if (update_matrices) {
         m_update_world_matrix_required = false;
@@ -925,7 +1111,7 @@ void SubSceneOverride::update(
 
         for (auto& mesh : m_meshes) {
             const auto& sample = scene_sample.drawable_samples[mesh.drawable_id];
-            if (!sample.visible)
+            if (!sample.visible || !mesh.instances.empty())
                 continue;
             const auto& world_matrix = mayaFromImath(sample.world_matrix) * node_world_matrix;
             for (auto render_item : { mesh.wireframe_item, mesh.shaded_item, mesh.textured_item })
@@ -933,6 +1119,36 @@ void SubSceneOverride::update(
                     render_item->setMatrix(&world_matrix);
         }
     }
+
+    // Update instances. Each visible drawable of an instanced mesh gets a
+    // matrix and, with the stock shaders, a diffuse colour.
+    if (update_matrices || update_visibility || update_shaded_shaders) {
+        for (auto& mesh : m_meshes) {
+            if (mesh.instances.empty() || !m_buffers[mesh.drawable_id].geometry)
+                continue;
+
+            MMatrixArray matrices;
+            MFloatArray colors;
+            for (const auto drawable_id : mesh.instances) {
+                const auto& sample = scene_sample.drawable_samples[drawable_id];
+                if (!sampleIsVisible(sample))
+                    continue;
+                matrices.append(mayaFromImath(sample.world_matrix) * node_world_matrix);
+                const auto color = getDrawableColor(drawable_id);
+                for (int i = 0; i < 3; ++i)
+                    colors.append(color[i]);
+                colors.append(1.0f);
+            }
+            // The items are disabled.
+            if (matrices.length() == 0)
+                continue;
+
+            for (auto render_item : { mesh.wireframe_item, mesh.shaded_item, mesh.textured_item })
+                if (render_item)
+                    CHECK_MSTATUS(setInstanceTransformArray(*render_item, matrices));
+            CHECK_MSTATUS(setExtraInstanceData(*mesh.shaded_item, "diffuseColor", colors));
+        }
+    }
 }
 
 const char* SubSceneOverride::BBoxWireframe::RENDER_ITEM_NAME = "alembicHolder_bbox";
@@ -974,6 +1190,46 @@ void SubSceneOverride::BBoxWireframe::updateBBox(MHWRender::MPxSubSceneOverride&
     CHECK_MSTATUS(parent.setGeometryForRenderItem(*render_item, vba, index_buffer, &maya_bbox));
 }
 
+const char* SubSceneOverride::Proxies::RENDER_ITEM_NAME = "alembicHolder_proxies";
+
+SubSceneOverride::Proxies::Proxies()
+    : render_item(nullptr)
+    , position_buffer(MVertexBufferDescriptor("", MGeometry::kPosition, MGeometry::kFloat, 3))
+    , index_buffer(MGeometry::kUnsignedInt32)
+{}
+
+void SubSceneOverride::Proxies::initRenderItem(ShapeNode::ProxyMode mode)
+{
+    const auto primitive = (mode == ShapeNode::kProxyPoint) ? MGeometry::kPoints : MGeometry::kLines;
+    render_item = MRenderItem::Create(RENDER_ITEM_NAME, MRenderItem::DecorationItem, primitive);
+    render_item->setDrawMode(MGeometry::DrawMode(MGeometry::kWireframe | MGeometry::kShaded | MGeometry::kTextured));
+    render_item->depthPriority(MRenderItem::sActiveWireDepthPriority);
+    render_item->setSelectionMask(MSelectionMask(kPluginId));
+    render_item->enable(false);
+}
+
+void SubSceneOverride::Proxies::updateGeometry(MHWRender::MPxSubSceneOverride& parent,
+    const std::vector<V3f>& positions, const std::vector<uint32_t>& indices, const Box3f& bbox)
+{
+    render_item->enable(!positions.empty());
+    if (positions.empty())
+        return;
+
+    auto ptr = static_cast<V3f*>(position_buffer.acquire(unsigned(positions.size()), true));
+    std::copy(positions.begin(), positions.end(), ptr);
+    position_buffer.commit(ptr);
+
+    MVertexBufferArray vba;
+    vba.addBuffer("positions", &position_buffer);
+    const auto maya_bbox = mayaFromImath(bbox);
+    if (indices.empty()) {
+        CHECK_MSTATUS(parent.setGeometryForRenderItem(*render_item, vba, MIndexBuffer(MGeometry::kUnsignedInt32), &maya_bbox));
+    } else {
+        index_buffer.update(indices.data(), 0, unsigned(indices.size()), true);
+        CHECK_MSTATUS(parent.setGeometryForRenderItem(*render_item, vba, index_buffer, &maya_bbox));
+    }
+}
+
 bool SubSceneOverride::getSelectionPath(const MHWRender::MRenderItem& renderItem, MDagPath& dagPath) const
 {
     dagPath = MDagPath::getAPathTo(m_object);
@@ -981,19 +1237,40 @@ bool SubSceneOverride::getSelectionPath(const MHWRender::MRenderItem& renderItem
 }
 
 
-VP2Scene::VP2Scene(const HierarchyNodeCategories& categories)
+VP2Scene::VP2Scene(const HierarchyNodeCategories& categories, VertexFormat format)
+    : m_format(format)
+{
+    addCaches(categories);
+}
+
+void VP2Scene::addCaches(const HierarchyNodeCategories& categories)
+{
+    const auto drawable_count = categories.drawableCount();
+    for (auto drawable_id = DrawableID(m_vp2_caches.size()); drawable_id < drawable_count; ++drawable_id)
+        m_vp2_caches.emplace_back(categories.drawableNode(drawable_id), this, m_format);
+}
+
+VP2Scene::~VP2Scene()
 {
-    m_vp2_caches.reserve(categories.drawableCount());
-    for (const auto& drawable : categories.drawables())
-        m_vp2_caches.emplace_back(drawable.node_ref);
+    // The retained buffers must not survive the caches.
+    vp2BufferCacheRetention().releaseOwner(this);
 }
 
-void VP2Scene::updateVP2Buffers(chrono_t time, const DrawableSampleVector& in_samples, VP2BufferHandlesVector& out_buffers)
+void VP2Scene::updateVP2Buffers(const HierarchyNodeCategories& categories,
+    chrono_t time, const DrawableSampleVector& in_samples, VP2BufferHandlesVector& out_buffers,
+    const std::vector<bool>& drawn_as_instance)
 {
     tbb::mutex::scoped_lock guard(m_mutex);
 
+    if (m_vp2_caches.size() < in_samples.size())
+        addCaches(categories);
+
     out_buffers.resize(in_samples.size());
     for (size_t i = 0; i < in_samples.size(); ++i) {
+        if (i < drawn_as_instance.size() && drawn_as_instance[i]) {
+            out_buffers[i] = VP2BufferHandles();
+            continue;
+        }
         auto& cache = m_vp2_caches[in_samples[i].drawable_id];
         out_buffers[i] = cache.sampleBuffers(time, in_samples[i].cache_handles);
     }
@@ -1010,27 +1287,58 @@ namespace {
         output.update(input.data(), 0, unsigned(input.size()), true);
     }
 
+    void updateNarrowIndexBuffer(const std::vector<uint32_t>& input, MIndexBuffer& output)
+    {
+        if (input.empty())
+            return;
+        auto buffer = static_cast<uint16_t*>(output.acquire(unsigned(input.size()), true));
+        if (!buffer)
+            return;
+        for (size_t i = 0; i < input.size(); ++i)
+            buffer[i] = uint16_t(input[i]);
+        output.commit(buffer);
+    }
+
+    // The compact format uses 16 bit indices when they can address all the
+    // vertices.
+    MGeometry::DataType indexDataType(const IndexBufferSample& sample, VertexFormat format)
+    {
+        if (format != VertexFormat::COMPACT)
+            return MGeometry::kUnsignedInt32;
+        uint32_t max_index = 0;
+        for (const auto index : sample.triangle_buffer)
+            max_index = std::max(max_index, index);
+        for (const auto index : sample.wireframe_buffer)
+            max_index = std::max(max_index, index);
+        return max_index <= std::numeric_limits<uint16_t>::max() ? MGeometry::kUnsignedInt16 : MGeometry::kUnsignedInt32;
+    }
+
     void updateVP2IndexBufferSample(const IndexBufferSample& cpu_buffer, VP2IndexBufferSample& out_gpu_buffer)
     {
-        updateVP2Buffer(cpu_buffer.triangle_buffer, out_gpu_buffer.triangle_buffer);
-        updateVP2Buffer(cpu_buffer.wireframe_buffer, out_gpu_buffer.wireframe_buffer);
+        if (out_gpu_buffer.triangle_buffer.dataType() == MGeometry::kUnsignedInt16) {
+            updateNarrowIndexBuffer(cpu_buffer.triangle_buffer, out_gpu_buffer.triangle_buffer);
+            updateNarrowIndexBuffer(cpu_buffer.wireframe_buffer, out_gpu_buffer.wireframe_buffer);
+        } else {
+            updateVP2Buffer(cpu_buffer.triangle_buffer, out_gpu_buffer.triangle_buffer);
+            updateVP2Buffer(cpu_buffer.wireframe_buffer, out_gpu_buffer.wireframe_buffer);
+        }
     }
 
     void updateVP2GeometrySample(const GeometrySample& input, VP2GeometrySample& output)
     {
         updateVP2Buffer(input.positions, output.positions);
         updateVP2Buffer(input.normals, output.normals);
-        updateVP2Buffer(input.tangents, output.tangents);
-        updateVP2Buffer(input.bitangents, output.bitangents);
 
         output.flags = VP2GeometrySample::POSITIONS_ONLY;
         if (!input.normals.empty()) {
             assert(input.normals.size() == input.positions.size());
             output.flags |= VP2GeometrySample::HAS_NORMALS;
         }
-        if (!input.tangents.empty()) {
+        if (!input.tangents.empty() && output.format == VertexFormat::FULL) {
             assert(input.tangents.size() == input.positions.size());
             assert(input.bitangents.size() == input.positions.size());
+            updateVP2Buffer(input.tangents, output.tangents);
+            updateVP2Buffer(input.bitangents, output.bitangents);
             output.flags |= VP2GeometrySample::HAS_TANGENT_BASIS;
         }
     }
@@ -1040,15 +1348,39 @@ namespace {
         updateVP2Buffer(input.uvs, output.uvs);
     }
 
+    // Add the uploaded buffers to the memory report, with the size they
+    // would have in the full format.
+    void tallyMemory(VP2IndexBufferSample& sample, VertexFormat format)
+    {
+        const auto index_count = size_t(sample.triangle_buffer.size()) + size_t(sample.wireframe_buffer.size());
+        sample.tally.set(format, sampleBytes(sample), index_count * sizeof(uint32_t));
+    }
+    void tallyMemory(VP2GeometrySample& sample)
+    {
+        const auto vector_count = size_t(sample.positions.vertexCount()) + size_t(sample.normals.vertexCount()) +
+            size_t(sample.tangents.vertexCount()) + size_t(sample.bitangents.vertexCount());
+        sample.tally.set(sample.format, sampleBytes(sample), vector_count * sizeof(V3f));
+    }
+    void tallyMemory(VP2TexCoordsSample& sample)
+    {
+        sample.tally.set(sample.format, sampleBytes(sample), size_t(sample.uvs.vertexCount()) * sizeof(V2f));
+    }
+
 } // unnamed namespace
 
-VP2DrawableBufferCache::VP2DrawableBufferCache(const Hierarchy::Node& node)
-    : m_has_indices(false)
+VP2DrawableBufferCache::VP2DrawableBufferCache(const Hierarchy::Node& node, const void* retention_owner, VertexFormat format)
+    : m_format(node.type == Hierarchy::NodeType::POLYMESH ? format : VertexFormat::FULL)
+    , m_has_indices(false)
     , m_num_samples(0)
     , m_constant_indices(true)
     , m_constant_geometry(true)
     , m_constant_texcoords(true)
 {
+    auto& retention = vp2BufferCacheRetention();
+    m_vp2_index_buffer_cache.setRetention(&retention, retention_owner, &sampleBytes);
+    m_vp2_geometry_sample_cache.setRetention(&retention, retention_owner, &sampleBytes);
+    m_vp2_texcoords_sample_cache.setRetention(&retention, retention_owner, &sampleBytes);
+
     if (node.type == Hierarchy::NodeType::POLYMESH) {
         auto schema = Alembic::AbcGeom::IPolyMesh(node.source_object).getSchema();
         auto face_counts_property = schema.getFaceCountsProperty();
@@ -1092,8 +1424,10 @@ VP2BufferHandles VP2DrawableBufferCache::sampleBuffers(chrono_t time, const Draw
         const auto indices_sidx = m_constant_indices ? 0 : m_time_sampling->getFloorIndex(time, m_num_samples).first;
         res.indices = m_vp2_index_buffer_cache.get(indices_sidx);
         if (!res.indices && cache_handles.indices) {
-            auto indices = std::unique_ptr<VP2IndexBufferSample>(new VP2IndexBufferSample());
+            auto indices = std::unique_ptr<VP2IndexBufferSample>(
+                new VP2IndexBufferSample(indexDataType(*cache_handles.indices, m_format)));
             updateVP2IndexBufferSample(*cache_handles.indices, *indices);
+            tallyMemory(*indices, m_format);
             res.indices = m_vp2_index_buffer_cache.put(indices_sidx, indices.release());
         }
     }
@@ -1103,7 +1437,7 @@ VP2BufferHandles VP2DrawableBufferCache::sampleBuffers(chrono_t time, const Draw
     res.geometry = m_vp2_geometry_sample_cache.get(geometry_key);
     if (!res.geometry && cache_handles.geometry.endpoints[0]) {
         const auto cpu_geo = cache_handles.geometry;
-        auto geometry = std::unique_ptr<VP2GeometrySample>(new VP2GeometrySample());
+        auto geometry = std::unique_ptr<VP2GeometrySample>(new VP2GeometrySample(m_format));
 
         // Interpolate if needed.
         if (
@@ -1139,6 +1473,7 @@ VP2BufferHandles VP2DrawableBufferCache::sampleBuffers(chrono_t time, const Draw
             updateVP2GeometrySample(*cpu_geo.endpoints[0], *geometry);
         }
 
+        tallyMemory(*geometry);
         res.geometry = m_vp2_geometry_sample_cache.put(geometry_key, geometry.release());
     }
 
@@ -1147,7 +1482,7 @@ VP2BufferHandles VP2DrawableBufferCache::sampleBuffers(chrono_t time, const Draw
     res.texcoords = m_vp2_texcoords_sample_cache.get(texcoords_key);
     if (!res.texcoords && cache_handles.texcoords.endpoints[0]) {
         const auto cpu_uvs = cache_handles.texcoords;
-        auto texcoords = std::unique_ptr<VP2TexCoordsSample>(new VP2TexCoordsSample());
+        auto texcoords = std::unique_ptr<VP2TexCoordsSample>(new VP2TexCoordsSample(m_format));
 
         // Interpolate if needed.
         if (cache_handles.texcoords.endpoints[1] && cache_handles.texcoords.alpha != 0) {
@@ -1164,27 +1499,70 @@ VP2BufferHandles VP2DrawableBufferCache::sampleBuffers(chrono_t time, const Draw
             updateVP2TexCoordsSample(*cpu_uvs.endpoints[0], *texcoords);
         }
 
+        tallyMemory(*texcoords);
+
         res.texcoords = m_vp2_texcoords_sample_cache.put(texcoords_key, texcoords.release());
     }
 
     return res;
 }
 
+CacheRetention& vp2BufferCacheRetention()
+{
+    static CacheRetention retention(size_t(512) << 20);
+    return retention;
+}
+
+namespace {
+    std::atomic<size_t> s_vp2_full_bytes(0);
+    std::atomic<size_t> s_vp2_compact_bytes(0);
+    std::atomic<size_t> s_vp2_compact_as_full_bytes(0);
+} // unnamed namespace
+
+void VP2MemoryTally::set(VertexFormat format, size_t bytes, size_t full_bytes)
+{
+    if (m_format == VertexFormat::COMPACT) {
+        s_vp2_compact_bytes -= m_bytes;
+        s_vp2_compact_as_full_bytes -= m_full_bytes;
+    } else {
+        s_vp2_full_bytes -= m_bytes;
+    }
+    m_format = format;
+    m_bytes = bytes;
+    m_full_bytes = full_bytes;
+    if (m_format == VertexFormat::COMPACT) {
+        s_vp2_compact_bytes += m_bytes;
+        s_vp2_compact_as_full_bytes += m_full_bytes;
+    } else {
+        s_vp2_full_bytes += m_bytes;
+    }
+}
+
+VP2MemoryReport vp2MemoryReport()
+{
+    VP2MemoryReport report;
+    report.full_bytes = s_vp2_full_bytes;
+    report.compact_bytes = s_vp2_compact_bytes;
+    report.compact_as_full_bytes = s_vp2_compact_as_full_bytes;
+    return report;
+}
+
 VP2SceneCache& VP2SceneCache::instance()
 {
     static VP2SceneCache instance;
     return instance;
 }
 
-VP2ScenePtr VP2SceneCache::getScene(const AlembicSceneKey& key, const AlembicScenePtr& scene)
+VP2ScenePtr VP2SceneCache::getScene(const AlembicSceneKey& key, const AlembicScenePtr& scene, VertexFormat format)
 {
     if (!scene)
         return nullptr;
     tbb::mutex::scoped_lock guard(m_mutex);
-    auto ptr = m_scene_cache.get(key);
+    auto& scene_cache = m_scene_caches[size_t(format)];
+    auto ptr = scene_cache.get(key);
     if (ptr)
         return ptr;
-    return m_scene_cache.put(key, new VP2Scene(scene->nodeCategories()));
+    return scene_cache.put(key, new VP2Scene(scene->nodeCategories(), format));
 }
 
 } // namespace AlembicHolder
@@ -7,15 +7,49 @@
 #include <maya/MPxSubSceneOverride.h>
 #include <maya/MSelectionContext.h>
 #include <maya/MMessage.h>
+#include <deque>
+#include <map>
+#include <string>
 
 namespace AlembicHolder {
 
+// Layout of the VP2 buffers of the meshes. The compact format stores the
+// indices in 16 bits when the vertex count allows and leaves out the tangent
+// basis. Both are drawn by the stock shaders, which only read float normals
+// and uvs.
+enum class VertexFormat { FULL, COMPACT };
+
+// GPU memory of the VP2 samples alive, by vertex format. The compact samples
+// also count the memory they would take in the full format.
+struct VP2MemoryReport {
+    size_t full_bytes;
+    size_t compact_bytes;
+    size_t compact_as_full_bytes;
+};
+VP2MemoryReport vp2MemoryReport();
+
+// Adds the memory of a VP2 sample to the report while the sample is alive.
+class VP2MemoryTally {
+public:
+    VP2MemoryTally() : m_format(VertexFormat::FULL), m_bytes(0), m_full_bytes(0) {}
+    ~VP2MemoryTally() { set(VertexFormat::FULL, 0, 0); }
+    VP2MemoryTally(const VP2MemoryTally&) = delete;
+    VP2MemoryTally& operator=(const VP2MemoryTally&) = delete;
+    // Set once the buffers of the sample are uploaded.
+    void set(VertexFormat format, size_t bytes, size_t full_bytes);
+private:
+    VertexFormat m_format;
+    size_t m_bytes;
+    size_t m_full_bytes;
+};
+
 struct VP2IndexBufferSample {
     MHWRender::MIndexBuffer triangle_buffer;
     MHWRender::MIndexBuffer wireframe_buffer;
-    VP2IndexBufferSample()
-        : triangle_buffer(MHWRender::MGeometry::kUnsignedInt32)
-        , wireframe_buffer(MHWRender::MGeometry::kUnsignedInt32)
+    VP2MemoryTally tally;
+    VP2IndexBufferSample(MHWRender::MGeometry::DataType data_type = MHWRender::MGeometry::kUnsignedInt32)
+        : triangle_buffer(data_type)
+        , wireframe_buffer(data_type)
     {}
 };
 typedef Cache<index_t, VP2IndexBufferSample> VP2IndexBufferSampleCache;
@@ -29,19 +63,25 @@ struct VP2GeometrySample {
     typedef uint8_t Flags;
     enum FlagConstants : Flags { POSITIONS_ONLY = 0, HAS_NORMALS = 1, HAS_TANGENT_BASIS = 2 };
     Flags flags;
-    VP2GeometrySample()
+    VertexFormat format;
+    VP2MemoryTally tally;
+    VP2GeometrySample(VertexFormat format_ = VertexFormat::FULL)
         : positions(MHWRender::MVertexBufferDescriptor("", MHWRender::MGeometry::kPosition, MHWRender::MGeometry::kFloat, 3))
         , normals(MHWRender::MVertexBufferDescriptor("", MHWRender::MGeometry::kNormal, MHWRender::MGeometry::kFloat, 3))
         , tangents(MHWRender::MVertexBufferDescriptor("", MHWRender::MGeometry::kTangent, MHWRender::MGeometry::kFloat, 3))
         , bitangents(MHWRender::MVertexBufferDescriptor("", MHWRender::MGeometry::kBitangent, MHWRender::MGeometry::kFloat, 3))
         , flags(POSITIONS_ONLY)
+        , format(format_)
     {}
 };
 
 struct VP2TexCoordsSample {
     MHWRender::MVertexBuffer uvs;
-    VP2TexCoordsSample()
+    VertexFormat format;
+    VP2MemoryTally tally;
+    VP2TexCoordsSample(VertexFormat format_ = VertexFormat::FULL)
         : uvs(MHWRender::MVertexBufferDescriptor("", MHWRender::MGeometry::kTexture, MHWRender::MGeometry::kFloat, 2))
+        , format(format_)
     {}
 };
 
@@ -52,6 +92,31 @@ typedef VP2GeometrySampleCache::ValuePtr VP2GeometrySamplePtr;
 typedef Cache<chrono_t, VP2TexCoordsSample> VP2TexCoordsSampleCache;
 typedef VP2TexCoordsSampleCache::ValuePtr VP2TexCoordsSamplePtr;
 
+// GPU memory held by the buffers of a sample.
+inline size_t vertexBufferBytes(const MHWRender::MVertexBuffer& buffer)
+{
+    const auto descriptor = buffer.descriptor();
+    return size_t(buffer.vertexCount()) * descriptor.dimension() * descriptor.dataTypeSize();
+}
+inline size_t indexBufferBytes(const MHWRender::MIndexBuffer& buffer)
+{
+    const auto index_size = buffer.dataType() == MHWRender::MGeometry::kUnsignedInt16 ? sizeof(uint16_t) : sizeof(uint32_t);
+    return size_t(buffer.size()) * index_size;
+}
+inline size_t sampleBytes(const VP2IndexBufferSample& sample)
+{
+    return indexBufferBytes(sample.triangle_buffer) + indexBufferBytes(sample.wireframe_buffer);
+}
+inline size_t sampleBytes(const VP2GeometrySample& sample)
+{
+    return vertexBufferBytes(sample.positions) + vertexBufferBytes(sample.normals) +
+        vertexBufferBytes(sample.tangents) + vertexBufferBytes(sample.bitangents);
+}
+inline size_t sampleBytes(const VP2TexCoordsSample& sample) { return vertexBufferBytes(sample.uvs); }
+
+// Retains the recently used VP2 buffers of all the scenes.
+CacheRetention& vp2BufferCacheRetention();
+
 // On the GPU, only interpolated samples are stored (not the interpolation
 // endpoints). This struct stores handles to the buffer cache entries holding
 // the interpolated buffers.
@@ -64,9 +129,12 @@ typedef std::vector<VP2BufferHandles> VP2BufferHandlesVector;
 
 class VP2DrawableBufferCache {
 public:
-    VP2DrawableBufferCache(const Hierarchy::Node& node);
+    // The buffers are retained on behalf of retention_owner.
+    VP2DrawableBufferCache(const Hierarchy::Node& node, const void* retention_owner, VertexFormat format);
     VP2BufferHandles sampleBuffers(chrono_t time, const DrawableCacheHandles& cache_handles);
 private:
+    // The compact format only applies to the meshes.
+    VertexFormat m_format;
     Alembic::AbcCoreAbstract::TimeSamplingPtr m_time_sampling;
     size_t m_num_samples;
     bool m_has_indices;
@@ -81,10 +149,20 @@ private:
 
 class VP2Scene {
 public:
-    VP2Scene(const HierarchyNodeCategories& hierarchy_node_categories);
-    void updateVP2Buffers(chrono_t time, const DrawableSampleVector& in_samples, VP2BufferHandlesVector& out_buffers);
+    VP2Scene(const HierarchyNodeCategories& hierarchy_node_categories, VertexFormat format);
+    ~VP2Scene();
+    // The drawables flagged in drawn_as_instance are drawn with the buffers
+    // of another one and get none. The drawables published since the last
+    // call get their caches first.
+    void updateVP2Buffers(const HierarchyNodeCategories& hierarchy_node_categories,
+        chrono_t time, const DrawableSampleVector& in_samples, VP2BufferHandlesVector& out_buffers,
+        const std::vector<bool>& drawn_as_instance);
 private:
-    std::vector<VP2DrawableBufferCache> m_vp2_caches;
+    void addCaches(const HierarchyNodeCategories& hierarchy_node_categories);
+
+    VertexFormat m_format;
+    // The caches do not move when more are added.
+    std::deque<VP2DrawableBufferCache> m_vp2_caches;
     tbb::mutex m_mutex;
 };
 
@@ -93,9 +171,10 @@ typedef std::shared_ptr<VP2Scene> VP2ScenePtr;
 class VP2SceneCache {
 public:
     static VP2SceneCache& instance();
-    VP2ScenePtr getScene(const AlembicSceneKey& key, const AlembicScenePtr& scene);
+    VP2ScenePtr getScene(const AlembicSceneKey& key, const AlembicScenePtr& scene, VertexFormat format);
 private:
-    Cache<AlembicSceneKey, VP2Scene, AlembicSceneKeyHasher> m_scene_cache;
+    // One cache per vertex format, indexed by VertexFormat.
+    Cache<AlembicSceneKey, VP2Scene, AlembicSceneKeyHasher> m_scene_caches[2];
     tbb::mutex m_mutex;
 };
 
@@ -132,6 +211,14 @@ private:
     const MObject m_object;
     ShapeNode* m_shape_node;
 
+    // The views the holder is drawn in, by panel: the view drawn in
+    // frame_context and the previous views of the panels still visible.
+    std::map<std::string, ViewFilter::View> activeViews(const MHWRender::MFrameContext& frame_context) const;
+    // Level of detail filter of these views.
+    ViewFilter viewFilter(const std::map<std::string, ViewFilter::View>& views) const;
+    // Layout of the mesh buffers.
+    VertexFormat vertexFormat() const;
+
     bool m_update_world_matrix_required;
     MCallbackId m_world_matrix_changed_callback;
 
@@ -140,12 +227,27 @@ private:
     AlembicSceneKey m_scene_key;
     std::string m_selection_key;
     chrono_t m_sample_time;
+    // The scene grows while it loads.
+    size_t m_drawable_count;
+    bool m_scene_loading;
     bool m_bbox_extended_mode;
     bool m_is_selected;
     bool m_is_visible;
     std::string m_shader_assignments_json;
     bool m_texture_mode;
     M3dView::DisplayStyle m_display_style;
+    VertexFormat m_vertex_format;
+    // The render items are shared by the viewports, so the filter is built
+    // from all the views instead of the last one drawn.
+    std::map<std::string, ViewFilter::View> m_views;
+    ViewFilter m_view_filter;
+    ShapeNode::ProxyMode m_proxy_mode;
+
+    // Groups of visible meshes with identical buffers, each drawn by the
+    // render items of its first mesh with one instance per drawable. The
+    // other meshes of the groups are flagged in m_drawn_as_instance.
+    std::vector<std::vector<DrawableID>> m_instance_groups;
+    std::vector<bool> m_drawn_as_instance;
 
 private:
     // The m_vp2_cache_handle holds a handle to the caches belonging to the
@@ -186,6 +288,10 @@ private:
         std::string texture_path;
         TexturePtr texture;
 
+        // Drawables drawn by the items of this mesh, including itself. Empty
+        // if the mesh is not instanced.
+        std::vector<DrawableID> instances;
+
         TriangleMesh(DrawableID id)
             : drawable_id(id), wireframe_item(nullptr), shaded_item(nullptr), textured_item(nullptr)
         {}
@@ -205,6 +311,22 @@ private:
         operator bool() const { return render_item != nullptr; }
     };
     BBoxWireframe m_bbox_wireframe;
+
+    // Drawables too small on screen, drawn together as boxes or points.
+    struct Proxies {
+        static const char* RENDER_ITEM_NAME;
+        MHWRender::MRenderItem* render_item;
+        MHWRender::MVertexBuffer position_buffer;
+        MHWRender::MIndexBuffer index_buffer;
+        ShaderPtr point_shader;
+        Proxies();
+        void initRenderItem(ShapeNode::ProxyMode mode);
+        // Positions are in holder space, the indices are empty for points.
+        void updateGeometry(MHWRender::MPxSubSceneOverride& parent,
+            const std::vector<V3f>& positions, const std::vector<uint32_t>& indices, const Box3f& bbox);
+        operator bool() const { return render_item != nullptr; }
+    };
+    Proxies m_proxies;
     MColor m_wire_color;
     ShaderPtr m_wire_shader;
 };
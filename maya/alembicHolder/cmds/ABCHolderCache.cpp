@@ -0,0 +1,134 @@
+#include "ABCHolderCache.h"
+
+#include "../AlembicScene.h"
+#include "../SubSceneOverride.h"
+
+#include <maya/MArgDatabase.h>
+#include <json/json.h>
+
+using namespace AlembicHolder;
+
+const MString ABCHolderCache::commandName("ABCHolderCache");
+
+namespace {
+
+const char* kSamplesBudgetFlag = "-sb";
+const char* kSamplesBudgetFlagLong = "-samplesBudget";
+const char* kVP2BudgetFlag = "-vb";
+const char* kVP2BudgetFlagLong = "-vp2Budget";
+const char* kResetCountersFlag = "-rc";
+const char* kResetCountersFlagLong = "-resetCounters";
+const char* kFlushFlag = "-f";
+const char* kFlushFlagLong = "-flush";
+
+const double kMegabyte = 1024.0 * 1024.0;
+
+Json::Value statsToJson(const CacheRetention::Stats& stats)
+{
+    Json::Value res;
+    res["hits"] = Json::UInt64(stats.hits);
+    res["misses"] = Json::UInt64(stats.misses);
+    res["evictions"] = Json::UInt64(stats.evictions);
+    res["entries"] = Json::UInt64(stats.entries);
+    res["memoryMB"] = stats.bytes / kMegabyte;
+    res["budgetMB"] = stats.budget / kMegabyte;
+    return res;
+}
+
+// Memory of the VP2 buffers alive in each vertex format, and what the
+// compact ones would take in the full format.
+Json::Value vertexFormatsToJson(const VP2MemoryReport& report)
+{
+    Json::Value res;
+    res["fullMB"] = report.full_bytes / kMegabyte;
+    res["compactMB"] = report.compact_bytes / kMegabyte;
+    res["compactAsFullMB"] = report.compact_as_full_bytes / kMegabyte;
+    return res;
+}
+
+Json::Value kernelStatsToJson()
+{
+    Json::Value res;
+    for (size_t i = 0; i < size_t(MeshKernel::COUNT); ++i) {
+        const auto kernel = MeshKernel(i);
+        const auto stats = meshKernelStats(kernel);
+        Json::Value kernel_stats;
+        kernel_stats["calls"] = Json::UInt64(stats.calls);
+        kernel_stats["elements"] = Json::UInt64(stats.elements);
+        kernel_stats["milliseconds"] = stats.seconds * 1000.0;
+        res[meshKernelName(kernel)] = kernel_stats;
+    }
+    return res;
+}
+
+} // unnamed namespace
+
+void* ABCHolderCache::creator()
+{
+    return new ABCHolderCache();
+}
+
+MSyntax ABCHolderCache::newSyntax()
+{
+    MSyntax syntax;
+    syntax.addFlag(kSamplesBudgetFlag, kSamplesBudgetFlagLong, MSyntax::kLong);
+    syntax.addFlag(kVP2BudgetFlag, kVP2BudgetFlagLong, MSyntax::kLong);
+    syntax.addFlag(kResetCountersFlag, kResetCountersFlagLong);
+    syntax.addFlag(kFlushFlag, kFlushFlagLong);
+    syntax.enableQuery(false);
+    syntax.enableEdit(false);
+    return syntax;
+}
+
+MStatus ABCHolderCache::doIt( const MArgList& args )
+{
+    MStatus status;
+    MArgDatabase argData(syntax(), args, &status);
+    if (!status)
+        return status;
+
+    auto& sample_retention = sampleCacheRetention();
+    auto& vp2_retention = vp2BufferCacheRetention();
+
+    if (argData.isFlagSet(kSamplesBudgetFlag))
+    {
+        const int budget = argData.flagArgumentInt(kSamplesBudgetFlag, 0);
+        if (budget < 0)
+        {
+            displayError("The budget must be positive");
+            return MS::kFailure;
+        }
+        sample_retention.setBudget(size_t(budget) << 20);
+    }
+    if (argData.isFlagSet(kVP2BudgetFlag))
+    {
+        const int budget = argData.flagArgumentInt(kVP2BudgetFlag, 0);
+        if (budget < 0)
+        {
+            displayError("The budget must be positive");
+            return MS::kFailure;
+        }
+        vp2_retention.setBudget(size_t(budget) << 20);
+    }
+    if (argData.isFlagSet(kFlushFlag))
+    {
+        sample_retention.releaseAll();
+        vp2_retention.releaseAll();
+    }
+    if (argData.isFlagSet(kResetCountersFlag))
+    {
+        sample_retention.resetCounters();
+        vp2_retention.resetCounters();
+        resetMeshKernelStats();
+    }
+
+    Json::Value stats;
+    stats["samples"] = statsToJson(sample_retention.stats());
+    stats["vp2"] = statsToJson(vp2_retention.stats());
+    stats["vertexFormats"] = vertexFormatsToJson(vp2MemoryReport());
+    stats["kernels"] = kernelStatsToJson();
+    Json::FastWriter fastWriter;
+    setResult(MString(fastWriter.write(stats).c_str()));
+
+    return MS::kSuccess;
+}
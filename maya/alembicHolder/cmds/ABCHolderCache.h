@@ -0,0 +1,25 @@
+#ifndef ABCHOLDERCACHE_H_
+#define ABCHOLDERCACHE_H_
+
+#include <maya/MPxCommand.h>
+#include <maya/MSyntax.h>
+
+// Query and configure the retention of the alembicHolder caches.
+// Returns the counters of the sample and VP2 buffer caches, the VP2 memory by
+// vertex format and the timings of the kernels building the sample buffers,
+// as a json string.
+//   ABCHolderCache -samplesBudget 2048 -vp2Budget 1024;  // budgets in MB
+//   ABCHolderCache -resetCounters;
+//   ABCHolderCache -flush;  // release every retained buffer
+class ABCHolderCache : public MPxCommand
+{
+public:
+    MStatus doIt( const MArgList& args );
+    bool isUndoable() const {return false;};
+    static void* creator();
+    static MSyntax newSyntax();
+
+    static const MString commandName;
+};
+
+#endif /* ABCHOLDERCACHE_H_ */
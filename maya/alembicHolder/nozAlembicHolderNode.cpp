@@ -41,6 +41,7 @@ License along with this library.*/
 #include <maya/MHWGeometryUtilities.h>
 #include <maya/MFileObject.h>
 #include <maya/MObjectArray.h>
+#include <maya/MTimerMessage.h>
 
 #include <stdio.h>
 #include <map>
@@ -81,10 +82,17 @@ MObject nozAlembicHolder::aAbcFiles;
 MObject nozAlembicHolder::aObjectPath;
 MObject nozAlembicHolder::aSelectionPath;
 MObject nozAlembicHolder::aBoundingExtended;
+MObject nozAlembicHolder::aCompactVertexFormat;
 MObject nozAlembicHolder::aTime;
 MObject nozAlembicHolder::aTimeOffset;
 MObject nozAlembicHolder::aShaderPath;
 MObject nozAlembicHolder::aForceReload;
+MObject nozAlembicHolder::aPrefetchFrames;
+MObject nozAlembicHolder::aPrefetchDetectDirection;
+MObject nozAlembicHolder::aPrefetchMemoryBudget;
+MObject nozAlembicHolder::aViewCulling;
+MObject nozAlembicHolder::aProxyScreenSize;
+MObject nozAlembicHolder::aProxyMode;
 
 MObject nozAlembicHolder::aJsonFile;
 MObject nozAlembicHolder::aJsonFileSecondary;
@@ -111,6 +119,7 @@ MObject nozAlembicHolder::aBoundMin;
 MObject nozAlembicHolder::aBoundMax;
 
 nozAlembicHolder::nozAlembicHolder()
+    : m_loading_callback(0)
 {
     if (gGLFT == NULL)
         gGLFT = MHardwareRenderer::theRenderer()->glFunctionTable();
@@ -118,6 +127,7 @@ nozAlembicHolder::nozAlembicHolder()
 
 nozAlembicHolder::~nozAlembicHolder()
 {
+    removeLoadingCallback();
 }
 
 bool nozAlembicHolder::isBounded() const
@@ -155,6 +165,7 @@ MStatus nozAlembicHolder::initialize() {
     MFnNumericAttribute nAttr;
     MFnMessageAttribute mAttr;
     MFnUnitAttribute uAttr;
+    MFnEnumAttribute eAttr;
     MStatus stat;
 
     aAbcFiles = tAttr.create("cacheFileNames", "cfn", MFnData::kString);
@@ -207,6 +218,49 @@ MStatus nozAlembicHolder::initialize() {
     nAttr.setStorable(true);
     nAttr.setKeyable(true);
 
+    // Store the viewport buffers of the meshes in a compact format: 16 bit
+    // indices and no tangent basis.
+    aCompactVertexFormat = nAttr.create("compactVertexFormat", "cvf", MFnNumericData::kBoolean, false);
+    nAttr.setStorable(true);
+    nAttr.setKeyable(false);
+
+    // Playback prefetch: number of frames decoded ahead of the current time,
+    // whether they follow the direction of the playback, and the memory they
+    // may keep alive in megabytes.
+    aPrefetchFrames = nAttr.create("prefetchFrames", "pff", MFnNumericData::kInt, 0);
+    nAttr.setMin(0);
+    nAttr.setSoftMax(24);
+    nAttr.setStorable(true);
+    nAttr.setKeyable(false);
+
+    aPrefetchDetectDirection = nAttr.create("prefetchDetectDirection", "pfd", MFnNumericData::kBoolean, true);
+    nAttr.setStorable(true);
+    nAttr.setKeyable(false);
+
+    aPrefetchMemoryBudget = nAttr.create("prefetchMemoryBudget", "pfm", MFnNumericData::kInt, 512);
+    nAttr.setMin(0);
+    nAttr.setStorable(true);
+    nAttr.setKeyable(false);
+
+    // Viewport level of detail: the drawables out of the view, and the ones
+    // smaller on screen than proxyScreenSize pixels, are not decoded. The
+    // latter are drawn as boxes or points.
+    aViewCulling = nAttr.create("viewCulling", "vcl", MFnNumericData::kBoolean, false);
+    nAttr.setStorable(true);
+    nAttr.setKeyable(false);
+
+    aProxyScreenSize = nAttr.create("proxyScreenSize", "pss", MFnNumericData::kFloat, 0.0);
+    nAttr.setMin(0.0);
+    nAttr.setSoftMax(64.0);
+    nAttr.setStorable(true);
+    nAttr.setKeyable(false);
+
+    aProxyMode = eAttr.create("proxyMode", "pxm", kProxyBoundingBox);
+    eAttr.addField("Bounding Box", kProxyBoundingBox);
+    eAttr.addField("Point", kProxyPoint);
+    eAttr.setStorable(true);
+    eAttr.setKeyable(false);
+
     aJsonFile = tAttr.create("jsonFile", "jf", MFnStringData::kString, MObject::kNullObj);
     tAttr.setWritable(true);
     tAttr.setReadable(true);
@@ -342,10 +396,17 @@ MStatus nozAlembicHolder::initialize() {
     addAttribute(aObjectPath);
     addAttribute(aSelectionPath);
     addAttribute(aBoundingExtended);
+    addAttribute(aCompactVertexFormat);
     addAttribute(aForceReload);
     addAttribute(aShaderPath);
     addAttribute(aTime);
     addAttribute(aTimeOffset);
+    addAttribute(aPrefetchFrames);
+    addAttribute(aPrefetchDetectDirection);
+    addAttribute(aPrefetchMemoryBudget);
+    addAttribute(aViewCulling);
+    addAttribute(aProxyScreenSize);
+    addAttribute(aProxyMode);
 
 	addAttribute(aJsonFile);
 	addAttribute(aJsonFileSecondary);
@@ -375,6 +436,9 @@ MStatus nozAlembicHolder::initialize() {
     attributeAffects(aObjectPath, aUpdateCache);
     attributeAffects(aSelectionPath, aUpdateCache);
     attributeAffects(aForceReload, aUpdateCache);
+    attributeAffects(aPrefetchFrames, aUpdateCache);
+    attributeAffects(aPrefetchDetectDirection, aUpdateCache);
+    attributeAffects(aPrefetchMemoryBudget, aUpdateCache);
 
     // Update assinations
 	attributeAffects(aJsonFile, aUpdateAssign);
@@ -399,6 +463,71 @@ const nozAlembicHolder::SceneSample& nozAlembicHolder::getSample() const
     return m_sample;
 }
 
+bool nozAlembicHolder::setViewFilter(const ViewFilter& filter)
+{
+    updateCache();
+    if (!updateValue(m_view_filter, filter) || !m_scene || m_sample.empty())
+        return false;
+    return m_scene->refineHierarchySample(m_sample.time, &m_view_filter, m_sample.drawable_samples, m_sample.hierarchy_stat);
+}
+
+void nozAlembicHolder::sampleScene()
+{
+    // Read before sampling, a level published meanwhile is sampled by the
+    // next update.
+    m_sample.scene_loading = m_scene->isLoading();
+    m_scene->sampleHierarchy(m_sample.time, m_sample.drawable_samples, m_sample.hierarchy_stat, &m_view_filter);
+}
+
+void nozAlembicHolder::updateSelectionVisibility()
+{
+    m_sample.selection_visibility.assign(m_sample.drawable_samples.size(), true);
+    if (m_selection_key.empty())
+        return;
+    for (const auto& sample : m_sample.drawable_samples) {
+        m_sample.selection_visibility[sample.drawable_id] =
+            pathInJsonString(m_scene->getDrawableName(sample.drawable_id), m_selection_key);
+    }
+}
+
+void nozAlembicHolder::loadingCallback(float elapsed_time, float last_time, void* client_data)
+{
+    static_cast<nozAlembicHolder*>(client_data)->updateLoadedLevels();
+}
+
+void nozAlembicHolder::updateLoadedLevels()
+{
+    if (!m_scene || !m_sample.scene_loading) {
+        removeLoadingCallback();
+        return;
+    }
+
+    // Only resample once new drawables are published, or when the loading
+    // completes and the archive bounds are dropped.
+    const bool drawables_added = m_scene->nodeCategories().drawableCount() != m_sample.drawable_samples.size();
+    if (!drawables_added && m_scene->isLoading())
+        return;
+
+    sampleScene();
+    updateSelectionVisibility();
+    if (drawables_added)
+        updateDiffuseColorOverrides();
+    if (!m_sample.scene_loading)
+        removeLoadingCallback();
+
+    childChanged(kBoundingBoxChanged);
+    MHWRender::MRenderer::setGeometryDrawDirty(thisMObject());
+    M3dView::scheduleRefreshAllViews();
+}
+
+void nozAlembicHolder::removeLoadingCallback()
+{
+    if (m_loading_callback) {
+        MMessage::removeCallback(m_loading_callback);
+        m_loading_callback = 0;
+    }
+}
+
 const AlembicScenePtr& nozAlembicHolder::getScene() const
 {
     updateCache();
@@ -426,6 +555,26 @@ bool nozAlembicHolder::isBBExtendedMode() const
     return MPlug(thisMObject(), aBoundingExtended).asBool();
 }
 
+bool nozAlembicHolder::isCompactVertexFormat() const
+{
+    return MPlug(thisMObject(), aCompactVertexFormat).asBool();
+}
+
+bool nozAlembicHolder::isViewCulling() const
+{
+    return MPlug(thisMObject(), aViewCulling).asBool();
+}
+
+float nozAlembicHolder::getProxyScreenSize() const
+{
+    return MPlug(thisMObject(), aProxyScreenSize).asFloat();
+}
+
+nozAlembicHolder::ProxyMode nozAlembicHolder::getProxyMode() const
+{
+    return ProxyMode(MPlug(thisMObject(), aProxyMode).asShort());
+}
+
 const DiffuseColorOverrideMap& nozAlembicHolder::getDiffuseColorOverrides() const
 {
     updateCache();
@@ -689,28 +838,42 @@ MStatus nozAlembicHolder::compute(const MPlug& plug, MDataBlock& block)
             // First clear the drawable samples so the handles to the cache
             // buffers are deleted. The handles must not survive the caches.
             m_sample.drawable_samples.clear();
+            m_prefetcher.clear();
             m_scene = AlembicSceneCache::instance().getScene(m_scene_key);
+
+            // Batch sessions get the whole hierarchy at once.
+            if (m_scene && MGlobal::mayaState() != MGlobal::kInteractive)
+                m_scene->waitUntilLoaded();
         }
 
         if (m_scene) {
             // Update sample.
             const auto time_changed = updateValue(m_sample.time, getTime());
             if (m_sample.drawable_samples.empty() || time_changed) {
-                m_scene->sampleHierarchy(m_sample.time, m_sample.drawable_samples, m_sample.hierarchy_stat);
+                sampleScene();
             }
 
-            // Update selection visibility.
-            if (scene_key_changed) {
-                m_sample.selection_visibility.assign(m_scene->nodeCategories().drawableCount(), true);
+            // The levels published later are sampled by the loading
+            // callback.
+            if (m_sample.scene_loading && !m_loading_callback) {
+                m_loading_callback = MTimerMessage::addTimerCallback(0.1f, loadingCallback, this, &status);
+                CHECK_MSTATUS(status);
             }
 
+            // Decode the next frames in the background while playing.
+            PrefetchSettings prefetch_settings;
+            prefetch_settings.frame_count = block.inputValue(aPrefetchFrames).asInt();
+            prefetch_settings.detect_direction = block.inputValue(aPrefetchDetectDirection).asBool();
+            prefetch_settings.memory_budget = size_t(std::max(0, block.inputValue(aPrefetchMemoryBudget).asInt())) << 20;
+            prefetch_settings.view_filter = m_view_filter;
+            const auto frame_duration = MTime(1.0, MTime::uiUnit()).as(MTime::kSeconds);
+            m_prefetcher.update(m_scene, m_sample.time, frame_duration, prefetch_settings);
+
+            // Update selection visibility.
             const auto selection_key_changed = updateValue(m_selection_key, getSelectionKey());
-            if (scene_key_changed || selection_key_changed) {
-                for (auto& sample : m_sample.drawable_samples) {
-                    const auto visible = m_selection_key.empty() ||
-                        pathInJsonString(m_scene->getDrawableName(sample.drawable_id), m_selection_key);
-                    m_sample.selection_visibility[sample.drawable_id] = visible;
-                }
+            if (scene_key_changed || selection_key_changed ||
+                m_sample.selection_visibility.size() != m_sample.drawable_samples.size()) {
+                updateSelectionVisibility();
             }
         }
 
@@ -744,7 +907,7 @@ void* CAlembicHolderUI::creator() {
 CAlembicHolderUI::CAlembicHolderUI() {
 }
 
-void CAlembicHolderUI::updateVP1Drawables(const nozAlembicHolder::SceneSample& scene_sample, const DiffuseColorOverrideMap& color_overrides, const StaticMaterialVector& static_materials)
+void CAlembicHolderUI::updateVP1Drawables(const nozAlembicHolder::SceneSample& scene_sample, const DiffuseColorOverrideMap& color_overrides, const AlembicScene* scene)
 {
     m_vp1drawables.drawables.clear();
     for (const auto& drawable : scene_sample.drawable_samples) {
@@ -778,7 +941,7 @@ void CAlembicHolderUI::updateVP1Drawables(const nozAlembicHolder::SceneSample& s
         auto& item = m_vp1drawables.drawables.back();
         item.world_matrix = drawable.world_matrix;
         item.drawable_id = drawable.drawable_id;
-        const auto& static_material = static_materials[drawable.drawable_id];
+        const auto& static_material = scene->getStaticMaterial(drawable.drawable_id);
         item.diffuse_color = static_material.diffuse_color;
 
         if (drawable.cache_handles.indices) {
@@ -854,7 +1017,7 @@ void CAlembicHolderUI::updateVP1Drawables(const nozAlembicHolder::SceneSample& s
         m_vp1drawables.textures.resize(m_vp1drawables.drawables.size());
         for (size_t i = 0; i < m_vp1drawables.drawables.size(); ++i) {
             const auto& drawable = m_vp1drawables.drawables[i];
-            const auto& static_material = static_materials[drawable.drawable_id];
+            const auto& static_material = scene->getStaticMaterial(drawable.drawable_id);
             const auto override_it = color_overrides.find(drawable.drawable_id);
             std::string texture_path = static_material.diffuse_texture_path;
             if (override_it != color_overrides.end())
@@ -879,7 +1042,7 @@ void CAlembicHolderUI::getDrawRequests(const MDrawInfo & info,
     const auto& sample = shapeNode->getSample();
 
     // Update GL buffers.
-    updateVP1Drawables(sample, shapeNode->getDiffuseColorOverrides(), scene ? scene->staticMaterials() : StaticMaterialVector());
+    updateVP1Drawables(sample, shapeNode->getDiffuseColorOverrides(), scene.get());
 
     getDrawData(&m_vp1drawables, data);
     request.setDrawData(data);
@@ -16,6 +16,7 @@ License along with this library.*/
 #define _nozAlembicHolderNode
 
 #include "AlembicScene.h"
+#include "PlaybackPrefetcher.h"
 #include "RenderModules.h"
 #include "Foundation.h"
 #include "TextureLoader.h"
@@ -26,6 +27,7 @@ License along with this library.*/
 #include <maya/MPxNode.h>
 #include <maya/MFnNumericAttribute.h>
 #include <maya/MFnData.h>
+#include <maya/MFnEnumAttribute.h>
 #include <maya/MFnDagNode.h>
 #include <maya/MFnMessageAttribute.h>
 #include <maya/MFnTypedAttribute.h>
@@ -105,6 +107,11 @@ public:
     std::string getSelectionKey() const;
     chrono_t getTime() const;
     bool isBBExtendedMode() const;
+    bool isCompactVertexFormat() const;
+    enum ProxyMode { kProxyBoundingBox, kProxyPoint };
+    bool isViewCulling() const;
+    float getProxyScreenSize() const;
+    ProxyMode getProxyMode() const;
     const DiffuseColorOverrideMap& getDiffuseColorOverrides() const;
     std::string getShaderAssignmentsJson() const;
 
@@ -113,21 +120,39 @@ public:
         DrawableSampleVector drawable_samples;
         HierarchyStat hierarchy_stat;
         std::vector<bool> selection_visibility;
-        SceneSample() : time(-std::numeric_limits<chrono_t>::infinity()) {}
+        // The scene was still loading when sampled, its bbox includes the
+        // bounds of the archive.
+        bool scene_loading;
+        SceneSample() : time(-std::numeric_limits<chrono_t>::infinity()), scene_loading(false) {}
         bool empty() const { return drawable_samples.empty(); }
     };
     const SceneSample& getSample() const;
 
+    // Set by the viewport from the view the holder is drawn in. The sample
+    // is refined at once, returns true if it changed.
+    bool setViewFilter(const ViewFilter& filter);
+
 private:
     AlembicSceneKey m_scene_key;
     AlembicScenePtr m_scene;
     SceneSample m_sample;
+    ViewFilter m_view_filter;
     std::string m_selection_key;
+    PlaybackPrefetcher m_prefetcher;
 
     std::string m_shader_assignments;
     DiffuseColorOverrideMap m_diffuse_color_overrides;
     void updateDiffuseColorOverrides();
 
+    void sampleScene();
+    void updateSelectionVisibility();
+
+    // Polls the scene while it loads, so the levels it publishes get drawn.
+    MCallbackId m_loading_callback;
+    static void loadingCallback(float elapsed_time, float last_time, void* client_data);
+    void updateLoadedLevels();
+    void removeLoadingCallback();
+
 private:
     holderPrms m_params;
 public:
@@ -136,11 +161,18 @@ public:
     static    MObject    aAbcFiles;
     static    MObject    aObjectPath;
     static    MObject    aBoundingExtended;
+    static    MObject    aCompactVertexFormat;
     static    MObject    aTime;
     static    MObject    aTimeOffset;
     static    MObject    aSelectionPath;
     static    MObject    aShaderPath;
     static    MObject    aForceReload;
+    static    MObject    aPrefetchFrames;
+    static    MObject    aPrefetchDetectDirection;
+    static    MObject    aPrefetchMemoryBudget;
+    static    MObject    aViewCulling;
+    static    MObject    aProxyScreenSize;
+    static    MObject    aProxyMode;
 
 	static    MObject    aJsonFile;
 	static    MObject    aJsonFileSecondary;
@@ -257,7 +289,7 @@ public:
 
 private:
     VP1DrawableContainer m_vp1drawables;
-    void updateVP1Drawables(const nozAlembicHolder::SceneSample& scene_sample, const DiffuseColorOverrideMap& color_overrides, const StaticMaterialVector& static_materials);
+    void updateVP1Drawables(const nozAlembicHolder::SceneSample& scene_sample, const DiffuseColorOverrideMap& color_overrides, const AlembicScene* scene);
     void drawWithTwoSidedLightingSupport(const VP1DrawableContainer& drawable_container, VP1DrawSettings draw_settings) const;
 }; // class CAlembicHolderUI
 
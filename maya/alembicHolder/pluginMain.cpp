@@ -17,6 +17,7 @@ License along with this library.*/
 #include "version.h"
 
 #include "cmds/ABCGetTags.h"
+#include "cmds/ABCHolderCache.h"
 #include "json/json.h"
 
 #include <maya/MFnPlugin.h>
@@ -79,6 +80,12 @@ DLLEXPORT MStatus initializePlugin( MObject obj )
         return status;
     }
 
+    status = plugin.registerCommand( ABCHolderCache::commandName, ABCHolderCache::creator, ABCHolderCache::newSyntax);
+    if (!status) {
+        status.perror("registerCommand");
+        return status;
+    }
+
     if(MGlobal::mayaState() == MGlobal::kInteractive)
     {
         int polyMeshProirity = MSelectionMask::getSelectionTypePriority( "polymesh");
@@ -155,6 +162,15 @@ DLLEXPORT MStatus uninitializePlugin( MObject obj)
         return status;
     }
 
+    status = plugin.deregisterCommand( ABCHolderCache::commandName );
+    if (!status) {
+        status.perror("deregisterCommand");
+        return status;
+    }
+
+    sampleCacheRetention().releaseAll();
+    vp2BufferCacheRetention().releaseAll();
+
     if(MGlobal::mayaState() == MGlobal::kInteractive)
     {
 
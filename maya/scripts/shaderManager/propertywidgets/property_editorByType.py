@@ -64,19 +64,27 @@ PROPERTY_ADD_LIST = {
 'polymesh'       : [
                     {'name' :'forceVisible', 'type': AI_TYPE_BOOLEAN, 'value' : False},
                     {'name' :'sss_setname', 'type': AI_TYPE_STRING, 'value' : ""},
-                    {'name' :'velocity_multiplier', 'type': AI_TYPE_FLOAT, 'value' : 1.0}
+                    {'name' :'velocity_multiplier', 'type': AI_TYPE_FLOAT, 'value' : 1.0},
+                    {'name' :'nurbs_sampling', 'type': AI_TYPE_INT, 'value' : 0},
+                    {'name' :'nurbs_tolerance', 'type': AI_TYPE_FLOAT, 'value' : 0.001}
                   ],
 'points'         : [
                     {'name' :'forceVisible', 'type': AI_TYPE_BOOLEAN, 'value' : False}, 
                     {'name' :'radius_attribute', 'type': AI_TYPE_STRING, 'value' : "pscale"},
                     {'name' :'radius_multiplier', 'type': AI_TYPE_FLOAT, 'value' : 1.0},
-                    {'name' :'velocity_multiplier', 'type': AI_TYPE_FLOAT, 'value' : 1.0}
+                    {'name' :'velocity_multiplier', 'type': AI_TYPE_FLOAT, 'value' : 1.0},
+                    {'name' :'lod_density', 'type': AI_TYPE_FLOAT, 'value' : 1.0},
+                    {'name' :'lod_distance', 'type': AI_TYPE_FLOAT, 'value' : 0.0},
+                    {'name' :'lod_min_density', 'type': AI_TYPE_FLOAT, 'value' : 0.0}
                     ],
 'curves'         : [
                     {'name' :'forceVisible', 'type': AI_TYPE_BOOLEAN, 'value' : False}, 
                     {'name' :'radius_attribute', 'type': AI_TYPE_STRING, 'value' : "pscale"},
                     {'name' :'radius_multiplier', 'type': AI_TYPE_FLOAT, 'value' : 1.0},
-                    {'name' :'velocity_multiplier', 'type': AI_TYPE_FLOAT, 'value' : 1.0}
+                    {'name' :'velocity_multiplier', 'type': AI_TYPE_FLOAT, 'value' : 1.0},
+                    {'name' :'lod_density', 'type': AI_TYPE_FLOAT, 'value' : 1.0},
+                    {'name' :'lod_distance', 'type': AI_TYPE_FLOAT, 'value' : 0.0},
+                    {'name' :'lod_min_density', 'type': AI_TYPE_FLOAT, 'value' : 0.0}
                     ],                    
 'mesh_light'    :  [
                     {'name' :'convert_to_mesh_light', 'type': AI_TYPE_BOOLEAN, 'value' : False}